@@ -0,0 +1,215 @@
+// Microbenchmark for the compositing merge kernels, and a check of the
+// direct-send compositing context across ranks.
+// Usage: mpirun -np N morviq_composite_bench [width] [height] [iterations]
+
+#include "compositor/CompositeContext.h"
+#include "compositor/CompositeKernels.h"
+#include "utils/ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mpi.h>
+#include <new>
+#include <random>
+#include <vector>
+
+// Counts every C++ heap allocation in the process
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+using namespace morviq;
+
+namespace {
+
+using MergeFn = void (*)(const uint8_t*, const float*, const uint8_t*, const float*,
+                         uint8_t*, float*, size_t);
+
+struct Buffers {
+    std::vector<uint8_t> color1, color2, colorOut;
+    std::vector<float> depth1, depth2, depthOut;
+
+    explicit Buffers(size_t pixels)
+        : color1(pixels * 4), color2(pixels * 4), colorOut(pixels * 4),
+          depth1(pixels), depth2(pixels), depthOut(pixels) {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+        for (size_t i = 0; i < pixels; ++i) {
+            // Valid premultiplied pixels: color channels never exceed alpha
+            uint8_t a1 = static_cast<uint8_t>(byte(rng));
+            uint8_t a2 = static_cast<uint8_t>(byte(rng));
+            for (int c = 0; c < 3; ++c) {
+                color1[i * 4 + c] = static_cast<uint8_t>(byte(rng) * a1 / 255);
+                color2[i * 4 + c] = static_cast<uint8_t>(byte(rng) * a2 / 255);
+            }
+            color1[i * 4 + 3] = a1;
+            color2[i * 4 + 3] = a2;
+            depth1[i] = depth(rng);
+            depth2[i] = depth(rng);
+        }
+    }
+};
+
+template <typename F>
+double gpixelsPerSecond(size_t pixels, int iterations, F&& run) {
+    run(); // warm-up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(pixels) * iterations / seconds / 1e9;
+}
+
+int maxDifference(MergeFn reference, MergeFn candidate, const Buffers& in, size_t pixels) {
+    std::vector<uint8_t> refColor(pixels * 4), outColor(pixels * 4);
+    std::vector<float> refDepth(pixels), outDepth(pixels);
+    reference(in.color1.data(), in.depth1.data(), in.color2.data(), in.depth2.data(),
+              refColor.data(), refDepth.data(), pixels);
+    candidate(in.color1.data(), in.depth1.data(), in.color2.data(), in.depth2.data(),
+              outColor.data(), outDepth.data(), pixels);
+    int worst = 0;
+    for (size_t i = 0; i < pixels * 4; ++i) {
+        worst = std::max(worst, std::abs(static_cast<int>(refColor[i]) - outColor[i]));
+    }
+    for (size_t i = 0; i < pixels; ++i) {
+        if (refDepth[i] != outDepth[i]) return 256;
+    }
+    return worst;
+}
+
+// Fills rank's frame with a pattern every rank can reproduce; rank 0
+// checks the composite against merging the patterns in rank order
+void fillRankFrame(Frame& frame, int rank) {
+    std::mt19937 rng(1000 + rank);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+    const size_t pixels = static_cast<size_t>(frame.width) * frame.height;
+    for (size_t i = 0; i < pixels; ++i) {
+        for (int c = 0; c < 4; ++c) frame.colorBuffer[i * 4 + c] = static_cast<uint8_t>(byte(rng));
+        frame.depthBuffer[i] = depth(rng);
+    }
+}
+
+// Composites frames through CompositeContext on every rank: the result must
+// match merging the ranks' frames in order, and after the first frame
+// execute() must not touch the heap on any rank
+bool checkContext(int rank, int size, int width, int height, int frames) {
+    Frame local(width, height);
+    Frame output(width, height);
+    fillRankFrame(local, rank);
+    CompositeContext context(rank, size, MPI_COMM_WORLD);
+    CompositeParams params;
+    params.mode = CompositeParams::MIN_DEPTH;
+
+    context.prepare(local);
+    context.execute(local, output, params);
+    const size_t before = allocations.load();
+    for (int f = 0; f < frames; ++f) {
+        context.prepare(local);
+        context.execute(local, output, params);
+    }
+    unsigned long heap = allocations.load() - before;
+    int rebuilds = context.getRebuildCount();
+
+    bool match = true;
+    if (rank == 0) {
+        Frame expected(width, height);
+        Frame peer(width, height);
+        fillRankFrame(expected, 0);
+        for (int r = 1; r < size; ++r) {
+            fillRankFrame(peer, r);
+            kernels::merge(params.mode, expected.colorBuffer.get(), expected.depthBuffer.get(),
+                           peer.colorBuffer.get(), peer.depthBuffer.get(),
+                           expected.colorBuffer.get(), expected.depthBuffer.get(),
+                           static_cast<size_t>(width) * height);
+        }
+        match = std::memcmp(expected.colorBuffer.get(), output.colorBuffer.get(), output.colorBufferSize()) == 0 &&
+                std::memcmp(expected.depthBuffer.get(), output.depthBuffer.get(), output.depthBufferSize()) == 0;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &heap, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &rebuilds, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (rank == 0) {
+        std::printf("context, %d ranks, %d frames: %lu heap allocations after the first frame, "
+                    "%d rebuild(s), composite %s\n", size, frames, heap, rebuilds, match ? "matches" : "DIFFERS");
+    }
+    return heap == 0 && rebuilds == 1 && match;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? std::atoi(argv[1]) : 3840;
+    int height = argc > 2 ? std::atoi(argv[2]) : 2160;
+    int iterations = argc > 3 ? std::atoi(argv[3]) : 20;
+    size_t pixels = static_cast<size_t>(width) * height;
+
+    MPI_Init(&argc, &argv);
+    int rank = 0;
+    int size = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    bool ok = size == 1 || checkContext(rank, size, width, height, iterations);
+    if (rank != 0) {
+        MPI_Finalize();
+        return ok ? 0 : 1;
+    }
+    if (size > 1) {
+        std::printf("correctness: %s\n", ok ? "ok" : "FAILED");
+    }
+
+    Buffers buffers(pixels);
+    ThreadPool& pool = ThreadPool::shared();
+
+    struct Kernel {
+        const char* name;
+        CompositeParams::Mode mode;
+        MergeFn scalar;
+        MergeFn simd;
+        int tolerance;
+    } kernelsUnderTest[] = {
+        {"min-depth", CompositeParams::MIN_DEPTH, kernels::minDepthMergeScalar, kernels::minDepthMerge, 0},
+        // Fixed-point rounding vs. float truncation differs by at most one step
+        {"over", CompositeParams::ALPHA_BLEND, kernels::overMergeScalar, kernels::overMerge, 1},
+        {"max", CompositeParams::MAX_INTENSITY, kernels::maxMergeScalar, kernels::maxMerge, 0},
+    };
+
+    std::printf("%dx%d, %d iterations, SIMD: %s, threads: %zu\n",
+                width, height, iterations, kernels::simdLevel(), pool.size() + 1);
+    std::printf("%-10s %12s %12s %14s %8s\n", "kernel", "scalar", "simd", "simd+threads", "maxdiff");
+
+    int status = ok ? 0 : 1;
+    for (const auto& k : kernelsUnderTest) {
+        Buffers& b = buffers;
+        auto call = [&](MergeFn fn) {
+            return [&, fn]() {
+                fn(b.color1.data(), b.depth1.data(), b.color2.data(), b.depth2.data(),
+                   b.colorOut.data(), b.depthOut.data(), pixels);
+            };
+        };
+        double scalar = gpixelsPerSecond(pixels, iterations, call(k.scalar));
+        double simd = gpixelsPerSecond(pixels, iterations, call(k.simd));
+        double threaded = gpixelsPerSecond(pixels, iterations, [&]() {
+            kernels::mergeRows(k.mode, b.color1.data(), b.depth1.data(), b.color2.data(),
+                               b.depth2.data(), b.colorOut.data(), b.depthOut.data(),
+                               width, height, &pool);
+        });
+        int diff = maxDifference(k.scalar, k.simd, buffers, pixels);
+        if (diff > k.tolerance) status = 1;
+        std::printf("%-10s %9.3f Gp/s %7.3f Gp/s %9.3f Gp/s %8d\n",
+                    k.name, scalar, simd, threaded, diff);
+    }
+    MPI_Finalize();
+    return status;
+}
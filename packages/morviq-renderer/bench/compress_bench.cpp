@@ -0,0 +1,241 @@
+// Measures the fixed-rate brick compression (CompressedVolume) at several
+// rates: size, error, compress and decompress throughput, and trilinear
+// sampling speed against uncompressed floats, both along rays (as the ray
+// marcher samples) and at random positions. Checks decode consistency and
+// error bounds first; exits non-zero on a failure.
+// Usage: morviq_compress_bench [size] [iterations] [raw float32 file of size^3]
+
+#include "data/CompressedVolume.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <vector>
+
+using namespace morviq;
+
+namespace {
+
+std::unique_ptr<VolumeData> makeVolume(int nx, int ny, int nz) {
+    auto volume = std::make_unique<VolumeData>();
+    volume->dimensions[0] = nx;
+    volume->dimensions[1] = ny;
+    volume->dimensions[2] = nz;
+    volume->voxelCount = static_cast<size_t>(nx) * ny * nz;
+    volume->data.reset(new float[volume->voxelCount]());
+    return volume;
+}
+
+// Smooth shells and waves in [0, 1], like the tissue volumes
+void fillField(VolumeData& volume) {
+    const int* d = volume.dimensions;
+    size_t i = 0;
+    for (int z = 0; z < d[2]; ++z) {
+        for (int y = 0; y < d[1]; ++y) {
+            for (int x = 0; x < d[0]; ++x) {
+                const float u = x / float(d[0]), v = y / float(d[1]), w = z / float(d[2]);
+                const float r = std::sqrt((u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f) + (w - 0.5f) * (w - 0.5f));
+                const float shell = std::exp(-std::pow((r - 0.3f) / 0.05f, 2.0f));
+                const float wave = 0.25f * (1.0f + std::sin(12.0f * u) * std::cos(9.0f * v) * std::sin(7.0f * w));
+                volume.data[i++] = std::min(1.0f, 0.7f * shell + 0.3f * wave);
+            }
+        }
+    }
+}
+
+bool readVolume(const char* path, VolumeData& volume) {
+    std::ifstream file(path, std::ios::binary);
+    return file && file.read(reinterpret_cast<char*>(volume.data.get()),
+                             static_cast<std::streamsize>(volume.voxelCount * sizeof(float)));
+}
+
+// Same interpolation as VolumeRenderer::sampleBlock on packed floats
+float sampleFloats(const VolumeData& volume, float x, float y, float z) {
+    const int* d = volume.dimensions;
+    const int x0 = static_cast<int>(x), y0 = static_cast<int>(y), z0 = static_cast<int>(z);
+    const int x1 = std::min(x0 + 1, d[0] - 1), y1 = std::min(y0 + 1, d[1] - 1), z1 = std::min(z0 + 1, d[2] - 1);
+    const float fx = x - x0, fy = y - y0, fz = z - z0;
+    const size_t stride = d[0], slice = static_cast<size_t>(d[0]) * d[1];
+    const float* p = volume.data.get();
+    auto at = [&](int xi, int yi, int zi) { return p[xi + yi * stride + zi * slice]; };
+    const float v00 = at(x0, y0, z0) * (1 - fx) + at(x1, y0, z0) * fx;
+    const float v01 = at(x0, y0, z1) * (1 - fx) + at(x1, y0, z1) * fx;
+    const float v10 = at(x0, y1, z0) * (1 - fx) + at(x1, y1, z0) * fx;
+    const float v11 = at(x0, y1, z1) * (1 - fx) + at(x1, y1, z1) * fx;
+    const float v0 = v00 * (1 - fy) + v10 * fy;
+    const float v1 = v01 * (1 - fy) + v11 * fy;
+    return v0 * (1 - fz) + v1 * fz;
+}
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rays on a grid of 256^2 marched diagonally through the volume like the
+// ray marcher: 0.01 of the volume per step, each with the six central
+// difference taps of a gradient. Returns samples per second.
+template <typename Sample>
+double raySamplesPerSecond(const VolumeData& volume, Sample&& sample, float& sink) {
+    const int* d = volume.dimensions;
+    const int rays = 256;
+    const float step = 0.01f * (d[2] - 1);
+    const float h = 0.01f * (d[0] - 1);
+    auto clamped = [&](float x, float y, float z) {
+        return sample(std::min(std::max(x, 0.0f), d[0] - 1.0f), std::min(std::max(y, 0.0f), d[1] - 1.0f),
+                      std::min(std::max(z, 0.0f), d[2] - 1.0f));
+    };
+    size_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int ry = 0; ry < rays; ++ry) {
+        for (int rx = 0; rx < rays; ++rx) {
+            float x = rx * (d[0] - 1) / float(rays), y = ry * (d[1] - 1) / float(rays), z = 0.0f;
+            for (; z <= d[2] - 1; z += step, x += 0.1f * step, y += 0.05f * step) {
+                sink += clamped(x, y, z) + clamped(x + h, y, z) - clamped(x - h, y, z) + clamped(x, y + h, z) -
+                        clamped(x, y - h, z) + clamped(x, y, z + h) - clamped(x, y, z - h);
+                count += 7;
+            }
+        }
+    }
+    return count / seconds(start);
+}
+
+template <typename Sample>
+double randomSamplesPerSecond(const std::vector<float>& positions, Sample&& sample, float& sink) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < positions.size(); i += 3) {
+        sink += sample(positions[i], positions[i + 1], positions[i + 2]);
+    }
+    return positions.size() / 3 / seconds(start);
+}
+
+struct Error {
+    double rmse = 0.0;
+    double maximum = 0.0;
+};
+
+Error compare(const VolumeData& volume, const std::vector<float>& decoded) {
+    Error error;
+    for (size_t i = 0; i < volume.voxelCount; ++i) {
+        const double e = std::fabs(double(decoded[i]) - volume.data[i]);
+        error.rmse += e * e;
+        error.maximum = std::max(error.maximum, e);
+    }
+    error.rmse = std::sqrt(error.rmse / volume.voxelCount);
+    return error;
+}
+
+// Samples at voxel centers must equal the decompressed voxels, whatever
+// the dimensions; rate 32 must be near lossless; all-zero must stay zero
+bool checkCorrectness() {
+    bool ok = true;
+    const int shapes[][3] = {{1, 1, 1}, {3, 5, 2}, {4, 4, 4}, {13, 7, 5}, {33, 17, 9}};
+    for (const auto& shape : shapes) {
+        auto volume = makeVolume(shape[0], shape[1], shape[2]);
+        fillField(*volume);
+        for (int rate : {1, 4, 16, 32}) {
+            auto compressed = CompressedVolume::encode(*volume, rate);
+            std::vector<float> decoded(volume->voxelCount);
+            compressed->decompress(decoded.data());
+            size_t i = 0;
+            for (int z = 0; z < shape[2]; ++z) {
+                for (int y = 0; y < shape[1]; ++y) {
+                    for (int x = 0; x < shape[0]; ++x, ++i) {
+                        if (compressed->sample(float(x), float(y), float(z)) != decoded[i]) {
+                            std::printf("sample/decompress mismatch at %d,%d,%d of %dx%dx%d rate %d\n", x, y, z,
+                                        shape[0], shape[1], shape[2], rate);
+                            ok = false;
+                        }
+                    }
+                }
+            }
+            if (rate == 32 && compare(*volume, decoded).maximum > 1e-6) {
+                std::printf("rate 32 error %g at %dx%dx%d\n", compare(*volume, decoded).maximum, shape[0],
+                            shape[1], shape[2]);
+                ok = false;
+            }
+        }
+    }
+    auto zero = makeVolume(9, 9, 9);
+    auto compressed = CompressedVolume::encode(*zero, 2);
+    std::vector<float> decoded(zero->voxelCount, 1.0f);
+    compressed->decompress(decoded.data());
+    if (compare(*zero, decoded).maximum != 0.0) {
+        std::printf("zero volume not preserved\n");
+        ok = false;
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const int size = argc > 1 ? std::atoi(argv[1]) : 128;
+    const int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 3;
+
+    const bool ok = checkCorrectness();
+    std::printf("correctness: %s\n", ok ? "ok" : "FAILED");
+
+    auto volume = makeVolume(size, size, size);
+    if (argc > 3) {
+        if (!readVolume(argv[3], *volume)) {
+            std::printf("cannot read %d^3 floats from %s\n", size, argv[3]);
+            return 1;
+        }
+    } else {
+        fillField(*volume);
+    }
+    const float lowest = *std::min_element(volume->data.get(), volume->data.get() + volume->voxelCount);
+    const float highest = *std::max_element(volume->data.get(), volume->data.get() + volume->voxelCount);
+    const double range = std::max(1e-30, double(highest) - lowest);
+    const double megabytes = volume->voxelCount * sizeof(float) / (1024.0 * 1024.0);
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> positions(3 * 2000000);
+    for (size_t i = 0; i < positions.size(); ++i) {
+        positions[i] = unit(rng) * (size - 1);
+    }
+
+    float sink = 0.0f;
+    auto floats = [&](float x, float y, float z) { return sampleFloats(*volume, x, y, z); };
+    std::printf("%d^3 %s, %.1f MB as floats, %d iterations\n", size, argc > 3 ? argv[3] : "synthetic field",
+                megabytes, iterations);
+    std::printf("rate  ratio  rel.RMSE  rel.max   compress  decompress  ray samples  hit rate  random samples\n");
+    std::printf("  32f   1.0         0         0          -           -  %6.1f M/s         -  %6.1f M/s\n",
+                raySamplesPerSecond(*volume, floats, sink) / 1e6,
+                randomSamplesPerSecond(positions, floats, sink) / 1e6);
+
+    for (int rate : {2, 4, 8, 12, 16, 24}) {
+        std::shared_ptr<CompressedVolume> compressed;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            compressed = CompressedVolume::encode(*volume, rate);
+        }
+        const double compressSeconds = seconds(start) / iterations;
+        const CompressedVolume& codec = *compressed;
+
+        std::vector<float> decoded(volume->voxelCount);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            codec.decompress(decoded.data());
+        }
+        const double decompressSeconds = seconds(start) / iterations;
+        const Error error = compare(*volume, decoded);
+
+        auto packed = [&](float x, float y, float z) { return codec.sample(x, y, z); };
+        const CompressedVolume::CacheStats before = codec.getCacheStats();
+        const double rays = raySamplesPerSecond(*volume, packed, sink);
+        const CompressedVolume::CacheStats after = codec.getCacheStats();
+        const double lookups = double(after.hits - before.hits) + double(after.misses - before.misses);
+        const double random = randomSamplesPerSecond(positions, packed, sink);
+        std::printf("%4d  %5.1f  %8.2g  %8.2g  %5.0f MB/s  %5.0f MB/s  %6.1f M/s    %5.1f%%  %6.1f M/s\n", rate,
+                    volume->voxelCount * sizeof(float) / double(codec.bytes()), error.rmse / range,
+                    error.maximum / range, megabytes / compressSeconds, megabytes / decompressSeconds,
+                    rays / 1e6, 100.0 * (after.hits - before.hits) / std::max(1.0, lookups), random / 1e6);
+    }
+    std::printf("(checksum %g)\n", sink);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// Compares ways for the ranks to read their bricks of one shared raw volume:
+// POSIX reads of each brick row, MPI-IO independent reads of a subarray file
+// view, and collective MPI_File_read_all at several aggregator counts. The
+// ranks split the volume into a 3D grid of bricks, so every brick is many
+// short strided rows. Checks every voxel; exits non-zero on a mismatch.
+// Usage: mpirun -np N morviq_io_bench [file] [size] [iterations] [cold]
+// Writes a size^3 float volume to file first if it is missing or too small.
+// "cold" evicts the file from this node's page cache before every read.
+
+#include "data/MPIVolumeReader.h"
+#include <mpi.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace morviq;
+
+namespace {
+
+float expected(int x, int y, int z) {
+    return static_cast<float>((x * 7 + y * 13 + z * 31) % 1021);
+}
+
+bool writeVolume(const std::string& path, int size) {
+    FILE* fp = std::fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    std::vector<float> slice(static_cast<size_t>(size) * size);
+    for (int z = 0; z < size; ++z) {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                slice[static_cast<size_t>(y) * size + x] = expected(x, y, z);
+            }
+        }
+        if (std::fwrite(slice.data(), sizeof(float), slice.size(), fp) != slice.size()) {
+            std::fclose(fp);
+            return false;
+        }
+    }
+    return std::fclose(fp) == 0;
+}
+
+void evict(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+size_t mismatches(const float* data, const int begin[3], const int size[3]) {
+    size_t bad = 0;
+    size_t i = 0;
+    for (int z = 0; z < size[2]; ++z) {
+        for (int y = 0; y < size[1]; ++y) {
+            for (int x = 0; x < size[0]; ++x) {
+                bad += data[i++] != expected(begin[0] + x, begin[1] + y, begin[2] + z);
+            }
+        }
+    }
+    return bad;
+}
+
+bool posixRead(const std::string& path, int volumeSize, const int begin[3], const int size[3], float* out) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    const size_t rowBytes = static_cast<size_t>(size[0]) * sizeof(float);
+    bool ok = true;
+    for (int z = 0; z < size[2] && ok; ++z) {
+        for (int y = 0; y < size[1] && ok; ++y) {
+            const off_t voxel = ((static_cast<off_t>(begin[2] + z) * volumeSize + begin[1] + y) *
+                                 volumeSize + begin[0]);
+            ok = pread(fd, out, rowBytes, voxel * sizeof(float)) == static_cast<ssize_t>(rowBytes);
+            out += size[0];
+        }
+    }
+    ::close(fd);
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank = 0;
+    int ranks = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    const std::string path = argc > 1 ? argv[1] : "morviq_io_bench.raw";
+    const int volumeSize = argc > 2 ? std::atoi(argv[2]) : 512;
+    const int iterations = argc > 3 ? std::max(1, std::atoi(argv[3])) : 3;
+    const bool cold = argc > 4 && std::strcmp(argv[4], "cold") == 0;
+    const size_t volumeBytes = static_cast<size_t>(volumeSize) * volumeSize * volumeSize * sizeof(float);
+
+    int ok = 1;
+    if (rank == 0) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0 || static_cast<size_t>(info.st_size) < volumeBytes) {
+            std::printf("writing %d^3 test volume to %s\n", volumeSize, path.c_str());
+            ok = writeVolume(path, volumeSize);
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) {
+        if (rank == 0) std::fprintf(stderr, "cannot write %s\n", path.c_str());
+        MPI_Finalize();
+        return 1;
+    }
+
+    // This rank's brick of a 3D grid of ranks
+    int grid[3] = {0, 0, 0};
+    MPI_Dims_create(ranks, 3, grid);
+    const int cell[3] = {rank % grid[0], rank / grid[0] % grid[1], rank / (grid[0] * grid[1])};
+    int begin[3];
+    int size[3];
+    for (int a = 0; a < 3; ++a) {
+        begin[a] = volumeSize * cell[a] / grid[a];
+        size[a] = volumeSize * (cell[a] + 1) / grid[a] - begin[a];
+    }
+    const int dimensions[3] = {volumeSize, volumeSize, volumeSize};
+    VoxelType type;
+    parseVoxelType("<f4", type);
+    std::vector<float> posixBuffer(static_cast<size_t>(size[0]) * size[1] * size[2]);
+
+    struct Mode {
+        const char* name;
+        ReadParams::Mode mode; // MAPPED stands for plain POSIX reads here
+        int aggregators;
+    };
+    std::vector<Mode> modes = {{"posix", ReadParams::MAPPED, 0},
+                               {"independent", ReadParams::INDEPENDENT, 0},
+                               {"collective", ReadParams::COLLECTIVE, 0}};
+    for (int aggregators = 1; aggregators < ranks; aggregators *= 2) {
+        modes.push_back({"collective", ReadParams::COLLECTIVE, aggregators});
+    }
+
+    if (rank == 0) {
+        std::printf("%d ranks as %dx%dx%d bricks of a %d^3 float volume (%.0f MB), %s cache, best of %d\n",
+                    ranks, grid[0], grid[1], grid[2], volumeSize, volumeBytes / 1048576.0,
+                    cold ? "cold" : "warm", iterations);
+        std::printf("%-12s %11s %10s %10s %8s\n", "mode", "aggregators", "seconds", "GB/s", "errors");
+    }
+
+    int failures = 0;
+    for (const Mode& mode : modes) {
+        double best = 1e30;
+        size_t errors = 0;
+        for (int it = 0; it < iterations; ++it) {
+            if (cold) evict(path);
+            MPI_Barrier(MPI_COMM_WORLD);
+            const double start = MPI_Wtime();
+            std::unique_ptr<VolumeData> block;
+            const float* data = posixBuffer.data();
+            int readOk = 1;
+            if (mode.mode == ReadParams::MAPPED) {
+                readOk = posixRead(path, volumeSize, begin, size, posixBuffer.data());
+            } else {
+                ReadParams params;
+                params.mode = mode.mode;
+                params.aggregators = mode.aggregators;
+                MPIVolumeReader reader(MPI_COMM_WORLD);
+                readOk = reader.open(path, dimensions, type, 0, params) && reader.read(begin, size, block);
+                reader.close();
+                data = block ? block->data.get() : nullptr;
+            }
+            double seconds = MPI_Wtime() - start;
+            MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+            best = std::min(best, seconds);
+            size_t bad = readOk && data ? mismatches(data, begin, size) : posixBuffer.size();
+            MPI_Allreduce(MPI_IN_PLACE, &bad, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+            errors += bad;
+        }
+        failures += errors > 0;
+        if (rank == 0) {
+            char aggregators[16] = "default";
+            if (mode.mode == ReadParams::MAPPED || mode.mode == ReadParams::INDEPENDENT) {
+                std::snprintf(aggregators, sizeof(aggregators), "-");
+            } else if (mode.aggregators > 0) {
+                std::snprintf(aggregators, sizeof(aggregators), "%d", mode.aggregators);
+            }
+            std::printf("%-12s %11s %10.4f %10.3f %8zu\n", mode.name, aggregators, best,
+                        volumeBytes / best / 1e9, errors);
+        }
+    }
+
+    MPI_Finalize();
+    return failures ? 1 : 0;
+}
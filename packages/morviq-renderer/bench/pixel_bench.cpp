@@ -0,0 +1,113 @@
+// Checks the SIMD pixel conversions against their scalar references and
+// reports throughput. Exits non-zero on any mismatch.
+// Usage: morviq_pixel_bench [width] [height] [iterations]
+
+#include "codec/PixelConvert.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace morviq;
+
+namespace {
+
+std::vector<uint8_t> randomFrame(int width, int height, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < rgba.size(); i += 4) {
+        // Mix of opaque, transparent and partial alpha, premultiplied
+        int roll = byte(rng);
+        uint8_t a = roll < 128 ? 255 : (roll < 160 ? 0 : static_cast<uint8_t>(byte(rng)));
+        for (int c = 0; c < 3; ++c) {
+            rgba[i + c] = static_cast<uint8_t>(byte(rng) * a / 255);
+        }
+        rgba[i + 3] = a;
+    }
+    return rgba;
+}
+
+struct I420 {
+    std::vector<uint8_t> y, u, v;
+    I420(int width, int height)
+        : y(static_cast<size_t>(width) * height),
+          u(static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2)),
+          v(u.size()) {}
+    bool operator==(const I420& o) const { return y == o.y && u == o.u && v == o.v; }
+};
+
+bool checkI420(int width, int height) {
+    std::vector<uint8_t> rgba = randomFrame(width, height, static_cast<uint32_t>(width * 131 + height));
+    I420 ref(width, height), out(width, height);
+    pixels::rgbaToI420Scalar(rgba.data(), width, height, ref.y.data(), ref.u.data(), ref.v.data());
+    pixels::rgbaToI420(rgba.data(), width, height, out.y.data(), out.u.data(), out.v.data());
+    if (!(ref == out)) {
+        std::printf("rgbaToI420 mismatch at %dx%d\n", width, height);
+        return false;
+    }
+    return true;
+}
+
+bool checkUnpremultiply(size_t pixelCount) {
+    std::vector<uint8_t> rgba = randomFrame(static_cast<int>(pixelCount), 1, static_cast<uint32_t>(pixelCount));
+    std::vector<uint8_t> ref(rgba.size()), out(rgba.size());
+    pixels::unpremultiplyScalar(rgba.data(), ref.data(), pixelCount);
+    pixels::unpremultiply(rgba.data(), out.data(), pixelCount);
+    if (ref != out) {
+        std::printf("unpremultiply mismatch at %zu pixels\n", pixelCount);
+        return false;
+    }
+    return true;
+}
+
+template <typename F>
+double millisecondsPerRun(int iterations, F&& run) {
+    run(); // warm-up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+           iterations;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? std::atoi(argv[1]) : 1920;
+    int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+    int iterations = argc > 3 ? std::atoi(argv[3]) : 50;
+
+    // Odd sizes and widths around the 16-pixel SIMD step exercise the tails
+    bool ok = true;
+    const int sizes[][2] = {{1, 1}, {2, 2}, {3, 5}, {7, 3}, {15, 9}, {16, 16}, {17, 17},
+                            {31, 2}, {33, 7}, {64, 48}, {101, 63}, {width, height}};
+    for (const auto& size : sizes) {
+        ok = checkI420(size[0], size[1]) && ok;
+    }
+    for (size_t n : {1u, 3u, 4u, 7u, 8u, 9u, 31u, 1000u}) {
+        ok = checkUnpremultiply(n) && ok;
+    }
+    std::printf("correctness: %s\n", ok ? "ok" : "FAILED");
+
+    std::vector<uint8_t> rgba = randomFrame(width, height, 7);
+    I420 out(width, height);
+    std::vector<uint8_t> straight(rgba.size());
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+
+    std::printf("%dx%d, %d iterations\n", width, height, iterations);
+    std::printf("  rgbaToI420Scalar   %8.3f ms\n", millisecondsPerRun(iterations, [&] {
+        pixels::rgbaToI420Scalar(rgba.data(), width, height, out.y.data(), out.u.data(), out.v.data());
+    }));
+    std::printf("  rgbaToI420         %8.3f ms\n", millisecondsPerRun(iterations, [&] {
+        pixels::rgbaToI420(rgba.data(), width, height, out.y.data(), out.u.data(), out.v.data());
+    }));
+    std::printf("  unpremultiplyScalar %7.3f ms\n", millisecondsPerRun(iterations, [&] {
+        pixels::unpremultiplyScalar(rgba.data(), straight.data(), pixelCount);
+    }));
+    std::printf("  unpremultiply       %7.3f ms\n", millisecondsPerRun(iterations, [&] {
+        pixels::unpremultiply(rgba.data(), straight.data(), pixelCount);
+    }));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+// Measures the sparse grid (SparseVolume) on segmented volumes of scattered
+// cells at several active fractions: memory against dense floats, build
+// time, and ray marching speed (like the ray marcher, with gradient taps
+// where a sample contributes) for dense floats, sparse samples, and sparse
+// samples skipping empty space. Checks exact agreement with the dense
+// volume and the empty-space skips first; exits non-zero on a failure.
+// Usage: morviq_sparse_bench [size] [iterations]
+
+#include "data/SparseVolume.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace morviq;
+
+namespace {
+
+std::unique_ptr<VolumeData> makeVolume(int nx, int ny, int nz, float background) {
+    auto volume = std::make_unique<VolumeData>();
+    volume->dimensions[0] = nx;
+    volume->dimensions[1] = ny;
+    volume->dimensions[2] = nz;
+    volume->voxelCount = static_cast<size_t>(nx) * ny * nz;
+    volume->data.reset(new float[volume->voxelCount]);
+    std::fill(volume->data.get(), volume->data.get() + volume->voxelCount, background);
+    return volume;
+}
+
+// Cells as balls of radius 2-8% of the volume, brightest at their centers,
+// until about fraction of the voxels are active
+void fillCells(VolumeData& volume, float fraction, float background, unsigned seed) {
+    const int* d = volume.dimensions;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float extent = static_cast<float>(std::min({d[0], d[1], d[2]}));
+    size_t active = 0;
+    while (active < fraction * volume.voxelCount) {
+        const float r = std::max(1.5f, (0.02f + 0.06f * unit(rng)) * extent);
+        const float c[3] = {unit(rng) * d[0], unit(rng) * d[1], unit(rng) * d[2]};
+        const float peak = 0.3f + 0.7f * unit(rng);
+        const int lo[3] = {std::max(0, int(c[0] - r)), std::max(0, int(c[1] - r)), std::max(0, int(c[2] - r))};
+        const int hi[3] = {std::min(d[0] - 1, int(c[0] + r) + 1), std::min(d[1] - 1, int(c[1] + r) + 1),
+                           std::min(d[2] - 1, int(c[2] + r) + 1)};
+        for (int z = lo[2]; z <= hi[2]; ++z) {
+            for (int y = lo[1]; y <= hi[1]; ++y) {
+                for (int x = lo[0]; x <= hi[0]; ++x) {
+                    const float q = ((x - c[0]) * (x - c[0]) + (y - c[1]) * (y - c[1]) + (z - c[2]) * (z - c[2])) /
+                                    (r * r);
+                    if (q >= 1.0f) continue;
+                    float& v = volume.data[x + static_cast<size_t>(y) * d[0] + static_cast<size_t>(z) * d[0] * d[1]];
+                    if (v == background) ++active;
+                    v = std::max(v, background + peak * (1.0f - q));
+                }
+            }
+        }
+    }
+}
+
+// Same interpolation as VolumeRenderer::sampleBlock on packed floats
+float sampleFloats(const VolumeData& volume, float x, float y, float z) {
+    const int* d = volume.dimensions;
+    const int x0 = static_cast<int>(x), y0 = static_cast<int>(y), z0 = static_cast<int>(z);
+    const int x1 = std::min(x0 + 1, d[0] - 1), y1 = std::min(y0 + 1, d[1] - 1), z1 = std::min(z0 + 1, d[2] - 1);
+    const float fx = x - x0, fy = y - y0, fz = z - z0;
+    const size_t stride = d[0], slice = static_cast<size_t>(d[0]) * d[1];
+    const float* p = volume.data.get();
+    auto at = [&](int xi, int yi, int zi) { return p[xi + yi * stride + zi * slice]; };
+    const float v00 = at(x0, y0, z0) * (1 - fx) + at(x1, y0, z0) * fx;
+    const float v01 = at(x0, y0, z1) * (1 - fx) + at(x1, y0, z1) * fx;
+    const float v10 = at(x0, y1, z0) * (1 - fx) + at(x1, y1, z0) * fx;
+    const float v11 = at(x0, y1, z1) * (1 - fx) + at(x1, y1, z1) * fx;
+    const float v0 = v00 * (1 - fy) + v10 * fy;
+    const float v1 = v01 * (1 - fy) + v11 * fy;
+    return v0 * (1 - fz) + v1 * fz;
+}
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rays on a grid of 256^2 marched diagonally through the volume in steps of
+// 0.005 of it, sampling the six gradient taps where a sample exceeds 0.05
+// as the ray marcher does. With skip, empty space is jumped over through
+// SparseVolume::emptyLength. Returns ray steps covered per second.
+template <typename Sample>
+double rayStepsPerSecond(const VolumeData& volume, const SparseVolume* skip, Sample&& sample, float& sink) {
+    const int* d = volume.dimensions;
+    const int rays = 256;
+    const float step = 0.005f * (d[2] - 1);
+    const float h = 1.0f;
+    const float dir[3] = {0.1f * step, 0.05f * step, step};
+    auto clamped = [&](float x, float y, float z) {
+        return sample(std::min(std::max(x, 0.0f), d[0] - 1.0f), std::min(std::max(y, 0.0f), d[1] - 1.0f),
+                      std::min(std::max(z, 0.0f), d[2] - 1.0f));
+    };
+    size_t steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int ry = 0; ry < rays; ++ry) {
+        for (int rx = 0; rx < rays; ++rx) {
+            const float origin[3] = {rx * (d[0] - 1) / float(rays), ry * (d[1] - 1) / float(rays), 0.0f};
+            const int count = static_cast<int>((d[2] - 1) / step) + 1;
+            for (int i = 0; i < count; ++i) {
+                const float p[3] = {origin[0] + dir[0] * i, origin[1] + dir[1] * i, origin[2] + dir[2] * i};
+                if (skip) {
+                    const float length = skip->emptyLength(p, dir);
+                    if (length > 0.0f) {
+                        i = std::max(i, i + static_cast<int>(std::ceil(length)) - 1);
+                        continue;
+                    }
+                }
+                const float v = clamped(p[0], p[1], p[2]);
+                if (v > 0.05f) {
+                    sink += clamped(p[0] + h, p[1], p[2]) - clamped(p[0] - h, p[1], p[2]) +
+                            clamped(p[0], p[1] + h, p[2]) - clamped(p[0], p[1] - h, p[2]) +
+                            clamped(p[0], p[1], p[2] + h) - clamped(p[0], p[1], p[2] - h);
+                }
+                sink += v;
+            }
+            steps += count;
+        }
+    }
+    return steps / seconds(start);
+}
+
+// Every voxel and random samples must equal the dense volume exactly at
+// tolerance 0, whatever the dimensions and background; no sample inside a
+// skipped span may differ from the background; a dense volume must be
+// refused
+bool checkCorrectness() {
+    bool ok = true;
+    const int shapes[][3] = {{1, 1, 1}, {8, 8, 8}, {13, 7, 5}, {150, 9, 20}, {70, 140, 33}};
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (const auto& shape : shapes) {
+        for (float background : {0.0f, 0.25f}) {
+            auto volume = makeVolume(shape[0], shape[1], shape[2], background);
+            fillCells(*volume, 0.02f, background, 3);
+            SparseParams params;
+            params.enabled = true;
+            params.background = background;
+            auto sparse = SparseVolume::build(*volume, params);
+            if (!sparse) {
+                // Small volumes may be mostly active; they are not checked
+                continue;
+            }
+            size_t i = 0;
+            for (int z = 0; z < shape[2]; ++z) {
+                for (int y = 0; y < shape[1]; ++y) {
+                    for (int x = 0; x < shape[0]; ++x, ++i) {
+                        if (sparse->value(x, y, z) != volume->data[i]) {
+                            std::printf("voxel mismatch at %d,%d,%d of %dx%dx%d\n", x, y, z, shape[0], shape[1],
+                                        shape[2]);
+                            ok = false;
+                        }
+                    }
+                }
+            }
+            const float last[3] = {shape[0] - 1.0f, shape[1] - 1.0f, shape[2] - 1.0f};
+            for (int n = 0; n < 20000; ++n) {
+                const float x = unit(rng) * last[0], y = unit(rng) * last[1], z = unit(rng) * last[2];
+                if (sparse->sample(x, y, z) != sampleFloats(*volume, x, y, z)) {
+                    std::printf("sample mismatch at %g,%g,%g of %dx%dx%d\n", x, y, z, shape[0], shape[1], shape[2]);
+                    ok = false;
+                }
+            }
+            for (int n = 0; n < 2000; ++n) {
+                const float p[3] = {unit(rng) * shape[0], unit(rng) * shape[1], unit(rng) * shape[2]};
+                const float d[3] = {unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f};
+                const float length = sparse->emptyLength(p, d);
+                for (int k = 0; k < 64; ++k) {
+                    const float s = length * k / 64.0f;
+                    const float x = std::min(std::max(p[0] + d[0] * s, 0.0f), last[0]);
+                    const float y = std::min(std::max(p[1] + d[1] * s, 0.0f), last[1]);
+                    const float z = std::min(std::max(p[2] + d[2] * s, 0.0f), last[2]);
+                    if (std::fabs(sampleFloats(*volume, x, y, z) - background) > 1e-6f) {
+                        std::printf("skipped a sample at %g,%g,%g of %dx%dx%d\n", x, y, z, shape[0], shape[1],
+                                    shape[2]);
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    auto dense = makeVolume(32, 32, 32, 0.0f);
+    fillCells(*dense, 0.9f, 0.0f, 7);
+    SparseParams params;
+    params.enabled = true;
+    if (SparseVolume::build(*dense, params)) {
+        std::printf("dense volume not refused\n");
+        ok = false;
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const int size = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 3;
+
+    const bool ok = checkCorrectness();
+    std::printf("correctness: %s\n", ok ? "ok" : "FAILED");
+
+    const double megabytes = double(size) * size * size * sizeof(float) / (1024.0 * 1024.0);
+    std::printf("%d^3 cells, %.1f MB as floats, %d iterations\n", size, megabytes, iterations);
+    std::printf("active  leaves  sparse MB  of dense   build     dense rays  sparse rays  skipping rays\n");
+    float sink = 0.0f;
+    for (float fraction : {0.01f, 0.05f, 0.15f, 0.3f}) {
+        auto volume = makeVolume(size, size, size, 0.0f);
+        fillCells(*volume, fraction, 0.0f, 1);
+        SparseParams params;
+        params.enabled = true;
+        std::shared_ptr<SparseVolume> sparse;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            sparse = SparseVolume::build(*volume, params);
+        }
+        const double buildSeconds = seconds(start) / iterations;
+        if (!sparse) {
+            std::printf("%5.1f%%  refused (over %.0f%% of dense)\n", 100.0 * fraction,
+                        100.0 * SparseVolume::kMaxDenseFraction);
+            continue;
+        }
+        const SparseVolume::Stats stats = sparse->getStats();
+        auto floats = [&](float x, float y, float z) { return sampleFloats(*volume, x, y, z); };
+        auto packed = [&](float x, float y, float z) { return sparse->sample(x, y, z); };
+        const double denseRays = rayStepsPerSecond(*volume, nullptr, floats, sink);
+        const double sparseRays = rayStepsPerSecond(*volume, nullptr, packed, sink);
+        const double skippingRays = rayStepsPerSecond(*volume, sparse.get(), packed, sink);
+        std::printf("%5.1f%%  %6zu  %9.1f  %7.1f%%  %4.0f ms  %7.1f M/s  %7.1f M/s    %7.1f M/s\n",
+                    100.0 * stats.activeVoxels / volume->voxelCount, stats.leaves,
+                    sparse->bytes() / (1024.0 * 1024.0), 100.0 * sparse->bytes() / (megabytes * 1024 * 1024),
+                    1e3 * buildSeconds, denseRays / 1e6, sparseRays / 1e6, skippingRays / 1e6);
+    }
+    std::printf("(checksum %g)\n", sink);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+// Checks that temporal accumulation averages still frames and resets on a
+// large camera move, and reports its cost per frame. Exits non-zero on a
+// failed check.
+// Usage: morviq_temporal_bench [width] [height] [iterations]
+
+#include "renderer/TemporalAccumulator.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace morviq;
+
+namespace {
+
+// Perspective camera at the origin looking down -z; view is camera-to-world
+Camera makeCamera(int width, int height, float offsetX) {
+    Camera camera;
+    camera.viewport[2] = width;
+    camera.viewport[3] = height;
+    const float nearPlane = 0.1f;
+    const float farPlane = 10.0f;
+    const float f = 1.0f / std::tan(0.5f * 60.0f * 3.14159265f / 180.0f);
+    float* p = camera.projection.m;
+    std::memset(p, 0, sizeof(camera.projection.m));
+    p[0] = f * height / width;
+    p[5] = f;
+    p[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    p[11] = -1.0f;
+    p[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+    camera.view.m[12] = offsetX;
+    return camera;
+}
+
+// A smooth image plus per-frame noise, as jittered samples give
+void fillFrame(Frame& frame, std::mt19937& rng) {
+    std::uniform_int_distribution<int> noise(-24, 24);
+    for (int y = 0; y < frame.height; ++y) {
+        for (int x = 0; x < frame.width; ++x) {
+            const size_t i = static_cast<size_t>(y) * frame.width + x;
+            const int base[4] = {x * 255 / frame.width, y * 255 / frame.height, 128, 200};
+            for (int c = 0; c < 4; ++c) {
+                frame.colorBuffer[i * 4 + c] = static_cast<uint8_t>(std::min(std::max(base[c] + noise(rng), 0), 255));
+            }
+            frame.depthBuffer[i] = 0.5f;
+        }
+    }
+}
+
+bool checkStill(int width, int height, int frames) {
+    TemporalAccumulator accumulator;
+    accumulator.initialize(width, height);
+    const Camera camera = makeCamera(width, height, 0.0f);
+    std::mt19937 rng(7);
+    Frame frame(width, height);
+    std::vector<double> sum(frame.colorBufferSize(), 0.0);
+    for (int f = 0; f < frames; ++f) {
+        fillFrame(frame, rng);
+        for (size_t i = 0; i < sum.size(); ++i) sum[i] += frame.colorBuffer[i];
+        accumulator.accumulate(frame, camera);
+    }
+    int worst = 0;
+    for (size_t i = 0; i < sum.size(); ++i) {
+        const int mean = static_cast<int>(sum[i] / frames + 0.5);
+        worst = std::max(worst, std::abs(mean - frame.colorBuffer[i]));
+    }
+    // Rounding the float history against rounding the exact mean
+    const bool ok = worst <= 1 && accumulator.getHistoryLength() == frames;
+    std::printf("still, %d frames: history %d, max difference from the mean %d: %s\n", frames,
+                accumulator.getHistoryLength(), worst, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+bool checkReset(int width, int height, int frames) {
+    TemporalAccumulator accumulator;
+    accumulator.initialize(width, height);
+    const Camera still = makeCamera(width, height, 0.0f);
+    std::mt19937 rng(11);
+    Frame frame(width, height);
+    for (int f = 0; f < frames; ++f) {
+        fillFrame(frame, rng);
+        accumulator.accumulate(frame, still);
+    }
+    // Far past TemporalParams::resetMotion at the frame's depth
+    const Camera moved = makeCamera(width, height, 0.5f);
+    fillFrame(frame, rng);
+    const std::vector<uint8_t> current(frame.colorBuffer.get(), frame.colorBuffer.get() + frame.colorBufferSize());
+    accumulator.accumulate(frame, moved);
+    const bool ok = accumulator.getHistoryLength() == 1 &&
+                    std::memcmp(current.data(), frame.colorBuffer.get(), current.size()) == 0;
+    std::printf("large move after %d frames: history %d, output %s the new frame: %s\n", frames,
+                accumulator.getHistoryLength(), ok ? "is" : "is not", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+template <typename F>
+double millisecondsPerRun(int iterations, F&& run) {
+    run(); // warm-up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+           iterations;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int width = argc > 1 ? std::atoi(argv[1]) : 1920;
+    int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+    int iterations = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    bool ok = checkStill(97, 61, 8);
+    ok = checkReset(97, 61, 4) && ok;
+    std::printf("correctness: %s\n", ok ? "ok" : "FAILED");
+
+    TemporalAccumulator accumulator;
+    accumulator.initialize(width, height);
+    std::mt19937 rng(3);
+    Frame frame(width, height);
+    fillFrame(frame, rng);
+    const Camera camera = makeCamera(width, height, 0.0f);
+    std::printf("%dx%d, %d iterations\n", width, height, iterations);
+    std::printf("  still      %8.3f ms\n", millisecondsPerRun(iterations, [&] {
+        accumulator.accumulate(frame, camera);
+    }));
+    // Sub-pixel to pixel moves each frame: reprojected, not reset
+    int step = 0;
+    std::printf("  moving     %8.3f ms\n", millisecondsPerRun(iterations, [&] {
+        accumulator.accumulate(frame, makeCamera(width, height, 1e-4f * (++step % 2)));
+    }));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "codec/SequenceWriter.h"
+#include "codec/PNGEncoder.h"
+#include <cstdio>
+#include <vector>
+
+namespace morviq {
+
+// Animated PNG streamed to disk. The first frame is the default image;
+// each later frame stores only the bounding box of the tiles that changed,
+// with dispose NONE (keep the canvas) and blend SOURCE (replace, alpha
+// included), so the canvas always equals the rendered frame. Frames are
+// compressed with PNGEncoder's parallel stripes and written as they come;
+// the frame count in acTL is patched in close(), so the path must be a
+// seekable file.
+class APNGWriter : public SequenceWriter {
+public:
+    APNGWriter(const PNGEncodeParams& params, int fps);
+    ~APNGWriter() override;
+    
+    bool open(const std::string& path, int width, int height) override;
+    bool writeFrame(const Frame& frame) override;
+    bool close() override;
+    
+    std::string getFileExtension() const override { return "png"; }
+    
+private:
+    static constexpr int kTileSize = 16;
+    
+    PNGEncoder encoder;
+    int fps;
+    FILE* file;
+    long actlOffset;
+    int width;
+    int height;
+    uint32_t frameCount;
+    uint32_t sequence;
+    
+    std::vector<uint8_t> previous;
+    std::vector<uint8_t> dirty;
+    std::vector<uint8_t> region;
+};
+
+} // namespace morviq
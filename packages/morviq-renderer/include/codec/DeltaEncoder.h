@@ -0,0 +1,59 @@
+#pragma once
+
+#include "codec/Encoder.h"
+#include <vector>
+
+namespace morviq {
+
+// Dirty-rectangle frame stream. Each frame is compared with the previously
+// encoded one in square tiles and only the tiles that changed are stored;
+// every keyframeInterval frames (and on the first frame or a resize) all
+// tiles are stored. Pixels are premultiplied RGBA8 as rendered, so a
+// client keeps one frame buffer and pastes each record's tiles into it.
+//
+//   offset  size  field (little-endian)
+//   0       4     magic "MVQD"
+//   4       4     version (1)
+//   8       4     width
+//   12      4     height
+//   16      2     tile size
+//   18      2     flags (bit 0: keyframe, bit 1: premultiplied alpha)
+//   20      4     frame index
+//   24      4     tile count N
+//   28      ...   N x { u16 tileX, u16 tileY, pixels }
+//
+// A tile at (tileX, tileY) covers x from tileX * tileSize for
+// min(tileSize, width - x0) pixels, likewise for y; its pixels follow
+// row by row with no padding.
+class DeltaEncoder : public Encoder {
+public:
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint16_t kFlagKeyframe = 1u << 0;
+    static constexpr uint16_t kFlagPremultiplied = 1u << 1;
+    static constexpr size_t kHeaderSize = 28;
+    
+    explicit DeltaEncoder(int keyframeInterval = 30, int tileSize = 64);
+    
+    bool encode(const Frame& frame, std::vector<uint8_t>& output) override;
+    
+    std::string getMimeType() const override { return "application/x-morviq-delta"; }
+    std::string getFileExtension() const override { return "mvqd"; }
+    bool isStateful() const override { return true; }
+    
+    void requestKeyframe() override { forceKeyframe = true; }
+    bool wroteKeyframe() const override { return lastKeyframe; }
+    
+private:
+    int keyframeInterval;
+    int tileSize;
+    uint32_t frameIndex;
+    bool forceKeyframe;
+    bool lastKeyframe;
+    
+    int width;
+    int height;
+    std::vector<uint8_t> previous;
+    std::vector<uint8_t> dirty;
+};
+
+} // namespace morviq
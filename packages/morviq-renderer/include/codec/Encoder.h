@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -11,9 +12,28 @@ public:
     virtual ~Encoder() = default;
     
     virtual bool encode(const Frame& frame, std::vector<uint8_t>& output) = 0;
-    virtual bool encodeToFile(const Frame& frame, const std::string& filename) = 0;
+    // Default: encode() into a reused buffer, then write it out.
+    virtual bool encodeToFile(const Frame& frame, const std::string& filename);
     
     virtual std::string getMimeType() const = 0;
+    virtual std::string getFileExtension() const = 0;
+    // True if the output depends on earlier frames, so frames must be
+    // encoded one at a time, in order, by a single instance.
+    virtual bool isStateful() const { return false; }
+    // Stateful encoders write the next frame so that it decodes on its own
+    // (a keyframe), e.g. for a consumer that joins or lost a frame.
+    virtual void requestKeyframe() {}
+    // False if the output of the last encode() needs earlier frames.
+    virtual bool wroteKeyframe() const { return true; }
+    
+protected:
+    static bool writeFile(const std::string& filename, const std::vector<uint8_t>& data);
+    
+private:
+    std::vector<uint8_t> fileBuffer;
 };
 
-} // namespace morviq
\ No newline at end of file
+// Encoder for the format selected in params (--format).
+std::unique_ptr<Encoder> createEncoder(const OutputParams& params);
+
+} // namespace morviq
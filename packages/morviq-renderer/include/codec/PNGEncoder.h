@@ -1,21 +1,66 @@
 #pragma once
 
 #include "types.h"
+#include "codec/Encoder.h"
+#include "codec/PNGStream.h"
+#include <cstdio>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace morviq {
 
-class PNGEncoder {
+struct PNGEncodeParams {
+    int compressionLevel = 6;                   // zlib level, 0-9
+    PNGFilterStrategy filter = FILTER_ADAPTIVE; // FILTER_SUB is the fast choice
+    bool parallel = true;                       // stripe encode on the shared thread pool
+
+    PNGEncodeParams() = default;
+    explicit PNGEncodeParams(const OutputParams& output)
+        : compressionLevel(output.compressionLevel),
+          filter(static_cast<PNGFilterStrategy>(output.pngFilter)) {}
+};
+
+class PNGEncoder : public Encoder {
 public:
     PNGEncoder();
-    ~PNGEncoder();
-    
-    bool encode(const Frame& frame, const std::string& filename);
-    bool encodeToMemory(const Frame& frame, std::vector<uint8_t>& output);
-    
+    explicit PNGEncoder(const PNGEncodeParams& params);
+    ~PNGEncoder() override;
+
+    void setParams(const PNGEncodeParams& p) { params = p; }
+    const PNGEncodeParams& getParams() const { return params; }
+
+    bool encode(const Frame& frame, std::vector<uint8_t>& output) override;
+    // Streams straight to the file without building the PNG in memory
+    bool encodeToFile(const Frame& frame, const std::string& filename) override;
+
+    std::string getMimeType() const override { return "image/png"; }
+    std::string getFileExtension() const override { return "png"; }
+
+    // Parallel filter + deflate of a contiguous premultiplied RGBA8 image
+    // into getStripeCount() stripes that form one zlib stream in order.
+    // Stripes stay valid until the next call.
+    bool compressStripes(const uint8_t* rgba, int width, int height);
+    size_t getStripeCount() const { return stripeCount; }
+    const PNGStripe& getStripe(size_t i) const { return stripes[i]; }
+
 private:
-    void writePNG(const std::string& filename, const uint8_t* image, 
+    PNGEncodeParams params;
+
+    // Scratch kept between frames so steady-state encoding does not allocate
+    std::vector<uint8_t> filtered;
+    std::vector<std::unique_ptr<PNGStripeEncoder>> stripeEncoders;
+    std::vector<PNGStripe> stripes;
+    size_t stripeCount = 0;
+    std::vector<uint8_t> straight;       // libpng path only
+    std::vector<uint8_t*> rowPointers;   // libpng path only
+
+    bool encodeStriped(const Frame& frame, const PNGStreamWriter::Sink& sink);
+    // Exactly one of fp / output is non-null
+    bool encodeLibpng(const Frame& frame, FILE* fp, std::vector<uint8_t>* output);
+
+    void writePNG(const std::string& filename, const uint8_t* image,
                   int width, int height, int channels);
 };
 
-} // namespace morviq
\ No newline at end of file
+} // namespace morviq
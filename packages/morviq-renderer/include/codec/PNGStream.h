@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+struct z_stream_s;
+
+namespace morviq {
+
+// Row filter choice for stripe encoding. FILTER_ADAPTIVE picks per row the
+// filter with the smallest sum of absolute residuals (libpng's heuristic).
+enum PNGFilterStrategy {
+    FILTER_NONE = 0,
+    FILTER_SUB = 1,
+    FILTER_UP = 2,
+    FILTER_AVERAGE = 3,
+    FILTER_PAETH = 4,
+    FILTER_ADAPTIVE = 5
+};
+
+// One independently compressed run of scanlines. Stripes deflated with
+// last=false end on a byte-aligned sync flush, so concatenating the stripes
+// of an image in order yields a single valid zlib/deflate stream (the pigz
+// approach); adler/rawLength let the writer combine the stream checksum.
+struct PNGStripe {
+    std::vector<uint8_t> data;
+    uint32_t adler = 1;
+    size_t rawLength = 0;
+};
+
+// Filters and deflates stripes of RGBA8 scanlines. Input is straight alpha,
+// or premultiplied when premultiplied=true, in which case rows are converted
+// on the fly in the same pass as the filter. Keeps its deflate state and
+// scratch between calls (deflateReset), so encoding a stream of same-sized
+// frames does not allocate.
+class PNGStripeEncoder {
+public:
+    PNGStripeEncoder();
+    ~PNGStripeEncoder();
+
+    PNGStripeEncoder(const PNGStripeEncoder&) = delete;
+    PNGStripeEncoder& operator=(const PNGStripeEncoder&) = delete;
+
+    // prevRow is the image row just above the stripe (nullptr if unknown or
+    // the stripe starts the image; the first row then uses the Sub filter so
+    // the stripe never depends on data it has not seen).
+    bool encode(const uint8_t* rgba, const uint8_t* prevRow,
+                int width, int rows, int compressionLevel,
+                PNGFilterStrategy filter, bool last, PNGStripe& out,
+                bool premultiplied = false);
+
+    // The two halves of encode(), for callers that filter a whole image
+    // first. filter() writes rows * (width * 4 + 1) bytes to out. compress()
+    // may be given the filtered bytes preceding the stripe as a dictionary
+    // (the last 32 KiB are used), which keeps the ratio close to a
+    // single-stream encode.
+    void filter(const uint8_t* rgba, const uint8_t* prevRow, int width, int rows,
+                PNGFilterStrategy strategy, uint8_t* out, bool premultiplied = false);
+    bool compress(const uint8_t* filtered, size_t length,
+                  const uint8_t* dictionary, size_t dictLength,
+                  int compressionLevel, PNGFilterStrategy strategy, bool last, PNGStripe& out);
+
+private:
+    z_stream_s* stream;
+    int streamLevel;
+    int streamStrategy;
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> candidates;
+    std::vector<uint8_t> rowScratch;
+};
+
+// Streams a PNG (RGBA8, non-interlaced) whose IDAT payload arrives as
+// stripes in image order. Each stripe becomes its own IDAT chunk, so the
+// writer never holds more than the stripe it is given. For APNG frames the
+// payload can go to fdAT chunks instead (beginData with a sequence counter).
+class PNGStreamWriter {
+public:
+    using Sink = std::function<bool(const uint8_t*, size_t)>;
+
+    explicit PNGStreamWriter(Sink sink);
+
+    static Sink fileSink(FILE* fp);
+    static Sink memorySink(std::vector<uint8_t>& out);
+
+    // Signature + IHDR, then beginData() for the default image.
+    bool begin(int width, int height);
+    // Starts a new compressed image stream. With frameSequence set, data is
+    // written as fdAT chunks numbered from (and advancing) *frameSequence.
+    void beginData(uint32_t* frameSequence = nullptr);
+    bool writeStripe(const uint8_t* data, size_t size, uint32_t adler, size_t rawLength);
+    bool writeStripe(const PNGStripe& stripe) {
+        return writeStripe(stripe.data.data(), stripe.data.size(), stripe.adler, stripe.rawLength);
+    }
+    // Ends the current image stream (Adler-32 trailer).
+    bool finishData();
+    // finishData() + IEND.
+    bool finish();
+
+    // Writes one PNG chunk (length, type, data, CRC) to the sink.
+    bool writeChunk(const char type[4], const uint8_t* data, size_t size);
+
+private:
+    Sink sink;
+    uint32_t adler;
+    bool headerWritten;
+    uint32_t* sequence;
+
+    bool writeDataChunk(const uint8_t* data, size_t size);
+};
+
+} // namespace morviq
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace morviq {
+
+// Color conversions shared by the frame encoders. Input is the renderer's
+// premultiplied RGBA8. None of these allocate; callers own the scratch.
+namespace pixels {
+
+// Premultiplied -> straight alpha through a 64 KiB (alpha, value) table.
+// Fully opaque and fully transparent runs are detected 4 or 8 pixels at a
+// time with SIMD and copied / cleared without lookups. dst may equal src.
+void unpremultiply(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+
+// Reference float implementation; unpremultiply() matches it bit for bit.
+void unpremultiplyScalar(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+
+// RGBA8 -> packed RGB8 (alpha dropped). dst must not overlap src.
+void packRGB(const uint8_t* rgba, uint8_t* rgb, size_t pixelCount);
+
+// Premultiplied RGBA8 -> planar I420 (BT.601 limited range). Premultiplied
+// color is the image composited over black, which is what video wants.
+// Chroma is the average of each 2x2 block; odd edges repeat the last
+// row/column. Plane strides are width and (width + 1) / 2. Uses SSSE3
+// integer math, 16 luma / 4 chroma samples at a time.
+void rgbaToI420(const uint8_t* rgba, int width, int height,
+                uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane);
+
+// Reference implementation; rgbaToI420() matches it bit for bit.
+void rgbaToI420Scalar(const uint8_t* rgba, int width, int height,
+                      uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane);
+
+// Marks which tileSize x tileSize tiles differ between two RGBA8 frames of
+// the same size (edge tiles are clipped). dirty holds one byte per tile,
+// row-major; returns the number of dirty tiles. Compares 16/32 bytes per
+// step and stops scanning a tile at its first difference.
+size_t diffTiles(const uint8_t* current, const uint8_t* previous,
+                 int width, int height, int tileSize, uint8_t* dirty);
+
+} // namespace pixels
+} // namespace morviq
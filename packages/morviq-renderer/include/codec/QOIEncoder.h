@@ -0,0 +1,22 @@
+#pragma once
+
+#include "codec/Encoder.h"
+#include <vector>
+
+namespace morviq {
+
+// "Quite OK Image" format (qoiformat.org): a single linear pass with a
+// 64-entry color cache, small deltas and runs. Lossless, straight alpha,
+// many times faster than deflate at a similar size on rendered frames.
+class QOIEncoder : public Encoder {
+public:
+    bool encode(const Frame& frame, std::vector<uint8_t>& output) override;
+    
+    std::string getMimeType() const override { return "image/qoi"; }
+    std::string getFileExtension() const override { return "qoi"; }
+    
+private:
+    std::vector<uint8_t> straight; // one row of un-premultiplied pixels
+};
+
+} // namespace morviq
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "codec/Encoder.h"
+
+namespace morviq {
+
+// Uncompressed frame dump: a 24-byte little-endian header followed by the
+// color buffer exactly as rendered (premultiplied RGBA8, top row first).
+//
+//   offset  size  field
+//   0       4     magic "MVQR"
+//   4       4     version (1)
+//   8       4     width
+//   12      4     height
+//   16      4     channels
+//   20      4     flags (bit 0: premultiplied alpha)
+class RawEncoder : public Encoder {
+public:
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kFlagPremultiplied = 1u << 0;
+    static constexpr size_t kHeaderSize = 24;
+    
+    bool encode(const Frame& frame, std::vector<uint8_t>& output) override;
+    
+    std::string getMimeType() const override { return "application/octet-stream"; }
+    std::string getFileExtension() const override { return "raw"; }
+};
+
+} // namespace morviq
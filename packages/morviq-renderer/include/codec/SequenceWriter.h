@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+#include <memory>
+#include <string>
+
+namespace morviq {
+
+// Output formats that append every frame to one stream (APNG, Y4M) rather
+// than writing a file per frame. Frames must arrive in order from a single
+// thread.
+class SequenceWriter {
+public:
+    virtual ~SequenceWriter() = default;
+    
+    virtual bool open(const std::string& path, int width, int height) = 0;
+    virtual bool writeFrame(const Frame& frame) = 0;
+    // Finalizes headers (e.g. the frame count) and closes the stream.
+    virtual bool close() = 0;
+    
+    virtual std::string getFileExtension() const = 0;
+};
+
+// Writer for OutputParams::format, or nullptr for per-frame formats.
+std::unique_ptr<SequenceWriter> createSequenceWriter(const OutputParams& params);
+
+} // namespace morviq
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "codec/SequenceWriter.h"
+#include <cstdio>
+#include <vector>
+
+namespace morviq {
+
+// Planar YUV 4:2:0 video for piping into an external encoder, e.g.
+//   morviq_renderer --format y4m --video-out - | ffmpeg -i - out.mp4
+// Y4M writes the YUV4MPEG2 stream header and a FRAME marker per frame; raw
+// I420 writes bare Y, U, V planes (the consumer must be told the size and
+// rate). Colour is BT.601 limited range over black, see pixels::rgbaToI420.
+// A path of "-" writes to stdout.
+class Y4MWriter : public SequenceWriter {
+public:
+    Y4MWriter(bool withHeader, int fps);
+    ~Y4MWriter() override;
+    
+    bool open(const std::string& path, int width, int height) override;
+    bool writeFrame(const Frame& frame) override;
+    bool close() override;
+    
+    std::string getFileExtension() const override { return withHeader ? "y4m" : "yuv"; }
+    
+private:
+    bool withHeader;
+    int fps;
+    FILE* file;
+    bool ownsFile;
+    int width;
+    int height;
+    std::vector<uint8_t> planes; // Y, U, V back to back
+};
+
+} // namespace morviq
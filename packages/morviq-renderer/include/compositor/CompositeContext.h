@@ -0,0 +1,58 @@
+#pragma once
+
+#include "types.h"
+#include "utils/PinnedBuffer.h"
+#include <mpi.h>
+#include <vector>
+
+namespace morviq {
+
+// Persistent direct-send schedule for DepthCompositor. The MPI_Send_init /
+// MPI_Recv_init requests and the pinned receive buffers are built once per
+// (resolution, rank layout, local buffer) and every frame afterwards is
+// MPI_Start calls plus the merges, with no heap allocation. Rank 0 keeps
+// only kSlots frames of receive buffers, whatever the rank count: each
+// peer's requests point at slot (peer - 1) % kSlots and are started once
+// the previous peer in that slot has been merged.
+class CompositeContext {
+public:
+    CompositeContext(int rank, int size, MPI_Comm comm);
+    ~CompositeContext();
+
+    CompositeContext(const CompositeContext&) = delete;
+    CompositeContext& operator=(const CompositeContext&) = delete;
+
+    // Rebuilds the schedule only if the resolution, the communicator size or
+    // the address of the local frame buffers changed. Returns true on rebuild.
+    bool prepare(const Frame& localFrame);
+
+    // Runs one frame: non-root ranks send their local frame, rank 0 merges
+    // every peer into outputFrame (pre-filled with its own local frame) in
+    // rank order while the next peer's transfer is in flight.
+    void execute(const Frame& localFrame, Frame& outputFrame, const CompositeParams& params);
+
+    int getRebuildCount() const { return rebuildCount; }
+
+private:
+    int mpiRank;
+    int mpiSize;
+    MPI_Comm mpiComm;
+
+    int width;
+    int height;
+    const uint8_t* boundColor;
+    const float* boundDepth;
+    int rebuildCount;
+
+    static constexpr int kSlots = 2;
+
+    // Root: color + depth receive buffers per slot. Others: unused.
+    std::vector<PinnedBuffer<uint8_t>> recvColor;
+    std::vector<PinnedBuffer<float>> recvDepth;
+    // Root: two receives per peer, ordered by peer. Others: color + depth send.
+    std::vector<MPI_Request> requests;
+
+    void release();
+};
+
+} // namespace morviq
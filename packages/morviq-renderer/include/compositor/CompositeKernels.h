@@ -0,0 +1,59 @@
+#pragma once
+
+#include "types.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace morviq {
+
+class ThreadPool;
+
+// Pixel merge kernels used by the compositors. Colors are premultiplied
+// RGBA8, depths are one float per pixel. Every kernel tolerates colorOut
+// aliasing color1 (in-place accumulation into the running composite).
+namespace kernels {
+
+// Instruction set the vectorized kernels were compiled for.
+const char* simdLevel();
+
+// Reference per-pixel implementations; kept for validation and benchmarks.
+void minDepthMergeScalar(const uint8_t* color1, const float* depth1,
+                         const uint8_t* color2, const float* depth2,
+                         uint8_t* colorOut, float* depthOut, size_t pixelCount);
+void overMergeScalar(const uint8_t* color1, const float* depth1,
+                     const uint8_t* color2, const float* depth2,
+                     uint8_t* colorOut, float* depthOut, size_t pixelCount);
+void maxMergeScalar(const uint8_t* color1, const float* depth1,
+                    const uint8_t* color2, const float* depth2,
+                    uint8_t* colorOut, float* depthOut, size_t pixelCount);
+
+// Vectorized (SSE2/AVX2/AVX-512BW) kernels.
+// minDepthMerge: keep the nearer pixel (ties keep input 1).
+// overMerge: depth-sorted premultiplied "near over far" in 8-bit fixed point.
+// maxMerge: per-channel maximum color, minimum depth.
+void minDepthMerge(const uint8_t* color1, const float* depth1,
+                   const uint8_t* color2, const float* depth2,
+                   uint8_t* colorOut, float* depthOut, size_t pixelCount);
+void overMerge(const uint8_t* color1, const float* depth1,
+               const uint8_t* color2, const float* depth2,
+               uint8_t* colorOut, float* depthOut, size_t pixelCount);
+void maxMerge(const uint8_t* color1, const float* depth1,
+              const uint8_t* color2, const float* depth2,
+              uint8_t* colorOut, float* depthOut, size_t pixelCount);
+
+// Single-threaded dispatch of the kernel for the given mode.
+void merge(CompositeParams::Mode mode,
+           const uint8_t* color1, const float* depth1,
+           const uint8_t* color2, const float* depth2,
+           uint8_t* colorOut, float* depthOut, size_t pixelCount);
+
+// Runs the kernel for the given mode over a width x height image, split
+// into row ranges on the pool (ThreadPool::shared() when pool is null).
+void mergeRows(CompositeParams::Mode mode,
+               const uint8_t* color1, const float* depth1,
+               const uint8_t* color2, const float* depth2,
+               uint8_t* colorOut, float* depthOut,
+               int width, int height, ThreadPool* pool = nullptr);
+
+} // namespace kernels
+} // namespace morviq
@@ -2,9 +2,12 @@
 
 #include "types.h"
 #include <mpi.h>
+#include <memory>
 
 namespace morviq {
 
+class CompositeContext;
+
 class DepthCompositor {
 public:
     DepthCompositor(int rank, int size, MPI_Comm comm);
@@ -24,15 +27,11 @@ private:
     int frameWidth;
     int frameHeight;
     
-    std::unique_ptr<uint8_t[]> recvColorBuffer;
-    std::unique_ptr<float[]> recvDepthBuffer;
+    // Persistent direct-send schedule, rebuilt only on layout changes
+    std::unique_ptr<CompositeContext> context;
     
     void binarySwapComposite(const Frame& localFrame, Frame& outputFrame, const CompositeParams& params);
     void directSendComposite(const Frame& localFrame, Frame& outputFrame, const CompositeParams& params);
-    void minDepthMerge(const uint8_t* color1, const float* depth1,
-                       const uint8_t* color2, const float* depth2,
-                       uint8_t* colorOut, float* depthOut,
-                       size_t pixelCount);
 };
 
 } // namespace morviq
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.h"
+#include <mpi.h>
+#include <memory>
+#include <vector>
+
+namespace morviq {
+
+class DepthCompositor;
+
+// Two-level compositor. Ranks sharing a node render straight into slots of
+// an MPI shared-memory window; the node's ranks then merge those slots in
+// place, each taking a band of rows, and only the node leader's partial
+// image enters the inter-node DepthCompositor.
+class HierarchicalCompositor {
+public:
+    HierarchicalCompositor(int rank, int size, MPI_Comm comm);
+    ~HierarchicalCompositor();
+
+    bool initialize(int width, int height);
+    void shutdown();
+
+    // Points frame at this rank's slot in the shared window. Rendering into
+    // that frame is what makes the node-local merge copy-free.
+    void attachLocalFrame(Frame& frame);
+
+    // Composites the attached local frames; the result lands in outputFrame
+    // on rank 0 of comm (outputFrame is ignored elsewhere).
+    void composite(Frame& outputFrame, const CompositeParams& params);
+
+    int getNodeRank() const { return nodeRank; }
+    int getNodeSize() const { return nodeSize; }
+    int getNodeCount() const { return nodeCount; }
+
+private:
+    int mpiRank;
+    int mpiSize;
+    MPI_Comm mpiComm;
+
+    MPI_Comm nodeComm;
+    MPI_Comm leaderComm;
+    int nodeRank;
+    int nodeSize;
+    int nodeCount;
+
+    MPI_Win window;
+    std::vector<uint8_t*> slotColor;
+    std::vector<float*> slotDepth;
+
+    int frameWidth;
+    int frameHeight;
+
+    std::unique_ptr<DepthCompositor> interNodeCompositor;
+    Frame nodeFrame;
+
+    void nodeSync();
+};
+
+} // namespace morviq
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "types.h"
+#include "utils/PinnedBuffer.h"
+#include <mpi.h>
+#include <vector>
+
+namespace morviq {
+
+// Sort-last composite that leaves the result distributed: rank r owns the
+// row stripe [rowBegin(r), rowBegin(r + 1)). Every rank sends each stripe of
+// its local frame to the owner in one MPI_Alltoallv; owners merge the
+// stripes in rank order. Nothing is gathered to rank 0.
+class TileCompositor {
+public:
+    TileCompositor(int rank, int size, MPI_Comm comm);
+    ~TileCompositor();
+
+    bool initialize(int width, int height);
+    void shutdown();
+
+    void composite(const Frame& localFrame, const CompositeParams& params);
+
+    // This rank's composited stripe (width x rowCount(rank)).
+    const Frame& getTile() const { return tile; }
+    int rowBegin(int rank) const { return rowStart[rank]; }
+    int rowCount(int rank) const { return rowStart[rank + 1] - rowStart[rank]; }
+
+private:
+    int mpiRank;
+    int mpiSize;
+    MPI_Comm mpiComm;
+
+    int frameWidth;
+    int frameHeight;
+
+    std::vector<int> rowStart;
+    std::vector<int> sendColorCounts, sendColorDispls, recvColorCounts, recvColorDispls;
+    std::vector<int> sendDepthCounts, sendDepthDispls, recvDepthCounts, recvDepthDispls;
+
+    // Stripes of this rank's rows from every rank, in rank order
+    PinnedBuffer<uint8_t> recvColor;
+    PinnedBuffer<float> recvDepth;
+    Frame tile;
+};
+
+} // namespace morviq
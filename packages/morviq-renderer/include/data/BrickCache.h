@@ -0,0 +1,88 @@
+#pragma once
+
+#include "types.h"
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace morviq {
+
+// Process-wide cache of loaded blocks shared by every loader, time step and
+// level of detail, so revisiting a time step or zoom level reads nothing.
+// Blocks are handed out as views whose voxels belong to the cache entry; an
+// entry is pinned while any view of it lives (e.g. the blocks of the frame
+// being rendered) and unpinned entries are evicted least recently used
+// first once the byte budget is exceeded. Pinned entries may hold the
+// cache over budget. Thread-safe.
+class BrickCache {
+public:
+    struct Key {
+        std::string source; // resolved file or array path
+        int timeStep;
+        int scale;
+        int begin[3];
+        int size[3];
+        int rate = 0; // bits per voxel held compressed, 0 for floats
+        bool sparse = false; // held as a SparseVolume where that saves memory
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0;
+        size_t entries = 0;
+        size_t budget = 0;
+    };
+
+    static BrickCache& shared();
+
+    explicit BrickCache(size_t budgetBytes = kDefaultBudget);
+
+    BrickCache(const BrickCache&) = delete;
+    BrickCache& operator=(const BrickCache&) = delete;
+
+    // 0 disables caching; evicts down to the new budget
+    void setBudget(size_t bytes);
+
+    // A view of the cached block, or nullptr on a miss
+    std::unique_ptr<VolumeData> find(const Key& key);
+    // Caches block and returns a view of it; a null block is passed through
+    std::unique_ptr<VolumeData> insert(const Key& key, std::unique_ptr<VolumeData> block);
+    // find(), or load() and insert() on a miss. load runs unlocked, so two
+    // threads missing the same key may both load it.
+    std::unique_ptr<VolumeData> fetch(const Key& key,
+                                      const std::function<std::unique_ptr<VolumeData>()>& load);
+
+    void clear();
+    Stats getStats() const;
+
+    static constexpr size_t kDefaultBudget = size_t(1) << 30;
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    struct Entry {
+        Key key;
+        std::shared_ptr<VolumeData> block;
+        size_t bytes;
+    };
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+    Stats stats;
+
+    // Called with the lock held
+    void evict(size_t reserve);
+    static std::unique_ptr<VolumeData> makeView(const std::shared_ptr<VolumeData>& block);
+};
+
+} // namespace morviq
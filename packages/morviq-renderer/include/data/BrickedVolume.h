@@ -0,0 +1,84 @@
+#pragma once
+
+#include "types.h"
+#include "data/MappedFile.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace morviq {
+
+// A time step converted by morviq_convert (tools/convert.cpp): every level of
+// a mip pyramid cut into bricks of brickSize^3 voxels, each stored with
+// ghost voxels on every side as one fixed-size run of little-endian floats in
+// bricks.dat, so any brick is one contiguous read at a computable offset.
+// Ghost voxels outside the volume repeat its faces. bricks.idx holds the
+// header below followed by the per-brick minimum (over stored voxels, ghosts
+// included), maximum, and histogram of interior voxels over valueRange.
+// Level l has ((d - 1) >> l) + 1 voxels per axis, as the raw levels of
+// DataLoader, down to a level that fits one brick; bricks are ordered by
+// level, then z, y, x.
+class BrickedVolume {
+public:
+    struct Header {
+        char magic[8];
+        uint32_t byteOrder;  // kByteOrder as written
+        uint32_t version;
+        int32_t dimensions[3];
+        int32_t brickSize;
+        int32_t ghost;
+        int32_t levelCount;
+        int32_t histogramBins;
+        float spacing[3];
+        float valueRange[2]; // of level 0
+        uint64_t brickCount;
+    };
+
+    // Per-brick annotations in the order of the index
+    struct Annotations {
+        std::vector<float> minimum;
+        std::vector<float> maximum;
+        std::vector<uint32_t> histograms; // histogramBins per brick
+    };
+
+    BrickedVolume();
+    ~BrickedVolume();
+
+    // indexPath is a bricks.idx; its bricks.dat is mapped alongside
+    bool open(const std::string& indexPath, const MapOptions& options = MapOptions());
+
+    const Header& getHeader() const { return header; }
+    const Annotations& getAnnotations() const { return annotations; }
+    int getLevelCount() const { return header.levelCount; }
+    void getDimensions(int level, int dimensions[3]) const;
+    // Voxels [begin, begin + size) (x, y, z) of a level: a view into the
+    // mapping if one stored brick holds them (as an out-of-core page of
+    // brickSize does), otherwise copied from each brick it overlaps
+    std::unique_ptr<VolumeData> loadRegion(int level, const int begin[3], const int size[3]) const;
+
+    // Layout shared with the converter
+    static void levelDimensions(const int dimensions[3], int level, int out[3]);
+    static int levelCount(const int dimensions[3], int brickSize);
+    static void bricksPerAxis(const int dimensions[3], int level, int brickSize, int out[3]);
+    // Index of the first brick of each level, and the total as the last entry
+    static std::vector<uint64_t> levelFirstBricks(const int dimensions[3], int brickSize, int levelCount);
+    static size_t brickBytes(int brickSize, int ghost);
+    static bool writeIndex(const std::string& path, const Header& header, const Annotations& annotations);
+    static std::string dataPath(const std::string& indexPath);
+
+    static constexpr char kMagic[8] = {'M', 'V', 'Q', 'B', 'R', 'I', 'C', 'K'};
+    static constexpr uint32_t kByteOrder = 0x01020304u;
+    static constexpr uint32_t kVersion = 1;
+
+private:
+    Header header;
+    Annotations annotations;
+    std::vector<uint64_t> firstBricks;
+    std::shared_ptr<MappedFile> file;
+    std::string path;
+
+    const float* brickVoxels(int level, int bx, int by, int bz) const;
+};
+
+} // namespace morviq
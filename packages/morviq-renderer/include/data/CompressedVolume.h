@@ -0,0 +1,62 @@
+#pragma once
+
+#include "types.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace morviq {
+
+// Voxels of a block held as a fixed-rate compressed stream in the style of
+// ZFP: each 4^3 cell gets a common exponent, a decorrelating integer
+// transform and an embedded bit-plane code cut off at exactly rate bits per
+// voxel. Every cell therefore takes the same number of 64-bit words and
+// decodes on its own. Samples go through a small cache of decoded cells;
+// like the ray marcher, sampling is single-threaded.
+class CompressedVolume : public VoxelStorage {
+public:
+    struct CacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // The voxels of block compressed at rate bits per voxel (kMinRate..kMaxRate)
+    static std::shared_ptr<CompressedVolume> encode(const VolumeData& block, int rate);
+    // A copy of block holding them as its VolumeData::storage; data is null
+    static std::unique_ptr<VolumeData> compress(const VolumeData& block, int rate);
+
+    float sample(float x, float y, float z) const override;
+    // The words plus the decode cache, counted from the start so a budget
+    // sees the same size before and after the first sample
+    size_t bytes() const override;
+    // All voxels, packed x fastest
+    void decompress(float* out) const;
+
+    int getRate() const { return rate; }
+    CacheStats getCacheStats() const { return cacheStats; }
+
+    static constexpr int kMinRate = 1;
+    static constexpr int kMaxRate = 32;
+    // Most decoded cells kept per volume (256 B each); a volume of fewer
+    // cells keeps the next power of two at or above its cell count, and at
+    // least the eight a sample can span
+    static constexpr int kCacheCells = 1024;
+
+private:
+    int dimensions[3];
+    int cells[3];
+    int rate; // 64-bit words per cell
+    std::vector<uint64_t> words;
+    size_t cacheSlots; // power of two, at least 8
+
+    // Allocated on the first sample
+    mutable std::vector<float> cacheValues;
+    mutable std::vector<size_t> cacheTags;
+    mutable CacheStats cacheStats;
+
+    CompressedVolume(const int dimensions[3], int rate);
+    // Decoded voxels of cell (cx, cy, cz), 4^3 x fastest
+    const float* cell(int cx, int cy, int cz) const;
+};
+
+} // namespace morviq
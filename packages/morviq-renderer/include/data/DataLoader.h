@@ -1,27 +1,100 @@
 #pragma once
 
 #include "types.h"
+#include "data/MappedFile.h"
+#include "data/VoxelType.h"
 #include <string>
 #include <memory>
 
 namespace morviq {
 
+class ZarrLoader;
+class BrickedVolume;
+
 class DataLoader {
 public:
+    // A raw volume is described by a JSON sidecar with the same stem
+    // (volume.raw -> volume.json):
+    //   {"dimensions": [x, y, z], "dtype": "<f4", "spacing": [1, 1, 1], "headerBytes": 0,
+    //    "compressRate": 0}
+    // Without one it is the legacy 128^3 little-endian float volume.
+    struct RawHeader {
+        int dimensions[3];
+        VoxelType type;
+        float spacing[3];
+        size_t headerBytes;
+        int compressRate;
+    };
+    
     DataLoader();
     ~DataLoader();
     
     void setBasePath(const std::string& path);
+    // How raw volumes are mapped; takes effect for files mapped afterwards
+    void setMapOptions(const MapOptions& options);
+    // Bits per voxel loaded blocks are compressed to (see
+    // data/CompressedVolume.h). Negative: each dataset's own "compressRate"
+    // (raw sidecar or Zarr .zattrs), 0: uncompressed.
+    void setCompressRate(int rate);
+    // Loaded blocks are held as sparse grids where that saves memory (see
+    // data/SparseVolume.h), taking precedence over compression
+    void setSparseParams(const SparseParams& params);
     
     std::unique_ptr<VolumeData> loadVolume(const std::string& dataset, int timeStep);
     std::unique_ptr<VolumeData> loadZarr(const std::string& path, int timeStep);
     std::unique_ptr<VolumeData> generateProceduralVolume(int size);
     
+    // True if the dataset stores the time step (no procedural fallback)
+    bool hasTimeStep(const std::string& dataset, int timeStep);
+    // Time steps the dataset stores, numbered from 0
+    int getTimeStepCount(const std::string& dataset);
+    // Levels of detail: the levels of a Zarr multiscale group, or a raw
+    // volume subsampled by 2 per level down to about kMinLevelSize voxels
+    int getLevelCount(const std::string& dataset, int timeStep);
+    // Dimensions (x, y, z) of a time step at a level, read from metadata only
+    bool getDimensions(const std::string& dataset, int timeStep, int dimensions[3], int scale = 0);
+    // Voxels [begin, begin + size) (x, y, z) of a time step at a level. Only
+    // the Zarr chunks or raw rows overlapping the region are read.
+    std::unique_ptr<VolumeData> loadRegion(const std::string& dataset, int timeStep,
+                                           const int begin[3], const int size[3], int scale = 0);
+    // True if the time step is a raw file; fills its path and header, e.g.
+    // for reading it with MPIVolumeReader instead
+    bool getRawVolume(const std::string& dataset, int timeStep, std::string& path, RawHeader& header);
+    // Rate the blocks of a time step are held at, 0 for uncompressed
+    int getCompressRate(const std::string& dataset, int timeStep);
+    // block as it is held after loading: sparse, compressed at rate, or as is
+    std::unique_ptr<VolumeData> packBlock(std::unique_ptr<VolumeData> block, int rate) const;
+    static bool readRawHeader(const std::string& filename, RawHeader& header);
+    
+    static constexpr int kMinLevelSize = 32;
+    
 private:
+    enum Source { SOURCE_PROCEDURAL, SOURCE_RAW, SOURCE_ZARR, SOURCE_BRICKED };
+    
     std::string basePath;
+    // Kept open so the bricks of one time step share the parsed metadata
+    std::unique_ptr<ZarrLoader> zarr;
+    std::string zarrPath;
+    // Time steps converted by morviq_convert (see data/BrickedVolume.h)
+    std::unique_ptr<BrickedVolume> bricked;
+    std::string brickedPath;
+    // Kept mapped so the blocks of one file share the mapping
+    MapOptions mapOptions;
+    int compressRate;
+    SparseParams sparseParams;
+    std::shared_ptr<MappedFile> rawFile;
+    std::string rawFilePath;
     
-    std::unique_ptr<VolumeData> loadRawVolume(const std::string& filename, 
-                                              int width, int height, int depth);
+    Source resolve(const std::string& dataset, int timeStep, std::string& path) const;
+    ZarrLoader* openZarr(const std::string& path);
+    BrickedVolume* openBricked(const std::string& path);
+    std::shared_ptr<MappedFile> mapRaw(const std::string& filename);
+    std::unique_ptr<VolumeData> loadRawRegion(const std::string& filename,
+                                              const int begin[3], const int size[3], int scale = 0);
+    std::unique_ptr<VolumeData> subsampleRawRegion(const MappedFile& file, const RawHeader& header,
+                                                   const int begin[3], const int size[3], int scale);
+    std::unique_ptr<VolumeData> generateProceduralRegion(int size, const int begin[3],
+                                                         const int regionSize[3]);
 };
 
-} // namespace morviq
\ No newline at end of file
+} // namespace morviq
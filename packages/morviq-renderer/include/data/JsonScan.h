@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace morviq {
+namespace json {
+
+// Just enough JSON for the small metadata files the loaders read (raw
+// volume sidecars, Zarr .zarray/.zattrs): values are found by key with no
+// regard for nesting, so keys must be unique in the part searched.
+
+// Position of the value of "key" (first non-blank after the colon) at or
+// after from, or npos
+inline size_t findValue(const std::string& json, const std::string& key, size_t from = 0) {
+    auto pos = json.find("\"" + key + "\"", from);
+    if (pos == std::string::npos) return pos;
+    pos = json.find(':', pos);
+    if (pos == std::string::npos) return pos;
+    return json.find_first_not_of(" \t\r\n", pos + 1);
+}
+
+// Reads up to count numbers of the array value of key; returns how many
+inline int parseNumbers(const std::string& json, const std::string& key, double* out, int count) {
+    auto pos = findValue(json, key);
+    if (pos == std::string::npos || json[pos] != '[') return 0;
+    const char* p = json.c_str() + pos + 1;
+    int n = 0;
+    while (n < count) {
+        char* end;
+        double value = std::strtod(p, &end);
+        if (end == p) break;
+        out[n++] = value;
+        p = end;
+        while (*p == ' ' || *p == ',' || *p == '\n' || *p == '\r' || *p == '\t') ++p;
+    }
+    return n;
+}
+
+// The integer array value of key; false if missing or empty
+inline bool parseIntArray(const std::string& json, const std::string& key, std::vector<int>& out) {
+    out.clear();
+    auto pos = findValue(json, key);
+    if (pos == std::string::npos || json[pos] != '[') return false;
+    auto end = json.find(']', pos);
+    if (end == std::string::npos) return false;
+    std::string arr = json.substr(pos + 1, end - pos - 1);
+    size_t i = 0;
+    while (i < arr.size()) {
+        while (i < arr.size() && (arr[i] == ',' || std::isspace(static_cast<unsigned char>(arr[i])))) ++i;
+        size_t j = i;
+        while (j < arr.size() && (arr[j] == '-' || (arr[j] >= '0' && arr[j] <= '9'))) ++j;
+        if (j > i) {
+            out.push_back(std::stoi(arr.substr(i, j - i)));
+            i = j;
+        } else {
+            break;
+        }
+    }
+    return !out.empty();
+}
+
+// The string value of key (no escapes) at or after from
+inline bool parseString(const std::string& json, const std::string& key, std::string& out, size_t from = 0) {
+    auto pos = findValue(json, key, from);
+    if (pos == std::string::npos || json[pos] != '"') return false;
+    auto end = json.find('"', pos + 1);
+    if (end == std::string::npos) return false;
+    out = json.substr(pos + 1, end - pos - 1);
+    return true;
+}
+
+} // namespace json
+} // namespace morviq
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "types.h"
+#include "data/VoxelType.h"
+#include <memory>
+#include <string>
+#include <mpi.h>
+
+namespace morviq {
+
+// Reads blocks of a raw volume with MPI-IO. Each block is described to MPI
+// as a subarray file view; in collective mode the ranks read together with
+// MPI_File_read_all, so collective buffering turns many small strided
+// requests into a few large contiguous ones issued by the aggregators.
+// open, read and close are collective over the communicator.
+class MPIVolumeReader {
+public:
+    explicit MPIVolumeReader(MPI_Comm comm);
+    ~MPIVolumeReader();
+    
+    bool open(const std::string& filename, const int dimensions[3], const VoxelType& type,
+              size_t headerBytes, const ReadParams& params);
+    // Every rank calls read the same number of times; a rank with nothing
+    // (more) to read passes an empty size and gets no block.
+    bool read(const int begin[3], const int size[3], std::unique_ptr<VolumeData>& block);
+    void close();
+    
+private:
+    MPI_Comm comm;
+    MPI_File file;
+    MPI_Info info;
+    MPI_Datatype element; // one voxel as stored
+    std::string path;
+    int dimensions[3];
+    VoxelType type;
+    MPI_Offset headerBytes;
+    bool collective;
+    std::unique_ptr<uint8_t[]> staging; // stored voxels of non-float types
+    size_t stagingSize;
+};
+
+} // namespace morviq
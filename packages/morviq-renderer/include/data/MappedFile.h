@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace morviq {
+
+struct MapOptions {
+    bool populate = false;  // MAP_POPULATE: fault the whole file in at map time
+    bool hugePages = false; // MADV_HUGEPAGE: transparent huge pages where the filesystem allows
+};
+
+// Read-only shared mapping of a whole file. Processes that map the same file
+// share its page-cache pages, so ranks on one node hold one copy. The mapping
+// is advised random access; callers announce the ranges they will read.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool open(const std::string& path, const MapOptions& options);
+    void close();
+    
+    const uint8_t* data() const { return static_cast<const uint8_t*>(base); }
+    size_t size() const { return length; }
+    
+    // Starts reading [offset, offset + bytes) in the background (MADV_WILLNEED)
+    void willNeed(size_t offset, size_t bytes) const;
+    
+private:
+    void* base;
+    size_t length;
+};
+
+} // namespace morviq
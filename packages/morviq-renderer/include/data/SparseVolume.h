@@ -0,0 +1,78 @@
+#pragma once
+
+#include "types.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace morviq {
+
+// Sparse grid for mostly empty blocks such as segmented cells, after VDB: a
+// dense root table of internal nodes, each covering 16^3 tiles of 8^3
+// voxels. A tile is stored as a dense leaf only if it holds active voxels
+// (further than a tolerance from the background value); the nodes index
+// their leaves through child bitmasks and popcount prefixes, so memory
+// scales with the active leaves rather than the bounding box. Every other
+// voxel reads as the background. A second bitmask per node marks the tiles
+// whose samples can differ from the background (a trilinear sample also
+// reads the next voxel up, possibly in a neighbouring leaf), so rays step
+// over empty tiles and nodes without sampling them.
+class SparseVolume : public VoxelStorage {
+public:
+    struct Stats {
+        size_t nodes = 0;
+        size_t leaves = 0;
+        size_t activeVoxels = 0;
+    };
+
+    // The voxels of block as a sparse grid, or nullptr if that would not
+    // take at most kMaxDenseFraction of the dense block's memory
+    static std::shared_ptr<SparseVolume> build(const VolumeData& block, const SparseParams& params);
+    // A copy of block holding them as its VolumeData::storage, or nullptr
+    static std::unique_ptr<VolumeData> fromDense(const VolumeData& block, const SparseParams& params);
+
+    float sample(float x, float y, float z) const override;
+    size_t bytes() const override;
+    float background() const override { return backgroundValue; }
+    float emptyLength(const float p[3], const float d[3]) const override;
+
+    float value(int x, int y, int z) const;
+    Stats getStats() const;
+
+    static constexpr int kLeafLog2 = 3; // 8^3 voxels per leaf
+    static constexpr int kNodeLog2 = 4; // 16^3 tiles per internal node
+    static constexpr float kMaxDenseFraction = 0.5f;
+
+private:
+    static constexpr int kLeafSize = 1 << kLeafLog2;
+    static constexpr int kLeafVoxels = kLeafSize * kLeafSize * kLeafSize;
+    static constexpr int kNodeTiles = 1 << (3 * kNodeLog2);
+    static constexpr int kNodeWords = kNodeTiles / 64;
+    static constexpr int kNodeLog2Voxels = kNodeLog2 + kLeafLog2;
+
+    struct Leaf {
+        uint64_t activeMask[kLeafVoxels / 64];
+        float values[kLeafVoxels];
+    };
+    struct Node {
+        uint64_t childMask[kNodeWords];  // tiles stored as leaves
+        uint64_t sampleMask[kNodeWords]; // tiles whose samples may not be background
+        uint32_t prefix[kNodeWords];     // leaves before each childMask word
+        uint32_t firstLeaf;
+    };
+
+    int dimensions[3];
+    int rootSize[3];
+    float backgroundValue;
+    std::vector<int32_t> root; // node per 128^3 region, or -1
+    std::vector<Node> nodes;
+    std::vector<Leaf> leaves;
+    // A leaf of background voxels, read where no leaf is stored
+    std::vector<float> backgroundLeaf;
+
+    SparseVolume(const int dimensions[3], float background);
+    // The leaf voxels of the tile holding voxel (x, y, z), or backgroundLeaf
+    const float* leafValues(int x, int y, int z) const;
+};
+
+} // namespace morviq
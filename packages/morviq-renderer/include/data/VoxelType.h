@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace morviq {
+
+// Numpy-style dtype ("<f4", "|u1", ">i2", ...), as used by Zarr and the raw
+// volume header: byte order, kind (f, i or u) and item size in bytes.
+struct VoxelType {
+    std::string name = "<f4";
+    char kind = 'f';
+    int itemSize = 4;
+    bool swapBytes = false; // byte order differs from the host
+    
+    // Stored exactly as the host's float, so voxels can be used in place
+    bool isNativeFloat() const { return kind == 'f' && itemSize == 4 && !swapBytes; }
+};
+
+// False for structured or unsupported types
+bool parseVoxelType(const std::string& name, VoxelType& type);
+
+// Converts count voxels stride bytes apart into consecutive floats
+using VoxelConvertFn = void (*)(const uint8_t* src, size_t stride, bool swap, float* dst, size_t count);
+VoxelConvertFn voxelConverter(const VoxelType& type);
+
+} // namespace morviq
@@ -1,31 +1,69 @@
 #pragma once
 
 #include "types.h"
+#include "data/VoxelType.h"
 #include <string>
 #include <vector>
 #include <memory>
 
 namespace morviq {
 
+// Reader for Zarr v2 arrays of 3 (z, y, x) or 4 (t, z, y, x) dimensions,
+// either a single array or a multiscale group whose levels are the arrays
+// "0", "1", ... next to its .zgroup. Chunks may be raw or zlib/gzip
+// compressed, in C or F order, of any integer or float dtype (converted to
+// float as is); missing chunks read as fill_value. Chunks are read and
+// decoded in parallel on the shared thread pool directly into the output
+// volume.
 class ZarrLoader {
 public:
     ZarrLoader();
     ~ZarrLoader();
-    
+
     bool open(const std::string& path);
-    
+
+    // The whole volume of time step t (ignored for 3D arrays) at a level.
     std::unique_ptr<VolumeData> loadTimeStep(int t, int scale = 0);
-    std::unique_ptr<VolumeData> loadBrick(int t, int scale, 
+    // The chunk-aligned brick at chunk coordinates (brickX, brickY, brickZ).
+    // Edge bricks are clipped.
+    std::unique_ptr<VolumeData> loadBrick(int t, int scale,
                                           int brickX, int brickY, int brickZ);
-    
+    // Voxels [begin, begin + size) (x, y, z); only the chunks overlapping
+    // the region are read. VolumeData::offset is begin.
+    std::unique_ptr<VolumeData> loadRegion(int t, int scale, const int begin[3], const int size[3]);
+
+    // Level 0, in .zarray order (slowest axis first)
     const std::vector<int>& getShape() const { return shape; }
     const std::vector<int>& getChunks() const { return chunks; }
-    
+    int getLevelCount() const { return static_cast<int>(levels.size()); }
+    const std::vector<int>& getLevelShape(int scale) const { return levels[scale].shape; }
+    // "compressRate" of the root .zattrs (see DataLoader::setCompressRate), or 0
+    int getCompressRate() const { return compressRate; }
+
 private:
+    enum Codec { CODEC_RAW, CODEC_ZLIB };
+
+    struct Array {
+        std::string path;
+        std::vector<int> shape;
+        std::vector<int> chunks;
+        VoxelType type;
+        bool fortranOrder = false;
+        Codec codec = CODEC_RAW;
+        float fillValue = 0.0f;
+        char separator = '.';
+    };
+
     std::string zarrPath;
+    std::vector<Array> levels;
     std::vector<int> shape;
     std::vector<int> chunks;
     std::string dtype;
+    int compressRate;
+
+    static bool parseArray(const std::string& path, Array& array);
+    // Reads voxels [begin, begin + size) (x, y, z) of time step t into out
+    bool readRegion(const Array& array, int t, const int begin[3], const int size[3], float* out) const;
 };
 
-} // namespace morviq
\ No newline at end of file
+} // namespace morviq
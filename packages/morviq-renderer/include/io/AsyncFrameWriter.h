@@ -0,0 +1,94 @@
+#pragma once
+
+#include "types.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace morviq {
+
+class Encoder;
+class SequenceWriter;
+class FramePublisher;
+
+// Bounded encode-and-write queue. The render loop hands over a finished
+// frame by swapping buffers (no copy); a pool of encoder threads compresses
+// queued frames concurrently and whichever thread completes the oldest
+// outstanding frame writes the files, so output stays in submission order.
+// Stateful encoders (Encoder::isStateful) get a single encoder thread.
+// With a SequenceWriter, that one thread appends each frame to the sequence
+// instead of writing a file per frame; with FramePublishers, encoded
+// frames go to each of them instead of to disk.
+class AsyncFrameWriter {
+public:
+    AsyncFrameWriter();
+    ~AsyncFrameWriter();
+
+    AsyncFrameWriter(const AsyncFrameWriter&) = delete;
+    AsyncFrameWriter& operator=(const AsyncFrameWriter&) = delete;
+
+    // Preallocates params.queueDepth frame buffers of width x height. An
+    // open sequence or publishers, if given, are borrowed and must outlive
+    // shutdown().
+    bool initialize(int width, int height, const OutputParams& params,
+                    SequenceWriter* sequence = nullptr,
+                    const std::vector<FramePublisher*>& publishers = {});
+    // Drains the queue and joins the encoder threads.
+    void shutdown();
+
+    // Takes ownership of *frame and replaces it with a recycled buffer of the
+    // same size. Returns false if the frame was dropped (DROP_NEWEST with a
+    // full queue); *frame is then left untouched.
+    bool submit(std::unique_ptr<Frame>& frame, const std::string& path);
+
+    // Blocks until every accepted frame has been written or dropped.
+    void flush();
+
+    uint64_t getWrittenCount() const;
+    uint64_t getDroppedCount() const;
+
+private:
+    enum JobState { JOB_QUEUED, JOB_ENCODING, JOB_DONE };
+
+    struct Job {
+        std::unique_ptr<Frame> frame;
+        std::string path;
+        std::vector<uint8_t> encoded;
+        JobState state = JOB_QUEUED;
+        bool ok = false;
+        bool keyframe = true; // see Encoder::wroteKeyframe
+    };
+
+    OutputParams params;
+    int frameWidth;
+    int frameHeight;
+    std::vector<std::unique_ptr<Job>> jobs;
+    std::vector<Job*> freeJobs;
+    std::deque<Job*> pending;  // waiting for an encoder
+    std::deque<Job*> inFlight; // every accepted job, in submission order
+    std::vector<std::unique_ptr<Encoder>> encoderInstances;
+    std::vector<std::thread> encoders;
+    SequenceWriter* sequence;
+    std::vector<FramePublisher*> publishers;
+
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable slotAvailable;
+    std::condition_variable drained;
+    bool stopping;
+    bool writing;
+    uint64_t writtenCount;
+    uint64_t droppedCount;
+
+    void encoderLoop(Encoder* encoder);
+    // Called with the lock held; writes completed jobs at the head of inFlight.
+    void writeCompleted(std::unique_lock<std::mutex>& lock);
+    void recycle(Job* job);
+};
+
+} // namespace morviq
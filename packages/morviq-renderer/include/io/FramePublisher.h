@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace morviq {
+
+// Destination for encoded frames that replaces writing files (shared-memory
+// ring, streaming socket). publish() is called from one thread at a time, in
+// frame order, and must not block on slow consumers.
+class FramePublisher {
+public:
+    virtual ~FramePublisher() = default;
+    // keyframe: the frame decodes without the ones before it (always true
+    // for stateless formats; see Encoder::wroteKeyframe)
+    virtual bool publish(const uint8_t* data, size_t size, bool keyframe) = 0;
+    // True, once, if a consumer can only continue from a keyframe; the
+    // caller then asks its encoder for one (Encoder::requestKeyframe).
+    virtual bool takeKeyframeRequest() { return false; }
+};
+
+} // namespace morviq
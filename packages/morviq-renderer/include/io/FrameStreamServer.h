@@ -0,0 +1,84 @@
+#pragma once
+
+#include "io/FramePublisher.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace morviq {
+
+// Pushes encoded frames to subscribers over TCP (127.0.0.1, like the
+// ControlServer) or a Unix domain socket. Every frame is sent as a 16-byte
+// little-endian header followed by the payload:
+//
+//   offset  size  field
+//   0       4     payload length
+//   4       4     format (OutputParams::Format)
+//   8       8     frame number, counting from 0 at start()
+//
+// Sockets are non-blocking and each subscriber only ever has the frame in
+// flight plus the newest one waiting: a frame published while an older one
+// is still waiting replaces it (latest-frame-wins), so a slow consumer skips
+// frames instead of stalling the render loop or growing a queue. Frames are
+// always sent whole; a subscriber that connects mid-stream starts at the
+// next frame. For formats whose frames build on earlier ones (delta), a
+// subscriber that joins or skips a frame is sent nothing until the next
+// keyframe, and takeKeyframeRequest() asks the encoder for one.
+class FrameStreamServer : public FramePublisher {
+public:
+    static constexpr size_t kHeaderSize = 16;
+
+    FrameStreamServer();
+    ~FrameStreamServer() override;
+
+    FrameStreamServer(const FrameStreamServer&) = delete;
+    FrameStreamServer& operator=(const FrameStreamServer&) = delete;
+
+    bool start(int port, uint32_t format);
+    bool startUnix(const std::string& path, uint32_t format);
+    void stop();
+
+    // Copies the frame and hands it to the sender thread; never blocks on
+    // subscribers.
+    bool publish(const uint8_t* data, size_t size, bool keyframe) override;
+    bool takeKeyframeRequest() override { return keyframeRequested.exchange(false); }
+
+    uint64_t getSkippedCount() const { return skipped.load(); }
+
+private:
+    using Buffer = std::shared_ptr<std::vector<uint8_t>>;
+
+    struct Subscriber {
+        int fd;
+        Buffer sending; // frame in flight
+        size_t offset;
+        Buffer waiting; // newest frame not yet started
+        bool synced;    // has every frame since its last keyframe
+    };
+
+    int listenFd;
+    int wakeFd;
+    std::string unixPath;
+    uint32_t format;
+    std::thread serverThread;
+    std::atomic<bool> running;
+
+    std::mutex mutex; // guards latest, latestKeyframe, frameCount and pool
+    Buffer latest;
+    bool latestKeyframe;
+    uint64_t frameCount;
+    std::vector<Buffer> pool;
+    std::atomic<uint64_t> skipped;
+    std::atomic<bool> keyframeRequested;
+
+    bool startThread();
+    void serve();
+    Buffer acquireBuffer();
+    // Sends as much as the socket takes; false if the subscriber is gone.
+    bool flush(Subscriber& subscriber);
+};
+
+} // namespace morviq
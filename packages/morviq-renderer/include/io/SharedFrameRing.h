@@ -0,0 +1,144 @@
+#pragma once
+
+#include "io/FramePublisher.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace morviq {
+
+// Frame handoff to a local consumer (the gateway) through POSIX shared
+// memory instead of files. The segment /<name> holds a header, a fixed
+// array of slot descriptors and the slot payloads; frames go round-robin
+// into the slots, each guarded by a seqlock, so the writer never waits on a
+// reader and a reader works on the mapped bytes directly and then checks
+// that the slot was not overwritten meanwhile.
+//
+// After each frame the writer sends one byte to every client connected to
+// the Unix stream socket named in the header. Ticks are hints that may be
+// coalesced; readers always go to the newest published frame.
+//
+// Layout (native endianness, all offsets from the start of the segment):
+//
+//   0                    SharedRingHeader
+//   sizeof(header)       SharedRingSlot[slotCount]
+//   dataOffset           slotCount payloads of slotCapacity bytes each
+//
+// A payload is one encoded frame in the header's format (see
+// OutputParams::Format), exactly as it would have been written to a file.
+struct SharedRingHeader {
+    static constexpr uint32_t kMagic = 0x5351564d; // "MVQS"
+    static constexpr uint32_t kVersion = 1;
+    enum State : uint32_t { STATE_INIT = 0, STATE_LIVE = 1, STATE_CLOSED = 2 };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint64_t slotCapacity;
+    uint64_t dataOffset;
+    std::atomic<uint32_t> state;
+    uint32_t reserved;
+    // Frames published so far; the newest is in slot (published - 1) % slotCount
+    std::atomic<uint64_t> published;
+    char socketPath[108];
+};
+
+struct alignas(64) SharedRingSlot {
+    // Seqlock: 2n + 1 while frame n is being written, 2n + 2 once complete
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> size;
+    std::atomic<uint64_t> timestampNs; // CLOCK_MONOTONIC at publish
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory seqlock needs lock-free 64-bit atomics");
+
+// Writer side, owned by rank 0.
+class SharedFrameRing : public FramePublisher {
+public:
+    SharedFrameRing();
+    ~SharedFrameRing() override;
+
+    SharedFrameRing(const SharedFrameRing&) = delete;
+    SharedFrameRing& operator=(const SharedFrameRing&) = delete;
+
+    // Creates (or replaces) the segment and the notification socket
+    // /tmp/<name>.sock. slotCapacity bounds the size of one encoded frame.
+    bool initialize(const std::string& name, int slotCount, size_t slotCapacity,
+                    int width, int height, uint32_t format);
+    // Marks the ring closed and unlinks the segment and socket; mapped
+    // readers keep their view of the last frames.
+    void shutdown();
+
+    // Copies one encoded frame into the next slot and notifies readers.
+    // Returns false if it does not fit in a slot.
+    bool publish(const uint8_t* data, size_t size, bool keyframe) override;
+
+    uint64_t getPublishedCount() const { return published; }
+
+private:
+    std::string shmName;
+    uint8_t* base;
+    size_t mappedSize;
+    SharedRingHeader* header;
+    SharedRingSlot* slots;
+    uint64_t published;
+
+    int listenFd;
+    std::vector<int> clients;
+
+    void acceptClients();
+    void notifyClients();
+};
+
+// Reader side: maps an existing ring read-only.
+class SharedFrameRingReader {
+public:
+    // A frame as it sits in shared memory. Valid until the writer reuses the
+    // slot; confirm with stillValid() after consuming the bytes.
+    struct View {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        uint64_t frame = 0;       // publish index, from 0
+        uint64_t timestampNs = 0;
+        uint64_t sequence = 0;    // seqlock value the view was taken at
+        int slot = -1;
+    };
+
+    SharedFrameRingReader();
+    ~SharedFrameRingReader();
+
+    SharedFrameRingReader(const SharedFrameRingReader&) = delete;
+    SharedFrameRingReader& operator=(const SharedFrameRingReader&) = delete;
+
+    bool open(const std::string& name);
+    void close();
+
+    const SharedRingHeader& getHeader() const { return *header; }
+    bool isClosed() const;
+
+    // Connects to the notification socket; returns its fd (or -1) for poll().
+    int connectNotifications();
+    // Reads and discards pending ticks; returns false once the writer hangs up.
+    bool drainNotifications();
+
+    // Newest complete frame with an index >= minFrame. Returns false if
+    // there is none yet.
+    bool latest(View& view, uint64_t minFrame = 0) const;
+    // True if the slot still holds the frame the view was taken from.
+    bool stillValid(const View& view) const;
+
+private:
+    const uint8_t* base;
+    size_t mappedSize;
+    const SharedRingHeader* header;
+    const SharedRingSlot* slots;
+    int notifyFd;
+};
+
+} // namespace morviq
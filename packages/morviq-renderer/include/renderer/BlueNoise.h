@@ -0,0 +1,19 @@
+#pragma once
+
+namespace morviq {
+
+// 64x64 tileable blue-noise ranks in [0, 1), generated once with
+// void-and-cluster. Used to decorrelate per-pixel ray-start jitter so the
+// residual error is high-frequency and averages out in a few frames.
+class BlueNoise {
+public:
+    static constexpr int kSize = 64;
+
+    static float sample(int x, int y) {
+        return tile()[(y & (kSize - 1)) * kSize + (x & (kSize - 1))];
+    }
+
+    static const float* tile();
+};
+
+} // namespace morviq
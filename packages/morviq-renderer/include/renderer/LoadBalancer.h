@@ -0,0 +1,63 @@
+#pragma once
+
+#include "types.h"
+#include <cstdint>
+#include <mpi.h>
+#include <vector>
+
+namespace morviq {
+
+// Cuts the volume into a grid of bricks and assigns them to ranks (see
+// BalanceParams). A k-d tree halves the ranks along the longest axis of
+// their box at the brick plane that best splits the cost, so each rank owns
+// one box and the partial images still composite by depth. update() gathers
+// every rank's render time and sums the per-brick costs each frame and, past
+// the threshold, moves the planes; every rank computes the same tree from
+// the same reduced data.
+class LoadBalancer {
+public:
+    LoadBalancer(int rank, int size, MPI_Comm comm);
+
+    // dimensions (voxels, or null when unknown) shape the grid and the
+    // splits; a call with the same dimensions keeps the assignment and costs
+    void decompose(const BalanceParams& params, const int dimensions[3]);
+    const std::vector<BrickInfo>& getAssignedBricks() const { return assigned; }
+
+    // Bricks per axis; brick ids run x fastest
+    const int* getGrid() const { return grid; }
+
+    // Collective, once per frame when rebalancing: this rank's render time
+    // and the work (samples) it did in each brick, by id. Returns true if
+    // the bricks were reassigned.
+    bool update(double seconds, const std::vector<uint64_t>& work);
+    // Slowest rank's render time over the mean, minus one, of the last update
+    float getImbalance() const { return imbalance; }
+
+private:
+    int mpiRank;
+    int mpiSize;
+    MPI_Comm mpiComm;
+    BalanceParams params;
+    bool kdTree = false;
+    int dimensions[3];
+    int grid[3];
+    std::vector<BrickInfo> bricks; // scan order, x fastest; id is the index
+    std::vector<int> owners;       // rank of each brick
+    std::vector<BrickInfo> assigned;
+    std::vector<double> costs;    // smoothed seconds per brick
+    std::vector<double> sent;        // this rank's cost of each brick (0 unless owned)
+    std::vector<double> summed;      // sent summed over the ranks
+    std::vector<double> rankSeconds; // render time of every rank
+    float imbalance = 0.0f;
+    int framesOver = 0;
+    int framesSinceRebalance = 0;
+    bool measured = false;
+
+    // Owners from a k-d tree over ranks [first, end) and bricks [lo, hi)
+    void split(const std::vector<double>& weights, int first, int end, const int lo[3], const int hi[3],
+               std::vector<int>& result) const;
+    double slowestRank(const std::vector<int>& brickOwners) const;
+    void assign(const std::vector<int>& brickOwners);
+};
+
+} // namespace morviq
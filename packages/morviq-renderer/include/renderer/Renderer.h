@@ -1,14 +1,28 @@
 #pragma once
 
 #include "types.h"
+#include "codec/Encoder.h"
+#include "codec/PNGStream.h"
+#include "codec/SequenceWriter.h"
+#include "data/DataLoader.h"
+#include "data/MappedFile.h"
 #include <memory>
 #include <mpi.h>
 
 namespace morviq {
 
-class DataLoader;
 class VolumeRenderer;
 class DepthCompositor;
+class HierarchicalCompositor;
+class TileCompositor;
+class AsyncFrameWriter;
+class SharedFrameRing;
+class FrameStreamServer;
+class FramePublisher;
+class TemporalAccumulator;
+class TimestepPrefetcher;
+class VirtualVolume;
+class LoadBalancer;
 
 class Renderer {
 public:
@@ -19,16 +33,50 @@ public:
     void shutdown();
     
     void setDataPath(const std::string& path);
+    void setMapOptions(const MapOptions& options);
+    // Raw volumes: mapped per rank or read with MPI-IO; loadVolume is then collective
+    void setReadParams(const ReadParams& params);
     bool loadVolume(const std::string& dataset, int timeStep);
+    // Out-of-core rendering: with a memory budget, loadVolume pages the
+    // dataset in on demand instead of loading the bricks up front
+    void setPagingParams(const PagingParams& params);
+    // Byte budget of the process-wide BrickCache (see data/BrickCache.h)
+    void setCacheBudget(size_t bytes);
+    // Bits per voxel loaded blocks are held at; negative: per dataset (see
+    // DataLoader::setCompressRate)
+    void setCompressRate(int rate);
+    // Loaded blocks held as sparse grids where that saves memory
+    void setSparseParams(const SparseParams& params);
+    // Staging buffers for time steps loaded ahead of playback (default 2);
+    // 0 makes updateTimeStep load synchronously
+    void setPrefetchSlots(int slots);
+    // Call before each render() with the time step to show. Collective.
+    // Prefetched steps replace the volume between frames once every rank
+    // holds its blocks; until then the current step stays on screen.
+    // Returns true if the volume changed.
+    bool updateTimeStep(int timeStep);
     
     void setCamera(const Camera& camera);
     void setTransferFunction(const TransferFunction& tf);
     void setRenderParams(const RenderParams& params);
+    // Starts temporal accumulation over; call when the scene changes in a way
+    // the renderer cannot see (e.g. regenerated volume data).
+    void resetHistory();
+    // Call before initialize(); selects the compositor.
+    void setCompositeParams(const CompositeParams& params);
+    // Call before initialize(); how bricks are cut and moved between ranks.
+    void setBalanceParams(const BalanceParams& params);
+    // Call before initialize(); enables the background encode queue on rank 0.
+    void setOutputParams(const OutputParams& params);
     VolumeRenderer* getVolumeRenderer() { return volumeRenderer.get(); }
     
     bool render();
     const Frame& getFrame() const { return *currentFrame; }
+    // Slowest rank's render time over the mean, minus one, in the last frame
+    // (measured while rebalancing)
+    float getImbalance() const;
     
+    // Collective when distributed output is enabled; otherwise only rank 0 writes.
     void saveFrame(const std::string& outputPath, int frameNumber);
     
 private:
@@ -37,20 +85,70 @@ private:
     MPI_Comm mpiComm;
     
     std::unique_ptr<DataLoader> dataLoader;
+    std::unique_ptr<TimestepPrefetcher> prefetcher;
+    std::unique_ptr<VirtualVolume> virtualVolume;
+    PagingParams pagingParams;
+    std::string dataPath;
+    MapOptions mapOptions;
+    int compressRate = -1;
+    SparseParams sparseParams;
+    std::string currentDataset;
+    int currentTimeStep = 0;
+    int prefetchSlots = 2;
+    int failedTimeStep = -1;
     std::unique_ptr<VolumeRenderer> volumeRenderer;
     std::unique_ptr<DepthCompositor> compositor;
+    std::unique_ptr<HierarchicalCompositor> nodeCompositor;
+    std::unique_ptr<TileCompositor> tileCompositor;
+    std::unique_ptr<AsyncFrameWriter> frameWriter;
     std::unique_ptr<Frame> currentFrame;
     std::unique_ptr<Frame> compositeFrame;
+    std::unique_ptr<TemporalAccumulator> temporal;
+    int jitterFrame = 0;
+    Frame emptyFrame; // output placeholder on ranks that do not receive the composite
+    
+    std::unique_ptr<Encoder> encoder;
+    std::unique_ptr<SequenceWriter> sequenceWriter; // APNG: one file for the run
+    bool sequenceOpen = false;
+    // Frame publishing (replaces files when any is set)
+    std::unique_ptr<SharedFrameRing> frameRing;
+    std::unique_ptr<FrameStreamServer> frameStream;
+    std::vector<FramePublisher*> publishers;
+    std::vector<uint8_t> encoded; // synchronous publishing
+    
+    // Distributed output: per-rank stripe encode state, reused across frames
+    std::unique_ptr<PNGStripeEncoder> stripeEncoder;
+    PNGStripe stripe;
     
     Camera camera;
     TransferFunction transferFunction;
     RenderParams renderParams;
+    CompositeParams compositeParams;
+    OutputParams outputParams;
+    ReadParams readParams;
+    BalanceParams balanceParams;
     
+    std::unique_ptr<LoadBalancer> balancer;
     std::vector<BrickInfo> assignedBricks;
+    std::vector<BrickInfo> renderedBricks; // assignedBricks merged as blockRegions() loads them
+    double renderSeconds = 0.0; // of this rank's bricks in the last frame
     
-    void assignBricks();
+    // dimensions: of the dataset, or null before one is loaded
+    void assignBricks(const int dimensions[3]);
+    void takeAssignment();
+    // Loads the assigned bricks of a time step
+    bool loadBricks(const std::string& dataset, int timeStep, const int dimensions[3]);
+    // Feeds the frame's render times to the balancer and loads moved bricks
+    void balance();
+    // Boxes to load for the assigned bricks
+    std::vector<BrickInfo> blockRegions() const;
+    bool readRawBlocks(const std::string& path, const DataLoader::RawHeader& header, int timeStep, int rate,
+                       const std::vector<BrickInfo>& regions, size_t& loadedVoxels);
     void renderBricks();
     void compositeFrames();
+    void saveDistributedFrame(const std::string& filePath);
+    bool initializePublishers(int width, int height);
+    void initializeTemporal();
 };
 
 } // namespace morviq
\ No newline at end of file
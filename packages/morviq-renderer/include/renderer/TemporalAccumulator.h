@@ -0,0 +1,52 @@
+#pragma once
+
+#include "types.h"
+#include <vector>
+
+namespace morviq {
+
+// Accumulates successive composited frames so jittered, coarse-step renders
+// converge while the view holds still.
+//
+// A still camera averages frames progressively (weight 1/n) up to
+// maxHistory. When it moves slightly, each pixel is reprojected into the
+// previous frame using its depth, and the history found there is clamped to
+// the current frame's 3x3 neighbourhood (so stale colours cannot ghost) and
+// blended with a fixed weight. Larger moves reset the history.
+struct TemporalParams {
+    int maxHistory = 16;      // frames averaged while still
+    float blend = 0.2f;       // weight of the current frame while moving
+    float resetMotion = 0.1f; // reset beyond this motion, as a fraction of the width
+};
+
+class TemporalAccumulator {
+public:
+    TemporalAccumulator();
+
+    bool initialize(int width, int height, const TemporalParams& params = TemporalParams());
+    // Drops the history; the next frame starts a new accumulation.
+    void reset();
+
+    // Folds frame into the history and overwrites its colour with the result.
+    // Reprojection reads the frame's window-space depth.
+    void accumulate(Frame& frame, const Camera& camera);
+
+    int getHistoryLength() const { return historyLength; }
+
+private:
+    enum Motion { STILL, MOVING, RESET };
+
+    int width;
+    int height;
+    TemporalParams params;
+    std::vector<float> history[2]; // RGBA in 0..255, double-buffered
+    int current;                   // index of the valid history
+    int historyLength;             // 0 when empty
+    bool previousUsedCamera;
+    float previousViewProj[16];
+    float reprojection[16]; // current NDC to previous clip space
+
+    Motion classifyMotion(const Frame& frame, const Camera& camera);
+};
+
+} // namespace morviq
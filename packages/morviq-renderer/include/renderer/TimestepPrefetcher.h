@@ -0,0 +1,86 @@
+#pragma once
+
+#include "types.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace morviq {
+
+class DataLoader;
+
+// Loads upcoming time steps in the background so playback does not wait on
+// reads. request() takes the time step the viewer wants each frame; from
+// the changes it sees it predicts the playback direction, stride and rate
+// and queues the next steps into a bounded set of staging slots, skipping
+// ahead when a load takes longer than a step is shown. One worker thread
+// with its own DataLoader fills the slots with this rank's blocks; take()
+// hands a finished step over for swapping into the VolumeRenderer.
+class TimestepPrefetcher {
+public:
+    enum Status { PENDING, READY, FAILED };
+
+    TimestepPrefetcher();
+    ~TimestepPrefetcher();
+
+    TimestepPrefetcher(const TimestepPrefetcher&) = delete;
+    TimestepPrefetcher& operator=(const TimestepPrefetcher&) = delete;
+
+    // regions are the bricks (volume coordinates) to load of each time step,
+    // grown by VolumeRenderer::kGhostVoxels; displayed is the step already
+    // in the renderer.
+    bool start(std::unique_ptr<DataLoader> loader, const std::string& dataset,
+               const std::vector<BrickInfo>& regions, int displayed, int slotCount);
+    // Joins the worker after its current load and frees the slots.
+    void stop();
+
+    // The time step to show next; updates the prediction and the queue.
+    void request(int timeStep);
+    Status status(int timeStep) const;
+    // Moves out the blocks of a READY time step and frees its slot; the step
+    // becomes the displayed one.
+    bool take(int timeStep, std::vector<std::unique_ptr<VolumeData>>& blocks);
+    // Blocks of the replaced time step, freed on the worker thread.
+    void retire(std::vector<std::unique_ptr<VolumeData>>& blocks);
+
+private:
+    enum SlotState { SLOT_FREE, SLOT_QUEUED, SLOT_LOADING, SLOT_READY, SLOT_FAILED };
+
+    struct Slot {
+        int timeStep = -1;
+        SlotState state = SLOT_FREE;
+        unsigned generation = 0; // bumped on reuse; a stale load is dropped
+        std::vector<std::unique_ptr<VolumeData>> blocks;
+    };
+
+    std::unique_ptr<DataLoader> dataLoader;
+    std::string dataset;
+    std::vector<BrickInfo> regions;
+    std::vector<Slot> slots;
+    std::vector<std::unique_ptr<VolumeData>> retired;
+
+    // Playback prediction
+    int target;
+    int displayed;
+    int stride;                 // signed time steps per change
+    double lastChange;          // seconds, steady clock
+    double changeInterval;      // running mean between changes
+    double loadSeconds;         // running mean per loaded step
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable;
+    bool stopping;
+
+    // Called with the lock held
+    void schedule();
+    Slot* findSlot(int timeStep);
+    const Slot* findSlot(int timeStep) const;
+    void workerLoop();
+    bool load(int timeStep, std::vector<std::unique_ptr<VolumeData>>& blocks);
+};
+
+} // namespace morviq
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "types.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace morviq {
+
+class DataLoader;
+
+// Out-of-core view of one time step that need not fit in memory. Every
+// level of detail is cut into pages of pageSize^3 voxels, pageSize a power
+// of two (plus one shared voxel on the high faces), and a page table per
+// level points at the
+// resident pages. A sample whose page is missing falls back to the finest
+// resident coarser level and queues the page; a worker thread loads queued
+// pages and update() maps them in between frames, evicting the pages
+// sampled least recently to stay within the memory budget. The coarsest
+// level stays resident, so every sample has data. Sampling is single-
+// threaded, like the ray marcher.
+class VirtualVolume {
+public:
+    struct Stats {
+        int levels = 0;
+        size_t residentPages = 0;
+        size_t residentBytes = 0;
+        size_t queuedPages = 0;
+        uint64_t pagesLoaded = 0;
+        uint64_t pagesEvicted = 0;
+    };
+
+    VirtualVolume();
+    ~VirtualVolume();
+
+    VirtualVolume(const VirtualVolume&) = delete;
+    VirtualVolume& operator=(const VirtualVolume&) = delete;
+
+    // Reads the level metadata and the coarsest level, then starts the
+    // loader thread
+    bool open(std::unique_ptr<DataLoader> loader, const std::string& dataset, int timeStep,
+              const PagingParams& params);
+    void close();
+
+    // Between frames: maps the pages loaded since the last call. Returns
+    // how many, so the caller can restart accumulation as the image refines.
+    int update();
+    // Before a frame: pages finer than one voxel per step are not worth
+    // their memory, so sampling starts at that level.
+    void beginFrame(float stepSize);
+    // After a frame: queues the pages it missed, nearest-first in march order.
+    void endFrame();
+    // Trilinear sample at pos in [0,1]^3
+    float sample(const Vec3& pos);
+
+    Stats getStats() const;
+
+private:
+    static constexpr int kMissing = -1;
+    static constexpr int kFailed = -2;
+
+    struct Level {
+        int dimensions[3];
+        int pages[3];
+        std::vector<int> table;          // page -> index into resident, or kMissing / kFailed
+        std::vector<uint32_t> requested; // frame of the last miss
+    };
+    struct Page {
+        std::unique_ptr<VolumeData> block;
+        int level = 0;
+        size_t index = 0;
+        uint32_t lastUsed = 0;
+        bool permanent = false;
+    };
+    struct Request {
+        int level;
+        size_t index;
+        uint64_t key() const { return (static_cast<uint64_t>(level) << 56) | index; }
+    };
+    struct Loaded {
+        Request request;
+        std::unique_ptr<VolumeData> block;
+    };
+
+    std::string dataset;
+    int timeStep;
+    int pageSize;
+    int pageShift; // pageSize = 1 << pageShift
+    size_t memoryBudget;
+    std::vector<Level> levels;
+    std::vector<Page> resident;
+    std::vector<int> freePages;
+    size_t residentBytes;
+    int finestLevel;
+    uint32_t frame;
+    // The finest-level page hit last; rays sample it many times in a row
+    const VolumeData* lastBlock;
+    float lastLow[3];
+    float lastHigh[3];
+    std::vector<Request> misses;
+    uint64_t pagesLoaded;
+    uint64_t pagesEvicted;
+
+    // Shared with the loader thread
+    std::unique_ptr<DataLoader> dataLoader;
+    std::deque<Request> queue;
+    std::unordered_set<uint64_t> loading;
+    std::vector<Loaded> loaded;
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable;
+    bool stopping;
+
+    void pageRegion(const Request& request, int begin[3], int size[3]) const;
+    std::unique_ptr<VolumeData> loadPage(const Request& request);
+    bool mapPage(const Request& request, std::unique_ptr<VolumeData> block, bool permanent);
+    void workerLoop();
+};
+
+} // namespace morviq
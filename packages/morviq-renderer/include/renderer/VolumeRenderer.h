@@ -1,10 +1,14 @@
 #pragma once
 
 #include "types.h"
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace morviq {
 
+class VirtualVolume;
+
 class VolumeRenderer {
 public:
     VolumeRenderer();
@@ -13,22 +17,88 @@ public:
     bool initialize(int width, int height);
     void shutdown();
     
+    // Replaces the volume with one dataset or block
     void setVolumeData(std::unique_ptr<VolumeData> data);
+    // Adds a block of the dataset (see VolumeData::offset); each brick
+    // samples the first block that covers it
+    void addVolumeBlock(std::unique_ptr<VolumeData> block);
+    void clearVolumeData();
+    // Exchanges all blocks with blocks in one step, e.g. the next time step
+    // between frames; blocks receives the previous ones
+    void swapVolumeBlocks(std::vector<std::unique_ptr<VolumeData>>& blocks);
+    // Samples this out-of-core volume instead of the blocks; not owned
+    void setVirtualVolume(VirtualVolume* volume) { virtualVolume = volume; }
     void setCamera(const Camera& camera);
     void setTransferFunction(const TransferFunction& tf);
     void setRenderParams(const RenderParams& params);
     void setBioelectricParams(const std::string& jsonParams);
     
-    void renderBrick(const BrickInfo& brick, Frame& frame);
+    // Offsets each ray start by a blue-noise fraction of a step that changes
+    // every frame, so temporal accumulation averages out the step pattern.
+    // A negative frame disables jitter.
+    void setJitterFrame(int frame) { jitterFrame = frame; }
+    
+    // Ray casts the union of the bricks into frame; rays cross brick faces
+    // on one sample grid, so adjacent bricks join without seams.
+    void renderBricks(const std::vector<BrickInfo>& bricks, Frame& frame);
+    // Samples the last renderBricks took in each cell of a grid over the
+    // volume (x fastest), a gradient counting as its six taps; the measure
+    // LoadBalancer splits render time by
+    void setWorkGrid(const int grid[3]);
+    const std::vector<uint64_t>& getWork() const { return work; }
+    
+    // Voxel box [begin, begin + size) a brick samples, grown by ghost
+    // layers on every side and clipped to the dataset. One ghost layer
+    // keeps trilinear interpolation across brick faces exact.
+    static void brickRegion(const BrickInfo& brick, const int fullDimensions[3], int ghost,
+                            int begin[3], int size[3]);
+    static constexpr int kGhostVoxels = 1;
+    // Trilinear sample at voxel coordinates of a block, clamped to it
+    static float sampleBlock(const VolumeData& volume, float x, float y, float z);
+    
+    // True for a perspective camera such as the interactive client sends;
+    // rays are then cast from it into the world box [-1,1]^3 and the depth
+    // buffer holds the opacity-weighted depth of each pixel in window
+    // coordinates. Otherwise renderBrick uses its fixed orbit view.
+    static bool usesCamera(const Camera& camera) {
+        const float* p = camera.projection.m;
+        return p[15] == 0.0f && p[11] != 0.0f && p[0] != 0.0f && p[5] != 0.0f;
+    }
     
 private:
-    std::unique_ptr<VolumeData> volumeData;
+    // A brick with the block it samples (null: the virtual volume); scale
+    // and shift map volume coordinates [0,1] to the block's voxels
+    struct BrickBlock {
+        const VolumeData* volume;
+        Vec3 minBounds;
+        Vec3 maxBounds;
+        float scale[3];
+        float shift[3];
+        // Storage whose empty regions rays skip (background below the
+        // contribution threshold), or null
+        const VoxelStorage* emptySpace;
+    };
+    // Ray segment through one brick
+    struct Segment {
+        float tNear;
+        float tFar;
+        const BrickBlock* block;
+    };
+    
+    std::vector<std::unique_ptr<VolumeData>> blocks;
+    VirtualVolume* virtualVolume = nullptr;
+    bool generatedVolume;
+    std::vector<BrickBlock> brickBlocks;
+    int workGrid[3];
+    std::vector<uint64_t> work;
+    std::vector<Segment> segments;
     Camera camera;
     TransferFunction transferFunction;
     RenderParams renderParams;
     
     int frameWidth;
     int frameHeight;
+    int jitterFrame;
     
     // Bioelectric simulation parameters
     struct BioelectricState {
@@ -43,11 +113,20 @@ private:
         bool gapJunctionsEnabled = true;
     } bioelectricState;
     
-    void generateBioelectricVolume();
-    void raycast(const Vec3& origin, const Vec3& direction, 
-                 const BrickInfo& brick, Vec4& color, float& depth);
-    Vec3 sampleGradient(const Vec3& pos);
-    float sampleVolume(const Vec3& pos);
+    void generateBioelectricVolume(const std::vector<BrickInfo>& bricks);
+    void fillBioelectric(VolumeData& block);
+    bool bindBricks(const std::vector<BrickInfo>& bricks);
+    // Bricks without a block sample the virtual volume
+    void bindVirtualBricks(const std::vector<BrickInfo>& bricks);
+    // Ray through the pixel center in volume coordinates, clipped to [0,1]^3;
+    // false if it misses the volume. depthScale converts t to eye-space depth.
+    bool cameraRay(int px, int py, Vec3& origin, Vec3& direction,
+                   float& tNear, float& tFar, float& depthScale) const;
+    float windowDepth(float eyeDepth) const;
+    // Index into work of the cell holding pos
+    size_t workCell(const Vec3& pos) const;
+    Vec3 sampleGradient(const BrickBlock& block, const Vec3& pos);
+    float sampleVolume(const BrickBlock& block, const Vec3& pos);
     Vec4 applyTransferFunction(float value);
 };
 
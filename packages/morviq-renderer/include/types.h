@@ -4,6 +4,7 @@
 #include <array>
 #include <memory>
 #include <cstdint>
+#include <string>
 
 namespace morviq {
 
@@ -57,18 +58,70 @@ struct TransferFunction {
     }
 };
 
+// Voxels are heap-owned by default. Voxels inside a file mapping hold a
+// reference to it instead, and the last VolumeData using it unmaps it.
+struct VolumeDataDeleter {
+    mutable std::shared_ptr<const void> mapping;
+    void operator()(float* p) const {
+        if (mapping) mapping.reset();
+        else delete[] p;
+    }
+};
+
+// Voxels of a block held other than as a dense float array: compressed
+// (data/CompressedVolume.h) or sparse (data/SparseVolume.h)
+class VoxelStorage {
+public:
+    virtual ~VoxelStorage() = default;
+    // Trilinear sample at voxel coordinates already clamped to the block
+    virtual float sample(float x, float y, float z) const = 0;
+    virtual size_t bytes() const = 0;
+    // Value of every voxel the storage does not hold
+    virtual float background() const { return 0.0f; }
+    // Length of the ray p + t d (voxel coordinates) from t = 0 along which
+    // every sample is the background; 0 where it may not be
+    virtual float emptyLength(const float p[3], const float d[3]) const {
+        (void)p;
+        (void)d;
+        return 0.0f;
+    }
+};
+
 struct VolumeData {
-    std::unique_ptr<float[]> data;
+    std::unique_ptr<float[], VolumeDataDeleter> data;
+    // Set instead of data for a block not held as floats; shared by the
+    // views of a cached block
+    std::shared_ptr<const VoxelStorage> storage;
     int dimensions[3];
     float spacing[3];
     float origin[3];
     size_t voxelCount;
+    // A block cut from a larger dataset holds its voxels
+    // [offset, offset + dimensions); fullDimensions of 0 means the whole dataset
+    int offset[3];
+    int fullDimensions[3];
+    // Voxels between consecutive rows and slices; 0 means packed. A block
+    // viewing a mapped file keeps the file's pitches. Mapped voxels are
+    // read-only.
+    size_t rowPitch;
+    size_t slicePitch;
     
     VolumeData() {
         dimensions[0] = dimensions[1] = dimensions[2] = 0;
         spacing[0] = spacing[1] = spacing[2] = 1.0f;
         origin[0] = origin[1] = origin[2] = 0.0f;
         voxelCount = 0;
+        offset[0] = offset[1] = offset[2] = 0;
+        fullDimensions[0] = fullDimensions[1] = fullDimensions[2] = 0;
+        rowPitch = 0;
+        slicePitch = 0;
+    }
+    
+    // Bytes the block keeps resident
+    size_t bytes() const { return storage ? storage->bytes() : voxelCount * sizeof(float); }
+    size_t rowStride() const { return rowPitch ? rowPitch : static_cast<size_t>(dimensions[0]); }
+    size_t sliceStride() const {
+        return slicePitch ? slicePitch : static_cast<size_t>(dimensions[0]) * dimensions[1];
     }
 };
 
@@ -80,14 +133,24 @@ struct RenderParams {
     int maxSteps;
     bool enableShadows;
     bool enableGradients;
+    // Jitter ray starts and accumulate frames on rank 0 (see TemporalAccumulator)
+    bool temporalAccumulation;
     
     RenderParams() : quality(1), stepSize(0.01f), maxSteps(1000),
-                     enableShadows(false), enableGradients(true) {}
+                     enableShadows(false), enableGradients(true), temporalAccumulation(false) {}
+};
+
+// Frame buffers are heap-owned by default; a borrowed buffer (see
+// Frame::attach) is left alone on destruction.
+template <typename T>
+struct FrameBufferDeleter {
+    bool owned = true;
+    void operator()(T* p) const { if (owned) delete[] p; }
 };
 
 struct Frame {
-    std::unique_ptr<uint8_t[]> colorBuffer;
-    std::unique_ptr<float[]> depthBuffer;
+    std::unique_ptr<uint8_t[], FrameBufferDeleter<uint8_t>> colorBuffer;
+    std::unique_ptr<float[], FrameBufferDeleter<float>> depthBuffer;
     int width;
     int height;
     int channels;
@@ -97,8 +160,20 @@ struct Frame {
     Frame(int w, int h, int c = 4) : width(w), height(h), channels(c) {
         size_t colorSize = width * height * channels;
         size_t depthSize = width * height;
-        colorBuffer = std::make_unique<uint8_t[]>(colorSize);
-        depthBuffer = std::make_unique<float[]>(depthSize);
+        colorBuffer.reset(new uint8_t[colorSize]());
+        depthBuffer.reset(new float[depthSize]());
+    }
+    
+    // Point the frame at externally managed memory (e.g. an MPI shared
+    // window) without copying; the memory must outlive the frame.
+    void attach(uint8_t* color, float* depth, int w, int h, int c = 4) {
+        width = w;
+        height = h;
+        channels = c;
+        colorBuffer = std::unique_ptr<uint8_t[], FrameBufferDeleter<uint8_t>>(
+            color, FrameBufferDeleter<uint8_t>{false});
+        depthBuffer = std::unique_ptr<float[], FrameBufferDeleter<float>>(
+            depth, FrameBufferDeleter<float>{false});
     }
     
     size_t colorBufferSize() const { return width * height * channels; }
@@ -125,9 +200,107 @@ struct CompositeParams {
     
     Mode mode;
     bool useGPU;
+    bool hierarchical; // merge node-local frames in shared memory first
+    bool distributedOutput; // keep the final image as per-rank row stripes
     int numRanks;
     
-    CompositeParams() : mode(MIN_DEPTH), useGPU(false), numRanks(1) {}
+    CompositeParams() : mode(MIN_DEPTH), useGPU(false), hierarchical(false),
+                        distributedOutput(false), numRanks(1) {}
+};
+
+struct OutputParams {
+    enum Overflow {
+        BLOCK,       // stall the render loop until a buffer frees up
+        DROP_NEWEST, // skip the frame being submitted
+        DROP_OLDEST  // replace the oldest frame not yet being encoded
+    };
+    
+    enum Format {
+        PNG,
+        QOI,
+        RAW,  // uncompressed RGBA with a small header
+        DELTA, // changed tiles against the previous frame
+        APNG,  // one animated PNG for the whole run
+        Y4M,   // YUV4MPEG2 video stream
+        I420   // headerless planar YUV 4:2:0 frames
+    };
+    
+    Format format;
+    bool async;         // encode and write on background threads
+    int queueDepth;     // frame buffers owned by the output queue
+    int encoderThreads;
+    Overflow overflow;
+    int compressionLevel; // PNG zlib level, 0-9
+    int pngFilter;        // PNGFilterStrategy
+    int keyframeInterval; // DELTA: full frame every N frames
+    int deltaTileSize;    // DELTA: tile edge in pixels
+    int sequenceFps;      // APNG / Y4M: playback rate
+    std::string sequencePath; // APNG / Y4M / I420: output file, "-" for stdout;
+                              // empty writes composited/animation.<ext>
+    // Publishing: frames go to these instead of files
+    std::string shmName;      // shared-memory ring name
+    int shmSlots;
+    int streamPort;           // TCP frame stream on 127.0.0.1, 0 = off
+    std::string streamSocket; // Unix-socket frame stream path
+    
+    OutputParams() : format(PNG), async(false), queueDepth(3), encoderThreads(2), overflow(BLOCK),
+                     compressionLevel(6), pngFilter(5), keyframeInterval(30), deltaTileSize(64),
+                     sequenceFps(30), shmSlots(4), streamPort(0) {}
+    
+    bool publishes() const { return !shmName.empty() || streamPort > 0 || !streamSocket.empty(); }
+};
+
+// How ranks read their bricks of a raw volume
+struct ReadParams {
+    enum Mode {
+        MAPPED,      // each rank maps the file (see MappedFile)
+        INDEPENDENT, // MPI-IO, each rank reads its file view on its own
+        COLLECTIVE   // MPI-IO, MPI_File_read_all with collective buffering
+    };
+    
+    Mode mode;
+    int aggregators; // cb_nodes hint: ranks that access the file, 0 = MPI default
+    int bufferSize;  // cb_buffer_size hint in bytes, 0 = MPI default
+    
+    ReadParams() : mode(MAPPED), aggregators(0), bufferSize(0) {}
+};
+
+// Out-of-core rendering through a VirtualVolume; a budget of 0 loads each
+// rank's bricks up front instead
+struct PagingParams {
+    size_t memoryBudget; // bytes of resident pages per rank
+    int pageSize;        // voxels per page edge
+    
+    PagingParams() : memoryBudget(0), pageSize(64) {}
+};
+
+// Loaded blocks are held as a SparseVolume where that takes at most half
+// their dense memory; voxels within tolerance of background are inactive
+struct SparseParams {
+    bool enabled;
+    float background;
+    float tolerance;
+    
+    SparseParams() : enabled(false), background(0.0f), tolerance(0.0f) {}
+};
+
+// How the volume is cut into a grid of bricks and spread over the ranks.
+// With a threshold, per-brick render times are gathered every frame and the
+// k-d tree is recut by cost once the slowest rank exceeds the mean by that
+// fraction for hysteresis frames.
+struct BalanceParams {
+    enum Decomposition {
+        AUTO,   // GRID while every rank gets a brick and nothing moves, else KD_TREE
+        GRID,   // equal runs of bricks in scan order
+        KD_TREE // one box of bricks per rank, ranks halved along the longest axis
+    };
+    
+    Decomposition decomposition;
+    int bricks[3];   // per axis; 0: 2x2x2 for GRID, 16 bricks per rank for KD_TREE
+    float threshold; // 0 = static; rebalancing uses KD_TREE
+    int hysteresis;  // frames over threshold, and between rebalances
+    
+    BalanceParams() : decomposition(AUTO), bricks{0, 0, 0}, threshold(0.0f), hysteresis(5) {}
 };
 
 } // namespace morviq
\ No newline at end of file
@@ -20,6 +20,8 @@ public:
     static void initialize(int rank);
     static void shutdown();
     static void setLevel(Level level);
+    // Defaults to std::cout; switch to std::cerr when stdout carries data.
+    static void setOutput(std::ostream& stream);
     static void log(Level level, const std::string& message);
     
     static int getRank() { return mpiRank; }
@@ -28,6 +30,7 @@ private:
     static int mpiRank;
     static Level currentLevel;
     static bool initialized;
+    static std::ostream* output;
 };
 
 #define LOG_DEBUG(msg) do { \
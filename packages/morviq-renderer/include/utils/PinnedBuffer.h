@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace morviq {
+
+// Page-aligned buffer that is locked into RAM when the process is allowed
+// to (RLIMIT_MEMLOCK); locking is best effort and failure only means the
+// pages stay pageable. Used for long-lived MPI transfer buffers.
+template <typename T>
+class PinnedBuffer {
+public:
+    PinnedBuffer() : ptr(nullptr), count(0), pinned(false) {}
+    explicit PinnedBuffer(size_t n) : PinnedBuffer() { allocate(n); }
+    ~PinnedBuffer() { release(); }
+
+    PinnedBuffer(const PinnedBuffer&) = delete;
+    PinnedBuffer& operator=(const PinnedBuffer&) = delete;
+
+    PinnedBuffer(PinnedBuffer&& other) noexcept
+        : ptr(other.ptr), count(other.count), pinned(other.pinned) {
+        other.ptr = nullptr;
+        other.count = 0;
+        other.pinned = false;
+    }
+
+    PinnedBuffer& operator=(PinnedBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            ptr = other.ptr;
+            count = other.count;
+            pinned = other.pinned;
+            other.ptr = nullptr;
+            other.count = 0;
+            other.pinned = false;
+        }
+        return *this;
+    }
+
+    bool allocate(size_t n) {
+        release();
+        if (n == 0) return true;
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t bytes = (n * sizeof(T) + pageSize - 1) / pageSize * pageSize;
+        void* mem = nullptr;
+        if (posix_memalign(&mem, pageSize, bytes) != 0) {
+            return false;
+        }
+        // Touch every page now so the first frame does not pay for faults
+        std::memset(mem, 0, bytes);
+        pinned = mlock(mem, bytes) == 0;
+        ptr = static_cast<T*>(mem);
+        count = n;
+        return true;
+    }
+
+    void release() {
+        if (!ptr) return;
+        if (pinned) {
+            const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            munlock(ptr, (count * sizeof(T) + pageSize - 1) / pageSize * pageSize);
+        }
+        std::free(ptr);
+        ptr = nullptr;
+        count = 0;
+        pinned = false;
+    }
+
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool isPinned() const { return pinned; }
+
+private:
+    T* ptr;
+    size_t count;
+    bool pinned;
+};
+
+} // namespace morviq
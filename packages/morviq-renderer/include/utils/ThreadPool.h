@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace morviq {
+
+// Fixed-size worker pool used for data-parallel loops (compositing rows,
+// chunk decode, stripe encode). parallelFor jobs live on the caller's stack
+// and are claimed range by range, so a loop performs no heap allocation and
+// nested loops cannot deadlock (the caller can always finish its own job).
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    template <typename F>
+    auto submit(F&& fn) -> std::future<typename std::invoke_result<F>::type> {
+        using Result = typename std::invoke_result<F>::type;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(fn));
+        std::future<Result> future = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return future;
+    }
+
+    // Splits [begin, end) into at most size()+1 contiguous ranges of at least
+    // minChunk items and runs body(rangeBegin, rangeEnd) on each; the calling
+    // thread takes part. Returns once every range is done.
+    void parallelFor(size_t begin, size_t end,
+                     const std::function<void(size_t, size_t)>& body,
+                     size_t minChunk = 1);
+
+    // Process-wide pool sized to the hardware concurrency.
+    static ThreadPool& shared();
+
+private:
+    struct ForJob;
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    ForJob* jobs;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable jobFinished;
+    bool stopping;
+
+    void enqueue(std::function<void()> task);
+    void workerLoop();
+    static void runRange(ForJob& job, size_t range);
+};
+
+} // namespace morviq
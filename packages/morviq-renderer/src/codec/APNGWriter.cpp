@@ -0,0 +1,162 @@
+#include "codec/APNGWriter.h"
+#include "codec/PixelConvert.h"
+#include "utils/ByteOrder.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace morviq {
+
+namespace {
+
+constexpr uint8_t kDisposeNone = 0;
+constexpr uint8_t kBlendSource = 0;
+
+void makeACTL(uint8_t* actl, uint32_t frames) {
+    putBE32(actl, frames);
+    putBE32(actl + 4, 0); // loop forever
+}
+
+} // namespace
+
+APNGWriter::APNGWriter(const PNGEncodeParams& params, int framesPerSecond)
+    : encoder(params), fps(std::max(1, framesPerSecond)), file(nullptr), actlOffset(0),
+      width(0), height(0), frameCount(0), sequence(0) {}
+
+APNGWriter::~APNGWriter() {
+    close();
+}
+
+bool APNGWriter::open(const std::string& path, int w, int h) {
+    close();
+    if (path == "-") {
+        LOG_ERROR("APNGWriter: cannot write to stdout, close() seeks back to patch acTL");
+        return false;
+    }
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        LOG_ERROR("APNGWriter: failed to open " << path);
+        return false;
+    }
+    width = w;
+    height = h;
+    frameCount = 0;
+    sequence = 0;
+    previous.assign(static_cast<size_t>(w) * h * 4, 0);
+    const int tilesX = (w + kTileSize - 1) / kTileSize;
+    const int tilesY = (h + kTileSize - 1) / kTileSize;
+    dirty.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+
+    PNGStreamWriter writer(PNGStreamWriter::fileSink(file));
+    if (!writer.begin(w, h)) return false;
+    actlOffset = std::ftell(file);
+    uint8_t actl[8];
+    makeACTL(actl, 0);
+    return writer.writeChunk("acTL", actl, sizeof(actl));
+}
+
+bool APNGWriter::writeFrame(const Frame& frame) {
+    if (!file || frame.width != width || frame.height != height || frame.channels != 4) {
+        LOG_ERROR("APNGWriter: frame does not match the open sequence");
+        return false;
+    }
+    const uint8_t* current = frame.colorBuffer.get();
+    const size_t stride = static_cast<size_t>(width) * 4;
+
+    // Region to store: everything for the default image, else the bounding
+    // box of the changed tiles (1x1 if nothing changed; frames can't be empty)
+    int x0 = 0, y0 = 0, x1 = width, y1 = height;
+    if (frameCount > 0) {
+        const int tilesX = (width + kTileSize - 1) / kTileSize;
+        const int tilesY = (height + kTileSize - 1) / kTileSize;
+        pixels::diffTiles(current, previous.data(), width, height, kTileSize, dirty.data());
+        int tx0 = tilesX, ty0 = tilesY, tx1 = -1, ty1 = -1;
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int tx = 0; tx < tilesX; ++tx) {
+                if (!dirty[static_cast<size_t>(ty) * tilesX + tx]) continue;
+                tx0 = std::min(tx0, tx);
+                ty0 = std::min(ty0, ty);
+                tx1 = std::max(tx1, tx);
+                ty1 = std::max(ty1, ty);
+            }
+        }
+        if (tx1 < 0) {
+            x1 = 1;
+            y1 = 1;
+        } else {
+            x0 = tx0 * kTileSize;
+            y0 = ty0 * kTileSize;
+            x1 = std::min(width, (tx1 + 1) * kTileSize);
+            y1 = std::min(height, (ty1 + 1) * kTileSize);
+        }
+    }
+    const int regionWidth = x1 - x0;
+    const int regionHeight = y1 - y0;
+
+    const uint8_t* pixelsIn = current;
+    if (regionWidth != width || regionHeight != height) {
+        const size_t rowBytes = static_cast<size_t>(regionWidth) * 4;
+        if (region.size() < rowBytes * regionHeight) region.resize(rowBytes * regionHeight);
+        for (int y = 0; y < regionHeight; ++y) {
+            std::memcpy(region.data() + y * rowBytes, current + (y0 + y) * stride + x0 * 4, rowBytes);
+        }
+        pixelsIn = region.data();
+    }
+    if (!encoder.compressStripes(pixelsIn, regionWidth, regionHeight)) {
+        return false;
+    }
+
+    uint8_t fctl[26];
+    putBE32(fctl, sequence++);
+    putBE32(fctl + 4, static_cast<uint32_t>(regionWidth));
+    putBE32(fctl + 8, static_cast<uint32_t>(regionHeight));
+    putBE32(fctl + 12, static_cast<uint32_t>(x0));
+    putBE32(fctl + 16, static_cast<uint32_t>(y0));
+    putBE16(fctl + 20, 1);
+    putBE16(fctl + 22, static_cast<uint16_t>(fps));
+    fctl[24] = kDisposeNone;
+    fctl[25] = kBlendSource;
+
+    PNGStreamWriter writer(PNGStreamWriter::fileSink(file));
+    bool ok = writer.writeChunk("fcTL", fctl, sizeof(fctl));
+    // The default image is the first frame and uses IDAT; later frames use fdAT
+    writer.beginData(frameCount > 0 ? &sequence : nullptr);
+    for (size_t s = 0; ok && s < encoder.getStripeCount(); ++s) {
+        ok = writer.writeStripe(encoder.getStripe(s));
+    }
+    ok = ok && writer.finishData();
+    if (!ok) {
+        LOG_ERROR("APNGWriter: failed to write frame " << frameCount);
+        return false;
+    }
+
+    for (int y = y0; y < y1; ++y) {
+        std::memcpy(previous.data() + y * stride + x0 * 4, current + y * stride + x0 * 4,
+                    static_cast<size_t>(regionWidth) * 4);
+    }
+    ++frameCount;
+    return true;
+}
+
+bool APNGWriter::close() {
+    if (!file) return true;
+
+    PNGStreamWriter writer(PNGStreamWriter::fileSink(file));
+    bool ok = writer.writeChunk("IEND", nullptr, 0);
+
+    // Patch the frame count now that it is known
+    uint8_t actl[8];
+    makeACTL(actl, frameCount);
+    ok = ok && std::fseek(file, actlOffset, SEEK_SET) == 0 &&
+         writer.writeChunk("acTL", actl, sizeof(actl));
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+    if (!ok) {
+        LOG_ERROR("APNGWriter: failed to finalize sequence");
+    } else {
+        LOG_INFO("APNGWriter: wrote " << frameCount << " frames");
+    }
+    return ok;
+}
+
+} // namespace morviq
@@ -0,0 +1,84 @@
+#include "codec/DeltaEncoder.h"
+#include "codec/PixelConvert.h"
+#include "utils/ByteOrder.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace morviq {
+
+DeltaEncoder::DeltaEncoder(int interval, int tile)
+    : keyframeInterval(std::max(1, interval)),
+      tileSize(std::max(8, std::min(tile, 1024))),
+      frameIndex(0), forceKeyframe(true), lastKeyframe(true), width(0), height(0) {}
+
+bool DeltaEncoder::encode(const Frame& frame, std::vector<uint8_t>& output) {
+    if (frame.channels != 4) {
+        LOG_WARN("DeltaEncoder: expected RGBA (4 channels), got " << frame.channels);
+        return false;
+    }
+
+    const int tilesX = (frame.width + tileSize - 1) / tileSize;
+    const int tilesY = (frame.height + tileSize - 1) / tileSize;
+    const size_t tileCount = static_cast<size_t>(tilesX) * tilesY;
+    const size_t frameBytes = frame.colorBufferSize();
+    const uint8_t* current = frame.colorBuffer.get();
+
+    bool keyframe = forceKeyframe || frame.width != width || frame.height != height ||
+                    frameIndex % static_cast<uint32_t>(keyframeInterval) == 0;
+    if (frame.width != width || frame.height != height) {
+        width = frame.width;
+        height = frame.height;
+        previous.assign(frameBytes, 0);
+        dirty.assign(tileCount, 1);
+    }
+
+    size_t dirtyCount = tileCount;
+    if (keyframe) {
+        std::fill(dirty.begin(), dirty.end(), 1);
+    } else {
+        dirtyCount = pixels::diffTiles(current, previous.data(), width, height, tileSize, dirty.data());
+    }
+
+    // Worst case every tile: the whole frame plus 4 bytes of coordinates per tile
+    output.resize(kHeaderSize + tileCount * 4 + frameBytes);
+    uint8_t* out = output.data();
+    std::memcpy(out, "MVQD", 4);
+    putLE32(out + 4, kVersion);
+    putLE32(out + 8, static_cast<uint32_t>(width));
+    putLE32(out + 12, static_cast<uint32_t>(height));
+    putLE16(out + 16, static_cast<uint16_t>(tileSize));
+    putLE16(out + 18, static_cast<uint16_t>(kFlagPremultiplied | (keyframe ? kFlagKeyframe : 0)));
+    putLE32(out + 20, frameIndex);
+    putLE32(out + 24, static_cast<uint32_t>(dirtyCount));
+    out += kHeaderSize;
+
+    const size_t stride = static_cast<size_t>(width) * 4;
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            if (!dirty[static_cast<size_t>(ty) * tilesX + tx]) continue;
+            putLE16(out, static_cast<uint16_t>(tx));
+            putLE16(out + 2, static_cast<uint16_t>(ty));
+            out += 4;
+            const int x0 = tx * tileSize;
+            const int y0 = ty * tileSize;
+            const size_t rowBytes = static_cast<size_t>(std::min(tileSize, width - x0)) * 4;
+            const int rows = std::min(tileSize, height - y0);
+            for (int y = y0; y < y0 + rows; ++y) {
+                const size_t offset = y * stride + static_cast<size_t>(x0) * 4;
+                std::memcpy(out, current + offset, rowBytes);
+                // The reference only needs the tiles that changed
+                std::memcpy(previous.data() + offset, current + offset, rowBytes);
+                out += rowBytes;
+            }
+        }
+    }
+    output.resize(out - output.data());
+
+    forceKeyframe = false;
+    lastKeyframe = keyframe;
+    ++frameIndex;
+    return true;
+}
+
+} // namespace morviq
@@ -1,7 +1,39 @@
 #include "codec/Encoder.h"
+#include "codec/DeltaEncoder.h"
+#include "codec/PNGEncoder.h"
+#include "codec/QOIEncoder.h"
+#include "codec/RawEncoder.h"
+#include "utils/Logger.h"
+#include <cstdio>
 
 namespace morviq {
 
-// Base encoder implementation if needed
+bool Encoder::encodeToFile(const Frame& frame, const std::string& filename) {
+    return encode(frame, fileBuffer) && writeFile(filename, fileBuffer);
+}
 
-} // namespace morviq
\ No newline at end of file
+bool Encoder::writeFile(const std::string& filename, const std::vector<uint8_t>& data) {
+    FILE* fp = std::fopen(filename.c_str(), "wb");
+    if (!fp) {
+        LOG_ERROR("Encoder: failed to open file: " << filename);
+        return false;
+    }
+    bool ok = std::fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return std::fclose(fp) == 0 && ok;
+}
+
+std::unique_ptr<Encoder> createEncoder(const OutputParams& params) {
+    switch (params.format) {
+        case OutputParams::QOI:
+            return std::make_unique<QOIEncoder>();
+        case OutputParams::RAW:
+            return std::make_unique<RawEncoder>();
+        case OutputParams::DELTA:
+            return std::make_unique<DeltaEncoder>(params.keyframeInterval, params.deltaTileSize);
+        case OutputParams::PNG:
+        default:
+            return std::make_unique<PNGEncoder>(PNGEncodeParams(params));
+    }
+}
+
+} // namespace morviq
@@ -1,70 +1,62 @@
 #include "codec/PNGEncoder.h"
+#include "codec/PixelConvert.h"
 #include "utils/Logger.h"
+#include "utils/ThreadPool.h"
 #include <png.h>
 #include <vector>
 #include <cstdio>
+#include <algorithm>
+#include <atomic>
 
 namespace morviq {
 
-// PNG encoder implementation using libpng
+// PNG encoder: striped parallel deflate (default) or libpng
+
+namespace {
+
+// Below this much filtered data per stripe the sync-flush and dictionary
+// overhead outweighs the extra thread
+constexpr size_t kMinStripeBytes = 256 * 1024;
+
+int libpngFilters(PNGFilterStrategy filter) {
+    switch (filter) {
+        case FILTER_NONE:    return PNG_FILTER_NONE;
+        case FILTER_SUB:     return PNG_FILTER_SUB;
+        case FILTER_UP:      return PNG_FILTER_UP;
+        case FILTER_AVERAGE: return PNG_FILTER_AVG;
+        case FILTER_PAETH:   return PNG_FILTER_PAETH;
+        default:             return PNG_ALL_FILTERS;
+    }
+}
+
+} // namespace
 
 PNGEncoder::PNGEncoder() {}
 
+PNGEncoder::PNGEncoder(const PNGEncodeParams& p) : params(p) {}
+
 PNGEncoder::~PNGEncoder() {}
 
-bool PNGEncoder::encode(const Frame& frame, const std::string& filename) {
+bool PNGEncoder::encodeToFile(const Frame& frame, const std::string& filename) {
     if (frame.channels != 4) {
         LOG_WARN("PNGEncoder: expected RGBA (4 channels), got " << frame.channels);
         return false;
     }
-    // Convert from premultiplied RGBA to straight alpha for PNG display
-    std::vector<uint8_t> straight(frame.colorBufferSize());
-    const uint8_t* src = frame.colorBuffer.get();
-    for (size_t i = 0; i < static_cast<size_t>(frame.width * frame.height); ++i) {
-        float a = src[i * 4 + 3] / 255.0f;
-        if (a > 0.0f) {
-            straight[i * 4 + 0] = static_cast<uint8_t>(std::min(255.0f, src[i * 4 + 0] / a));
-            straight[i * 4 + 1] = static_cast<uint8_t>(std::min(255.0f, src[i * 4 + 1] / a));
-            straight[i * 4 + 2] = static_cast<uint8_t>(std::min(255.0f, src[i * 4 + 2] / a));
-            straight[i * 4 + 3] = src[i * 4 + 3];
-        } else {
-            straight[i * 4 + 0] = 0;
-            straight[i * 4 + 1] = 0;
-            straight[i * 4 + 2] = 0;
-            straight[i * 4 + 3] = 0;
-        }
-    }
-
     FILE* fp = std::fopen(filename.c_str(), "wb");
     if (!fp) {
         LOG_ERROR("PNGEncoder: failed to open file: " << filename);
         return false;
     }
+    bool ok = params.parallel ? encodeStriped(frame, PNGStreamWriter::fileSink(fp))
+                              : encodeLibpng(frame, fp, nullptr);
+    return std::fclose(fp) == 0 && ok;
+}
 
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png_ptr) { std::fclose(fp); return false; }
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) { png_destroy_write_struct(&png_ptr, nullptr); std::fclose(fp); return false; }
-    if (setjmp(png_jmpbuf(png_ptr))) { png_destroy_write_struct(&png_ptr, &info_ptr); std::fclose(fp); return false; }
-
-    png_init_io(png_ptr, fp);
-    png_set_IHDR(png_ptr, info_ptr,
-                 frame.width, frame.height,
-                 8, PNG_COLOR_TYPE_RGBA,
-                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-
-    png_write_info(png_ptr, info_ptr);
-
-    std::vector<png_bytep> rows(frame.height);
-    for (int y = 0; y < frame.height; ++y) {
-        rows[y] = (png_bytep)(straight.data() + y * frame.width * frame.channels);
-    }
-    png_write_image(png_ptr, rows.data());
-    png_write_end(png_ptr, nullptr);
-
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    std::fclose(fp);
-    return true;
+bool PNGEncoder::encode(const Frame& frame, std::vector<uint8_t>& output) {
+    output.clear();
+    if (frame.channels != 4) return false;
+    return params.parallel ? encodeStriped(frame, PNGStreamWriter::memorySink(output))
+                           : encodeLibpng(frame, nullptr, &output);
 }
 
 static void png_memory_write(png_structp png_ptr, png_bytep data, png_size_t length) {
@@ -73,50 +65,116 @@ static void png_memory_write(png_structp png_ptr, png_bytep data, png_size_t len
 }
 static void png_memory_flush(png_structp) {}
 
-bool PNGEncoder::encodeToMemory(const Frame& frame, std::vector<uint8_t>& output) {
-    output.clear();
-    if (frame.channels != 4) return false;
-    // Convert from premultiplied RGBA to straight alpha
-    std::vector<uint8_t> straight(frame.colorBufferSize());
-    const uint8_t* src = frame.colorBuffer.get();
-    for (size_t i = 0; i < static_cast<size_t>(frame.width * frame.height); ++i) {
-        float a = src[i * 4 + 3] / 255.0f;
-        if (a > 0.0f) {
-            straight[i * 4 + 0] = static_cast<uint8_t>(std::min(255.0f, src[i * 4 + 0] / a));
-            straight[i * 4 + 1] = static_cast<uint8_t>(std::min(255.0f, src[i * 4 + 1] / a));
-            straight[i * 4 + 2] = static_cast<uint8_t>(std::min(255.0f, src[i * 4 + 2] / a));
-            straight[i * 4 + 3] = src[i * 4 + 3];
-        } else {
-            straight[i * 4 + 0] = 0;
-            straight[i * 4 + 1] = 0;
-            straight[i * 4 + 2] = 0;
-            straight[i * 4 + 3] = 0;
-        }
-    }
+bool PNGEncoder::encodeLibpng(const Frame& frame, FILE* fp, std::vector<uint8_t>* output) {
+    // Convert from premultiplied RGBA to straight alpha for PNG display
+    if (straight.size() < frame.colorBufferSize()) straight.resize(frame.colorBufferSize());
+    pixels::unpremultiply(frame.colorBuffer.get(), straight.data(),
+                          static_cast<size_t>(frame.width) * frame.height);
+
     png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
     if (!png_ptr) return false;
     png_infop info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) { png_destroy_write_struct(&png_ptr, nullptr); return false; }
     if (setjmp(png_jmpbuf(png_ptr))) { png_destroy_write_struct(&png_ptr, &info_ptr); return false; }
 
-    png_set_write_fn(png_ptr, &output, png_memory_write, png_memory_flush);
-
+    if (fp) {
+        png_init_io(png_ptr, fp);
+    } else {
+        png_set_write_fn(png_ptr, output, png_memory_write, png_memory_flush);
+    }
     png_set_IHDR(png_ptr, info_ptr,
                  frame.width, frame.height,
                  8, PNG_COLOR_TYPE_RGBA,
                  PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_compression_level(png_ptr, params.compressionLevel);
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, libpngFilters(params.filter));
+
     png_write_info(png_ptr, info_ptr);
 
-    std::vector<png_bytep> rows(frame.height);
+    rowPointers.resize(frame.height);
     for (int y = 0; y < frame.height; ++y) {
-        rows[y] = (png_bytep)(straight.data() + y * frame.width * frame.channels);
+        rowPointers[y] = straight.data() + static_cast<size_t>(y) * frame.width * frame.channels;
     }
-    png_write_image(png_ptr, rows.data());
+    png_write_image(png_ptr, rowPointers.data());
     png_write_end(png_ptr, nullptr);
+
     png_destroy_write_struct(&png_ptr, &info_ptr);
     return true;
 }
 
+bool PNGEncoder::encodeStriped(const Frame& frame, const PNGStreamWriter::Sink& sink) {
+    bool ok = compressStripes(frame.colorBuffer.get(), frame.width, frame.height);
+    PNGStreamWriter writer(sink);
+    ok = ok && writer.begin(frame.width, frame.height);
+    for (size_t s = 0; ok && s < stripeCount; ++s) {
+        ok = writer.writeStripe(stripes[s]);
+    }
+    return ok && writer.finish();
+}
+
+bool PNGEncoder::compressStripes(const uint8_t* rgba, int width, int height) {
+    // pigz-style: un-premultiply and filter the whole image in one pass,
+    // then deflate row stripes in parallel, each primed with the 32 KiB of
+    // filtered data before it, and splice the sync-flushed streams into one
+    // zlib stream.
+    ThreadPool& pool = ThreadPool::shared();
+    const size_t stride = static_cast<size_t>(width) * 4;
+    const size_t rawLength = (stride + 1) * height;
+
+    stripeCount = std::max<size_t>(1, rawLength / kMinStripeBytes);
+    stripeCount = std::min(stripeCount, pool.size() + 1);
+    stripeCount = std::min(stripeCount, static_cast<size_t>(std::max(1, height)));
+    while (stripeEncoders.size() < stripeCount) {
+        stripeEncoders.push_back(std::make_unique<PNGStripeEncoder>());
+    }
+    if (stripes.size() < stripeCount) stripes.resize(stripeCount);
+    if (filtered.size() < rawLength) filtered.resize(rawLength);
+
+    struct StripeJob {
+        PNGEncoder* self;
+        const uint8_t* rgba;
+        int width;
+        int height;
+        size_t stride;
+        size_t count;
+        std::atomic<bool> failed{false};
+        int rowBegin(size_t s) const { return static_cast<int>(static_cast<size_t>(height) * s / count); }
+    } job;
+    job.self = this;
+    job.rgba = rgba;
+    job.width = width;
+    job.height = height;
+    job.stride = stride;
+    job.count = stripeCount;
+    StripeJob* j = &job;
+
+    pool.parallelFor(0, stripeCount, [j](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            const int y0 = j->rowBegin(s);
+            const uint8_t* rows = j->rgba + y0 * j->stride;
+            j->self->stripeEncoders[s]->filter(rows, y0 > 0 ? rows - j->stride : nullptr,
+                                               j->width, j->rowBegin(s + 1) - y0,
+                                               j->self->params.filter,
+                                               j->self->filtered.data() + y0 * (j->stride + 1),
+                                               true);
+        }
+    });
+    pool.parallelFor(0, stripeCount, [j](size_t begin, size_t end) {
+        PNGEncoder* self = j->self;
+        for (size_t s = begin; s < end; ++s) {
+            const size_t offset = j->rowBegin(s) * (j->stride + 1);
+            const size_t length = j->rowBegin(s + 1) * (j->stride + 1) - offset;
+            if (!self->stripeEncoders[s]->compress(self->filtered.data() + offset, length,
+                                                   self->filtered.data(), offset,
+                                                   self->params.compressionLevel, self->params.filter,
+                                                   s + 1 == j->count, self->stripes[s])) {
+                j->failed = true;
+            }
+        }
+    });
+    return !job.failed;
+}
+
 void PNGEncoder::writePNG(const std::string& filename, const uint8_t* image, 
                           int width, int height, int channels) {
     Frame f;
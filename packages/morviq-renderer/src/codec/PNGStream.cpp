@@ -0,0 +1,276 @@
+#include "codec/PNGStream.h"
+#include "codec/PixelConvert.h"
+#include "utils/ByteOrder.h"
+#include "utils/Logger.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace morviq {
+
+namespace {
+
+constexpr int kBytesPerPixel = 4;
+const uint8_t kPNGSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    if (pb <= pc) return static_cast<uint8_t>(b);
+    return static_cast<uint8_t>(c);
+}
+
+// Writes filter byte + residuals for one scanline; prev may be nullptr only
+// for filters that do not read the previous row.
+void filterRow(int type, const uint8_t* row, const uint8_t* prev, size_t stride, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(type);
+    uint8_t* o = out + 1;
+    switch (type) {
+        case FILTER_SUB:
+            for (size_t i = 0; i < kBytesPerPixel; ++i) o[i] = row[i];
+            for (size_t i = kBytesPerPixel; i < stride; ++i) o[i] = row[i] - row[i - kBytesPerPixel];
+            break;
+        case FILTER_UP:
+            for (size_t i = 0; i < stride; ++i) o[i] = row[i] - prev[i];
+            break;
+        case FILTER_AVERAGE:
+            for (size_t i = 0; i < kBytesPerPixel; ++i) o[i] = row[i] - (prev[i] >> 1);
+            for (size_t i = kBytesPerPixel; i < stride; ++i) {
+                o[i] = row[i] - static_cast<uint8_t>((row[i - kBytesPerPixel] + prev[i]) >> 1);
+            }
+            break;
+        case FILTER_PAETH:
+            for (size_t i = 0; i < kBytesPerPixel; ++i) o[i] = row[i] - paeth(0, prev[i], 0);
+            for (size_t i = kBytesPerPixel; i < stride; ++i) {
+                o[i] = row[i] - paeth(row[i - kBytesPerPixel], prev[i], prev[i - kBytesPerPixel]);
+            }
+            break;
+        default:
+            std::memcpy(o, row, stride);
+            break;
+    }
+}
+
+size_t residualCost(const uint8_t* filtered, size_t stride) {
+    size_t sum = 0;
+    for (size_t i = 1; i <= stride; ++i) {
+        sum += static_cast<size_t>(std::abs(static_cast<int8_t>(filtered[i])));
+    }
+    return sum;
+}
+
+} // namespace
+
+PNGStripeEncoder::PNGStripeEncoder() : stream(nullptr), streamLevel(-2), streamStrategy(-1) {}
+
+PNGStripeEncoder::~PNGStripeEncoder() {
+    if (stream) {
+        deflateEnd(stream);
+        delete stream;
+    }
+}
+
+void PNGStripeEncoder::filter(const uint8_t* rgba, const uint8_t* prevRow, int width, int rows,
+                              PNGFilterStrategy strategy, uint8_t* out, bool premultiplied) {
+    const size_t stride = static_cast<size_t>(width) * kBytesPerPixel;
+    if (strategy == FILTER_ADAPTIVE && candidates.size() < 5 * (stride + 1)) {
+        candidates.resize(5 * (stride + 1));
+    }
+    if (premultiplied && rowScratch.size() < 2 * stride) {
+        rowScratch.resize(2 * stride);
+    }
+
+    // Premultiplied input is converted one row ahead of the filter into a
+    // two-row ring, so the straight image is never materialized.
+    const uint8_t* prev = prevRow;
+    if (premultiplied && prevRow) {
+        pixels::unpremultiply(prevRow, rowScratch.data() + stride, width);
+        prev = rowScratch.data() + stride;
+    }
+
+    for (int y = 0; y < rows; ++y) {
+        const uint8_t* row = rgba + static_cast<size_t>(y) * stride;
+        if (premultiplied) {
+            uint8_t* straightRow = rowScratch.data() + (y & 1) * stride;
+            pixels::unpremultiply(row, straightRow, width);
+            row = straightRow;
+        }
+        uint8_t* dst = out + static_cast<size_t>(y) * (stride + 1);
+        if (strategy == FILTER_ADAPTIVE) {
+            int best = FILTER_NONE;
+            size_t bestCost = static_cast<size_t>(-1);
+            for (int type = FILTER_NONE; type <= FILTER_PAETH; ++type) {
+                if (!prev && type >= FILTER_UP) break;
+                uint8_t* candidate = candidates.data() + type * (stride + 1);
+                filterRow(type, row, prev, stride, candidate);
+                size_t cost = residualCost(candidate, stride);
+                if (cost < bestCost) { bestCost = cost; best = type; }
+            }
+            std::memcpy(dst, candidates.data() + best * (stride + 1), stride + 1);
+        } else {
+            int type = strategy;
+            if (!prev && type >= FILTER_UP) type = FILTER_SUB;
+            filterRow(type, row, prev, stride, dst);
+        }
+        prev = row;
+    }
+}
+
+bool PNGStripeEncoder::compress(const uint8_t* filteredData, size_t length,
+                                const uint8_t* dictionary, size_t dictLength,
+                                int compressionLevel, PNGFilterStrategy strategyHint,
+                                bool last, PNGStripe& out) {
+    out.rawLength = length;
+    out.adler = static_cast<uint32_t>(adler32(adler32(0L, Z_NULL, 0), filteredData,
+                                              static_cast<uInt>(length)));
+
+    const int strategy = strategyHint == FILTER_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+    if (!stream) {
+        stream = new z_stream();
+        // Raw deflate: the zlib header and Adler-32 trailer are written once
+        // per image by PNGStreamWriter.
+        if (deflateInit2(stream, compressionLevel, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+            delete stream;
+            stream = nullptr;
+            LOG_ERROR("PNGStripeEncoder: deflateInit2 failed");
+            return false;
+        }
+        streamLevel = compressionLevel;
+        streamStrategy = strategy;
+    } else {
+        deflateReset(stream);
+        if (streamLevel != compressionLevel || streamStrategy != strategy) {
+            deflateParams(stream, compressionLevel, strategy);
+            streamLevel = compressionLevel;
+            streamStrategy = strategy;
+        }
+    }
+
+    if (dictionary && dictLength > 0) {
+        // Prime the window with the bytes the decoder will have just
+        // inflated, so matches may reach back across the stripe boundary
+        const size_t window = std::min<size_t>(dictLength, 32768);
+        deflateSetDictionary(stream, dictionary + dictLength - window, static_cast<uInt>(window));
+    }
+
+    // Sync flush adds at most a few bytes beyond deflateBound
+    const size_t bound = deflateBound(stream, static_cast<uLong>(length)) + 16;
+    if (out.data.capacity() < bound) out.data.reserve(bound);
+    out.data.resize(bound);
+
+    stream->next_in = const_cast<uint8_t*>(filteredData);
+    stream->avail_in = static_cast<uInt>(length);
+    stream->next_out = out.data.data();
+    stream->avail_out = static_cast<uInt>(bound);
+    int rc = deflate(stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if ((last && rc != Z_STREAM_END) || (!last && rc != Z_OK) || stream->avail_in != 0) {
+        LOG_ERROR("PNGStripeEncoder: deflate failed (" << rc << ")");
+        return false;
+    }
+    out.data.resize(bound - stream->avail_out);
+    return true;
+}
+
+bool PNGStripeEncoder::encode(const uint8_t* rgba, const uint8_t* prevRow,
+                              int width, int rows, int compressionLevel,
+                              PNGFilterStrategy strategy, bool last, PNGStripe& out,
+                              bool premultiplied) {
+    const size_t rawLength = static_cast<size_t>(rows) * (static_cast<size_t>(width) * kBytesPerPixel + 1);
+    if (filtered.size() < rawLength) filtered.resize(rawLength);
+    filter(rgba, prevRow, width, rows, strategy, filtered.data(), premultiplied);
+    return compress(filtered.data(), rawLength, nullptr, 0, compressionLevel, strategy, last, out);
+}
+
+PNGStreamWriter::PNGStreamWriter(Sink sink)
+    : sink(std::move(sink)), adler(1), headerWritten(false), sequence(nullptr) {}
+
+PNGStreamWriter::Sink PNGStreamWriter::fileSink(FILE* fp) {
+    return [fp](const uint8_t* data, size_t size) {
+        return std::fwrite(data, 1, size, fp) == size;
+    };
+}
+
+PNGStreamWriter::Sink PNGStreamWriter::memorySink(std::vector<uint8_t>& out) {
+    return [&out](const uint8_t* data, size_t size) {
+        out.insert(out.end(), data, data + size);
+        return true;
+    };
+}
+
+bool PNGStreamWriter::writeChunk(const char type[4], const uint8_t* data, size_t size) {
+    uint8_t header[8];
+    putBE32(header, static_cast<uint32_t>(size));
+    std::memcpy(header + 4, type, 4);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, header + 4, 4);
+    if (size > 0) crc = crc32(crc, data, static_cast<uInt>(size));
+    uint8_t trailer[4];
+    putBE32(trailer, static_cast<uint32_t>(crc));
+    return sink(header, 8) && (size == 0 || sink(data, size)) && sink(trailer, 4);
+}
+
+bool PNGStreamWriter::begin(int width, int height) {
+    uint8_t ihdr[13];
+    putBE32(ihdr, static_cast<uint32_t>(width));
+    putBE32(ihdr + 4, static_cast<uint32_t>(height));
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 6;  // color type RGBA
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // no interlace
+    beginData();
+    return sink(kPNGSignature, sizeof(kPNGSignature)) && writeChunk("IHDR", ihdr, sizeof(ihdr));
+}
+
+void PNGStreamWriter::beginData(uint32_t* frameSequence) {
+    adler = 1;
+    headerWritten = false;
+    sequence = frameSequence;
+}
+
+bool PNGStreamWriter::writeDataChunk(const uint8_t* data, size_t size) {
+    if (!sequence) {
+        return writeChunk("IDAT", data, size);
+    }
+    // fdAT: 4-byte sequence number, then the same payload an IDAT would carry
+    uint8_t header[12];
+    putBE32(header, static_cast<uint32_t>(size + 4));
+    std::memcpy(header + 4, "fdAT", 4);
+    putBE32(header + 8, (*sequence)++);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, header + 4, 8);
+    crc = crc32(crc, data, static_cast<uInt>(size));
+    uint8_t trailer[4];
+    putBE32(trailer, static_cast<uint32_t>(crc));
+    return sink(header, 12) && sink(data, size) && sink(trailer, 4);
+}
+
+bool PNGStreamWriter::writeStripe(const uint8_t* data, size_t size, uint32_t stripeAdler, size_t rawLength) {
+    // Any scanlines deflate to at least one byte; no data for them means the
+    // stripe was lost and the stream would not decode
+    if (size == 0 && rawLength != 0) return false;
+    if (!headerWritten) {
+        // zlib header: deflate, 32K window, no preset dictionary
+        const uint8_t zlibHeader[2] = {0x78, 0x01};
+        if (!writeDataChunk(zlibHeader, sizeof(zlibHeader))) return false;
+        headerWritten = true;
+    }
+    adler = static_cast<uint32_t>(adler32_combine(adler, stripeAdler, static_cast<z_off_t>(rawLength)));
+    return size == 0 || writeDataChunk(data, size);
+}
+
+bool PNGStreamWriter::finishData() {
+    uint8_t trailer[4];
+    putBE32(trailer, adler);
+    return writeDataChunk(trailer, sizeof(trailer));
+}
+
+bool PNGStreamWriter::finish() {
+    return finishData() && writeChunk("IEND", nullptr, 0);
+}
+
+} // namespace morviq
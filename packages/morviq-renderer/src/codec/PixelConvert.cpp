@@ -0,0 +1,322 @@
+#include "codec/PixelConvert.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace morviq {
+namespace pixels {
+
+namespace {
+
+inline uint8_t unpremultiplyValue(uint8_t value, uint8_t alpha) {
+    float a = alpha / 255.0f;
+    return static_cast<uint8_t>(std::min(255.0f, value / a));
+}
+
+// straight[a][c] for a > 0, built from the float formula so results match
+// the reference exactly.
+struct UnpremultiplyTable {
+    uint8_t straight[256][256];
+
+    UnpremultiplyTable() {
+        std::memset(straight[0], 0, sizeof(straight[0]));
+        for (int a = 1; a < 256; ++a) {
+            for (int c = 0; c < 256; ++c) {
+                straight[a][c] = unpremultiplyValue(static_cast<uint8_t>(c), static_cast<uint8_t>(a));
+            }
+        }
+    }
+};
+
+const UnpremultiplyTable& table() {
+    static const UnpremultiplyTable instance;
+    return instance;
+}
+
+inline void unpremultiplyPixelLUT(const UnpremultiplyTable& t, const uint8_t* src, uint8_t* dst) {
+    const uint8_t a = src[3];
+    const uint8_t* row = t.straight[a];
+    const uint8_t r = row[src[0]];
+    const uint8_t g = row[src[1]];
+    const uint8_t b = row[src[2]];
+    dst[0] = r;
+    dst[1] = g;
+    dst[2] = b;
+    dst[3] = a;
+}
+
+inline bool bytesEqual(const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        if (!_mm256_testz_si256(x, x)) return false;
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        if (_mm_movemask_epi8(x) != 0xffff) return false;
+    }
+#endif
+    for (; i < n; ++i) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+inline uint8_t clampByte(int v) {
+    return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+inline uint8_t lumaBT601(int r, int g, int b) {
+    return clampByte(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline void chromaBT601(int r, int g, int b, uint8_t* u, uint8_t* v) {
+    *u = clampByte(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    *v = clampByte(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// Row kernels for rgbaToI420. Everything stays in exact integer math, so
+// results match lumaBT601 / chromaBT601 bit for bit.
+void lumaRowI420(const uint8_t* row, int width, uint8_t* yRow) {
+    int x = 0;
+#if defined(__SSSE3__)
+    // 16 pixels per step: widen to 16 bits, then one madd per channel pair
+    // and a horizontal add give the 32-bit sums
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coeff = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i offset = _mm_set1_epi16(16);
+    for (; x + 16 <= width; x += 16) {
+        __m128i sums[4];
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + (x + 4 * k) * 4));
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), coeff);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), coeff);
+            sums[k] = _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), round), 8);
+        }
+        __m128i y0 = _mm_add_epi16(_mm_packs_epi32(sums[0], sums[1]), offset);
+        __m128i y1 = _mm_add_epi16(_mm_packs_epi32(sums[2], sums[3]), offset);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yRow + x), _mm_packus_epi16(y0, y1));
+    }
+#endif
+    for (; x < width; ++x) {
+        yRow[x] = lumaBT601(row[x * 4 + 0], row[x * 4 + 1], row[x * 4 + 2]);
+    }
+}
+
+void chromaRowI420(const uint8_t* row0, const uint8_t* row1, int width,
+                   uint8_t* uRow, uint8_t* vRow) {
+    const int chromaWidth = (width + 1) / 2;
+    int cx = 0;
+#if defined(__SSSE3__)
+    // 4 samples (8x2 source pixels) per step; an odd last column is left to
+    // the scalar tail
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i coeffU = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    const __m128i coeffV = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i offset = _mm_set1_epi16(128);
+    for (; 2 * cx + 8 <= width; cx += 4) {
+        __m128i avg[2];
+        for (int k = 0; k < 2; ++k) {
+            const size_t at = static_cast<size_t>(2 * cx + 4 * k) * 4;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + at));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + at));
+            // Vertical sums, then add horizontal neighbours: 2x2 box per sample
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+            hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+            avg[k] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+        }
+        __m128i u = _mm_hadd_epi32(_mm_madd_epi16(avg[0], coeffU), _mm_madd_epi16(avg[1], coeffU));
+        __m128i v = _mm_hadd_epi32(_mm_madd_epi16(avg[0], coeffV), _mm_madd_epi16(avg[1], coeffV));
+        u = _mm_srai_epi32(_mm_add_epi32(u, round), 8);
+        v = _mm_srai_epi32(_mm_add_epi32(v, round), 8);
+        __m128i uv = _mm_add_epi16(_mm_packs_epi32(u, v), offset);
+        uv = _mm_packus_epi16(uv, uv);
+        const uint32_t uBytes = static_cast<uint32_t>(_mm_cvtsi128_si32(uv));
+        const uint32_t vBytes = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(uv, 4)));
+        std::memcpy(uRow + cx, &uBytes, 4);
+        std::memcpy(vRow + cx, &vBytes, 4);
+    }
+#endif
+    for (; cx < chromaWidth; ++cx) {
+        const int x0 = 2 * cx * 4;
+        const int x1 = 2 * cx + 1 < width ? x0 + 4 : x0;
+        const int r = (row0[x0 + 0] + row0[x1 + 0] + row1[x0 + 0] + row1[x1 + 0] + 2) >> 2;
+        const int g = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1] + 2) >> 2;
+        const int b = (row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2] + 2) >> 2;
+        chromaBT601(r, g, b, &uRow[cx], &vRow[cx]);
+    }
+}
+
+} // namespace
+
+void unpremultiplyScalar(const uint8_t* src, uint8_t* dst, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const uint8_t a = src[i * 4 + 3];
+        if (a > 0) {
+            dst[i * 4 + 0] = unpremultiplyValue(src[i * 4 + 0], a);
+            dst[i * 4 + 1] = unpremultiplyValue(src[i * 4 + 1], a);
+            dst[i * 4 + 2] = unpremultiplyValue(src[i * 4 + 2], a);
+            dst[i * 4 + 3] = a;
+        } else {
+            std::memset(dst + i * 4, 0, 4);
+        }
+    }
+}
+
+void unpremultiply(const uint8_t* src, uint8_t* dst, size_t pixelCount) {
+    const UnpremultiplyTable& t = table();
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i alphaMask8 = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+    for (; i + 8 <= pixelCount; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i alpha = _mm256_and_si256(v, alphaMask8);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, alphaMask8)) == -1) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), v);
+        } else if (_mm256_testz_si256(alpha, alpha)) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_setzero_si256());
+        } else {
+            for (size_t k = 0; k < 8; ++k) {
+                unpremultiplyPixelLUT(t, src + (i + k) * 4, dst + (i + k) * 4);
+            }
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i alphaMask4 = _mm_set1_epi32(static_cast<int>(0xff000000u));
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i alpha = _mm_and_si128(v, alphaMask4);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask4)) == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+        } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_setzero_si128());
+        } else {
+            for (size_t k = 0; k < 4; ++k) {
+                unpremultiplyPixelLUT(t, src + (i + k) * 4, dst + (i + k) * 4);
+            }
+        }
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        unpremultiplyPixelLUT(t, src + i * 4, dst + i * 4);
+    }
+}
+
+void packRGB(const uint8_t* rgba, uint8_t* rgb, size_t pixelCount) {
+    size_t i = 0;
+#if defined(__SSSE3__)
+    // 16 RGBA pixels -> 48 RGB bytes per iteration
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    for (; i + 16 <= pixelCount; i += 16) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(rgba + i * 4);
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(in + 0), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(in + 1), shuffle);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(in + 2), shuffle);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(in + 3), shuffle);
+        __m128i* out = reinterpret_cast<__m128i*>(rgb + i * 3);
+        _mm_storeu_si128(out + 0, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128(out + 1, _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128(out + 2, _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        rgb[i * 3 + 0] = rgba[i * 4 + 0];
+        rgb[i * 3 + 1] = rgba[i * 4 + 1];
+        rgb[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+}
+
+void rgbaToI420Scalar(const uint8_t* rgba, int width, int height,
+                      uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane) {
+    const size_t stride = static_cast<size_t>(width) * 4;
+    const int chromaWidth = (width + 1) / 2;
+
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = rgba + y * stride;
+        uint8_t* yRow = yPlane + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            yRow[x] = lumaBT601(row[x * 4 + 0], row[x * 4 + 1], row[x * 4 + 2]);
+        }
+    }
+
+    for (int cy = 0; cy < (height + 1) / 2; ++cy) {
+        const uint8_t* row0 = rgba + (2 * cy) * stride;
+        const uint8_t* row1 = 2 * cy + 1 < height ? row0 + stride : row0;
+        uint8_t* uRow = uPlane + static_cast<size_t>(cy) * chromaWidth;
+        uint8_t* vRow = vPlane + static_cast<size_t>(cy) * chromaWidth;
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            const int x0 = 2 * cx * 4;
+            const int x1 = 2 * cx + 1 < width ? x0 + 4 : x0;
+            const int r = (row0[x0 + 0] + row0[x1 + 0] + row1[x0 + 0] + row1[x1 + 0] + 2) >> 2;
+            const int g = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1] + 2) >> 2;
+            const int b = (row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2] + 2) >> 2;
+            chromaBT601(r, g, b, &uRow[cx], &vRow[cx]);
+        }
+    }
+}
+
+void rgbaToI420(const uint8_t* rgba, int width, int height,
+                uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane) {
+    // One pass over row pairs: the chroma step re-reads the two rows the luma
+    // step just pulled into cache
+    const size_t stride = static_cast<size_t>(width) * 4;
+    const int chromaWidth = (width + 1) / 2;
+
+    for (int cy = 0; cy < (height + 1) / 2; ++cy) {
+        const uint8_t* row0 = rgba + (2 * cy) * stride;
+        const uint8_t* row1 = 2 * cy + 1 < height ? row0 + stride : row0;
+        lumaRowI420(row0, width, yPlane + static_cast<size_t>(2 * cy) * width);
+        if (row1 != row0) {
+            lumaRowI420(row1, width, yPlane + static_cast<size_t>(2 * cy + 1) * width);
+        }
+        chromaRowI420(row0, row1, width, uPlane + static_cast<size_t>(cy) * chromaWidth,
+                      vPlane + static_cast<size_t>(cy) * chromaWidth);
+    }
+}
+
+size_t diffTiles(const uint8_t* current, const uint8_t* previous,
+                 int width, int height, int tileSize, uint8_t* dirty) {
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    const size_t stride = static_cast<size_t>(width) * 4;
+    size_t dirtyCount = 0;
+
+    for (int ty = 0; ty < tilesY; ++ty) {
+        uint8_t* dirtyRow = dirty + static_cast<size_t>(ty) * tilesX;
+        std::memset(dirtyRow, 0, tilesX);
+        const int y0 = ty * tileSize;
+        const int y1 = std::min(height, y0 + tileSize);
+        // Row-major scan keeps both frames streaming through the cache
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t* cur = current + y * stride;
+            const uint8_t* prev = previous + y * stride;
+            for (int tx = 0; tx < tilesX; ++tx) {
+                if (dirtyRow[tx]) continue;
+                const size_t x0 = static_cast<size_t>(tx) * tileSize * 4;
+                const size_t bytes = std::min(static_cast<size_t>(tileSize) * 4, stride - x0);
+                if (!bytesEqual(cur + x0, prev + x0, bytes)) {
+                    dirtyRow[tx] = 1;
+                    ++dirtyCount;
+                }
+            }
+        }
+    }
+    return dirtyCount;
+}
+
+} // namespace pixels
+} // namespace morviq
@@ -0,0 +1,119 @@
+#include "codec/QOIEncoder.h"
+#include "codec/PixelConvert.h"
+#include "utils/ByteOrder.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace morviq {
+
+namespace {
+
+constexpr uint8_t kOpIndex = 0x00;
+constexpr uint8_t kOpDiff = 0x40;
+constexpr uint8_t kOpLuma = 0x80;
+constexpr uint8_t kOpRun = 0xc0;
+constexpr uint8_t kOpRGB = 0xfe;
+constexpr uint8_t kOpRGBA = 0xff;
+constexpr size_t kHeaderSize = 14;
+const uint8_t kEndMarker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+inline uint32_t pack(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t hashIndex(const uint8_t* p) {
+    return (p[0] * 3u + p[1] * 5u + p[2] * 7u + p[3] * 11u) & 63u;
+}
+
+} // namespace
+
+bool QOIEncoder::encode(const Frame& frame, std::vector<uint8_t>& output) {
+    if (frame.channels != 4) {
+        LOG_WARN("QOIEncoder: expected RGBA (4 channels), got " << frame.channels);
+        return false;
+    }
+    const size_t pixelCount = static_cast<size_t>(frame.width) * frame.height;
+    // Un-premultiply one row at a time just ahead of the encoder so the
+    // conversion stays in cache
+    const size_t chunk = static_cast<size_t>(std::max(1, frame.width));
+    if (straight.size() < chunk * 4) straight.resize(chunk * 4);
+
+    // Worst case is one RGBA op (5 bytes) per pixel
+    output.resize(kHeaderSize + pixelCount * 5 + sizeof(kEndMarker));
+    uint8_t* out = output.data();
+    std::memcpy(out, "qoif", 4);
+    putBE32(out + 4, static_cast<uint32_t>(frame.width));
+    putBE32(out + 8, static_cast<uint32_t>(frame.height));
+    out[12] = 4; // channels
+    out[13] = 0; // sRGB with linear alpha
+    out += kHeaderSize;
+
+    uint32_t index[64] = {};
+    uint8_t prev[4] = {0, 0, 0, 255};
+    uint32_t prevPacked = pack(prev);
+    int run = 0;
+
+    const uint8_t* px = nullptr;
+    size_t chunkEnd = 0;
+    for (size_t i = 0; i < pixelCount; ++i, px += 4) {
+        if (i == chunkEnd) {
+            const size_t n = std::min(chunk, pixelCount - i);
+            pixels::unpremultiply(frame.colorBuffer.get() + i * 4, straight.data(), n);
+            px = straight.data();
+            chunkEnd = i + n;
+        }
+        const uint32_t packed = pack(px);
+        if (packed == prevPacked) {
+            if (++run == 62 || i + 1 == pixelCount) {
+                *out++ = kOpRun | static_cast<uint8_t>(run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *out++ = kOpRun | static_cast<uint8_t>(run - 1);
+            run = 0;
+        }
+
+        const uint32_t slot = hashIndex(px);
+        if (index[slot] == packed) {
+            *out++ = kOpIndex | static_cast<uint8_t>(slot);
+        } else {
+            index[slot] = packed;
+            if (px[3] == prev[3]) {
+                const int8_t vr = static_cast<int8_t>(px[0] - prev[0]);
+                const int8_t vg = static_cast<int8_t>(px[1] - prev[1]);
+                const int8_t vb = static_cast<int8_t>(px[2] - prev[2]);
+                const int vgr = vr - vg;
+                const int vgb = vb - vg;
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    *out++ = kOpDiff | static_cast<uint8_t>((vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                    *out++ = kOpLuma | static_cast<uint8_t>(vg + 32);
+                    *out++ = static_cast<uint8_t>((vgr + 8) << 4 | (vgb + 8));
+                } else {
+                    *out++ = kOpRGB;
+                    *out++ = px[0];
+                    *out++ = px[1];
+                    *out++ = px[2];
+                }
+            } else {
+                *out++ = kOpRGBA;
+                std::memcpy(out, px, 4);
+                out += 4;
+            }
+        }
+        std::memcpy(prev, px, 4);
+        prevPacked = packed;
+    }
+
+    std::memcpy(out, kEndMarker, sizeof(kEndMarker));
+    out += sizeof(kEndMarker);
+    output.resize(out - output.data());
+    return true;
+}
+
+} // namespace morviq
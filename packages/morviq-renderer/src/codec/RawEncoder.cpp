@@ -0,0 +1,23 @@
+#include "codec/RawEncoder.h"
+#include "utils/ByteOrder.h"
+#include <cstring>
+
+namespace morviq {
+
+bool RawEncoder::encode(const Frame& frame, std::vector<uint8_t>& output) {
+    const size_t payload = frame.colorBufferSize();
+    output.resize(kHeaderSize + payload);
+    uint8_t* header = output.data();
+    std::memcpy(header, "MVQR", 4);
+    putLE32(header + 4, kVersion);
+    putLE32(header + 8, static_cast<uint32_t>(frame.width));
+    putLE32(header + 12, static_cast<uint32_t>(frame.height));
+    putLE32(header + 16, static_cast<uint32_t>(frame.channels));
+    putLE32(header + 20, kFlagPremultiplied);
+    if (payload > 0) {
+        std::memcpy(output.data() + kHeaderSize, frame.colorBuffer.get(), payload);
+    }
+    return true;
+}
+
+} // namespace morviq
@@ -0,0 +1,20 @@
+#include "codec/SequenceWriter.h"
+#include "codec/APNGWriter.h"
+#include "codec/Y4MWriter.h"
+
+namespace morviq {
+
+std::unique_ptr<SequenceWriter> createSequenceWriter(const OutputParams& params) {
+    switch (params.format) {
+        case OutputParams::APNG:
+            return std::make_unique<APNGWriter>(PNGEncodeParams(params), params.sequenceFps);
+        case OutputParams::Y4M:
+            return std::make_unique<Y4MWriter>(true, params.sequenceFps);
+        case OutputParams::I420:
+            return std::make_unique<Y4MWriter>(false, params.sequenceFps);
+        default:
+            return nullptr;
+    }
+}
+
+} // namespace morviq
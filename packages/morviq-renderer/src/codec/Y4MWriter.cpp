@@ -0,0 +1,76 @@
+#include "codec/Y4MWriter.h"
+#include "codec/PixelConvert.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <csignal>
+
+namespace morviq {
+
+Y4MWriter::Y4MWriter(bool header, int framesPerSecond)
+    : withHeader(header), fps(std::max(1, framesPerSecond)), file(nullptr), ownsFile(false),
+      width(0), height(0) {}
+
+Y4MWriter::~Y4MWriter() {
+    close();
+}
+
+bool Y4MWriter::open(const std::string& path, int w, int h) {
+    close();
+    if (path == "-") {
+        // A consumer that exits early should fail the write, not kill the run
+        std::signal(SIGPIPE, SIG_IGN);
+        file = stdout;
+        ownsFile = false;
+    } else {
+        file = std::fopen(path.c_str(), "wb");
+        ownsFile = true;
+        if (!file) {
+            LOG_ERROR("Y4MWriter: failed to open " << path);
+            return false;
+        }
+    }
+    width = w;
+    height = h;
+    const size_t chroma = static_cast<size_t>((w + 1) / 2) * ((h + 1) / 2);
+    planes.resize(static_cast<size_t>(w) * h + 2 * chroma);
+
+    if (withHeader &&
+        std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                     w, h, fps) < 0) {
+        LOG_ERROR("Y4MWriter: failed to write stream header");
+        return false;
+    }
+    return true;
+}
+
+bool Y4MWriter::writeFrame(const Frame& frame) {
+    if (!file || frame.width != width || frame.height != height || frame.channels != 4) {
+        LOG_ERROR("Y4MWriter: frame does not match the open stream");
+        return false;
+    }
+    uint8_t* yPlane = planes.data();
+    uint8_t* uPlane = yPlane + static_cast<size_t>(width) * height;
+    uint8_t* vPlane = uPlane + static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+    pixels::rgbaToI420(frame.colorBuffer.get(), width, height, yPlane, uPlane, vPlane);
+
+    static const char kFrameMarker[] = "FRAME\n";
+    bool ok = !withHeader || std::fwrite(kFrameMarker, 1, sizeof(kFrameMarker) - 1, file) ==
+                                 sizeof(kFrameMarker) - 1;
+    ok = ok && std::fwrite(planes.data(), 1, planes.size(), file) == planes.size();
+    if (!ok) {
+        LOG_ERROR("Y4MWriter: write failed");
+    }
+    return ok;
+}
+
+bool Y4MWriter::close() {
+    if (!file) return true;
+    bool ok = std::fflush(file) == 0;
+    if (ownsFile) {
+        ok = std::fclose(file) == 0 && ok;
+    }
+    file = nullptr;
+    return ok;
+}
+
+} // namespace morviq
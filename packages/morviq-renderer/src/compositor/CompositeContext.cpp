@@ -0,0 +1,107 @@
+#include "compositor/CompositeContext.h"
+#include "compositor/CompositeKernels.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace morviq {
+
+CompositeContext::CompositeContext(int rank, int size, MPI_Comm comm)
+    : mpiRank(rank), mpiSize(size), mpiComm(comm), width(0), height(0),
+      boundColor(nullptr), boundDepth(nullptr), rebuildCount(0) {}
+
+CompositeContext::~CompositeContext() {
+    release();
+}
+
+void CompositeContext::release() {
+    for (auto& request : requests) {
+        if (request != MPI_REQUEST_NULL) MPI_Request_free(&request);
+    }
+    requests.clear();
+    recvColor.clear();
+    recvDepth.clear();
+    boundColor = nullptr;
+    boundDepth = nullptr;
+}
+
+bool CompositeContext::prepare(const Frame& localFrame) {
+    if (localFrame.width == width && localFrame.height == height &&
+        localFrame.colorBuffer.get() == boundColor &&
+        localFrame.depthBuffer.get() == boundDepth && !requests.empty()) {
+        return false;
+    }
+
+    release();
+    width = localFrame.width;
+    height = localFrame.height;
+    boundColor = localFrame.colorBuffer.get();
+    boundDepth = localFrame.depthBuffer.get();
+    const int pixelCount = width * height;
+
+    if (mpiRank == 0) {
+        const int slots = std::min(kSlots, mpiSize - 1);
+        recvColor.resize(slots);
+        recvDepth.resize(slots);
+        bool allPinned = true;
+        for (int slot = 0; slot < slots; ++slot) {
+            recvColor[slot].allocate(static_cast<size_t>(pixelCount) * 4);
+            recvDepth[slot].allocate(static_cast<size_t>(pixelCount));
+            allPinned = allPinned && recvColor[slot].isPinned() && recvDepth[slot].isPinned();
+        }
+        requests.assign(2 * (mpiSize - 1), MPI_REQUEST_NULL);
+        for (int peer = 1; peer < mpiSize; ++peer) {
+            const int slot = (peer - 1) % kSlots;
+            MPI_Recv_init(recvColor[slot].data(), pixelCount * 4, MPI_UNSIGNED_CHAR,
+                          peer, 0, mpiComm, &requests[2 * (peer - 1)]);
+            MPI_Recv_init(recvDepth[slot].data(), pixelCount, MPI_FLOAT,
+                          peer, 1, mpiComm, &requests[2 * (peer - 1) + 1]);
+        }
+        if (!allPinned) {
+            LOG_WARN("CompositeContext: could not lock " << slots * pixelCount * 5 / (1024 * 1024)
+                     << " MB of receive buffers (RLIMIT_MEMLOCK), they stay pageable");
+        }
+    } else {
+        requests.assign(2, MPI_REQUEST_NULL);
+        MPI_Send_init(boundColor, pixelCount * 4, MPI_UNSIGNED_CHAR, 0, 0, mpiComm, &requests[0]);
+        MPI_Send_init(boundDepth, pixelCount, MPI_FLOAT, 0, 1, mpiComm, &requests[1]);
+    }
+
+    ++rebuildCount;
+    LOG_DEBUG("CompositeContext: built persistent schedule for " << width << "x" << height
+              << " across " << mpiSize << " ranks");
+    return true;
+}
+
+void CompositeContext::execute(const Frame& localFrame, Frame& outputFrame,
+                               const CompositeParams& params) {
+    if (mpiRank != 0) {
+        MPI_Startall(static_cast<int>(requests.size()), requests.data());
+        MPI_Waitall(static_cast<int>(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+        return;
+    }
+
+    const int peers = mpiSize - 1;
+    MPI_Startall(2 * std::min(kSlots, peers), requests.data());
+
+    std::memcpy(outputFrame.colorBuffer.get(), localFrame.colorBuffer.get(), localFrame.colorBufferSize());
+    std::memcpy(outputFrame.depthBuffer.get(), localFrame.depthBuffer.get(), localFrame.depthBufferSize());
+
+    // Merge in rank order so blending stays deterministic; the next peer
+    // streams into the other slot while this one is merged, and a merged
+    // slot is handed straight to the peer kSlots further on.
+    for (int peer = 1; peer < mpiSize; ++peer) {
+        const int slot = (peer - 1) % kSlots;
+        MPI_Waitall(2, &requests[2 * (peer - 1)], MPI_STATUSES_IGNORE);
+        kernels::mergeRows(params.mode,
+                           outputFrame.colorBuffer.get(), outputFrame.depthBuffer.get(),
+                           recvColor[slot].data(), recvDepth[slot].data(),
+                           outputFrame.colorBuffer.get(), outputFrame.depthBuffer.get(),
+                           width, height);
+        if (peer + kSlots < mpiSize) {
+            MPI_Startall(2, &requests[2 * (peer + kSlots - 1)]);
+        }
+    }
+}
+
+} // namespace morviq
@@ -0,0 +1,159 @@
+#include "compositor/HierarchicalCompositor.h"
+#include "compositor/CompositeKernels.h"
+#include "compositor/DepthCompositor.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace morviq {
+
+namespace {
+
+constexpr size_t kSlotAlignment = 64;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+HierarchicalCompositor::HierarchicalCompositor(int rank, int size, MPI_Comm comm)
+    : mpiRank(rank), mpiSize(size), mpiComm(comm),
+      nodeComm(MPI_COMM_NULL), leaderComm(MPI_COMM_NULL),
+      nodeRank(0), nodeSize(1), nodeCount(1), window(MPI_WIN_NULL),
+      frameWidth(0), frameHeight(0) {}
+
+HierarchicalCompositor::~HierarchicalCompositor() {
+    shutdown();
+}
+
+bool HierarchicalCompositor::initialize(int width, int height) {
+    shutdown();
+    frameWidth = width;
+    frameHeight = height;
+
+    // Keying by world rank keeps rank 0 as node rank 0 and leader rank 0
+    MPI_Comm_split_type(mpiComm, MPI_COMM_TYPE_SHARED, mpiRank, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    MPI_Comm_size(nodeComm, &nodeSize);
+
+    MPI_Comm_split(mpiComm, nodeRank == 0 ? 0 : MPI_UNDEFINED, mpiRank, &leaderComm);
+    int isLeader = nodeRank == 0 ? 1 : 0;
+    MPI_Allreduce(&isLeader, &nodeCount, 1, MPI_INT, MPI_SUM, mpiComm);
+
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    size_t colorBytes = alignUp(pixelCount * 4, kSlotAlignment);
+    size_t slotBytes = alignUp(colorBytes + pixelCount * sizeof(float), kSlotAlignment);
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    // Let each rank's slot sit in its own (first-touch, NUMA-local) pages
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    void* base = nullptr;
+    int rc = MPI_Win_allocate_shared(static_cast<MPI_Aint>(slotBytes), 1, info, nodeComm, &base, &window);
+    MPI_Info_free(&info);
+    if (rc != MPI_SUCCESS) {
+        LOG_ERROR("HierarchicalCompositor: MPI_Win_allocate_shared failed");
+        window = MPI_WIN_NULL;
+        return false;
+    }
+
+    slotColor.assign(nodeSize, nullptr);
+    slotDepth.assign(nodeSize, nullptr);
+    for (int r = 0; r < nodeSize; ++r) {
+        MPI_Aint size = 0;
+        int dispUnit = 0;
+        void* slot = nullptr;
+        MPI_Win_shared_query(window, r, &size, &dispUnit, &slot);
+        slotColor[r] = static_cast<uint8_t*>(slot);
+        slotDepth[r] = reinterpret_cast<float*>(static_cast<uint8_t*>(slot) + colorBytes);
+    }
+
+    // Passive-target epoch for the lifetime of the window; frames are
+    // ordered with MPI_Win_sync plus node barriers.
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+
+    nodeFrame.attach(slotColor[0], slotDepth[0], width, height, 4);
+
+    if (leaderComm != MPI_COMM_NULL && nodeCount > 1) {
+        int leaderRank = 0;
+        int leaderSize = 1;
+        MPI_Comm_rank(leaderComm, &leaderRank);
+        MPI_Comm_size(leaderComm, &leaderSize);
+        interNodeCompositor = std::make_unique<DepthCompositor>(leaderRank, leaderSize, leaderComm);
+        if (!interNodeCompositor->initialize(width, height)) {
+            return false;
+        }
+    }
+
+    if (mpiRank == 0) {
+        LOG_INFO("Hierarchical compositing: " << nodeCount << " node(s), "
+                 << nodeSize << " rank(s) on node 0");
+    }
+    return true;
+}
+
+void HierarchicalCompositor::shutdown() {
+    interNodeCompositor.reset();
+    nodeFrame = Frame();
+    slotColor.clear();
+    slotDepth.clear();
+    if (window != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(window);
+        MPI_Win_free(&window);
+    }
+    if (leaderComm != MPI_COMM_NULL) MPI_Comm_free(&leaderComm);
+    if (nodeComm != MPI_COMM_NULL) MPI_Comm_free(&nodeComm);
+}
+
+void HierarchicalCompositor::attachLocalFrame(Frame& frame) {
+    frame.attach(slotColor[nodeRank], slotDepth[nodeRank], frameWidth, frameHeight, 4);
+}
+
+void HierarchicalCompositor::nodeSync() {
+    MPI_Win_sync(window);
+    MPI_Barrier(nodeComm);
+    MPI_Win_sync(window);
+}
+
+void HierarchicalCompositor::composite(Frame& outputFrame, const CompositeParams& params) {
+    // Every node rank has finished writing its slot
+    nodeSync();
+
+    if (nodeSize > 1) {
+        // Each node rank merges one band of rows across all slots into slot 0,
+        // reading its peers' memory directly.
+        int rowsPerRank = (frameHeight + nodeSize - 1) / nodeSize;
+        int rowBegin = std::min(frameHeight, nodeRank * rowsPerRank);
+        int rowEnd = std::min(frameHeight, rowBegin + rowsPerRank);
+        size_t offset = static_cast<size_t>(rowBegin) * frameWidth;
+        size_t count = static_cast<size_t>(rowEnd - rowBegin) * frameWidth;
+        for (int r = 1; r < nodeSize && count > 0; ++r) {
+            kernels::merge(params.mode,
+                           slotColor[0] + offset * 4, slotDepth[0] + offset,
+                           slotColor[r] + offset * 4, slotDepth[r] + offset,
+                           slotColor[0] + offset * 4, slotDepth[0] + offset, count);
+        }
+        // Slot 0 now holds the node composite; peers may not reuse their
+        // slots until every band is merged.
+        nodeSync();
+    }
+
+    if (nodeRank != 0) {
+        return;
+    }
+
+    if (interNodeCompositor) {
+        if (mpiRank == 0) {
+            interNodeCompositor->composite(nodeFrame, outputFrame, params);
+        } else {
+            Frame unused;
+            interNodeCompositor->composite(nodeFrame, unused, params);
+        }
+    } else if (mpiRank == 0) {
+        std::memcpy(outputFrame.colorBuffer.get(), nodeFrame.colorBuffer.get(), nodeFrame.colorBufferSize());
+        std::memcpy(outputFrame.depthBuffer.get(), nodeFrame.depthBuffer.get(), nodeFrame.depthBufferSize());
+    }
+}
+
+} // namespace morviq
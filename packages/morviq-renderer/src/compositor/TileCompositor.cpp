@@ -0,0 +1,79 @@
+#include "compositor/TileCompositor.h"
+#include "compositor/CompositeKernels.h"
+#include "utils/Logger.h"
+#include <cstring>
+
+namespace morviq {
+
+TileCompositor::TileCompositor(int rank, int size, MPI_Comm comm)
+    : mpiRank(rank), mpiSize(size), mpiComm(comm), frameWidth(0), frameHeight(0) {}
+
+TileCompositor::~TileCompositor() {
+    shutdown();
+}
+
+bool TileCompositor::initialize(int width, int height) {
+    frameWidth = width;
+    frameHeight = height;
+
+    rowStart.resize(mpiSize + 1);
+    for (int r = 0; r <= mpiSize; ++r) {
+        rowStart[r] = static_cast<int>(static_cast<long long>(height) * r / mpiSize);
+    }
+
+    const int myRows = rowCount(mpiRank);
+    sendColorCounts.assign(mpiSize, 0); sendColorDispls.assign(mpiSize, 0);
+    recvColorCounts.assign(mpiSize, 0); recvColorDispls.assign(mpiSize, 0);
+    sendDepthCounts.assign(mpiSize, 0); sendDepthDispls.assign(mpiSize, 0);
+    recvDepthCounts.assign(mpiSize, 0); recvDepthDispls.assign(mpiSize, 0);
+    for (int r = 0; r < mpiSize; ++r) {
+        // Stripes are contiguous rows, so the local frame is sent in place
+        sendDepthCounts[r] = rowCount(r) * width;
+        sendDepthDispls[r] = rowStart[r] * width;
+        sendColorCounts[r] = sendDepthCounts[r] * 4;
+        sendColorDispls[r] = sendDepthDispls[r] * 4;
+        recvDepthCounts[r] = myRows * width;
+        recvDepthDispls[r] = r * myRows * width;
+        recvColorCounts[r] = recvDepthCounts[r] * 4;
+        recvColorDispls[r] = recvDepthDispls[r] * 4;
+    }
+
+    const size_t stripePixels = static_cast<size_t>(myRows) * width;
+    if (!recvColor.allocate(stripePixels * 4 * mpiSize) ||
+        !recvDepth.allocate(stripePixels * mpiSize)) {
+        LOG_ERROR("TileCompositor: failed to allocate stripe buffers");
+        return false;
+    }
+    tile = Frame(width, myRows, 4);
+    return true;
+}
+
+void TileCompositor::shutdown() {
+    recvColor.release();
+    recvDepth.release();
+    tile = Frame();
+}
+
+void TileCompositor::composite(const Frame& localFrame, const CompositeParams& params) {
+    MPI_Alltoallv(localFrame.colorBuffer.get(), sendColorCounts.data(), sendColorDispls.data(),
+                  MPI_UNSIGNED_CHAR, recvColor.data(), recvColorCounts.data(),
+                  recvColorDispls.data(), MPI_UNSIGNED_CHAR, mpiComm);
+    MPI_Alltoallv(localFrame.depthBuffer.get(), sendDepthCounts.data(), sendDepthDispls.data(),
+                  MPI_FLOAT, recvDepth.data(), recvDepthCounts.data(),
+                  recvDepthDispls.data(), MPI_FLOAT, mpiComm);
+
+    if (tile.height == 0) return;
+
+    const size_t stripePixels = static_cast<size_t>(tile.width) * tile.height;
+    std::memcpy(tile.colorBuffer.get(), recvColor.data(), stripePixels * 4);
+    std::memcpy(tile.depthBuffer.get(), recvDepth.data(), stripePixels * sizeof(float));
+    for (int r = 1; r < mpiSize; ++r) {
+        kernels::mergeRows(params.mode,
+                           tile.colorBuffer.get(), tile.depthBuffer.get(),
+                           recvColor.data() + r * stripePixels * 4, recvDepth.data() + r * stripePixels,
+                           tile.colorBuffer.get(), tile.depthBuffer.get(),
+                           tile.width, tile.height);
+    }
+}
+
+} // namespace morviq
@@ -0,0 +1,133 @@
+#include "data/BrickCache.h"
+#include <algorithm>
+#include <functional>
+
+namespace morviq {
+
+bool BrickCache::Key::operator==(const Key& other) const {
+    for (int a = 0; a < 3; ++a) {
+        if (begin[a] != other.begin[a] || size[a] != other.size[a]) return false;
+    }
+    return timeStep == other.timeStep && scale == other.scale && rate == other.rate && sparse == other.sparse &&
+           source == other.source;
+}
+
+size_t BrickCache::KeyHash::operator()(const Key& key) const {
+    size_t hash = std::hash<std::string>()(key.source);
+    auto mix = [&hash](int value) {
+        hash ^= std::hash<int>()(value) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    };
+    mix(key.timeStep);
+    mix(key.scale);
+    mix(key.rate);
+    mix(key.sparse);
+    for (int a = 0; a < 3; ++a) {
+        mix(key.begin[a]);
+        mix(key.size[a]);
+    }
+    return hash;
+}
+
+BrickCache& BrickCache::shared() {
+    static BrickCache cache;
+    return cache;
+}
+
+BrickCache::BrickCache(size_t budgetBytes) {
+    stats.budget = budgetBytes;
+}
+
+void BrickCache::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.budget = bytes;
+    evict(0);
+}
+
+std::unique_ptr<VolumeData> BrickCache::makeView(const std::shared_ptr<VolumeData>& block) {
+    auto view = std::make_unique<VolumeData>();
+    std::copy(block->dimensions, block->dimensions + 3, view->dimensions);
+    std::copy(block->spacing, block->spacing + 3, view->spacing);
+    std::copy(block->origin, block->origin + 3, view->origin);
+    std::copy(block->offset, block->offset + 3, view->offset);
+    std::copy(block->fullDimensions, block->fullDimensions + 3, view->fullDimensions);
+    view->voxelCount = block->voxelCount;
+    view->rowPitch = block->rowPitch;
+    view->slicePitch = block->slicePitch;
+    view->storage = block->storage;
+    // The view's reference pins the entry
+    VolumeDataDeleter deleter;
+    deleter.mapping = block;
+    view->data = std::unique_ptr<float[], VolumeDataDeleter>(block->data.get(), deleter);
+    return view;
+}
+
+std::unique_ptr<VolumeData> BrickCache::find(const Key& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end()) {
+        ++stats.misses;
+        return nullptr;
+    }
+    ++stats.hits;
+    entries.splice(entries.begin(), entries, it->second);
+    return makeView(it->second->block);
+}
+
+std::unique_ptr<VolumeData> BrickCache::insert(const Key& key, std::unique_ptr<VolumeData> block) {
+    if (!block) return nullptr;
+    std::shared_ptr<VolumeData> shared(std::move(block));
+    const size_t bytes = shared->bytes();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        // Loaded twice concurrently; keep the first
+        entries.splice(entries.begin(), entries, it->second);
+        return makeView(it->second->block);
+    }
+    if (bytes > stats.budget) {
+        return makeView(shared);
+    }
+    evict(bytes);
+    entries.push_front(Entry{key, shared, bytes});
+    index[key] = entries.begin();
+    stats.bytes += bytes;
+    stats.entries = entries.size();
+    return makeView(shared);
+}
+
+std::unique_ptr<VolumeData> BrickCache::fetch(const Key& key,
+                                              const std::function<std::unique_ptr<VolumeData>()>& load) {
+    if (auto view = find(key)) {
+        return view;
+    }
+    return insert(key, load());
+}
+
+void BrickCache::evict(size_t reserve) {
+    // Oldest unpinned entries first; views of evicted entries stay valid
+    auto it = entries.end();
+    while (stats.bytes + reserve > stats.budget && it != entries.begin()) {
+        --it;
+        if (it->block.use_count() > 1) continue;
+        stats.bytes -= it->bytes;
+        ++stats.evictions;
+        index.erase(it->key);
+        it = entries.erase(it);
+    }
+    stats.entries = entries.size();
+}
+
+void BrickCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    stats.bytes = 0;
+    stats.entries = 0;
+}
+
+BrickCache::Stats BrickCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+} // namespace morviq
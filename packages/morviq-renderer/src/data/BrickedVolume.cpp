@@ -0,0 +1,220 @@
+#include "data/BrickedVolume.h"
+#include "utils/Logger.h"
+#include "utils/ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace morviq {
+
+BrickedVolume::BrickedVolume() : header() {}
+
+BrickedVolume::~BrickedVolume() {}
+
+void BrickedVolume::levelDimensions(const int dimensions[3], int level, int out[3]) {
+    for (int a = 0; a < 3; ++a) {
+        out[a] = ((dimensions[a] - 1) >> level) + 1;
+    }
+}
+
+int BrickedVolume::levelCount(const int dimensions[3], int brickSize) {
+    int levels = 1;
+    int level[3] = {dimensions[0], dimensions[1], dimensions[2]};
+    while (std::max({level[0], level[1], level[2]}) > brickSize) {
+        levelDimensions(dimensions, levels++, level);
+    }
+    return levels;
+}
+
+void BrickedVolume::bricksPerAxis(const int dimensions[3], int level, int brickSize, int out[3]) {
+    int level3[3];
+    levelDimensions(dimensions, level, level3);
+    for (int a = 0; a < 3; ++a) {
+        out[a] = (level3[a] + brickSize - 1) / brickSize;
+    }
+}
+
+std::vector<uint64_t> BrickedVolume::levelFirstBricks(const int dimensions[3], int brickSize, int levelCount) {
+    std::vector<uint64_t> first(levelCount + 1, 0);
+    for (int l = 0; l < levelCount; ++l) {
+        int bricks[3];
+        bricksPerAxis(dimensions, l, brickSize, bricks);
+        first[l + 1] = first[l] + static_cast<uint64_t>(bricks[0]) * bricks[1] * bricks[2];
+    }
+    return first;
+}
+
+size_t BrickedVolume::brickBytes(int brickSize, int ghost) {
+    const size_t stored = static_cast<size_t>(brickSize + 2 * ghost);
+    return stored * stored * stored * sizeof(float);
+}
+
+std::string BrickedVolume::dataPath(const std::string& indexPath) {
+    return std::filesystem::path(indexPath).replace_extension(".dat").string();
+}
+
+bool BrickedVolume::writeIndex(const std::string& path, const Header& header, const Annotations& annotations) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    const size_t count = header.brickCount;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(annotations.minimum.data()), count * sizeof(float));
+    file.write(reinterpret_cast<const char*>(annotations.maximum.data()), count * sizeof(float));
+    file.write(reinterpret_cast<const char*>(annotations.histograms.data()),
+               count * header.histogramBins * sizeof(uint32_t));
+    if (!file) {
+        LOG_ERROR("BrickedVolume: cannot write " << path);
+        return false;
+    }
+    return true;
+}
+
+bool BrickedVolume::open(const std::string& indexPath, const MapOptions& options) {
+    std::ifstream index(indexPath, std::ios::binary);
+    if (!index.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        LOG_ERROR("BrickedVolume: " << indexPath << " is not a brick index");
+        return false;
+    }
+    if (header.byteOrder != kByteOrder || header.version != kVersion) {
+        LOG_ERROR("BrickedVolume: " << indexPath << " has another byte order or version " << header.version);
+        return false;
+    }
+    if (header.brickSize < 1 || header.ghost < 0 || header.histogramBins < 0 || header.dimensions[0] < 1 ||
+        header.dimensions[1] < 1 || header.dimensions[2] < 1 ||
+        header.levelCount != levelCount(header.dimensions, header.brickSize)) {
+        LOG_ERROR("BrickedVolume: " << indexPath << " has an inconsistent header");
+        return false;
+    }
+    firstBricks = levelFirstBricks(header.dimensions, header.brickSize, header.levelCount);
+    const size_t count = header.brickCount;
+    if (firstBricks.back() != count) {
+        LOG_ERROR("BrickedVolume: " << indexPath << " lists " << count << " bricks, its layout "
+                  << firstBricks.back());
+        return false;
+    }
+    annotations.minimum.resize(count);
+    annotations.maximum.resize(count);
+    annotations.histograms.resize(count * header.histogramBins);
+    index.read(reinterpret_cast<char*>(annotations.minimum.data()), count * sizeof(float));
+    index.read(reinterpret_cast<char*>(annotations.maximum.data()), count * sizeof(float));
+    index.read(reinterpret_cast<char*>(annotations.histograms.data()),
+               count * header.histogramBins * sizeof(uint32_t));
+    if (!index) {
+        LOG_ERROR("BrickedVolume: " << indexPath << " is truncated");
+        return false;
+    }
+
+    auto mapped = std::make_shared<MappedFile>();
+    const std::string data = dataPath(indexPath);
+    if (!mapped->open(data, options)) {
+        return false;
+    }
+    if (mapped->size() < count * brickBytes(header.brickSize, header.ghost)) {
+        LOG_ERROR("BrickedVolume: " << data << " is smaller than its index describes");
+        return false;
+    }
+    file = mapped;
+    path = indexPath;
+    return true;
+}
+
+void BrickedVolume::getDimensions(int level, int dimensions[3]) const {
+    levelDimensions(header.dimensions, level, dimensions);
+}
+
+const float* BrickedVolume::brickVoxels(int level, int bx, int by, int bz) const {
+    int bricks[3];
+    bricksPerAxis(header.dimensions, level, header.brickSize, bricks);
+    const uint64_t index = firstBricks[level] + (static_cast<uint64_t>(bz) * bricks[1] + by) * bricks[0] + bx;
+    const size_t bytes = brickBytes(header.brickSize, header.ghost);
+    file->willNeed(index * bytes, bytes);
+    return reinterpret_cast<const float*>(file->data() + index * bytes);
+}
+
+std::unique_ptr<VolumeData> BrickedVolume::loadRegion(int level, const int begin[3], const int size[3]) const {
+    if (!file || level < 0 || level >= header.levelCount) {
+        return nullptr;
+    }
+    int dimensions[3];
+    getDimensions(level, dimensions);
+    for (int a = 0; a < 3; ++a) {
+        if (size[a] <= 0 || begin[a] < 0 || begin[a] + size[a] > dimensions[a]) {
+            LOG_ERROR("Region outside the bricked volume " << path);
+            return nullptr;
+        }
+    }
+    const int brickSize = header.brickSize;
+    const int ghost = header.ghost;
+    const size_t stored = static_cast<size_t>(brickSize + 2 * ghost);
+    int bricks[3];
+    bricksPerAxis(header.dimensions, level, brickSize, bricks);
+
+    auto volume = std::make_unique<VolumeData>();
+    for (int a = 0; a < 3; ++a) {
+        volume->dimensions[a] = size[a];
+        volume->offset[a] = begin[a];
+        volume->fullDimensions[a] = dimensions[a];
+        volume->spacing[a] = header.spacing[a] * static_cast<float>(1 << level);
+        volume->origin[a] = begin[a] * volume->spacing[a];
+    }
+    volume->voxelCount = static_cast<size_t>(size[0]) * size[1] * size[2];
+
+    // The brick whose stored voxels, ghosts included, hold the region
+    int home[3];
+    bool single = true;
+    for (int a = 0; a < 3; ++a) {
+        home[a] = std::min((begin[a] + ghost) / brickSize, bricks[a] - 1);
+        single = single && begin[a] >= home[a] * brickSize - ghost &&
+                 begin[a] + size[a] <= (home[a] + 1) * brickSize + ghost;
+    }
+    if (single) {
+        const float* voxels = brickVoxels(level, home[0], home[1], home[2]);
+        const size_t first = (begin[0] - home[0] * brickSize + ghost) +
+                             (begin[1] - home[1] * brickSize + ghost) * stored +
+                             (begin[2] - home[2] * brickSize + ghost) * stored * stored;
+        float* view = const_cast<float*>(voxels + first);
+        volume->data = std::unique_ptr<float[], VolumeDataDeleter>(view, VolumeDataDeleter{file});
+        volume->rowPitch = stored;
+        volume->slicePitch = stored * stored;
+        return volume;
+    }
+
+    // Otherwise gathered from the interiors of the bricks it overlaps
+    volume->data.reset(new float[volume->voxelCount]);
+    int low[3];
+    int high[3];
+    for (int a = 0; a < 3; ++a) {
+        low[a] = begin[a] / brickSize;
+        high[a] = (begin[a] + size[a] - 1) / brickSize;
+    }
+    const int span[3] = {high[0] - low[0] + 1, high[1] - low[1] + 1, high[2] - low[2] + 1};
+    const size_t count = static_cast<size_t>(span[0]) * span[1] * span[2];
+    float* out = volume->data.get();
+    ThreadPool::shared().parallelFor(0, count, [&](size_t first, size_t end) {
+        for (size_t i = first; i < end; ++i) {
+            const int b[3] = {low[0] + static_cast<int>(i % span[0]), low[1] + static_cast<int>(i / span[0] % span[1]),
+                              low[2] + static_cast<int>(i / span[0] / span[1])};
+            int from[3];
+            int to[3];
+            for (int a = 0; a < 3; ++a) {
+                from[a] = std::max(begin[a], b[a] * brickSize);
+                to[a] = std::min(begin[a] + size[a], (b[a] + 1) * brickSize);
+            }
+            const float* voxels = brickVoxels(level, b[0], b[1], b[2]);
+            for (int z = from[2]; z < to[2]; ++z) {
+                for (int y = from[1]; y < to[1]; ++y) {
+                    const float* row = voxels + (from[0] - b[0] * brickSize + ghost) +
+                                       (y - b[1] * brickSize + ghost) * stored +
+                                       (z - b[2] * brickSize + ghost) * stored * stored;
+                    std::copy(row, row + (to[0] - from[0]),
+                              out + (from[0] - begin[0]) + (y - begin[1]) * static_cast<size_t>(size[0]) +
+                                  (z - begin[2]) * static_cast<size_t>(size[0]) * size[1]);
+                }
+            }
+        }
+    });
+    return volume;
+}
+
+} // namespace morviq
@@ -0,0 +1,373 @@
+#include "data/CompressedVolume.h"
+#include "utils/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace morviq {
+
+namespace {
+
+constexpr int kCellVoxels = 64;
+constexpr int kIntPrecision = 32;
+constexpr int kExponentBits = 8;
+constexpr int kExponentBias = 127;
+constexpr uint32_t kNegabinaryMask = 0xaaaaaaaau;
+constexpr size_t kNoCell = std::numeric_limits<size_t>::max();
+
+// Coefficients in order of sequency (x + y + z), so the bit planes reach
+// the smooth part of a cell first
+struct Sequency {
+    uint8_t order[kCellVoxels];
+
+    Sequency() {
+        for (int i = 0; i < kCellVoxels; ++i) {
+            order[i] = static_cast<uint8_t>(i);
+        }
+        auto rank = [](int i) {
+            const int x = i & 3, y = (i >> 2) & 3, z = i >> 4;
+            return (x + y + z) * 64 + x * x + y * y + z * z;
+        };
+        std::stable_sort(order, order + kCellVoxels, [&](uint8_t a, uint8_t b) { return rank(a) < rank(b); });
+    }
+};
+
+const uint8_t* sequencyOrder() {
+    static const Sequency sequency;
+    return sequency.order;
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(uint64_t* words) : words(words), position(0) {}
+
+    // The low n (<= 64) bits of value
+    void write(uint64_t value, int n) {
+        if (n == 0) return;
+        if (n < 64) value &= (uint64_t(1) << n) - 1;
+        const int shift = position & 63;
+        words[position >> 6] |= value << shift;
+        if (shift + n > 64) words[(position >> 6) + 1] |= value >> (64 - shift);
+        position += n;
+    }
+    bool writeBit(bool bit) {
+        if (bit) words[position >> 6] |= uint64_t(1) << (position & 63);
+        ++position;
+        return bit;
+    }
+
+private:
+    uint64_t* words;
+    int position;
+};
+
+class BitReader {
+public:
+    explicit BitReader(const uint64_t* words) : words(words), position(0) {}
+
+    uint64_t read(int n) {
+        if (n == 0) return 0;
+        const int shift = position & 63;
+        const int word = position >> 6;
+        uint64_t value = words[word] >> shift;
+        if (shift + n > 64) value |= words[word + 1] << (64 - shift);
+        position += n;
+        return n < 64 ? value & ((uint64_t(1) << n) - 1) : value;
+    }
+    bool readBit() {
+        const bool bit = (words[position >> 6] >> (position & 63)) & 1u;
+        ++position;
+        return bit;
+    }
+
+private:
+    const uint64_t* words;
+    int position;
+};
+
+// Near-orthogonal integer transform of four values s apart, as in ZFP
+void forwardLift(int32_t* p, int s) {
+    int32_t x = p[0], y = p[s], z = p[2 * s], w = p[3 * s];
+    x += w; x >>= 1; w -= x;
+    z += y; z >>= 1; y -= z;
+    x += z; x >>= 1; z -= x;
+    w += y; w >>= 1; y -= w;
+    w += y >> 1; y -= w >> 1;
+    p[0] = x; p[s] = y; p[2 * s] = z; p[3 * s] = w;
+}
+
+void inverseLift(int32_t* p, int s) {
+    int32_t x = p[0], y = p[s], z = p[2 * s], w = p[3 * s];
+    y += w >> 1; w -= y >> 1;
+    y += w; w <<= 1; w -= y;
+    z += x; x <<= 1; x -= z;
+    y += z; z <<= 1; z -= y;
+    w += x; x <<= 1; x -= w;
+    p[0] = x; p[s] = y; p[2 * s] = z; p[3 * s] = w;
+}
+
+void forwardTransform(int32_t* cell) {
+    for (int z = 0; z < 4; ++z)
+        for (int y = 0; y < 4; ++y) forwardLift(cell + 4 * y + 16 * z, 1);
+    for (int x = 0; x < 4; ++x)
+        for (int z = 0; z < 4; ++z) forwardLift(cell + 16 * z + x, 4);
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 4; ++x) forwardLift(cell + x + 4 * y, 16);
+}
+
+void inverseTransform(int32_t* cell) {
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 4; ++x) inverseLift(cell + x + 4 * y, 16);
+    for (int x = 0; x < 4; ++x)
+        for (int z = 0; z < 4; ++z) inverseLift(cell + 16 * z + x, 4);
+    for (int z = 0; z < 4; ++z)
+        for (int y = 0; y < 4; ++y) inverseLift(cell + 4 * y + 16 * z, 1);
+}
+
+// Embedded code of the bit planes, most significant first, within bits.
+// n coefficients are known to be significant and have their bit sent
+// verbatim; the rest are group-tested (is any still zero coefficient
+// significant in this plane?) and run-length coded.
+void encodePlanes(BitWriter& writer, const uint32_t* coefficients, int bits) {
+    int n = 0;
+    for (int k = kIntPrecision; bits && k-- > 0;) {
+        uint64_t plane = 0;
+        for (int i = 0; i < kCellVoxels; ++i) {
+            plane += static_cast<uint64_t>((coefficients[i] >> k) & 1u) << i;
+        }
+        const int m = std::min(n, bits);
+        bits -= m;
+        writer.write(plane, m);
+        plane = m < 64 ? plane >> m : 0;
+        for (; n < kCellVoxels && bits && (bits--, writer.writeBit(plane != 0)); plane >>= 1, n++) {
+            for (; n < kCellVoxels - 1 && bits && (bits--, !writer.writeBit(plane & 1u)); plane >>= 1, n++) {
+            }
+        }
+    }
+}
+
+void decodePlanes(BitReader& reader, uint32_t* coefficients, int bits) {
+    std::fill(coefficients, coefficients + kCellVoxels, 0u);
+    int n = 0;
+    for (int k = kIntPrecision; bits && k-- > 0;) {
+        const int m = std::min(n, bits);
+        bits -= m;
+        uint64_t plane = reader.read(m);
+        for (; n < kCellVoxels && bits && (bits--, reader.readBit()); plane += uint64_t(1) << n++) {
+            for (; n < kCellVoxels - 1 && bits && (bits--, !reader.readBit()); n++) {
+            }
+        }
+        for (; plane; plane &= plane - 1) {
+            coefficients[__builtin_ctzll(plane)] += uint32_t(1) << k;
+        }
+    }
+}
+
+// Exactly rate words, which start zeroed
+void encodeCell(const float* values, int rate, uint64_t* out) {
+    float magnitude = 0.0f;
+    for (int i = 0; i < kCellVoxels; ++i) {
+        magnitude = std::max(magnitude, std::fabs(values[i]));
+    }
+    if (magnitude == 0.0f) {
+        return; // a 0 bit: all zero
+    }
+    BitWriter writer(out);
+    int exponent;
+    std::frexp(magnitude, &exponent);
+    exponent = std::max(exponent, 1 - kExponentBias);
+    writer.writeBit(true);
+    writer.write(static_cast<uint64_t>(exponent + kExponentBias), kExponentBits);
+
+    // Block floating point: integers of kIntPrecision - 2 bits leave the
+    // transform room to grow
+    int32_t ints[kCellVoxels];
+    for (int i = 0; i < kCellVoxels; ++i) {
+        ints[i] = static_cast<int32_t>(std::ldexp(values[i], kIntPrecision - 2 - exponent));
+    }
+    forwardTransform(ints);
+    const uint8_t* order = sequencyOrder();
+    uint32_t coefficients[kCellVoxels];
+    for (int i = 0; i < kCellVoxels; ++i) {
+        coefficients[i] = (static_cast<uint32_t>(ints[order[i]]) + kNegabinaryMask) ^ kNegabinaryMask;
+    }
+    encodePlanes(writer, coefficients, rate * 64 - 1 - kExponentBits);
+}
+
+void decodeCell(const uint64_t* in, int rate, float* values) {
+    BitReader reader(in);
+    if (!reader.readBit()) {
+        std::fill(values, values + kCellVoxels, 0.0f);
+        return;
+    }
+    const int exponent = static_cast<int>(reader.read(kExponentBits)) - kExponentBias;
+    uint32_t coefficients[kCellVoxels];
+    decodePlanes(reader, coefficients, rate * 64 - 1 - kExponentBits);
+    const uint8_t* order = sequencyOrder();
+    int32_t ints[kCellVoxels];
+    for (int i = 0; i < kCellVoxels; ++i) {
+        ints[order[i]] = static_cast<int32_t>((coefficients[i] ^ kNegabinaryMask) - kNegabinaryMask);
+    }
+    inverseTransform(ints);
+    const double scale = std::ldexp(1.0, exponent - (kIntPrecision - 2));
+    for (int i = 0; i < kCellVoxels; ++i) {
+        values[i] = static_cast<float>(ints[i] * scale);
+    }
+}
+
+} // namespace
+
+CompressedVolume::CompressedVolume(const int dims[3], int bitRate)
+    : rate(bitRate), cacheSlots(8) {
+    for (int a = 0; a < 3; ++a) {
+        dimensions[a] = dims[a];
+        cells[a] = (dims[a] + 3) / 4;
+    }
+    const size_t cellCount = static_cast<size_t>(cells[0]) * cells[1] * cells[2];
+    words.assign(cellCount * rate, 0);
+    while (cacheSlots < std::min(cellCount, static_cast<size_t>(kCacheCells))) {
+        cacheSlots *= 2;
+    }
+}
+
+size_t CompressedVolume::bytes() const {
+    return words.size() * sizeof(uint64_t) + cacheSlots * (kCellVoxels * sizeof(float) + sizeof(size_t));
+}
+
+std::shared_ptr<CompressedVolume> CompressedVolume::encode(const VolumeData& block, int rate) {
+    if (!block.data) return nullptr;
+    rate = std::min(std::max(rate, kMinRate), kMaxRate);
+    std::shared_ptr<CompressedVolume> volume(new CompressedVolume(block.dimensions, rate));
+    const int* cells = volume->cells;
+    const int* dims = block.dimensions;
+    const size_t stride = block.rowStride();
+    const size_t slice = block.sliceStride();
+    const float* data = block.data.get();
+    const size_t cellCount = static_cast<size_t>(cells[0]) * cells[1] * cells[2];
+    ThreadPool::shared().parallelFor(0, cellCount, [&](size_t first, size_t end) {
+        float values[kCellVoxels];
+        for (size_t index = first; index < end; ++index) {
+            const int cx = static_cast<int>(index % cells[0]);
+            const int cy = static_cast<int>(index / cells[0] % cells[1]);
+            const int cz = static_cast<int>(index / cells[0] / cells[1]);
+            // Partial cells at the high faces repeat the last voxel
+            for (int i = 0; i < kCellVoxels; ++i) {
+                const size_t x = std::min(cx * 4 + (i & 3), dims[0] - 1);
+                const size_t y = std::min(cy * 4 + ((i >> 2) & 3), dims[1] - 1);
+                const size_t z = std::min(cz * 4 + (i >> 4), dims[2] - 1);
+                const float value = data[x + y * stride + z * slice];
+                values[i] = std::isfinite(value) ? value : 0.0f;
+            }
+            encodeCell(values, rate, &volume->words[index * rate]);
+        }
+    }, 64);
+    return volume;
+}
+
+std::unique_ptr<VolumeData> CompressedVolume::compress(const VolumeData& block, int rate) {
+    auto volume = encode(block, rate);
+    if (!volume) return nullptr;
+    auto out = std::make_unique<VolumeData>();
+    std::copy(block.dimensions, block.dimensions + 3, out->dimensions);
+    std::copy(block.spacing, block.spacing + 3, out->spacing);
+    std::copy(block.origin, block.origin + 3, out->origin);
+    std::copy(block.offset, block.offset + 3, out->offset);
+    std::copy(block.fullDimensions, block.fullDimensions + 3, out->fullDimensions);
+    out->voxelCount = block.voxelCount;
+    out->storage = std::move(volume);
+    return out;
+}
+
+const float* CompressedVolume::cell(int cx, int cy, int cz) const {
+    const size_t index = (static_cast<size_t>(cz) * cells[1] + cy) * cells[0] + cx;
+    // The low three bits are the cell's parities, so the up to eight cells
+    // one sample spans never evict each other; the rest is hashed so the
+    // cells along any axis spread over the slots
+    const uint32_t hash = static_cast<uint32_t>(cx) * 73856093u ^ static_cast<uint32_t>(cy) * 19349663u ^
+                          static_cast<uint32_t>(cz) * 83492791u;
+    const size_t slot = (cx & 1) | (cy & 1) << 1 | (cz & 1) << 2 | (hash & ((cacheSlots >> 3) - 1)) << 3;
+    if (cacheTags.empty()) {
+        cacheValues.resize(cacheSlots * kCellVoxels);
+        cacheTags.assign(cacheSlots, kNoCell);
+    }
+    float* values = &cacheValues[slot * kCellVoxels];
+    if (cacheTags[slot] == index) {
+        ++cacheStats.hits;
+        return values;
+    }
+    ++cacheStats.misses;
+    decodeCell(&words[index * rate], rate, values);
+    cacheTags[slot] = index;
+    return values;
+}
+
+float CompressedVolume::sample(float x, float y, float z) const {
+    const int x0 = static_cast<int>(x);
+    const int y0 = static_cast<int>(y);
+    const int z0 = static_cast<int>(z);
+    const int x1 = std::min(x0 + 1, dimensions[0] - 1);
+    const int y1 = std::min(y0 + 1, dimensions[1] - 1);
+    const int z1 = std::min(z0 + 1, dimensions[2] - 1);
+    const float fx = x - x0;
+    const float fy = y - y0;
+    const float fz = z - z0;
+
+    // The corners span one to eight cells; each distinct cell is looked up once
+    const int cx[2] = {x0 >> 2, x1 >> 2};
+    const int cy[2] = {y0 >> 2, y1 >> 2};
+    const int cz[2] = {z0 >> 2, z1 >> 2};
+    const float* c[8];
+    for (int k = 0; k < 8; ++k) {
+        const int i = k & 1, j = (k >> 1) & 1, l = k >> 2;
+        if (i && cx[1] == cx[0]) {
+            c[k] = c[k - 1];
+        } else if (j && cy[1] == cy[0]) {
+            c[k] = c[k - 2];
+        } else if (l && cz[1] == cz[0]) {
+            c[k] = c[k - 4];
+        } else {
+            c[k] = cell(cx[i], cy[j], cz[l]);
+        }
+    }
+    const int ix[2] = {x0 & 3, x1 & 3};
+    const int iy[2] = {4 * (y0 & 3), 4 * (y1 & 3)};
+    const int iz[2] = {16 * (z0 & 3), 16 * (z1 & 3)};
+    const float v000 = c[0][ix[0] + iy[0] + iz[0]];
+    const float v100 = c[1][ix[1] + iy[0] + iz[0]];
+    const float v010 = c[2][ix[0] + iy[1] + iz[0]];
+    const float v110 = c[3][ix[1] + iy[1] + iz[0]];
+    const float v001 = c[4][ix[0] + iy[0] + iz[1]];
+    const float v101 = c[5][ix[1] + iy[0] + iz[1]];
+    const float v011 = c[6][ix[0] + iy[1] + iz[1]];
+    const float v111 = c[7][ix[1] + iy[1] + iz[1]];
+
+    const float v00 = v000 * (1 - fx) + v100 * fx;
+    const float v01 = v001 * (1 - fx) + v101 * fx;
+    const float v10 = v010 * (1 - fx) + v110 * fx;
+    const float v11 = v011 * (1 - fx) + v111 * fx;
+    const float v0 = v00 * (1 - fy) + v10 * fy;
+    const float v1 = v01 * (1 - fy) + v11 * fy;
+    return v0 * (1 - fz) + v1 * fz;
+}
+
+void CompressedVolume::decompress(float* out) const {
+    float values[kCellVoxels];
+    for (int cz = 0; cz < cells[2]; ++cz) {
+        for (int cy = 0; cy < cells[1]; ++cy) {
+            for (int cx = 0; cx < cells[0]; ++cx) {
+                const size_t index = (static_cast<size_t>(cz) * cells[1] + cy) * cells[0] + cx;
+                decodeCell(&words[index * rate], rate, values);
+                for (int i = 0; i < kCellVoxels; ++i) {
+                    const int x = cx * 4 + (i & 3);
+                    const int y = cy * 4 + ((i >> 2) & 3);
+                    const int z = cz * 4 + (i >> 4);
+                    if (x < dimensions[0] && y < dimensions[1] && z < dimensions[2]) {
+                        out[(static_cast<size_t>(z) * dimensions[1] + y) * dimensions[0] + x] = values[i];
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace morviq
@@ -1,12 +1,67 @@
 #include "data/DataLoader.h"
+#include "data/BrickCache.h"
+#include "data/BrickedVolume.h"
+#include "data/CompressedVolume.h"
+#include "data/JsonScan.h"
+#include "data/SparseVolume.h"
+#include "data/ZarrLoader.h"
 #include "utils/Logger.h"
+#include "utils/ThreadPool.h"
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
 namespace morviq {
 
-DataLoader::DataLoader() {}
+namespace {
+
+// Raw files without a sidecar header, and the procedural fallback
+constexpr int kRawSize = 128;
+constexpr int kProceduralSize = 64;
+
+std::unique_ptr<VolumeData> makeBlock(const int dimensions[3], const int begin[3], const int size[3]) {
+    auto volume = std::make_unique<VolumeData>();
+    for (int a = 0; a < 3; ++a) {
+        volume->dimensions[a] = size[a];
+        volume->offset[a] = begin[a];
+        volume->fullDimensions[a] = dimensions[a];
+        volume->origin[a] = static_cast<float>(begin[a]);
+    }
+    volume->voxelCount = static_cast<size_t>(size[0]) * size[1] * size[2];
+    volume->data.reset(new float[volume->voxelCount]());
+    return volume;
+}
+
+// Voxels per axis of a raw volume subsampled by 2^scale; level voxel i is
+// voxel i << scale of the full volume, so both span the same box
+void rawLevelDimensions(const int dimensions[3], int scale, int levelDimensions[3]) {
+    for (int a = 0; a < 3; ++a) {
+        levelDimensions[a] = ((dimensions[a] - 1) >> scale) + 1;
+    }
+}
+
+int rawLevelCount(const int dimensions[3], int minSize) {
+    int levels = 1;
+    while (true) {
+        int next[3];
+        rawLevelDimensions(dimensions, levels, next);
+        if (std::max({next[0], next[1], next[2]}) < minSize) return levels;
+        ++levels;
+    }
+}
+
+bool insideDataset(const int dimensions[3], const int begin[3], const int size[3]) {
+    for (int a = 0; a < 3; ++a) {
+        if (size[a] <= 0 || begin[a] < 0 || begin[a] + size[a] > dimensions[a]) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+DataLoader::DataLoader() : compressRate(-1) {}
 
 DataLoader::~DataLoader() {}
 
@@ -14,77 +69,461 @@ void DataLoader::setBasePath(const std::string& path) {
     basePath = path;
 }
 
-std::unique_ptr<VolumeData> DataLoader::loadVolume(const std::string& dataset, int timeStep) {
-    std::filesystem::path dataPath = basePath;
-    dataPath = dataPath / dataset / ("t_" + std::to_string(timeStep));
+void DataLoader::setMapOptions(const MapOptions& options) {
+    mapOptions = options;
+}
+
+void DataLoader::setCompressRate(int rate) {
+    compressRate = std::min(rate, CompressedVolume::kMaxRate);
+}
+
+void DataLoader::setSparseParams(const SparseParams& params) {
+    sparseParams = params;
+}
+
+DataLoader::Source DataLoader::resolve(const std::string& dataset, int timeStep, std::string& path) const {
+    std::filesystem::path datasetPath = std::filesystem::path(basePath) / dataset;
+    std::filesystem::path dataPath = datasetPath / ("t_" + std::to_string(timeStep));
     
-    if (std::filesystem::exists(dataPath / "volume.raw")) {
-        // Load raw volume
-        return loadRawVolume((dataPath / "volume.raw").string(), 128, 128, 128);
-    } else if (std::filesystem::exists(dataPath / ".zarray")) {
-        // Load Zarr volume
-        return loadZarr(dataPath.string(), timeStep);
-    } else {
-        LOG_WARN("Dataset not found, generating procedural volume");
-        return generateProceduralVolume(64);
+    if (std::filesystem::exists(datasetPath / ".zarray") || std::filesystem::exists(datasetPath / ".zgroup")) {
+        // One 4D (t, z, y, x) Zarr array or multiscale group for all time steps
+        path = datasetPath.string();
+        return SOURCE_ZARR;
+    } else if (std::filesystem::exists(dataPath / "bricks.idx")) {
+        // Converted by morviq_convert; preferred over a raw volume beside it
+        path = (dataPath / "bricks.idx").string();
+        return SOURCE_BRICKED;
+    } else if (std::filesystem::exists(dataPath / "volume.raw")) {
+        path = (dataPath / "volume.raw").string();
+        return SOURCE_RAW;
+    } else if (std::filesystem::exists(dataPath / ".zarray") || std::filesystem::exists(dataPath / ".zgroup")) {
+        path = dataPath.string();
+        return SOURCE_ZARR;
+    }
+    path.clear();
+    return SOURCE_PROCEDURAL;
+}
+
+ZarrLoader* DataLoader::openZarr(const std::string& path) {
+    if (zarr && zarrPath == path) {
+        return zarr.get();
+    }
+    zarr = std::make_unique<ZarrLoader>();
+    zarrPath = path;
+    if (!zarr->open(path)) {
+        zarr.reset();
+        zarrPath.clear();
+    }
+    return zarr.get();
+}
+
+BrickedVolume* DataLoader::openBricked(const std::string& path) {
+    if (bricked && brickedPath == path) {
+        return bricked.get();
+    }
+    bricked = std::make_unique<BrickedVolume>();
+    brickedPath = path;
+    if (!bricked->open(path, mapOptions)) {
+        bricked.reset();
+        brickedPath.clear();
+    }
+    return bricked.get();
+}
+
+int DataLoader::getTimeStepCount(const std::string& dataset) {
+    const std::string root = (std::filesystem::path(basePath) / dataset).string();
+    std::string path;
+    int count = 0;
+    while (resolve(dataset, count, path) != SOURCE_PROCEDURAL) {
+        if (path == root) {
+            // One array for all time steps
+            ZarrLoader* loader = openZarr(path);
+            if (!loader) return 0;
+            const std::vector<int>& shape = loader->getShape();
+            return shape.size() < 4 ? 1 : shape[0];
+        }
+        ++count;
+    }
+    return count;
+}
+
+std::unique_ptr<VolumeData> DataLoader::loadVolume(const std::string& dataset, int timeStep) {
+    std::string path;
+    switch (resolve(dataset, timeStep, path)) {
+        case SOURCE_ZARR:
+        case SOURCE_RAW:
+        case SOURCE_BRICKED: {
+            int dimensions[3];
+            if (!getDimensions(dataset, timeStep, dimensions)) return nullptr;
+            const int begin[3] = {0, 0, 0};
+            return loadRegion(dataset, timeStep, begin, dimensions);
+        }
+        case SOURCE_PROCEDURAL:
+            break;
+    }
+    LOG_WARN("Dataset not found, generating procedural volume");
+    return generateProceduralVolume(kProceduralSize);
+}
+
+bool DataLoader::hasTimeStep(const std::string& dataset, int timeStep) {
+    std::string path;
+    if (timeStep < 0) return false;
+    switch (resolve(dataset, timeStep, path)) {
+        case SOURCE_ZARR: {
+            ZarrLoader* loader = openZarr(path);
+            if (!loader) return false;
+            const std::vector<int>& shape = loader->getShape();
+            return shape.size() < 4 || timeStep < shape[0];
+        }
+        case SOURCE_RAW:
+        case SOURCE_BRICKED:
+            return true;
+        case SOURCE_PROCEDURAL:
+            break;
+    }
+    return false;
+}
+
+int DataLoader::getLevelCount(const std::string& dataset, int timeStep) {
+    std::string path;
+    switch (resolve(dataset, timeStep, path)) {
+        case SOURCE_ZARR: {
+            ZarrLoader* loader = openZarr(path);
+            return loader ? loader->getLevelCount() : 0;
+        }
+        case SOURCE_RAW: {
+            RawHeader header;
+            if (!readRawHeader(path, header)) return 0;
+            return rawLevelCount(header.dimensions, kMinLevelSize);
+        }
+        case SOURCE_BRICKED: {
+            BrickedVolume* volume = openBricked(path);
+            return volume ? volume->getLevelCount() : 0;
+        }
+        case SOURCE_PROCEDURAL:
+            break;
+    }
+    return 1;
+}
+
+bool DataLoader::getDimensions(const std::string& dataset, int timeStep, int dimensions[3], int scale) {
+    std::string path;
+    switch (resolve(dataset, timeStep, path)) {
+        case SOURCE_ZARR: {
+            ZarrLoader* loader = openZarr(path);
+            if (!loader || scale < 0 || scale >= loader->getLevelCount()) return false;
+            const std::vector<int>& shape = loader->getLevelShape(scale);
+            const size_t dims = shape.size();
+            for (int a = 0; a < 3; ++a) {
+                dimensions[a] = shape[dims - 1 - a];
+            }
+            return true;
+        }
+        case SOURCE_RAW: {
+            RawHeader header;
+            if (!readRawHeader(path, header) || scale < 0) return false;
+            rawLevelDimensions(header.dimensions, scale, dimensions);
+            return true;
+        }
+        case SOURCE_BRICKED: {
+            BrickedVolume* volume = openBricked(path);
+            if (!volume || scale < 0 || scale >= volume->getLevelCount()) return false;
+            volume->getDimensions(scale, dimensions);
+            return true;
+        }
+        case SOURCE_PROCEDURAL:
+            break;
+    }
+    LOG_WARN("Dataset not found, generating procedural volume");
+    dimensions[0] = dimensions[1] = dimensions[2] = kProceduralSize;
+    return true;
+}
+
+std::unique_ptr<VolumeData> DataLoader::loadRegion(const std::string& dataset, int timeStep,
+                                                   const int begin[3], const int size[3], int scale) {
+    std::string path;
+    const Source source = resolve(dataset, timeStep, path);
+    if (source == SOURCE_PROCEDURAL) {
+        return generateProceduralRegion(kProceduralSize, begin, size);
     }
+    const int rate = getCompressRate(dataset, timeStep);
+    BrickCache::Key key{path, timeStep, scale, {begin[0], begin[1], begin[2]}, {size[0], size[1], size[2]}, rate,
+                        sparseParams.enabled};
+    return BrickCache::shared().fetch(key, [&]() -> std::unique_ptr<VolumeData> {
+        std::unique_ptr<VolumeData> block;
+        if (source == SOURCE_RAW) {
+            block = loadRawRegion(path, begin, size, scale);
+        } else if (source == SOURCE_BRICKED) {
+            BrickedVolume* volume = openBricked(path);
+            block = volume ? volume->loadRegion(scale, begin, size) : nullptr;
+        } else if (ZarrLoader* loader = openZarr(path)) {
+            block = loader->loadRegion(timeStep, scale, begin, size);
+        }
+        // Cached packed, so the cache holds more time steps
+        return packBlock(std::move(block), rate);
+    });
+}
+
+std::unique_ptr<VolumeData> DataLoader::packBlock(std::unique_ptr<VolumeData> block, int rate) const {
+    if (!block || !block->data) {
+        return block;
+    }
+    if (sparseParams.enabled) {
+        if (auto sparse = SparseVolume::fromDense(*block, sparseParams)) {
+            return sparse;
+        }
+    }
+    return rate > 0 ? CompressedVolume::compress(*block, rate) : std::move(block);
+}
+
+bool DataLoader::getRawVolume(const std::string& dataset, int timeStep, std::string& path,
+                              RawHeader& header) {
+    return resolve(dataset, timeStep, path) == SOURCE_RAW && readRawHeader(path, header);
+}
+
+int DataLoader::getCompressRate(const std::string& dataset, int timeStep) {
+    if (compressRate >= 0) {
+        return compressRate;
+    }
+    std::string path;
+    int rate = 0;
+    switch (resolve(dataset, timeStep, path)) {
+        case SOURCE_ZARR: {
+            ZarrLoader* loader = openZarr(path);
+            rate = loader ? loader->getCompressRate() : 0;
+            break;
+        }
+        case SOURCE_RAW: {
+            RawHeader header;
+            rate = readRawHeader(path, header) ? header.compressRate : 0;
+            break;
+        }
+        case SOURCE_BRICKED:
+        case SOURCE_PROCEDURAL:
+            break;
+    }
+    return std::min(std::max(rate, 0), CompressedVolume::kMaxRate);
 }
 
 std::unique_ptr<VolumeData> DataLoader::loadZarr(const std::string& path, int timeStep) {
-    // Simplified Zarr loader - would implement full Zarr spec
     LOG_INFO("Loading Zarr dataset from " << path);
-    return generateProceduralVolume(128);
+    ZarrLoader* loader = openZarr(path);
+    if (!loader) {
+        return nullptr;
+    }
+    return loader->loadTimeStep(timeStep);
 }
 
-std::unique_ptr<VolumeData> DataLoader::loadRawVolume(const std::string& filename, 
-                                                      int width, int height, int depth) {
-    std::ifstream file(filename, std::ios::binary);
+bool DataLoader::readRawHeader(const std::string& filename, RawHeader& header) {
+    header.dimensions[0] = header.dimensions[1] = header.dimensions[2] = kRawSize;
+    header.type = VoxelType();
+    header.spacing[0] = header.spacing[1] = header.spacing[2] = 1.0f;
+    header.headerBytes = 0;
+    header.compressRate = 0;
+    
+    std::filesystem::path sidecar = std::filesystem::path(filename).replace_extension(".json");
+    std::ifstream file(sidecar);
     if (!file) {
-        LOG_ERROR("Failed to open volume file: " << filename);
-        return nullptr;
+        return true;
     }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
     
-    auto volume = std::make_unique<VolumeData>();
-    volume->dimensions[0] = width;
-    volume->dimensions[1] = height;
-    volume->dimensions[2] = depth;
-    volume->voxelCount = width * height * depth;
-    
-    volume->data = std::make_unique<float[]>(volume->voxelCount);
-    file.read(reinterpret_cast<char*>(volume->data.get()), 
-             volume->voxelCount * sizeof(float));
-    
+    double values[3];
+    if (json::parseNumbers(text, "dimensions", values, 3) != 3 ||
+        values[0] < 1 || values[1] < 1 || values[2] < 1) {
+        LOG_ERROR("Raw header " << sidecar << ": need \"dimensions\": [x, y, z]");
+        return false;
+    }
+    for (int a = 0; a < 3; ++a) {
+        header.dimensions[a] = static_cast<int>(values[a]);
+    }
+    auto pos = json::findValue(text, "dtype");
+    if (pos != std::string::npos) {
+        std::string name;
+        json::parseString(text, "dtype", name);
+        if (!parseVoxelType(name, header.type)) {
+            LOG_ERROR("Raw header " << sidecar << ": unsupported dtype '" << name << "'");
+            return false;
+        }
+    }
+    if (json::parseNumbers(text, "spacing", values, 3) == 3) {
+        for (int a = 0; a < 3; ++a) {
+            header.spacing[a] = static_cast<float>(values[a]);
+        }
+    }
+    pos = json::findValue(text, "headerBytes");
+    if (pos != std::string::npos) {
+        header.headerBytes = std::strtoull(text.c_str() + pos, nullptr, 10);
+    }
+    pos = json::findValue(text, "compressRate");
+    if (pos != std::string::npos) {
+        header.compressRate = std::atoi(text.c_str() + pos);
+    }
+    return true;
+}
+
+std::shared_ptr<MappedFile> DataLoader::mapRaw(const std::string& filename) {
+    if (rawFile && rawFilePath == filename) {
+        return rawFile;
+    }
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(filename, mapOptions)) {
+        return nullptr;
+    }
+    rawFile = file;
+    rawFilePath = filename;
+    return file;
+}
+
+std::unique_ptr<VolumeData> DataLoader::loadRawRegion(const std::string& filename,
+                                                      const int begin[3], const int size[3], int scale) {
+    RawHeader header;
+    if (!readRawHeader(filename, header)) {
+        return nullptr;
+    }
+    const int* dimensions = header.dimensions;
+    int levelDimensions[3];
+    rawLevelDimensions(dimensions, scale, levelDimensions);
+    if (scale < 0 || !insideDataset(levelDimensions, begin, size)) {
+        LOG_ERROR("Region outside the volume " << filename);
+        return nullptr;
+    }
+    std::shared_ptr<MappedFile> file = mapRaw(filename);
     if (!file) {
-        LOG_ERROR("Failed to read volume data");
         return nullptr;
     }
+    const size_t item = header.type.itemSize;
+    const size_t voxels = static_cast<size_t>(dimensions[0]) * dimensions[1] * dimensions[2];
+    if (file->size() < header.headerBytes + voxels * item) {
+        LOG_ERROR("Volume file " << filename << " is smaller than its header describes");
+        return nullptr;
+    }
+    if (scale > 0) {
+        return subsampleRawRegion(*file, header, begin, size, scale);
+    }
     
+    const size_t rowBytes = dimensions[0] * item;
+    const size_t sliceBytes = rowBytes * dimensions[1];
+    const size_t first = header.headerBytes + begin[2] * sliceBytes + begin[1] * rowBytes + begin[0] * item;
+    // Only this block's rows are read, one span per slice
+    for (int z = 0; z < size[2]; ++z) {
+        file->willNeed(first + z * sliceBytes, (size[1] - 1) * rowBytes + size[0] * item);
+    }
+    
+    std::unique_ptr<VolumeData> volume;
+    if (header.type.isNativeFloat() && header.headerBytes % alignof(float) == 0) {
+        // Use the voxels in place: no copy, and the pages stay shared
+        volume = std::make_unique<VolumeData>();
+        float* voxels = reinterpret_cast<float*>(const_cast<uint8_t*>(file->data() + first));
+        volume->data = std::unique_ptr<float[], VolumeDataDeleter>(voxels, VolumeDataDeleter{file});
+        volume->rowPitch = dimensions[0];
+        volume->slicePitch = static_cast<size_t>(dimensions[0]) * dimensions[1];
+        for (int a = 0; a < 3; ++a) {
+            volume->dimensions[a] = size[a];
+            volume->offset[a] = begin[a];
+            volume->fullDimensions[a] = dimensions[a];
+        }
+        volume->voxelCount = static_cast<size_t>(size[0]) * size[1] * size[2];
+    } else {
+        volume = makeBlock(dimensions, begin, size);
+        struct ConvertJob {
+            const uint8_t* source;
+            size_t rowBytes;
+            size_t sliceBytes;
+            const int* size;
+            VoxelConvertFn convert;
+            size_t item;
+            bool swap;
+            float* out;
+        } job{file->data() + first, rowBytes, sliceBytes, size, voxelConverter(header.type),
+              item, header.type.swapBytes, volume->data.get()};
+        ConvertJob* j = &job;
+        ThreadPool::shared().parallelFor(0, size[2], [j](size_t z0, size_t z1) {
+            for (size_t z = z0; z < z1; ++z) {
+                for (int y = 0; y < j->size[1]; ++y) {
+                    j->convert(j->source + z * j->sliceBytes + y * j->rowBytes, j->item, j->swap,
+                               j->out + (z * j->size[1] + y) * j->size[0], j->size[0]);
+                }
+            }
+        });
+    }
+    for (int a = 0; a < 3; ++a) {
+        volume->spacing[a] = header.spacing[a];
+        volume->origin[a] = begin[a] * header.spacing[a];
+    }
+    return volume;
+}
+
+std::unique_ptr<VolumeData> DataLoader::subsampleRawRegion(const MappedFile& file, const RawHeader& header,
+                                                           const int begin[3], const int size[3], int scale) {
+    // Every 2^scale-th voxel of every 2^scale-th row; a coarse level only
+    // touches the pages of the rows it keeps
+    int levelDimensions[3];
+    rawLevelDimensions(header.dimensions, scale, levelDimensions);
+    auto volume = makeBlock(levelDimensions, begin, size);
+    struct SubsampleJob {
+        const uint8_t* source;
+        size_t item;
+        size_t rowBytes;
+        size_t sliceBytes;
+        const int* begin;
+        const int* size;
+        int scale;
+        VoxelConvertFn convert;
+        bool swap;
+        float* out;
+    } job{file.data() + header.headerBytes, static_cast<size_t>(header.type.itemSize),
+          static_cast<size_t>(header.dimensions[0]) * header.type.itemSize,
+          static_cast<size_t>(header.dimensions[0]) * header.dimensions[1] * header.type.itemSize,
+          begin, size, scale, voxelConverter(header.type), header.type.swapBytes, volume->data.get()};
+    SubsampleJob* j = &job;
+    ThreadPool::shared().parallelFor(0, size[2], [j](size_t z0, size_t z1) {
+        const size_t stride = j->item << j->scale;
+        for (size_t z = z0; z < z1; ++z) {
+            const uint8_t* slice = j->source + (static_cast<size_t>(j->begin[2] + z) << j->scale) * j->sliceBytes;
+            for (int y = 0; y < j->size[1]; ++y) {
+                const uint8_t* row = slice + (static_cast<size_t>(j->begin[1] + y) << j->scale) * j->rowBytes +
+                                     (static_cast<size_t>(j->begin[0]) << j->scale) * j->item;
+                j->convert(row, stride, j->swap, j->out + (z * j->size[1] + y) * j->size[0], j->size[0]);
+            }
+        }
+    });
+    for (int a = 0; a < 3; ++a) {
+        volume->spacing[a] = header.spacing[a] * static_cast<float>(1 << scale);
+        volume->origin[a] = begin[a] * volume->spacing[a];
+    }
     return volume;
 }
 
 std::unique_ptr<VolumeData> DataLoader::generateProceduralVolume(int size) {
-    auto volume = std::make_unique<VolumeData>();
-    volume->dimensions[0] = size;
-    volume->dimensions[1] = size;
-    volume->dimensions[2] = size;
-    volume->voxelCount = size * size * size;
-    
-    volume->data = std::make_unique<float[]>(volume->voxelCount);
+    const int begin[3] = {0, 0, 0};
+    const int regionSize[3] = {size, size, size};
+    return generateProceduralRegion(size, begin, regionSize);
+}
+
+std::unique_ptr<VolumeData> DataLoader::generateProceduralRegion(int size, const int begin[3],
+                                                                 const int regionSize[3]) {
+    const int dimensions[3] = {size, size, size};
+    if (!insideDataset(dimensions, begin, regionSize)) {
+        LOG_ERROR("Region outside the procedural volume");
+        return nullptr;
+    }
+    auto volume = makeBlock(dimensions, begin, regionSize);
     
     // Generate a simple sphere
     float center = size / 2.0f;
     float radius = size / 3.0f;
     
-    for (int z = 0; z < size; ++z) {
-        for (int y = 0; y < size; ++y) {
-            for (int x = 0; x < size; ++x) {
+    size_t idx = 0;
+    for (int z = begin[2]; z < begin[2] + regionSize[2]; ++z) {
+        for (int y = begin[1]; y < begin[1] + regionSize[1]; ++y) {
+            for (int x = begin[0]; x < begin[0] + regionSize[0]; ++x) {
                 float dx = x - center;
                 float dy = y - center;
                 float dz = z - center;
                 float dist = std::sqrt(dx*dx + dy*dy + dz*dz);
                 
-                int idx = x + y * size + z * size * size;
-                volume->data[idx] = std::max(0.0f, 1.0f - dist / radius);
+                volume->data[idx++] = std::max(0.0f, 1.0f - dist / radius);
             }
         }
     }
@@ -92,4 +531,4 @@ std::unique_ptr<VolumeData> DataLoader::generateProceduralVolume(int size) {
     return volume;
 }
 
-} // namespace morviq
\ No newline at end of file
+} // namespace morviq
@@ -0,0 +1,145 @@
+#include "data/MPIVolumeReader.h"
+#include "utils/Logger.h"
+#include <climits>
+
+namespace morviq {
+
+namespace {
+
+std::string errorString(int code) {
+    char text[MPI_MAX_ERROR_STRING];
+    int length = 0;
+    MPI_Error_string(code, text, &length);
+    return std::string(text, length);
+}
+
+} // namespace
+
+MPIVolumeReader::MPIVolumeReader(MPI_Comm communicator)
+    : comm(communicator), file(MPI_FILE_NULL), info(MPI_INFO_NULL), element(MPI_DATATYPE_NULL),
+      headerBytes(0), collective(true), stagingSize(0) {
+    dimensions[0] = dimensions[1] = dimensions[2] = 0;
+}
+
+MPIVolumeReader::~MPIVolumeReader() {
+    close();
+}
+
+bool MPIVolumeReader::open(const std::string& filename, const int dims[3], const VoxelType& voxelType,
+                           size_t offset, const ReadParams& params) {
+    close();
+    path = filename;
+    for (int a = 0; a < 3; ++a) dimensions[a] = dims[a];
+    type = voxelType;
+    headerBytes = static_cast<MPI_Offset>(offset);
+    collective = params.mode != ReadParams::INDEPENDENT;
+    
+    // cb_nodes and cb_buffer_size are reserved MPI hints; romio_cb_read
+    // makes ROMIO use (or skip) two-phase I/O regardless of its heuristics
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "romio_cb_read", collective ? "enable" : "disable");
+    if (params.aggregators > 0) {
+        MPI_Info_set(info, "cb_nodes", std::to_string(params.aggregators).c_str());
+    }
+    if (params.bufferSize > 0) {
+        MPI_Info_set(info, "cb_buffer_size", std::to_string(params.bufferSize).c_str());
+    }
+    
+    int rc = MPI_File_open(comm, filename.c_str(), MPI_MODE_RDONLY, info, &file);
+    if (rc != MPI_SUCCESS) {
+        LOG_ERROR("MPI-IO: cannot open " << filename << ": " << errorString(rc));
+        file = MPI_FILE_NULL;
+        close();
+        return false;
+    }
+    MPI_Type_contiguous(type.itemSize, MPI_BYTE, &element);
+    MPI_Type_commit(&element);
+    return true;
+}
+
+bool MPIVolumeReader::read(const int begin[3], const int size[3], std::unique_ptr<VolumeData>& block) {
+    block.reset();
+    if (file == MPI_FILE_NULL) return false;
+    const bool empty = size[0] <= 0 || size[1] <= 0 || size[2] <= 0;
+    const size_t rows = empty ? 0 : static_cast<size_t>(size[1]) * size[2];
+    if (rows > INT_MAX) {
+        LOG_ERROR("MPI-IO: block too large");
+        return false;
+    }
+    
+    // The view exposes only this block's voxels, in (z, y, x) order
+    MPI_Datatype view = element;
+    MPI_Datatype row = element;
+    if (!empty) {
+        const int sizes[3] = {dimensions[2], dimensions[1], dimensions[0]};
+        const int subsizes[3] = {size[2], size[1], size[0]};
+        const int starts[3] = {begin[2], begin[1], begin[0]};
+        MPI_Type_create_subarray(3, sizes, subsizes, starts, MPI_ORDER_C, element, &view);
+        MPI_Type_commit(&view);
+        // Count in rows keeps large blocks within an int
+        MPI_Type_contiguous(size[0], element, &row);
+        MPI_Type_commit(&row);
+    }
+    int rc = MPI_File_set_view(file, headerBytes, element, view, "native", info);
+    
+    if (!empty) {
+        block = std::make_unique<VolumeData>();
+        for (int a = 0; a < 3; ++a) {
+            block->dimensions[a] = size[a];
+            block->offset[a] = begin[a];
+            block->fullDimensions[a] = dimensions[a];
+            block->origin[a] = static_cast<float>(begin[a]);
+        }
+        block->voxelCount = static_cast<size_t>(size[0]) * size[1] * size[2];
+        block->data.reset(new float[block->voxelCount]);
+    }
+    void* target = nullptr;
+    if (!empty) {
+        if (type.isNativeFloat()) {
+            target = block->data.get();
+        } else {
+            const size_t bytes = block->voxelCount * type.itemSize;
+            if (bytes > stagingSize) {
+                staging.reset(new uint8_t[bytes]);
+                stagingSize = bytes;
+            }
+            target = staging.get();
+        }
+    }
+    
+    MPI_Status status;
+    if (rc == MPI_SUCCESS) {
+        rc = collective ? MPI_File_read_all(file, target, static_cast<int>(rows), row, &status)
+                        : MPI_File_read(file, target, static_cast<int>(rows), row, &status);
+    }
+    if (!empty) {
+        MPI_Type_free(&row);
+        MPI_Type_free(&view);
+    }
+    if (rc != MPI_SUCCESS) {
+        LOG_ERROR("MPI-IO: reading " << path << " failed: " << errorString(rc));
+        block.reset();
+        return false;
+    }
+    if (!empty && !type.isNativeFloat()) {
+        voxelConverter(type)(staging.get(), type.itemSize, type.swapBytes, block->data.get(),
+                             block->voxelCount);
+    }
+    return true;
+}
+
+void MPIVolumeReader::close() {
+    if (file != MPI_FILE_NULL) {
+        MPI_File_close(&file);
+    }
+    if (element != MPI_DATATYPE_NULL) {
+        MPI_Type_free(&element);
+    }
+    if (info != MPI_INFO_NULL) {
+        MPI_Info_free(&info);
+    }
+    staging.reset();
+    stagingSize = 0;
+}
+
+} // namespace morviq
@@ -0,0 +1,74 @@
+#include "data/MappedFile.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace morviq {
+
+MappedFile::MappedFile() : base(nullptr), length(0) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path, const MapOptions& options) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("MappedFile: cannot open " << path << ": " << std::strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size <= 0) {
+        LOG_ERROR("MappedFile: " << path << " is empty or unreadable");
+        ::close(fd);
+        return false;
+    }
+    
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (options.populate) flags |= MAP_POPULATE;
+#endif
+    void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, flags, fd, 0);
+    // The mapping keeps the file referenced
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("MappedFile: mmap of " << path << " failed: " << std::strerror(errno));
+        return false;
+    }
+    base = mapping;
+    length = static_cast<size_t>(info.st_size);
+    
+    // Ray casting touches a brick's pages in view order, not file order, and
+    // a rank reads only its bricks; readahead would pull in other ranks' data
+    madvise(base, length, MADV_RANDOM);
+#ifdef MADV_HUGEPAGE
+    if (options.hugePages && madvise(base, length, MADV_HUGEPAGE) != 0) {
+        LOG_WARN("MappedFile: huge pages unavailable for " << path << ": " << std::strerror(errno));
+    }
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (base) {
+        munmap(base, length);
+        base = nullptr;
+        length = 0;
+    }
+}
+
+void MappedFile::willNeed(size_t offset, size_t bytes) const {
+    if (!base || offset >= length) return;
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / page * page;
+    const size_t end = std::min(offset + bytes, length);
+    madvise(static_cast<uint8_t*>(base) + begin, end - begin, MADV_WILLNEED);
+}
+
+} // namespace morviq
@@ -0,0 +1,293 @@
+#include "data/SparseVolume.h"
+#include "utils/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace morviq {
+
+SparseVolume::SparseVolume(const int dims[3], float background)
+    : backgroundValue(background), backgroundLeaf(kLeafVoxels, background) {
+    for (int a = 0; a < 3; ++a) {
+        dimensions[a] = dims[a];
+        rootSize[a] = ((dims[a] - 1) >> kNodeLog2Voxels) + 1;
+    }
+}
+
+std::shared_ptr<SparseVolume> SparseVolume::build(const VolumeData& block, const SparseParams& params) {
+    if (!block.data) return nullptr;
+    const int* dims = block.dimensions;
+    const int tiles[3] = {(dims[0] + kLeafSize - 1) >> kLeafLog2, (dims[1] + kLeafSize - 1) >> kLeafLog2,
+                          (dims[2] + kLeafSize - 1) >> kLeafLog2};
+    const size_t tileCount = static_cast<size_t>(tiles[0]) * tiles[1] * tiles[2];
+    const size_t stride = block.rowStride();
+    const size_t slice = block.sliceStride();
+    const float* data = block.data.get();
+    const float background = params.background;
+    const float tolerance = params.tolerance;
+    auto active = [&](float value) { return std::isfinite(value) && std::fabs(value - background) > tolerance; };
+    auto tileIndex = [&](int kx, int ky, int kz) {
+        return (static_cast<size_t>(kz) * tiles[1] + ky) * tiles[0] + kx;
+    };
+
+    // Tiles holding an active voxel become leaves
+    std::vector<uint8_t> tileActive(tileCount, 0);
+    ThreadPool::shared().parallelFor(0, tileCount, [&](size_t first, size_t end) {
+        for (size_t t = first; t < end; ++t) {
+            const int kx = static_cast<int>(t % tiles[0]);
+            const int ky = static_cast<int>(t / tiles[0] % tiles[1]);
+            const int kz = static_cast<int>(t / tiles[0] / tiles[1]);
+            const int x1 = std::min(dims[0], (kx + 1) * kLeafSize);
+            const int y1 = std::min(dims[1], (ky + 1) * kLeafSize);
+            const int z1 = std::min(dims[2], (kz + 1) * kLeafSize);
+            bool any = false;
+            for (int z = kz * kLeafSize; z < z1 && !any; ++z) {
+                for (int y = ky * kLeafSize; y < y1 && !any; ++y) {
+                    const float* row = data + y * stride + z * slice;
+                    for (int x = kx * kLeafSize; x < x1; ++x) {
+                        if (active(row[x])) {
+                            any = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            tileActive[t] = any;
+        }
+    }, 64);
+
+    std::shared_ptr<SparseVolume> volume(new SparseVolume(dims, background));
+    const size_t leafCount = static_cast<size_t>(std::count(tileActive.begin(), tileActive.end(), 1));
+    const size_t rootCount = static_cast<size_t>(volume->rootSize[0]) * volume->rootSize[1] * volume->rootSize[2];
+    const size_t estimate = leafCount * sizeof(Leaf) + rootCount * (sizeof(Node) + sizeof(int32_t));
+    if (estimate > kMaxDenseFraction * block.voxelCount * sizeof(float)) {
+        return nullptr;
+    }
+
+    // A sample in tile k reads voxels up to the first of tile k + 1
+    auto sampleActive = [&](int kx, int ky, int kz) {
+        for (int dz = 0; dz < 2; ++dz) {
+            for (int dy = 0; dy < 2; ++dy) {
+                for (int dx = 0; dx < 2; ++dx) {
+                    if (kx + dx < tiles[0] && ky + dy < tiles[1] && kz + dz < tiles[2] &&
+                        tileActive[tileIndex(kx + dx, ky + dy, kz + dz)]) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    };
+
+    // Nodes in root order, their leaves in tile bit order
+    const int nodeTiles = 1 << kNodeLog2;
+    std::vector<size_t> leafTiles;
+    leafTiles.reserve(leafCount);
+    volume->root.assign(rootCount, -1);
+    for (int rz = 0; rz < volume->rootSize[2]; ++rz) {
+        for (int ry = 0; ry < volume->rootSize[1]; ++ry) {
+            for (int rx = 0; rx < volume->rootSize[0]; ++rx) {
+                Node node = {};
+                bool used = false;
+                node.firstLeaf = static_cast<uint32_t>(leafTiles.size());
+                for (int bit = 0; bit < kNodeTiles; ++bit) {
+                    const int kx = rx * nodeTiles + (bit & (nodeTiles - 1));
+                    const int ky = ry * nodeTiles + ((bit >> kNodeLog2) & (nodeTiles - 1));
+                    const int kz = rz * nodeTiles + (bit >> (2 * kNodeLog2));
+                    if (kx >= tiles[0] || ky >= tiles[1] || kz >= tiles[2]) continue;
+                    const uint64_t flag = uint64_t(1) << (bit & 63);
+                    if (sampleActive(kx, ky, kz)) {
+                        node.sampleMask[bit >> 6] |= flag;
+                        used = true;
+                    }
+                    if (tileActive[tileIndex(kx, ky, kz)]) {
+                        node.childMask[bit >> 6] |= flag;
+                        leafTiles.push_back(tileIndex(kx, ky, kz));
+                    }
+                }
+                if (!used) continue;
+                uint32_t count = 0;
+                for (int w = 0; w < kNodeWords; ++w) {
+                    node.prefix[w] = count;
+                    count += static_cast<uint32_t>(__builtin_popcountll(node.childMask[w]));
+                }
+                volume->root[(static_cast<size_t>(rz) * volume->rootSize[1] + ry) * volume->rootSize[0] + rx] =
+                    static_cast<int32_t>(volume->nodes.size());
+                volume->nodes.push_back(node);
+            }
+        }
+    }
+
+    // Leaves keep every voxel of their tile, active or not, so sampling
+    // them matches the dense block
+    volume->leaves.resize(leafTiles.size());
+    ThreadPool::shared().parallelFor(0, leafTiles.size(), [&](size_t first, size_t end) {
+        for (size_t l = first; l < end; ++l) {
+            const size_t t = leafTiles[l];
+            const int kx = static_cast<int>(t % tiles[0]);
+            const int ky = static_cast<int>(t / tiles[0] % tiles[1]);
+            const int kz = static_cast<int>(t / tiles[0] / tiles[1]);
+            Leaf& leaf = volume->leaves[l];
+            std::fill(leaf.activeMask, leaf.activeMask + kLeafVoxels / 64, 0);
+            for (int i = 0; i < kLeafVoxels; ++i) {
+                const int x = kx * kLeafSize + (i & (kLeafSize - 1));
+                const int y = ky * kLeafSize + ((i >> kLeafLog2) & (kLeafSize - 1));
+                const int z = kz * kLeafSize + (i >> (2 * kLeafLog2));
+                float value = background;
+                if (x < dims[0] && y < dims[1] && z < dims[2]) {
+                    value = data[x + y * stride + z * slice];
+                    if (!std::isfinite(value)) value = background;
+                }
+                leaf.values[i] = value;
+                if (active(value)) {
+                    leaf.activeMask[i >> 6] |= uint64_t(1) << (i & 63);
+                }
+            }
+        }
+    }, 16);
+    return volume;
+}
+
+std::unique_ptr<VolumeData> SparseVolume::fromDense(const VolumeData& block, const SparseParams& params) {
+    auto volume = build(block, params);
+    if (!volume) return nullptr;
+    auto out = std::make_unique<VolumeData>();
+    std::copy(block.dimensions, block.dimensions + 3, out->dimensions);
+    std::copy(block.spacing, block.spacing + 3, out->spacing);
+    std::copy(block.origin, block.origin + 3, out->origin);
+    std::copy(block.offset, block.offset + 3, out->offset);
+    std::copy(block.fullDimensions, block.fullDimensions + 3, out->fullDimensions);
+    out->voxelCount = block.voxelCount;
+    out->storage = std::move(volume);
+    return out;
+}
+
+const float* SparseVolume::leafValues(int x, int y, int z) const {
+    const int32_t index = root[(static_cast<size_t>(z >> kNodeLog2Voxels) * rootSize[1] + (y >> kNodeLog2Voxels)) *
+                                   rootSize[0] + (x >> kNodeLog2Voxels)];
+    if (index < 0) return backgroundLeaf.data();
+    const Node& node = nodes[index];
+    const int mask = (1 << kNodeLog2) - 1;
+    const int bit = ((x >> kLeafLog2) & mask) | (((y >> kLeafLog2) & mask) << kNodeLog2) |
+                    (((z >> kLeafLog2) & mask) << (2 * kNodeLog2));
+    const uint64_t word = node.childMask[bit >> 6];
+    if (!((word >> (bit & 63)) & 1u)) return backgroundLeaf.data();
+    const uint64_t below = word & ((uint64_t(1) << (bit & 63)) - 1);
+    return leaves[node.firstLeaf + node.prefix[bit >> 6] + __builtin_popcountll(below)].values;
+}
+
+float SparseVolume::value(int x, int y, int z) const {
+    const int mask = kLeafSize - 1;
+    return leafValues(x, y, z)[(x & mask) + ((y & mask) << kLeafLog2) + ((z & mask) << (2 * kLeafLog2))];
+}
+
+float SparseVolume::sample(float x, float y, float z) const {
+    const int x0 = static_cast<int>(x);
+    const int y0 = static_cast<int>(y);
+    const int z0 = static_cast<int>(z);
+    const int x1 = std::min(x0 + 1, dimensions[0] - 1);
+    const int y1 = std::min(y0 + 1, dimensions[1] - 1);
+    const int z1 = std::min(z0 + 1, dimensions[2] - 1);
+    const float fx = x - x0;
+    const float fy = y - y0;
+    const float fz = z - z0;
+
+    // The corners span one to eight tiles; each distinct tile is looked up once
+    const int px[2] = {x0, x1};
+    const int py[2] = {y0, y1};
+    const int pz[2] = {z0, z1};
+    const bool splitX = (x0 >> kLeafLog2) != (x1 >> kLeafLog2);
+    const bool splitY = (y0 >> kLeafLog2) != (y1 >> kLeafLog2);
+    const bool splitZ = (z0 >> kLeafLog2) != (z1 >> kLeafLog2);
+    const float* c[8];
+    for (int k = 0; k < 8; ++k) {
+        const int i = k & 1, j = (k >> 1) & 1, l = k >> 2;
+        if (i && !splitX) {
+            c[k] = c[k - 1];
+        } else if (j && !splitY) {
+            c[k] = c[k - 2];
+        } else if (l && !splitZ) {
+            c[k] = c[k - 4];
+        } else {
+            c[k] = leafValues(px[i], py[j], pz[l]);
+        }
+    }
+    const int mask = kLeafSize - 1;
+    const int ix[2] = {x0 & mask, x1 & mask};
+    const int iy[2] = {(y0 & mask) << kLeafLog2, (y1 & mask) << kLeafLog2};
+    const int iz[2] = {(z0 & mask) << (2 * kLeafLog2), (z1 & mask) << (2 * kLeafLog2)};
+    const float v000 = c[0][ix[0] + iy[0] + iz[0]];
+    const float v100 = c[1][ix[1] + iy[0] + iz[0]];
+    const float v010 = c[2][ix[0] + iy[1] + iz[0]];
+    const float v110 = c[3][ix[1] + iy[1] + iz[0]];
+    const float v001 = c[4][ix[0] + iy[0] + iz[1]];
+    const float v101 = c[5][ix[1] + iy[0] + iz[1]];
+    const float v011 = c[6][ix[0] + iy[1] + iz[1]];
+    const float v111 = c[7][ix[1] + iy[1] + iz[1]];
+
+    const float v00 = v000 * (1 - fx) + v100 * fx;
+    const float v01 = v001 * (1 - fx) + v101 * fx;
+    const float v10 = v010 * (1 - fx) + v110 * fx;
+    const float v11 = v011 * (1 - fx) + v111 * fx;
+    const float v0 = v00 * (1 - fy) + v10 * fy;
+    const float v1 = v01 * (1 - fy) + v11 * fy;
+    return v0 * (1 - fz) + v1 * fz;
+}
+
+float SparseVolume::emptyLength(const float p[3], const float d[3]) const {
+    const float largest = std::max({std::fabs(d[0]), std::fabs(d[1]), std::fabs(d[2])});
+    if (largest == 0.0f) return 0.0f;
+    // Steps just past a face into the next box
+    const float nudge = 1e-3f / largest;
+    float t = 0.0f;
+    // Walks from empty box to empty box: a missing node is a 128^3 box, a
+    // tile without samples of its own an 8^3 box
+    for (int step = 0; step < 256; ++step) {
+        const float probe = step == 0 ? 0.0f : t + nudge;
+        int voxel[3];
+        for (int a = 0; a < 3; ++a) {
+            const float q = p[a] + d[a] * probe;
+            if (!(q >= 0.0f && q < dimensions[a])) return t;
+            voxel[a] = static_cast<int>(q);
+        }
+        const int32_t index = root[(static_cast<size_t>(voxel[2] >> kNodeLog2Voxels) * rootSize[1] +
+                                    (voxel[1] >> kNodeLog2Voxels)) * rootSize[0] + (voxel[0] >> kNodeLog2Voxels)];
+        int log2Size = kNodeLog2Voxels;
+        if (index >= 0) {
+            const Node& node = nodes[index];
+            const int mask = (1 << kNodeLog2) - 1;
+            const int bit = ((voxel[0] >> kLeafLog2) & mask) | (((voxel[1] >> kLeafLog2) & mask) << kNodeLog2) |
+                            (((voxel[2] >> kLeafLog2) & mask) << (2 * kNodeLog2));
+            if ((node.sampleMask[bit >> 6] >> (bit & 63)) & 1u) return t;
+            log2Size = kLeafLog2;
+        }
+        float exit = std::numeric_limits<float>::max();
+        for (int a = 0; a < 3; ++a) {
+            if (d[a] == 0.0f) continue;
+            const int low = (voxel[a] >> log2Size) << log2Size;
+            const float face = d[a] > 0.0f ? static_cast<float>(low + (1 << log2Size)) : static_cast<float>(low);
+            exit = std::min(exit, (face - p[a]) / d[a]);
+        }
+        t = std::max(exit, probe);
+    }
+    return t;
+}
+
+size_t SparseVolume::bytes() const {
+    return root.size() * sizeof(int32_t) + nodes.size() * sizeof(Node) + leaves.size() * sizeof(Leaf) +
+           backgroundLeaf.size() * sizeof(float);
+}
+
+SparseVolume::Stats SparseVolume::getStats() const {
+    Stats stats;
+    stats.nodes = nodes.size();
+    stats.leaves = leaves.size();
+    for (const Leaf& leaf : leaves) {
+        for (uint64_t word : leaf.activeMask) {
+            stats.activeVoxels += static_cast<size_t>(__builtin_popcountll(word));
+        }
+    }
+    return stats;
+}
+
+} // namespace morviq
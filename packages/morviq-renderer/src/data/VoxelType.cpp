@@ -0,0 +1,86 @@
+#include "data/VoxelType.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace morviq {
+
+namespace {
+
+template <typename U>
+U byteSwap(U v) {
+    if constexpr (sizeof(U) == 2) return __builtin_bswap16(v);
+    else if constexpr (sizeof(U) == 4) return __builtin_bswap32(v);
+    else return __builtin_bswap64(v);
+}
+
+template <typename T, typename U>
+void convertRun(const uint8_t* src, size_t stride, bool swap, float* dst, size_t count) {
+    static_assert(sizeof(T) == sizeof(U), "storage type must match");
+    if (!swap && stride == sizeof(T)) {
+        for (size_t i = 0; i < count; ++i) {
+            T v;
+            std::memcpy(&v, src + i * sizeof(T), sizeof(T));
+            dst[i] = static_cast<float>(v);
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        U bits;
+        std::memcpy(&bits, src + i * stride, sizeof(U));
+        if (swap) bits = byteSwap(bits);
+        T v;
+        std::memcpy(&v, &bits, sizeof(T));
+        dst[i] = static_cast<float>(v);
+    }
+}
+
+template <typename T>
+void convertBytes(const uint8_t* src, size_t stride, bool, float* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = static_cast<float>(static_cast<T>(src[i * stride]));
+    }
+}
+
+} // namespace
+
+bool parseVoxelType(const std::string& name, VoxelType& type) {
+    if (name.size() < 3 || (name[0] != '<' && name[0] != '>' && name[0] != '|' && name[0] != '=')) {
+        return false;
+    }
+    VoxelType parsed;
+    parsed.name = name;
+    parsed.kind = name[1];
+    parsed.itemSize = std::atoi(name.c_str() + 2);
+    const bool bigEndianHost = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+    const bool bigEndianData = name[0] == '>' || (name[0] == '=' && bigEndianHost);
+    parsed.swapBytes = parsed.itemSize > 1 && name[0] != '|' && bigEndianData != bigEndianHost;
+    if (!voxelConverter(parsed)) {
+        return false;
+    }
+    type = parsed;
+    return true;
+}
+
+VoxelConvertFn voxelConverter(const VoxelType& type) {
+    switch (type.kind) {
+        case 'f':
+            if (type.itemSize == 4) return convertRun<float, uint32_t>;
+            if (type.itemSize == 8) return convertRun<double, uint64_t>;
+            break;
+        case 'i':
+            if (type.itemSize == 1) return convertBytes<int8_t>;
+            if (type.itemSize == 2) return convertRun<int16_t, uint16_t>;
+            if (type.itemSize == 4) return convertRun<int32_t, uint32_t>;
+            if (type.itemSize == 8) return convertRun<int64_t, uint64_t>;
+            break;
+        case 'u':
+            if (type.itemSize == 1) return convertBytes<uint8_t>;
+            if (type.itemSize == 2) return convertRun<uint16_t, uint16_t>;
+            if (type.itemSize == 4) return convertRun<uint32_t, uint32_t>;
+            if (type.itemSize == 8) return convertRun<uint64_t, uint64_t>;
+            break;
+    }
+    return nullptr;
+}
+
+} // namespace morviq
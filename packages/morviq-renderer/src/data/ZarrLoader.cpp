@@ -1,127 +1,404 @@
 #include "data/ZarrLoader.h"
+#include "data/JsonScan.h"
+#include "data/VoxelType.h"
 #include "utils/Logger.h"
+#include "utils/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <filesystem>
+#include <limits>
+#include <zlib.h>
 
 namespace morviq {
 
-ZarrLoader::ZarrLoader() {}
+namespace {
+
+using json::findValue;
+using json::parseIntArray;
+using json::parseString;
+
+bool readFile(const std::string& path, std::vector<uint8_t>& out, bool& missing) {
+    missing = false;
+    FILE* fp = std::fopen(path.c_str(), "rb");
+    if (!fp) {
+        missing = errno == ENOENT;
+        return false;
+    }
+    bool ok = std::fseek(fp, 0, SEEK_END) == 0;
+    long size = ok ? std::ftell(fp) : -1;
+    ok = ok && size >= 0 && std::fseek(fp, 0, SEEK_SET) == 0;
+    if (ok) {
+        out.resize(static_cast<size_t>(size));
+        ok = std::fread(out.data(), 1, out.size(), fp) == out.size();
+    }
+    std::fclose(fp);
+    return ok;
+}
+
+bool inflateChunk(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+    z_stream zs{};
+    // 15 + 32: accept zlib and gzip streams
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) return false;
+    zs.next_in = const_cast<Bytef*>(in.data());
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = out.data();
+    zs.avail_out = static_cast<uInt>(out.size());
+    int ret = inflate(&zs, Z_FINISH);
+    const bool ok = ret == Z_STREAM_END && zs.total_out == out.size();
+    inflateEnd(&zs);
+    return ok;
+}
+
+} // namespace
+
+ZarrLoader::ZarrLoader() : compressRate(0) {}
 
 ZarrLoader::~ZarrLoader() {}
 
 bool ZarrLoader::open(const std::string& path) {
     zarrPath = path;
-    
-    // Read .zarray metadata
-    std::filesystem::path metaPath = std::filesystem::path(path) / ".zarray";
-    if (!std::filesystem::exists(metaPath)) {
-        LOG_ERROR("Zarr metadata not found: " << metaPath);
+    levels.clear();
+
+    const std::filesystem::path root(path);
+    if (std::filesystem::exists(root / ".zarray")) {
+        Array array;
+        if (!parseArray(path, array)) return false;
+        levels.push_back(std::move(array));
+    } else if (std::filesystem::exists(root / ".zgroup")) {
+        // Multiscale group: levels "0", "1", ... from full resolution down
+        for (int level = 0; std::filesystem::exists(root / std::to_string(level) / ".zarray"); ++level) {
+            Array array;
+            if (!parseArray((root / std::to_string(level)).string(), array)) return false;
+            levels.push_back(std::move(array));
+        }
+    }
+    if (levels.empty()) {
+        LOG_ERROR("Zarr metadata not found: " << path);
         return false;
     }
-    
-    // Parse JSON metadata (simplified - would use proper JSON parser)
+
+    shape = levels[0].shape;
+    chunks = levels[0].chunks;
+    dtype = levels[0].type.name;
+
+    compressRate = 0;
+    std::ifstream attrsFile(root / ".zattrs");
+    if (attrsFile) {
+        std::string attrs((std::istreambuf_iterator<char>(attrsFile)), std::istreambuf_iterator<char>());
+        auto pos = findValue(attrs, "compressRate");
+        if (pos != std::string::npos) {
+            compressRate = std::atoi(attrs.c_str() + pos);
+        }
+    }
+    return true;
+}
+
+bool ZarrLoader::parseArray(const std::string& path, Array& array) {
+    std::filesystem::path metaPath = std::filesystem::path(path) / ".zarray";
     std::ifstream metaFile(metaPath);
     if (!metaFile) {
-        LOG_ERROR("Failed to open Zarr metadata");
+        LOG_ERROR("Failed to open Zarr metadata " << metaPath);
         return false;
     }
     std::string json((std::istreambuf_iterator<char>(metaFile)), std::istreambuf_iterator<char>());
-    
-    auto parseArray = [&](const std::string& key, std::vector<int>& out, int expect=3) {
-        out.clear();
-        auto pos = json.find("\"" + key + "\"");
-        if (pos == std::string::npos) return false;
-        pos = json.find('[', pos);
-        if (pos == std::string::npos) return false;
-        auto end = json.find(']', pos);
-        if (end == std::string::npos) return false;
-        std::string arr = json.substr(pos + 1, end - pos - 1);
-        size_t i = 0;
-        while (i < arr.size()) {
-            while (i < arr.size() && (arr[i] == ' ' || arr[i] == ',')) ++i;
-            size_t j = i;
-            while (j < arr.size() && (arr[j] == '-' || (arr[j] >= '0' && arr[j] <= '9'))) ++j;
-            if (j > i) {
-                out.push_back(std::stoi(arr.substr(i, j - i)));
-                i = j;
-            } else {
+    array.path = path;
+
+    auto pos = findValue(json, "zarr_format");
+    if (pos != std::string::npos && std::atoi(json.c_str() + pos) != 2) {
+        LOG_ERROR("Zarr " << path << ": only zarr_format 2 is supported");
+        return false;
+    }
+
+    if (!parseIntArray(json, "shape", array.shape) || !parseIntArray(json, "chunks", array.chunks) ||
+        array.shape.size() != array.chunks.size() || array.shape.size() < 3 || array.shape.size() > 4) {
+        LOG_ERROR("Zarr " << path << ": need 3D (z, y, x) or 4D (t, z, y, x) shape and chunks");
+        return false;
+    }
+    for (size_t i = 0; i < array.shape.size(); ++i) {
+        if (array.shape[i] <= 0 || array.chunks[i] <= 0) {
+            LOG_ERROR("Zarr " << path << ": empty shape or chunks");
+            return false;
+        }
+    }
+
+    std::string dtypeName;
+    if (!parseString(json, "dtype", dtypeName) || !parseVoxelType(dtypeName, array.type)) {
+        LOG_ERROR("Zarr " << path << ": missing, structured or unsupported dtype " << dtypeName);
+        return false;
+    }
+
+    std::string order = "C";
+    parseString(json, "order", order);
+    array.fortranOrder = order == "F";
+
+    std::string separator = ".";
+    parseString(json, "dimension_separator", separator);
+    array.separator = separator == "/" ? '/' : '.';
+
+    array.fillValue = 0.0f;
+    pos = findValue(json, "fill_value");
+    if (pos != std::string::npos) {
+        if (json.compare(pos, 5, "\"NaN\"") == 0) {
+            array.fillValue = std::numeric_limits<float>::quiet_NaN();
+        } else if (json.compare(pos, 10, "\"Infinity\"") == 0) {
+            array.fillValue = std::numeric_limits<float>::infinity();
+        } else if (json.compare(pos, 11, "\"-Infinity\"") == 0) {
+            array.fillValue = -std::numeric_limits<float>::infinity();
+        } else if (json.compare(pos, 4, "null") != 0) {
+            array.fillValue = std::strtof(json.c_str() + pos, nullptr);
+        }
+    }
+
+    pos = findValue(json, "filters");
+    if (pos != std::string::npos && json.compare(pos, 4, "null") != 0 &&
+        json.find_first_not_of(" \t\r\n", pos + 1) != json.find(']', pos)) {
+        LOG_ERROR("Zarr " << path << ": filters are not supported");
+        return false;
+    }
+
+    array.codec = CODEC_RAW;
+    pos = findValue(json, "compressor");
+    if (pos != std::string::npos && json.compare(pos, 4, "null") != 0) {
+        std::string id;
+        parseString(json, "id", id, pos);
+        if (id == "zlib" || id == "gzip") {
+            array.codec = CODEC_ZLIB;
+        } else {
+            LOG_ERROR("Zarr " << path << ": unsupported compressor '" << id << "' (zlib, gzip or null)");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ZarrLoader::readRegion(const Array& array, int t, const int begin[3], const int size[3],
+                            float* out) const {
+    const int dims = static_cast<int>(array.shape.size());
+    const int spatial = dims - 3;
+    // Spatial axes in x, y, z order
+    int chunk[3];
+    for (int a = 0; a < 3; ++a) chunk[a] = array.chunks[dims - 1 - a];
+
+    // Element strides inside a decoded chunk, per .zarray axis
+    std::vector<size_t> strides(dims);
+    size_t chunkElements = 1;
+    if (array.fortranOrder) {
+        for (int i = 0; i < dims; ++i) {
+            strides[i] = chunkElements;
+            chunkElements *= array.chunks[i];
+        }
+    } else {
+        for (int i = dims - 1; i >= 0; --i) {
+            strides[i] = chunkElements;
+            chunkElements *= array.chunks[i];
+        }
+    }
+    const size_t chunkBytes = chunkElements * array.type.itemSize;
+
+    int first[3];
+    int last[3];
+    for (int a = 0; a < 3; ++a) {
+        first[a] = begin[a] / chunk[a];
+        last[a] = (begin[a] + size[a] - 1) / chunk[a];
+    }
+    const size_t countX = last[0] - first[0] + 1;
+    const size_t countY = last[1] - first[1] + 1;
+    const size_t chunkCount = countX * countY * (last[2] - first[2] + 1);
+
+    std::string prefix = array.path + "/";
+    size_t timeOffset = 0;
+    if (spatial == 1) {
+        prefix += std::to_string(t / array.chunks[0]) + array.separator;
+        timeOffset = (t % array.chunks[0]) * strides[0];
+    }
+
+    struct ChunkJob {
+        const Array* array;
+        const std::string* prefix;
+        const int* begin;
+        const int* size;
+        const int* first;
+        const int* chunk;
+        const size_t* strides; // x, y, z
+        size_t countX, countY, chunkCount, chunkBytes, timeOffset;
+        VoxelConvertFn convert;
+        float* out;
+        std::atomic<size_t> next;
+        std::atomic<bool> failed;
+    } job;
+    const size_t axisStrides[3] = {strides[dims - 1], strides[dims - 2], strides[dims - 3]};
+    job.array = &array;
+    job.prefix = &prefix;
+    job.begin = begin;
+    job.size = size;
+    job.first = first;
+    job.chunk = chunk;
+    job.strides = axisStrides;
+    job.countX = countX;
+    job.countY = countY;
+    job.chunkCount = chunkCount;
+    job.chunkBytes = chunkBytes;
+    job.timeOffset = timeOffset;
+    job.convert = voxelConverter(array.type);
+    job.out = out;
+    job.next = 0;
+    job.failed = false;
+    ChunkJob* j = &job;
+
+    // One range per thread, each pulling chunks until none are left, so a
+    // mix of missing and compressed chunks still balances
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(0, std::min(pool.size() + 1, chunkCount), [j](size_t, size_t) {
+        std::vector<uint8_t> stored;
+        std::vector<uint8_t> decoded;
+        const Array& a = *j->array;
+        for (size_t index = j->next++; index < j->chunkCount && !j->failed; index = j->next++) {
+            int c[3] = {j->first[0] + static_cast<int>(index % j->countX),
+                        j->first[1] + static_cast<int>(index / j->countX % j->countY),
+                        j->first[2] + static_cast<int>(index / (j->countX * j->countY))};
+            // Overlap of the chunk with the region, in voxels
+            int lo[3];
+            int hi[3];
+            for (int k = 0; k < 3; ++k) {
+                lo[k] = std::max(j->begin[k], c[k] * j->chunk[k]);
+                hi[k] = std::min(j->begin[k] + j->size[k], (c[k] + 1) * j->chunk[k]);
+            }
+            const size_t rowLength = hi[0] - lo[0];
+            auto destination = [&](int y, int z) {
+                return j->out + (static_cast<size_t>(z - j->begin[2]) * j->size[1] + (y - j->begin[1])) *
+                       j->size[0] + (lo[0] - j->begin[0]);
+            };
+
+            const std::string key = *j->prefix + std::to_string(c[2]) + a.separator +
+                                    std::to_string(c[1]) + a.separator + std::to_string(c[0]);
+            bool missing = false;
+            if (!readFile(key, stored, missing)) {
+                if (!missing) {
+                    LOG_ERROR("Zarr: cannot read chunk " << key);
+                    j->failed = true;
+                    break;
+                }
+                for (int z = lo[2]; z < hi[2]; ++z) {
+                    for (int y = lo[1]; y < hi[1]; ++y) {
+                        std::fill_n(destination(y, z), rowLength, a.fillValue);
+                    }
+                }
+                continue;
+            }
+
+            const uint8_t* data = stored.data();
+            if (a.codec == CODEC_ZLIB) {
+                decoded.resize(j->chunkBytes);
+                if (!inflateChunk(stored, decoded)) {
+                    LOG_ERROR("Zarr: corrupt or truncated chunk " << key);
+                    j->failed = true;
+                    break;
+                }
+                data = decoded.data();
+            } else if (stored.size() != j->chunkBytes) {
+                LOG_ERROR("Zarr: chunk " << key << " has " << stored.size() << " bytes, expected "
+                          << j->chunkBytes);
+                j->failed = true;
                 break;
             }
+
+            const size_t item = a.type.itemSize;
+            for (int z = lo[2]; z < hi[2]; ++z) {
+                for (int y = lo[1]; y < hi[1]; ++y) {
+                    const size_t element = j->timeOffset +
+                        (z - c[2] * j->chunk[2]) * j->strides[2] +
+                        (y - c[1] * j->chunk[1]) * j->strides[1] +
+                        (lo[0] - c[0] * j->chunk[0]) * j->strides[0];
+                    j->convert(data + element * item, j->strides[0] * item, a.type.swapBytes,
+                               destination(y, z), rowLength);
+                }
+            }
         }
-        if (expect > 0 && static_cast<int>(out.size()) != expect) {
-            LOG_WARN("Zarr metadata: key '" << key << "' expected " << expect << " elems, got " << out.size());
+    });
+    return !job.failed;
+}
+
+std::unique_ptr<VolumeData> ZarrLoader::loadRegion(int t, int scale, const int begin[3], const int size[3]) {
+    if (scale < 0 || scale >= static_cast<int>(levels.size())) {
+        LOG_ERROR("Zarr: no scale level " << scale << " in " << zarrPath);
+        return nullptr;
+    }
+    const Array& array = levels[scale];
+    const int dims = static_cast<int>(array.shape.size());
+    if (dims == 4 && (t < 0 || t >= array.shape[0])) {
+        LOG_ERROR("Zarr: time step " << t << " out of range [0, " << array.shape[0] << ")");
+        return nullptr;
+    }
+    for (int a = 0; a < 3; ++a) {
+        if (size[a] <= 0 || begin[a] < 0 || begin[a] + size[a] > array.shape[dims - 1 - a]) {
+            LOG_ERROR("Zarr: region outside the array");
+            return nullptr;
         }
-        return !out.empty();
-    };
-    
-    auto parseString = [&](const std::string& key, std::string& out) {
-        auto pos = json.find("\"" + key + "\"");
-        if (pos == std::string::npos) return false;
-        pos = json.find(':', pos);
-        if (pos == std::string::npos) return false;
-        pos = json.find('"', pos);
-        if (pos == std::string::npos) return false;
-        auto end = json.find('"', pos + 1);
-        if (end == std::string::npos) return false;
-        out = json.substr(pos + 1, end - pos - 1);
-        return true;
-    };
-    
-    if (!parseArray("shape", shape)) shape = {128,128,128};
-    if (!parseArray("chunks", chunks)) chunks = {64,64,64};
-    if (!parseString("dtype", dtype)) dtype = "<f4";
-    
-    return true;
+    }
+
+    auto volume = std::make_unique<VolumeData>();
+    for (int a = 0; a < 3; ++a) {
+        volume->dimensions[a] = size[a];
+        volume->offset[a] = begin[a];
+        volume->fullDimensions[a] = array.shape[dims - 1 - a];
+        volume->origin[a] = static_cast<float>(begin[a]);
+    }
+    volume->voxelCount = static_cast<size_t>(size[0]) * size[1] * size[2];
+    // Left uninitialized: every voxel is written by the chunk workers, which
+    // also first-touch the pages
+    volume->data.reset(new float[volume->voxelCount]);
+
+    if (!readRegion(array, t, begin, size, volume->data.get())) {
+        return nullptr;
+    }
+    return volume;
 }
 
 std::unique_ptr<VolumeData> ZarrLoader::loadTimeStep(int t, int scale) {
-    std::filesystem::path dataPath = zarrPath;
-    dataPath = dataPath / std::to_string(t) / std::to_string(scale);
-    
-    if (!std::filesystem::exists(dataPath)) {
-        LOG_ERROR("Zarr time step not found: " << dataPath);
+    if (scale < 0 || scale >= static_cast<int>(levels.size())) {
+        LOG_ERROR("Zarr: no scale level " << scale << " in " << zarrPath);
         return nullptr;
     }
-    
-    auto volume = std::make_unique<VolumeData>();
-    volume->dimensions[0] = shape[0] >> scale;
-    volume->dimensions[1] = shape[1] >> scale;
-    volume->dimensions[2] = shape[2] >> scale;
-    volume->voxelCount = volume->dimensions[0] * volume->dimensions[1] * volume->dimensions[2];
-    
-    volume->data = std::make_unique<float[]>(volume->voxelCount);
-    
-    // Load chunks (simplified - would implement proper chunked loading)
-    // For now, return procedural data
-    for (size_t i = 0; i < volume->voxelCount; ++i) {
-        volume->data[i] = static_cast<float>(i) / volume->voxelCount;
-    }
-    
+    const std::vector<int>& levelShape = levels[scale].shape;
+    const int dims = static_cast<int>(levelShape.size());
+    const int begin[3] = {0, 0, 0};
+    const int size[3] = {levelShape[dims - 1], levelShape[dims - 2], levelShape[dims - 3]};
+
+    auto start = std::chrono::steady_clock::now();
+    auto volume = loadRegion(t, scale, begin, size);
+    if (volume) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("Zarr: loaded " << size[0] << "x" << size[1] << "x" << size[2] << " (t=" << t
+                 << ", scale " << scale << ") in " << seconds << " s");
+    }
     return volume;
 }
 
-std::unique_ptr<VolumeData> ZarrLoader::loadBrick(int t, int scale, 
+std::unique_ptr<VolumeData> ZarrLoader::loadBrick(int t, int scale,
                                                   int brickX, int brickY, int brickZ) {
-    // Load specific brick from Zarr chunks
-    auto volume = std::make_unique<VolumeData>();
-    
-    volume->dimensions[0] = chunks[0];
-    volume->dimensions[1] = chunks[1];
-    volume->dimensions[2] = chunks[2];
-    volume->voxelCount = chunks[0] * chunks[1] * chunks[2];
-    
-    volume->origin[0] = brickX * chunks[0];
-    volume->origin[1] = brickY * chunks[1];
-    volume->origin[2] = brickZ * chunks[2];
-    
-    volume->data = std::make_unique<float[]>(volume->voxelCount);
-    
-    // Load chunk data (stub)
-    for (size_t i = 0; i < volume->voxelCount; ++i) {
-        volume->data[i] = 0.5f;
-    }
-    
-    return volume;
+    if (scale < 0 || scale >= static_cast<int>(levels.size())) {
+        LOG_ERROR("Zarr: no scale level " << scale << " in " << zarrPath);
+        return nullptr;
+    }
+    const Array& array = levels[scale];
+    const int dims = static_cast<int>(array.shape.size());
+    const int brick[3] = {brickX, brickY, brickZ};
+    int begin[3];
+    int size[3];
+    for (int a = 0; a < 3; ++a) {
+        const int chunk = array.chunks[dims - 1 - a];
+        begin[a] = brick[a] * chunk;
+        size[a] = std::min(chunk, array.shape[dims - 1 - a] - begin[a]);
+    }
+    return loadRegion(t, scale, begin, size);
 }
 
 } // namespace morviq
@@ -0,0 +1,205 @@
+#include "io/AsyncFrameWriter.h"
+#include "codec/Encoder.h"
+#include "codec/SequenceWriter.h"
+#include "io/FramePublisher.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace morviq {
+
+namespace {
+
+bool writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    FILE* fp = std::fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    bool ok = std::fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return std::fclose(fp) == 0 && ok;
+}
+
+} // namespace
+
+AsyncFrameWriter::AsyncFrameWriter()
+    : frameWidth(0), frameHeight(0), sequence(nullptr), stopping(false), writing(false),
+      writtenCount(0), droppedCount(0) {}
+
+AsyncFrameWriter::~AsyncFrameWriter() {
+    shutdown();
+}
+
+bool AsyncFrameWriter::initialize(int width, int height, const OutputParams& outputParams,
+                                  SequenceWriter* sequenceWriter,
+                                  const std::vector<FramePublisher*>& framePublishers) {
+    params = outputParams;
+    sequence = sequenceWriter;
+    publishers = framePublishers;
+    params.queueDepth = std::max(1, params.queueDepth);
+    params.encoderThreads = std::max(1, params.encoderThreads);
+    frameWidth = width;
+    frameHeight = height;
+
+    for (int i = 0; i < params.queueDepth; ++i) {
+        auto job = std::make_unique<Job>();
+        job->frame = std::make_unique<Frame>(width, height, 4);
+        freeJobs.push_back(job.get());
+        jobs.push_back(std::move(job));
+    }
+
+    stopping = false;
+    if (sequence) {
+        // Frames are appended to one stream, so they are encoded in order
+        params.encoderThreads = 1;
+        encoders.emplace_back(&AsyncFrameWriter::encoderLoop, this, nullptr);
+    }
+    for (int i = 0; !sequence && i < params.encoderThreads; ++i) {
+        encoderInstances.push_back(createEncoder(params));
+        if (encoderInstances.front()->isStateful()) {
+            // Inter-frame formats need every frame through one encoder, in order
+            params.encoderThreads = 1;
+        }
+        encoders.emplace_back(&AsyncFrameWriter::encoderLoop, this, encoderInstances.back().get());
+    }
+
+    LOG_INFO("AsyncFrameWriter: " << params.queueDepth << " buffers, "
+             << params.encoderThreads << " encoder threads");
+    return true;
+}
+
+void AsyncFrameWriter::shutdown() {
+    if (encoders.empty()) return;
+
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& thread : encoders) {
+        thread.join();
+    }
+    encoders.clear();
+    encoderInstances.clear();
+    freeJobs.clear();
+    jobs.clear();
+
+    LOG_INFO("AsyncFrameWriter: wrote " << writtenCount << " frames, dropped " << droppedCount);
+}
+
+bool AsyncFrameWriter::submit(std::unique_ptr<Frame>& frame, const std::string& path) {
+    if (!frame || frame->width != frameWidth || frame->height != frameHeight) {
+        LOG_ERROR("AsyncFrameWriter: frame does not match the queue resolution");
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (freeJobs.empty()) {
+        if (params.overflow == OutputParams::DROP_NEWEST) {
+            ++droppedCount;
+            return false;
+        }
+        if (params.overflow == OutputParams::DROP_OLDEST && !pending.empty()) {
+            // Not yet picked up by an encoder, so it can leave the ordering
+            Job* victim = pending.front();
+            pending.pop_front();
+            inFlight.erase(std::find(inFlight.begin(), inFlight.end(), victim));
+            ++droppedCount;
+            recycle(victim);
+            break;
+        }
+        slotAvailable.wait(lock);
+    }
+
+    Job* job = freeJobs.back();
+    freeJobs.pop_back();
+    job->frame.swap(frame);
+    job->path = path;
+    job->state = JOB_QUEUED;
+    job->ok = false;
+    pending.push_back(job);
+    inFlight.push_back(job);
+    lock.unlock();
+
+    workAvailable.notify_one();
+    return true;
+}
+
+void AsyncFrameWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return inFlight.empty(); });
+}
+
+uint64_t AsyncFrameWriter::getWrittenCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writtenCount;
+}
+
+uint64_t AsyncFrameWriter::getDroppedCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return droppedCount;
+}
+
+void AsyncFrameWriter::encoderLoop(Encoder* encoder) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        workAvailable.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) return;
+
+        Job* job = pending.front();
+        pending.pop_front();
+        job->state = JOB_ENCODING;
+        lock.unlock();
+
+        // Stateful encoders run on this thread alone, in frame order
+        bool resync = false;
+        for (FramePublisher* publisher : publishers) {
+            resync = publisher->takeKeyframeRequest() || resync;
+        }
+        if (encoder && resync) encoder->requestKeyframe();
+        bool ok = encoder ? encoder->encode(*job->frame, job->encoded)
+                          : sequence->writeFrame(*job->frame);
+
+        lock.lock();
+        job->ok = ok;
+        job->keyframe = !encoder || encoder->wroteKeyframe();
+        job->state = JOB_DONE;
+        writeCompleted(lock);
+    }
+}
+
+void AsyncFrameWriter::writeCompleted(std::unique_lock<std::mutex>& lock) {
+    // A single writer at a time; it re-checks the head after every file, so
+    // frames finished meanwhile by other encoders are not missed.
+    if (writing) return;
+    writing = true;
+    while (!inFlight.empty() && inFlight.front()->state == JOB_DONE) {
+        Job* job = inFlight.front();
+        inFlight.pop_front();
+        lock.unlock();
+
+        bool ok = job->ok;
+        for (FramePublisher* publisher : publishers) {
+            ok = ok && publisher->publish(job->encoded.data(), job->encoded.size(), job->keyframe);
+        }
+        if (ok && !sequence && publishers.empty()) {
+            ok = writeFile(job->path, job->encoded);
+        }
+        if (!ok) {
+            LOG_ERROR("AsyncFrameWriter: failed to write " << job->path);
+        }
+
+        lock.lock();
+        if (ok) ++writtenCount;
+        recycle(job);
+    }
+    writing = false;
+    if (inFlight.empty()) {
+        drained.notify_all();
+    }
+}
+
+void AsyncFrameWriter::recycle(Job* job) {
+    freeJobs.push_back(job);
+    slotAvailable.notify_one();
+}
+
+} // namespace morviq
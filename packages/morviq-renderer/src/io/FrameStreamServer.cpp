@@ -0,0 +1,262 @@
+#include "io/FrameStreamServer.h"
+#include "utils/ByteOrder.h"
+#include "utils/Logger.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace morviq {
+
+FrameStreamServer::FrameStreamServer()
+    : listenFd(-1), wakeFd(-1), format(0), running(false), latestKeyframe(true), frameCount(0), skipped(0),
+      keyframeRequested(false) {}
+
+FrameStreamServer::~FrameStreamServer() {
+    stop();
+}
+
+bool FrameStreamServer::start(int port, uint32_t frameFormat) {
+    if (running.load()) return true;
+    format = frameFormat;
+    listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        LOG_ERROR("FrameStreamServer: socket() failed");
+        return false;
+    }
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(port);
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 8) < 0) {
+        LOG_ERROR("FrameStreamServer: cannot listen on port " << port << ": " << std::strerror(errno));
+        ::close(listenFd); listenFd = -1;
+        return false;
+    }
+    LOG_INFO("FrameStreamServer: streaming on 127.0.0.1:" << port);
+    return startThread();
+}
+
+bool FrameStreamServer::startUnix(const std::string& path, uint32_t frameFormat) {
+    if (running.load()) return true;
+    format = frameFormat;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("FrameStreamServer: socket path too long: " << path);
+        return false;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        LOG_ERROR("FrameStreamServer: socket() failed");
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 8) < 0) {
+        LOG_ERROR("FrameStreamServer: cannot listen on " << path << ": " << std::strerror(errno));
+        ::close(listenFd); listenFd = -1;
+        return false;
+    }
+    unixPath = path;
+    LOG_INFO("FrameStreamServer: streaming on " << path);
+    return startThread();
+}
+
+bool FrameStreamServer::startThread() {
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        LOG_ERROR("FrameStreamServer: eventfd() failed");
+        ::close(listenFd); listenFd = -1;
+        return false;
+    }
+    frameCount = 0;
+    running = true;
+    serverThread = std::thread(&FrameStreamServer::serve, this);
+    return true;
+}
+
+void FrameStreamServer::stop() {
+    if (!running.load()) return;
+    running = false;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+    if (serverThread.joinable()) serverThread.join();
+    ::close(listenFd); listenFd = -1;
+    ::close(wakeFd); wakeFd = -1;
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+        unixPath.clear();
+    }
+    latest.reset();
+    pool.clear();
+    LOG_INFO("FrameStreamServer: streamed " << frameCount << " frames, skipped "
+             << skipped.load() << " for slow subscribers");
+}
+
+FrameStreamServer::Buffer FrameStreamServer::acquireBuffer() {
+    // A buffer is free once no subscriber references it any more
+    for (const Buffer& buffer : pool) {
+        if (buffer.use_count() == 1) {
+            // Pairs with the sender thread's release when it dropped its reference
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return buffer;
+        }
+    }
+    pool.push_back(std::make_shared<std::vector<uint8_t>>());
+    return pool.back();
+}
+
+bool FrameStreamServer::publish(const uint8_t* data, size_t size, bool keyframe) {
+    if (!running.load()) return false;
+    if (size > UINT32_MAX) {
+        LOG_WARN("FrameStreamServer: frame of " << size << " bytes is too large to stream");
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Buffer buffer = acquireBuffer();
+        buffer->resize(kHeaderSize + size);
+        uint8_t* out = buffer->data();
+        putLE32(out, static_cast<uint32_t>(size));
+        putLE32(out + 4, format);
+        putLE64(out + 8, frameCount++);
+        std::memcpy(out + kHeaderSize, data, size);
+        latest = std::move(buffer);
+        latestKeyframe = keyframe;
+    }
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+    return true;
+}
+
+bool FrameStreamServer::flush(Subscriber& subscriber) {
+    for (;;) {
+        if (!subscriber.sending) {
+            if (!subscriber.waiting) return true;
+            subscriber.sending = std::move(subscriber.waiting);
+            subscriber.offset = 0;
+        }
+        const std::vector<uint8_t>& frame = *subscriber.sending;
+        while (subscriber.offset < frame.size()) {
+            ssize_t n = send(subscriber.fd, frame.data() + subscriber.offset,
+                             frame.size() - subscriber.offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            subscriber.offset += static_cast<size_t>(n);
+        }
+        subscriber.sending.reset();
+    }
+}
+
+void FrameStreamServer::serve() {
+    std::vector<Subscriber> subscribers;
+    std::vector<pollfd> fds;
+    Buffer delivered; // last frame handed to the subscribers
+    uint64_t deliveredNumber = 0;
+
+    while (running.load()) {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        fds.push_back({wakeFd, POLLIN, 0});
+        for (const Subscriber& s : subscribers) {
+            // POLLIN only to notice hang-ups; subscribers send nothing
+            fds.push_back({s.fd, static_cast<short>(s.sending || s.waiting ? POLLIN | POLLOUT : POLLIN), 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("FrameStreamServer: poll() failed");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t ignored = ::read(wakeFd, &count, sizeof(count));
+            (void)ignored;
+            Buffer frame;
+            bool keyframe;
+            uint64_t number;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                frame = latest;
+                keyframe = latestKeyframe;
+                number = frameCount - 1;
+            }
+            if (frame && frame != delivered) {
+                // Frames replaced in latest before this thread saw them
+                // reached no subscriber
+                const bool gap = !delivered || number != deliveredNumber + 1;
+                delivered = frame;
+                deliveredNumber = number;
+                bool resync = false;
+                for (Subscriber& s : subscribers) {
+                    if (keyframe) {
+                        if (s.waiting) skipped.fetch_add(1);
+                        s.waiting = frame;
+                        s.synced = true;
+                    } else if (s.synced && !gap && !s.waiting) {
+                        s.waiting = frame;
+                    } else {
+                        // This frame builds on one the subscriber will not
+                        // get: nothing more until the next keyframe
+                        skipped.fetch_add(1);
+                        s.synced = false;
+                        resync = true;
+                    }
+                }
+                if (resync) keyframeRequested.store(true);
+            }
+        }
+
+        // Subscribers are at the back of fds in the same order; walk both
+        // backwards so removals don't shift what is still to visit
+        for (size_t i = subscribers.size(); i-- > 0;) {
+            Subscriber& s = subscribers[i];
+            const short revents = fds[i + 2].revents;
+            bool alive = !(revents & (POLLERR | POLLHUP | POLLNVAL));
+            if (alive && (revents & POLLIN)) {
+                char drain[256];
+                ssize_t n = recv(s.fd, drain, sizeof(drain), MSG_DONTWAIT);
+                alive = n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+            }
+            alive = alive && flush(s);
+            if (!alive) {
+                ::close(s.fd);
+                subscribers[i] = std::move(subscribers.back());
+                subscribers.pop_back();
+                LOG_INFO("FrameStreamServer: subscriber disconnected");
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            for (;;) {
+                int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) break;
+                if (unixPath.empty()) {
+                    int opt = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+                }
+                subscribers.push_back({fd, nullptr, 0, nullptr, false});
+                keyframeRequested.store(true);
+                LOG_INFO("FrameStreamServer: subscriber connected");
+            }
+        }
+    }
+
+    for (Subscriber& s : subscribers) {
+        ::close(s.fd);
+    }
+}
+
+} // namespace morviq
@@ -0,0 +1,305 @@
+#include "io/SharedFrameRing.h"
+#include "utils/Logger.h"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace morviq {
+
+namespace {
+
+constexpr size_t kPageSize = 4096;
+
+size_t roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+uint64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+std::string segmentName(const std::string& name) {
+    return "/" + name;
+}
+
+bool fillSocketAddress(const char* path, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) return false;
+    std::strcpy(addr.sun_path, path);
+    return true;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------- writer
+
+SharedFrameRing::SharedFrameRing()
+    : base(nullptr), mappedSize(0), header(nullptr), slots(nullptr), published(0), listenFd(-1) {}
+
+SharedFrameRing::~SharedFrameRing() {
+    shutdown();
+}
+
+bool SharedFrameRing::initialize(const std::string& name, int slotCount, size_t slotCapacity,
+                                 int width, int height, uint32_t format) {
+    if (name.empty() || name.find('/') != std::string::npos || slotCount < 2) {
+        LOG_ERROR("SharedFrameRing: need a name without '/' and at least 2 slots");
+        return false;
+    }
+    shmName = segmentName(name);
+    const size_t capacity = roundUp(slotCapacity, kPageSize);
+    const size_t dataOffset = roundUp(sizeof(SharedRingHeader) + slotCount * sizeof(SharedRingSlot),
+                                      kPageSize);
+    mappedSize = dataOffset + capacity * slotCount;
+
+    // A stale segment from a crashed run would confuse readers; start over
+    shm_unlink(shmName.c_str());
+    int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        LOG_ERROR("SharedFrameRing: shm_open " << shmName << " failed: " << std::strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(mappedSize)) != 0) {
+        LOG_ERROR("SharedFrameRing: ftruncate failed: " << std::strerror(errno));
+        ::close(fd);
+        shm_unlink(shmName.c_str());
+        return false;
+    }
+    void* mapping = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("SharedFrameRing: mmap failed: " << std::strerror(errno));
+        shm_unlink(shmName.c_str());
+        return false;
+    }
+    base = static_cast<uint8_t*>(mapping);
+
+    // Fresh pages are zero, which is a valid initial state for the atomics
+    header = reinterpret_cast<SharedRingHeader*>(base);
+    slots = reinterpret_cast<SharedRingSlot*>(base + sizeof(SharedRingHeader));
+    header->magic = SharedRingHeader::kMagic;
+    header->version = SharedRingHeader::kVersion;
+    header->slotCount = static_cast<uint32_t>(slotCount);
+    header->format = format;
+    header->width = static_cast<uint32_t>(width);
+    header->height = static_cast<uint32_t>(height);
+    header->slotCapacity = capacity;
+    header->dataOffset = dataOffset;
+    published = 0;
+
+    const std::string socketPath = "/tmp/" + name + ".sock";
+    sockaddr_un addr;
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd >= 0 && fillSocketAddress(socketPath.c_str(), addr)) {
+        unlink(socketPath.c_str());
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+            listen(listenFd, 8) == 0) {
+            std::strcpy(header->socketPath, socketPath.c_str());
+        } else {
+            LOG_WARN("SharedFrameRing: notification socket unavailable (" << std::strerror(errno)
+                     << "); readers must poll");
+            ::close(listenFd);
+            listenFd = -1;
+        }
+    }
+    header->state.store(SharedRingHeader::STATE_LIVE, std::memory_order_release);
+
+    LOG_INFO("SharedFrameRing: " << shmName << ", " << slotCount << " slots of "
+             << capacity / 1024 << " KiB");
+    return true;
+}
+
+void SharedFrameRing::shutdown() {
+    if (!base) return;
+
+    header->state.store(SharedRingHeader::STATE_CLOSED, std::memory_order_release);
+    for (int fd : clients) {
+        ::close(fd);
+    }
+    clients.clear();
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        listenFd = -1;
+        unlink(header->socketPath);
+    }
+    munmap(base, mappedSize);
+    shm_unlink(shmName.c_str());
+    base = nullptr;
+    header = nullptr;
+    slots = nullptr;
+
+    LOG_INFO("SharedFrameRing: published " << published << " frames");
+}
+
+bool SharedFrameRing::publish(const uint8_t* data, size_t size, bool /*keyframe*/) {
+    if (!base) return false;
+    if (size > header->slotCapacity) {
+        LOG_WARN("SharedFrameRing: frame of " << size << " bytes exceeds the slot capacity");
+        return false;
+    }
+    const uint64_t frame = published;
+    const uint32_t index = static_cast<uint32_t>(frame % header->slotCount);
+    SharedRingSlot& slot = slots[index];
+
+    // Odd sequence first, so a reader that overlaps the copy sees it changed
+    slot.sequence.store(2 * frame + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(base + header->dataOffset + index * header->slotCapacity, data, size);
+    slot.size.store(size, std::memory_order_relaxed);
+    slot.timestampNs.store(monotonicNs(), std::memory_order_relaxed);
+    slot.sequence.store(2 * frame + 2, std::memory_order_release);
+
+    published = frame + 1;
+    header->published.store(published, std::memory_order_release);
+
+    acceptClients();
+    notifyClients();
+    return true;
+}
+
+void SharedFrameRing::acceptClients() {
+    if (listenFd < 0) return;
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) break;
+        clients.push_back(fd);
+    }
+}
+
+void SharedFrameRing::notifyClients() {
+    const uint8_t tick = 1;
+    for (size_t i = 0; i < clients.size();) {
+        // A full socket buffer already holds unread ticks, so EAGAIN is fine
+        ssize_t n = send(clients[i], &tick, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            ::close(clients[i]);
+            clients[i] = clients.back();
+            clients.pop_back();
+            continue;
+        }
+        ++i;
+    }
+}
+
+// ---------------------------------------------------------------- reader
+
+SharedFrameRingReader::SharedFrameRingReader()
+    : base(nullptr), mappedSize(0), header(nullptr), slots(nullptr), notifyFd(-1) {}
+
+SharedFrameRingReader::~SharedFrameRingReader() {
+    close();
+}
+
+bool SharedFrameRingReader::open(const std::string& name) {
+    close();
+    const std::string shmName = segmentName(name);
+    int fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        LOG_ERROR("SharedFrameRingReader: shm_open " << shmName << " failed: " << std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(SharedRingHeader)) {
+        mappedSize = static_cast<size_t>(st.st_size);
+        mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("SharedFrameRingReader: cannot map " << shmName);
+        return false;
+    }
+    base = static_cast<const uint8_t*>(mapping);
+    header = reinterpret_cast<const SharedRingHeader*>(base);
+    slots = reinterpret_cast<const SharedRingSlot*>(base + sizeof(SharedRingHeader));
+
+    if (header->state.load(std::memory_order_acquire) == SharedRingHeader::STATE_INIT ||
+        header->magic != SharedRingHeader::kMagic || header->version != SharedRingHeader::kVersion ||
+        header->dataOffset + header->slotCapacity * header->slotCount > mappedSize) {
+        LOG_ERROR("SharedFrameRingReader: " << shmName << " is not a ready frame ring");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SharedFrameRingReader::close() {
+    if (notifyFd >= 0) {
+        ::close(notifyFd);
+        notifyFd = -1;
+    }
+    if (base) {
+        munmap(const_cast<uint8_t*>(base), mappedSize);
+        base = nullptr;
+        header = nullptr;
+        slots = nullptr;
+    }
+}
+
+bool SharedFrameRingReader::isClosed() const {
+    return header->state.load(std::memory_order_acquire) == SharedRingHeader::STATE_CLOSED;
+}
+
+int SharedFrameRingReader::connectNotifications() {
+    sockaddr_un addr;
+    if (notifyFd >= 0 || header->socketPath[0] == '\0' ||
+        !fillSocketAddress(header->socketPath, addr)) {
+        return notifyFd;
+    }
+    notifyFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (notifyFd >= 0 && connect(notifyFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(notifyFd);
+        notifyFd = -1;
+    }
+    return notifyFd;
+}
+
+bool SharedFrameRingReader::drainNotifications() {
+    if (notifyFd < 0) return true;
+    uint8_t buffer[256];
+    for (;;) {
+        ssize_t n = recv(notifyFd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) continue;
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+    }
+}
+
+bool SharedFrameRingReader::latest(View& view, uint64_t minFrame) const {
+    for (;;) {
+        const uint64_t published = header->published.load(std::memory_order_acquire);
+        if (published == 0 || published - 1 < minFrame) return false;
+
+        const uint64_t frame = published - 1;
+        const uint32_t index = static_cast<uint32_t>(frame % header->slotCount);
+        const SharedRingSlot& slot = slots[index];
+        const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * frame + 2) {
+            // Already being reused for a newer frame; take that one instead
+            continue;
+        }
+        view.data = base + header->dataOffset + index * header->slotCapacity;
+        view.size = slot.size.load(std::memory_order_relaxed);
+        view.timestampNs = slot.timestampNs.load(std::memory_order_relaxed);
+        view.frame = frame;
+        view.sequence = sequence;
+        view.slot = static_cast<int>(index);
+        if (!stillValid(view) || view.size > header->slotCapacity) continue;
+        return true;
+    }
+}
+
+bool SharedFrameRingReader::stillValid(const View& view) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slots[view.slot].sequence.load(std::memory_order_relaxed) == view.sequence;
+}
+
+} // namespace morviq
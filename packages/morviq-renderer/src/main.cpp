@@ -1,6 +1,8 @@
 #include <iostream>
 #include <mpi.h>
+#include <cstdio>
 #include <cstdlib>
+#include <cmath>
 #include <string>
 #include <chrono>
 #include <thread>
@@ -8,6 +10,9 @@
 #include "renderer/VolumeRenderer.h"
 #include "utils/Logger.h"
 #include "control/ControlServer.h"
+#include "codec/PNGStream.h"
+#include "data/MappedFile.h"
+#include <algorithm>
 
 using namespace morviq;
 
@@ -21,8 +26,27 @@ struct Config {
     int timeStep = 0;
     bool interactive = false;
     int port = 9090;
+    bool hierarchical = false;
+    bool distributedOutput = false;
+    bool temporal = false;
+    MapOptions mapOptions;
+    ReadParams read;
+    int prefetchSlots = 2;
+    int cacheMB = 1024;
+    int compressRate = -1;
+    SparseParams sparse;
+    BalanceParams balance;
+    PagingParams paging;
+    OutputParams output;
 };
 
+// Ends the run on a value an option does not take
+[[noreturn]] void rejectValue(const std::string& option, const std::string& value, const char* accepted) {
+    LOG_ERROR("Unknown " << option << " value '" << value << "' (expected " << accepted << ")");
+    MPI_Finalize();
+    exit(1);
+}
+
 Config parseArgs(int argc, char* argv[]) {
     Config config;
     
@@ -47,6 +71,102 @@ Config parseArgs(int argc, char* argv[]) {
             config.interactive = true;
         } else if (arg == "--port" && i + 1 < argc) {
             config.port = std::atoi(argv[++i]);
+        } else if (arg == "--hierarchical") {
+            config.hierarchical = true;
+        } else if (arg == "--distributed-output") {
+            config.distributedOutput = true;
+        } else if (arg == "--temporal") {
+            config.temporal = true;
+        } else if (arg == "--mmap-populate") {
+            config.mapOptions.populate = true;
+        } else if (arg == "--mmap-hugepages") {
+            config.mapOptions.hugePages = true;
+        } else if (arg == "--raw-io" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "independent") config.read.mode = ReadParams::INDEPENDENT;
+            else if (mode == "collective") config.read.mode = ReadParams::COLLECTIVE;
+            else if (mode == "mapped") config.read.mode = ReadParams::MAPPED;
+            else rejectValue(arg, mode, "mapped | independent | collective");
+        } else if (arg == "--io-aggregators" && i + 1 < argc) {
+            config.read.aggregators = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--io-buffer-mb" && i + 1 < argc) {
+            config.read.bufferSize = std::max(0, std::atoi(argv[++i])) * 1024 * 1024;
+        } else if (arg == "--page-budget-mb" && i + 1 < argc) {
+            config.paging.memoryBudget = static_cast<size_t>(std::max(0, std::atoi(argv[++i]))) * 1024 * 1024;
+        } else if (arg == "--page-size" && i + 1 < argc) {
+            config.paging.pageSize = std::max(8, std::atoi(argv[++i]));
+        } else if (arg == "--cache-mb" && i + 1 < argc) {
+            config.cacheMB = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--compress-rate" && i + 1 < argc) {
+            config.compressRate = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--sparse") {
+            config.sparse.enabled = true;
+        } else if (arg == "--sparse-background" && i + 1 < argc) {
+            config.sparse.background = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--sparse-tolerance" && i + 1 < argc) {
+            config.sparse.tolerance = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--bricks" && i + 1 < argc) {
+            int* n = config.balance.bricks;
+            if (std::sscanf(argv[++i], "%d,%d,%d", &n[0], &n[1], &n[2]) != 3) {
+                n[0] = n[1] = n[2] = 0;
+            }
+        } else if (arg == "--kd-tree") {
+            config.balance.decomposition = BalanceParams::KD_TREE;
+        } else if (arg == "--rebalance" && i + 1 < argc) {
+            config.balance.threshold = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--rebalance-hysteresis" && i + 1 < argc) {
+            config.balance.hysteresis = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--prefetch" && i + 1 < argc) {
+            config.prefetchSlots = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "qoi") config.output.format = OutputParams::QOI;
+            else if (format == "raw") config.output.format = OutputParams::RAW;
+            else if (format == "delta") config.output.format = OutputParams::DELTA;
+            else if (format == "apng") config.output.format = OutputParams::APNG;
+            else if (format == "y4m") config.output.format = OutputParams::Y4M;
+            else if (format == "i420") config.output.format = OutputParams::I420;
+            else if (format == "png") config.output.format = OutputParams::PNG;
+            else rejectValue(arg, format, "png | qoi | raw | delta | apng | y4m | i420");
+        } else if (arg == "--video-out" && i + 1 < argc) {
+            config.output.sequencePath = argv[++i];
+        } else if (arg == "--shm-ring" && i + 1 < argc) {
+            config.output.shmName = argv[++i];
+        } else if (arg == "--shm-slots" && i + 1 < argc) {
+            config.output.shmSlots = std::atoi(argv[++i]);
+        } else if (arg == "--stream-port" && i + 1 < argc) {
+            config.output.streamPort = std::atoi(argv[++i]);
+        } else if (arg == "--stream-socket" && i + 1 < argc) {
+            config.output.streamSocket = argv[++i];
+        } else if (arg == "--fps" && i + 1 < argc) {
+            config.output.sequenceFps = std::atoi(argv[++i]);
+        } else if (arg == "--keyframe-interval" && i + 1 < argc) {
+            config.output.keyframeInterval = std::atoi(argv[++i]);
+        } else if (arg == "--delta-tile" && i + 1 < argc) {
+            config.output.deltaTileSize = std::atoi(argv[++i]);
+        } else if (arg == "--async-output") {
+            config.output.async = true;
+        } else if (arg == "--output-queue" && i + 1 < argc) {
+            config.output.queueDepth = std::atoi(argv[++i]);
+        } else if (arg == "--encoder-threads" && i + 1 < argc) {
+            config.output.encoderThreads = std::atoi(argv[++i]);
+        } else if (arg == "--output-policy" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "drop-newest") config.output.overflow = OutputParams::DROP_NEWEST;
+            else if (policy == "drop-oldest") config.output.overflow = OutputParams::DROP_OLDEST;
+            else if (policy == "block") config.output.overflow = OutputParams::BLOCK;
+            else rejectValue(arg, policy, "block | drop-newest | drop-oldest");
+        } else if (arg == "--png-level" && i + 1 < argc) {
+            config.output.compressionLevel = std::max(0, std::min(9, std::atoi(argv[++i])));
+        } else if (arg == "--png-filter" && i + 1 < argc) {
+            std::string filter = argv[++i];
+            if (filter == "none") config.output.pngFilter = FILTER_NONE;
+            else if (filter == "sub") config.output.pngFilter = FILTER_SUB;
+            else if (filter == "up") config.output.pngFilter = FILTER_UP;
+            else if (filter == "average") config.output.pngFilter = FILTER_AVERAGE;
+            else if (filter == "paeth") config.output.pngFilter = FILTER_PAETH;
+            else if (filter == "adaptive") config.output.pngFilter = FILTER_ADAPTIVE;
+            else rejectValue(arg, filter, "none | sub | up | average | paeth | adaptive");
         } else if (arg == "--help") {
             std::cout << "Usage: " << argv[0] << " [options]\n"
                       << "Options:\n"
@@ -57,14 +177,60 @@ Config parseArgs(int argc, char* argv[]) {
                       << "  --data PATH      Data directory path\n"
                       << "  --dataset NAME   Dataset name (default: default)\n"
                       << "  --timestep T     Time step (default: 0)\n"
+                      << "  --mmap-populate  Fault raw volumes in when mapping them\n"
+                      << "  --mmap-hugepages Ask for huge pages on mapped raw volumes\n"
+                      << "  --raw-io M       Raw volumes: mapped (default) | independent | collective (MPI-IO)\n"
+                      << "  --io-aggregators N  MPI-IO cb_nodes hint (default: MPI's choice)\n"
+                      << "  --io-buffer-mb N MPI-IO cb_buffer_size hint\n"
+                      << "  --page-budget-mb N  Render out of core, paging bricks within N MB per rank\n"
+                      << "  --page-size N    Out-of-core page edge in voxels (default: 64)\n"
+                      << "  --cache-mb N     Loaded brick cache budget per rank (default: 1024, 0 = off)\n"
+                      << "  --compress-rate N  Hold bricks at N bits per voxel, 1-32 (0 = off, default: per dataset)\n"
+                      << "  --sparse         Hold mostly empty bricks as sparse grids\n"
+                      << "  --sparse-background V  Value of inactive voxels (default: 0)\n"
+                      << "  --sparse-tolerance E  Voxels within E of the background are inactive (default: 0)\n"
+                      << "  --bricks X,Y,Z   Bricks per axis (default: 2,2,2, or 16 per rank in a k-d tree)\n"
+                      << "  --kd-tree        Give each rank a box of bricks split by a k-d tree\n"
+                      << "                   (default with more ranks than bricks, or --rebalance)\n"
+                      << "  --rebalance F    Move k-d tree planes when the slowest rank renders F\n"
+                      << "                   (e.g. 0.1) slower than the mean (default: 0 = off)\n"
+                      << "  --rebalance-hysteresis N  Frames over the threshold, and between moves (default: 5)\n"
+                      << "  --prefetch N     Interactive: time steps loaded ahead (default: 2, 0 = load on demand)\n"
                       << "  --interactive    Enable interactive mode\n"
                       << "  --port P         Control port (default: 9090)\n"
+                      << "  --hierarchical   Merge node-local frames in shared memory before MPI compositing\n"
+                      << "  --distributed-output  Each rank encodes its composited stripe; rank 0 only writes\n"
+                      << "  --temporal       Jitter ray starts and accumulate frames; interactive\n"
+                      << "                   quality levels then use 3x coarser steps, at most 4x the base\n"
+                      << "  --format F       Frame format: png (default) | qoi | raw | delta | apng | y4m | i420\n"
+                      << "  --video-out P    APNG/Y4M/I420 output file, - for stdout (Y4M/I420 only)\n"
+                      << "                   (default: <out>/composited/animation.<ext>)\n"
+                      << "  --fps N          APNG/Y4M: playback rate (default: 30)\n"
+                      << "  --shm-ring NAME  Publish frames to shared memory /NAME instead of files\n"
+                      << "  --shm-slots N    Shared-memory ring slots (default: 4)\n"
+                      << "  --stream-port N  Push frames to TCP subscribers on 127.0.0.1:N instead of files\n"
+                      << "  --stream-socket P  Same, on the Unix socket P\n"
+                      << "  --keyframe-interval N  Delta: full frame every N frames (default: 30)\n"
+                      << "  --delta-tile N   Delta: tile size in pixels (default: 64)\n"
+                      << "  --async-output   Encode and write frames on background threads\n"
+                      << "  --output-queue N Frames buffered by the async writer (default: 3)\n"
+                      << "  --encoder-threads N  Async encoder threads (default: 2)\n"
+                      << "  --output-policy P    block | drop-newest | drop-oldest when the queue is full\n"
+                      << "  --png-level N    PNG zlib compression level 0-9 (default: 6)\n"
+                      << "  --png-filter F   none | sub | up | average | paeth | adaptive (default)\n"
                       << "  --help           Show this help\n";
             MPI_Finalize();
             exit(0);
         }
     }
     
+    if (config.output.format == OutputParams::APNG && config.output.sequencePath == "-") {
+        // The frame count in acTL is patched in on close, which needs a seekable file
+        LOG_ERROR("--video-out - (stdout) supports y4m and i420 only, not apng");
+        MPI_Finalize();
+        exit(1);
+    }
+    
     return config;
 }
 
@@ -110,6 +276,10 @@ int main(int argc, char* argv[]) {
     Logger::initialize(rank);
     
     Config config = parseArgs(argc, argv);
+    if (config.output.sequencePath == "-") {
+        // stdout carries the video stream
+        Logger::setOutput(std::cerr);
+    }
     
     if (rank == 0) {
         LOG_INFO("Morviq Renderer starting with " << size << " ranks");
@@ -119,6 +289,13 @@ int main(int argc, char* argv[]) {
     
     Renderer renderer(rank, size, MPI_COMM_WORLD);
     
+    CompositeParams compositeParams;
+    compositeParams.hierarchical = config.hierarchical;
+    compositeParams.distributedOutput = config.distributedOutput;
+    renderer.setCompositeParams(compositeParams);
+    renderer.setOutputParams(config.output);
+    renderer.setBalanceParams(config.balance);
+    
     if (!renderer.initialize(config.width, config.height)) {
         LOG_ERROR("Failed to initialize renderer");
         MPI_Finalize();
@@ -127,6 +304,13 @@ int main(int argc, char* argv[]) {
     
     if (!config.dataPath.empty()) {
         renderer.setDataPath(config.dataPath);
+        renderer.setMapOptions(config.mapOptions);
+        renderer.setReadParams(config.read);
+        renderer.setPrefetchSlots(config.prefetchSlots);
+        renderer.setPagingParams(config.paging);
+        renderer.setCacheBudget(static_cast<size_t>(config.cacheMB) * 1024 * 1024);
+        renderer.setCompressRate(config.compressRate);
+        renderer.setSparseParams(config.sparse);
         if (!renderer.loadVolume(config.dataset, config.timeStep)) {
             LOG_WARN("Failed to load volume data, using procedural data");
         }
@@ -141,6 +325,7 @@ int main(int argc, char* argv[]) {
     params.quality = 2;
     params.stepSize = 0.01f;
     params.enableGradients = true;
+    params.temporalAccumulation = config.temporal;
     
     renderer.setTransferFunction(tf);
     renderer.setRenderParams(params);
@@ -157,6 +342,14 @@ int main(int argc, char* argv[]) {
             });
         }
         
+        // Accumulation recovers the detail of finer steps over a few frames,
+        // but not of steps more than 4x the base one
+        const float stepScale = config.temporal ? 3.0f : 1.0f;
+        const float maxStep = 4.0f * params.stepSize;
+        std::string bioelectricParams;
+        int timeStep = config.timeStep;
+        int controlTimeStep = 0; // the control server's initial state
+        
         while (true) {
             // Rank 0: poll control state and broadcast
             ControlState s;
@@ -188,14 +381,27 @@ int main(int argc, char* argv[]) {
             renderer.setCamera(camera);
 
             // Apply render params mapping from quality
-            if (s.quality == 0) { params.quality = 0; params.stepSize = 0.02f; }
-            else if (s.quality == 2) { params.quality = 3; params.stepSize = 0.005f; }
-            else { params.quality = 1; params.stepSize = 0.01f; }
+            if (s.quality == 0) { params.quality = 0; params.stepSize = std::min(0.02f * stepScale, maxStep); }
+            else if (s.quality == 2) { params.quality = 3; params.stepSize = std::min(0.005f * stepScale, maxStep); }
+            else { params.quality = 1; params.stepSize = std::min(0.01f * stepScale, maxStep); }
             renderer.setRenderParams(params);
             
-            // Apply bioelectric parameters if present
-            if (!s.bioelectricParams.empty()) {
-                renderer.getVolumeRenderer()->setBioelectricParams(s.bioelectricParams);
+            // Switch to the requested time step once it is loaded; --timestep
+            // holds until the client sends one
+            if (s.timeStep != controlTimeStep) {
+                controlTimeStep = s.timeStep;
+                timeStep = s.timeStep;
+            }
+            if (!config.dataPath.empty()) {
+                renderer.updateTimeStep(timeStep);
+            }
+            
+            // Apply bioelectric parameters when they change; each change
+            // regenerates the volume
+            if (!s.bioelectricParams.empty() && s.bioelectricParams != bioelectricParams) {
+                bioelectricParams = s.bioelectricParams;
+                renderer.getVolumeRenderer()->setBioelectricParams(bioelectricParams);
+                renderer.resetHistory();
             }
             
             if (!renderer.render()) {
@@ -203,10 +409,8 @@ int main(int argc, char* argv[]) {
                 break;
             }
             
-            if (rank == 0) {
-                static int frameNum = 0;
-                renderer.saveFrame(config.outputPath, frameNum++);
-            }
+            static int frameNum = 0;
+            renderer.saveFrame(config.outputPath, frameNum++);
             
             std::this_thread::sleep_for(std::chrono::milliseconds(50));
         }
@@ -224,15 +428,20 @@ int main(int argc, char* argv[]) {
                 break;
             }
             
+            renderer.saveFrame(config.outputPath, frame);
+            
             if (rank == 0) {
-                renderer.saveFrame(config.outputPath, frame);
-                
                 if (frame % 10 == 0) {
                     auto currentTime = std::chrono::high_resolution_clock::now();
                     auto elapsed = std::chrono::duration<double>(currentTime - startTime).count();
                     double fps = (frame + 1) / elapsed;
-                    LOG_INFO("Frame " << frame << "/" << config.frames 
-                            << " (" << fps << " FPS)");
+                    if (config.balance.threshold > 0.0f) {
+                        LOG_INFO("Frame " << frame << "/" << config.frames << " (" << fps << " FPS, slowest rank "
+                                 << renderer.getImbalance() * 100.0f << "% over the mean)");
+                    } else {
+                        LOG_INFO("Frame " << frame << "/" << config.frames 
+                                << " (" << fps << " FPS)");
+                    }
                 }
             }
             
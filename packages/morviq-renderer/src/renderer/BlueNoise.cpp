@@ -0,0 +1,114 @@
+#include "renderer/BlueNoise.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace morviq {
+
+namespace {
+
+constexpr int kSize = BlueNoise::kSize;
+constexpr int kCount = kSize * kSize;
+constexpr float kSigma = 1.5f;
+
+// Void-and-cluster (Ulichney 1993) on a torus. energy[i] is the Gaussian
+// splat of all set pixels at i; the tightest cluster is the set pixel with
+// the highest energy and the largest void the empty pixel with the lowest.
+class VoidAndCluster {
+public:
+    VoidAndCluster() : kernel(kCount), energy(kCount, 0.0f), set(kCount, 0) {
+        for (int dy = 0; dy < kSize; ++dy) {
+            for (int dx = 0; dx < kSize; ++dx) {
+                const int wx = std::min(dx, kSize - dx);
+                const int wy = std::min(dy, kSize - dy);
+                kernel[dy * kSize + dx] = std::exp(-(wx * wx + wy * wy) / (2.0f * kSigma * kSigma));
+            }
+        }
+    }
+
+    void toggle(int i, bool on) {
+        set[i] = on;
+        const float sign = on ? 1.0f : -1.0f;
+        const int x = i % kSize;
+        const int y = i / kSize;
+        for (int j = 0; j < kCount; ++j) {
+            const int dx = (j % kSize - x + kSize) & (kSize - 1);
+            const int dy = (j / kSize - y + kSize) & (kSize - 1);
+            energy[j] += sign * kernel[dy * kSize + dx];
+        }
+    }
+
+    int tightestCluster() const { return extreme(true); }
+    int largestVoid() const { return extreme(false); }
+    bool isSet(int i) const { return set[i] != 0; }
+
+private:
+    std::vector<float> kernel;
+    std::vector<float> energy;
+    std::vector<uint8_t> set;
+
+    int extreme(bool ofSet) const {
+        int best = -1;
+        for (int i = 0; i < kCount; ++i) {
+            if ((set[i] != 0) != ofSet) continue;
+            if (best < 0 || (ofSet ? energy[i] > energy[best] : energy[i] < energy[best])) best = i;
+        }
+        return best;
+    }
+};
+
+std::vector<float> generate() {
+    VoidAndCluster pattern;
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> pixel(0, kCount - 1);
+
+    // Initial pattern: ~10% random points, relaxed until moving the tightest
+    // cluster into the largest void changes nothing
+    const int initial = kCount / 10;
+    for (int n = 0; n < initial;) {
+        int i = pixel(rng);
+        if (!pattern.isSet(i)) {
+            pattern.toggle(i, true);
+            ++n;
+        }
+    }
+    for (int iteration = 0; iteration < 4 * kCount; ++iteration) {
+        const int cluster = pattern.tightestCluster();
+        pattern.toggle(cluster, false);
+        const int gap = pattern.largestVoid();
+        pattern.toggle(gap, true);
+        if (gap == cluster) break;
+    }
+
+    std::vector<int> rank(kCount, -1);
+    VoidAndCluster copy = pattern;
+    // Phase 1: rank the initial points by removing tightest clusters
+    for (int r = initial - 1; r >= 0; --r) {
+        const int cluster = copy.tightestCluster();
+        copy.toggle(cluster, false);
+        rank[cluster] = r;
+    }
+    // Phase 2: fill the largest voids until every pixel is ranked
+    for (int r = initial; r < kCount; ++r) {
+        const int gap = pattern.largestVoid();
+        pattern.toggle(gap, true);
+        rank[gap] = r;
+    }
+
+    std::vector<float> values(kCount);
+    for (int i = 0; i < kCount; ++i) {
+        values[i] = (rank[i] + 0.5f) / kCount;
+    }
+    return values;
+}
+
+} // namespace
+
+const float* BlueNoise::tile() {
+    static const std::vector<float> values = generate();
+    return values.data();
+}
+
+} // namespace morviq
@@ -0,0 +1,229 @@
+#include "renderer/LoadBalancer.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace morviq {
+
+LoadBalancer::LoadBalancer(int rank, int size, MPI_Comm comm)
+    : mpiRank(rank), mpiSize(size), mpiComm(comm), dimensions{0, 0, 0}, grid{0, 0, 0} {}
+
+void LoadBalancer::decompose(const BalanceParams& balanceParams, const int dims[3]) {
+    const int known[3] = {dims ? dims[0] : 0, dims ? dims[1] : 0, dims ? dims[2] : 0};
+    if (!bricks.empty() && std::equal(known, known + 3, dimensions)) {
+        return;
+    }
+    params = balanceParams;
+    std::copy(known, known + 3, dimensions);
+
+    // Depth compositing needs each rank's bricks to form a box, which only
+    // the k-d tree keeps once bricks move
+    const bool given = params.bricks[0] > 0 && params.bricks[1] > 0 && params.bricks[2] > 0;
+    const int givenCount = given ? params.bricks[0] * params.bricks[1] * params.bricks[2] : 8;
+    kdTree = params.decomposition == BalanceParams::KD_TREE || params.threshold > 0.0f ||
+             (params.decomposition == BalanceParams::AUTO && givenCount < mpiSize);
+    if (given) {
+        std::copy(params.bricks, params.bricks + 3, grid);
+    } else if (!kdTree) {
+        grid[0] = grid[1] = grid[2] = 2;
+    } else {
+        // Halve the bricks along the axis with the most voxels per brick
+        // until each rank has about 16 to measure and move
+        grid[0] = grid[1] = grid[2] = 1;
+        while (grid[0] * grid[1] * grid[2] < 16 * mpiSize) {
+            int axis = 0;
+            float longest = 0.0f;
+            for (int a = 0; a < 3; ++a) {
+                const float extent = (dims ? dims[a] : 1) / static_cast<float>(grid[a]);
+                if (extent > longest) {
+                    longest = extent;
+                    axis = a;
+                }
+            }
+            grid[axis] *= 2;
+        }
+    }
+
+    bricks.clear();
+    const size_t totalVoxels = dims ? static_cast<size_t>(dims[0]) * dims[1] * dims[2] : 0;
+    const int count = grid[0] * grid[1] * grid[2];
+    for (int z = 0; z < grid[2]; ++z) {
+        for (int y = 0; y < grid[1]; ++y) {
+            for (int x = 0; x < grid[0]; ++x) {
+                BrickInfo brick;
+                brick.id = static_cast<int>(bricks.size());
+                brick.lodLevel = 0;
+                brick.minBounds = Vec3(static_cast<float>(x) / grid[0], static_cast<float>(y) / grid[1],
+                                       static_cast<float>(z) / grid[2]);
+                brick.maxBounds = Vec3(static_cast<float>(x + 1) / grid[0], static_cast<float>(y + 1) / grid[1],
+                                       static_cast<float>(z + 1) / grid[2]);
+                brick.voxelCount = totalVoxels / count;
+                brick.priority = 1.0f;
+                bricks.push_back(brick);
+            }
+        }
+    }
+
+    costs.assign(count, 1.0);
+    measured = false;
+    framesOver = 0;
+    framesSinceRebalance = 0;
+    imbalance = 0.0f;
+    std::vector<int> brickOwners(count, 0);
+    if (kdTree) {
+        const int lo[3] = {0, 0, 0};
+        split(costs, 0, mpiSize, lo, grid, brickOwners);
+    } else {
+        const int perRank = (count + mpiSize - 1) / mpiSize;
+        for (int i = 0; i < count; ++i) {
+            brickOwners[i] = i / perRank;
+        }
+    }
+    assign(brickOwners);
+    LOG_DEBUG("Rank " << mpiRank << " assigned " << assigned.size() << " of " << grid[0] << "x" << grid[1]
+              << "x" << grid[2] << " bricks" << (kdTree ? " in a k-d tree" : ""));
+}
+
+void LoadBalancer::split(const std::vector<double>& weights, int first, int end, const int lo[3],
+                         const int hi[3], std::vector<int>& result) const {
+    const int ranks = end - first;
+    const int left = ranks / 2;
+    // The plane giving the lowest cost per rank on its heavier side, over
+    // every axis the box can be cut along; sides too small to give each of
+    // their ranks a brick only as a last resort, and of equal costs the
+    // longest axis
+    int axis = -1;
+    int cut = 0;
+    double best = 0.0;
+    bool bestFits = false;
+    float bestExtent = 0.0f;
+    for (int a = 0; a < 3 && ranks > 1; ++a) {
+        if (hi[a] - lo[a] < 2) {
+            continue;
+        }
+        const float extent = (hi[a] - lo[a]) * (dimensions[a] > 0 ? dimensions[a] : 1) / static_cast<float>(grid[a]);
+        std::vector<double> slabs(hi[a] - lo[a], 0.0);
+        for (int z = lo[2]; z < hi[2]; ++z) {
+            for (int y = lo[1]; y < hi[1]; ++y) {
+                for (int x = lo[0]; x < hi[0]; ++x) {
+                    const int at[3] = {x, y, z};
+                    slabs[at[a] - lo[a]] += weights[(z * grid[1] + y) * grid[0] + x];
+                }
+            }
+        }
+        const double total = std::accumulate(slabs.begin(), slabs.end(), 0.0);
+        int slabBricks = 1;
+        for (int b = 0; b < 3; ++b) {
+            slabBricks *= b == a ? 1 : hi[b] - lo[b];
+        }
+        double prefix = 0.0;
+        for (int c = lo[a] + 1; c < hi[a]; ++c) {
+            prefix += slabs[c - 1 - lo[a]];
+            const double perRank = std::max(prefix / left, (total - prefix) / (ranks - left));
+            const bool fits = (c - lo[a]) * slabBricks >= left && (hi[a] - c) * slabBricks >= ranks - left;
+            const bool tie = std::abs(perRank - best) <= 1e-9 * best;
+            if (axis < 0 || (fits && !bestFits) ||
+                (fits == bestFits && (tie ? a != axis && extent > bestExtent : perRank < best))) {
+                axis = a;
+                cut = c;
+                best = perRank;
+                bestFits = fits;
+                bestExtent = extent;
+            }
+        }
+    }
+    if (axis < 0) {
+        // One rank, or one brick left: the first rank takes the box
+        for (int z = lo[2]; z < hi[2]; ++z) {
+            for (int y = lo[1]; y < hi[1]; ++y) {
+                for (int x = lo[0]; x < hi[0]; ++x) {
+                    result[(z * grid[1] + y) * grid[0] + x] = first;
+                }
+            }
+        }
+        return;
+    }
+    int leftHi[3] = {hi[0], hi[1], hi[2]};
+    int rightLo[3] = {lo[0], lo[1], lo[2]};
+    leftHi[axis] = cut;
+    rightLo[axis] = cut;
+    split(weights, first, first + left, lo, leftHi, result);
+    split(weights, first + left, end, rightLo, hi, result);
+}
+
+double LoadBalancer::slowestRank(const std::vector<int>& brickOwners) const {
+    std::vector<double> perRank(mpiSize, 0.0);
+    for (size_t i = 0; i < brickOwners.size(); ++i) {
+        perRank[brickOwners[i]] += costs[i];
+    }
+    return *std::max_element(perRank.begin(), perRank.end());
+}
+
+void LoadBalancer::assign(const std::vector<int>& brickOwners) {
+    owners = brickOwners;
+    assigned.clear();
+    for (size_t i = 0; i < bricks.size(); ++i) {
+        if (owners[i] == mpiRank) {
+            assigned.push_back(bricks[i]);
+        }
+    }
+}
+
+bool LoadBalancer::update(double seconds, const std::vector<uint64_t>& work) {
+    // Each owned brick's share of the render time, by the samples taken in
+    // it. Only the owner sends a brick's cost, so the sum over ranks adds a
+    // single non-zero term and every rank gets the same, exact costs.
+    const int count = static_cast<int>(bricks.size());
+    sent.assign(count, 0.0);
+    const uint64_t totalWork = work.size() == bricks.size()
+        ? std::accumulate(work.begin(), work.end(), uint64_t(0)) : 0;
+    if (totalWork > 0) {
+        for (int b = 0; b < count; ++b) {
+            sent[b] = owners[b] == mpiRank ? seconds * work[b] / totalWork : 0.0;
+        }
+    } else {
+        for (const BrickInfo& brick : assigned) {
+            sent[brick.id] = seconds / assigned.size();
+        }
+    }
+    summed.resize(count);
+    MPI_Allreduce(sent.data(), summed.data(), count, MPI_DOUBLE, MPI_SUM, mpiComm);
+    rankSeconds.resize(mpiSize);
+    MPI_Allgather(&seconds, 1, MPI_DOUBLE, rankSeconds.data(), 1, MPI_DOUBLE, mpiComm);
+
+    const double slowest = *std::max_element(rankSeconds.begin(), rankSeconds.end());
+    const double mean = std::accumulate(rankSeconds.begin(), rankSeconds.end(), 0.0) / mpiSize;
+    imbalance = mean > 0.0 ? static_cast<float>(slowest / mean - 1.0) : 0.0f;
+    for (int b = 0; b < count; ++b) {
+        costs[b] = measured ? 0.5 * (costs[b] + summed[b]) : summed[b];
+    }
+    measured = true;
+
+    ++framesSinceRebalance;
+    framesOver = imbalance > params.threshold ? framesOver + 1 : 0;
+    if (!kdTree || framesOver < params.hysteresis || framesSinceRebalance < params.hysteresis) {
+        return false;
+    }
+    framesOver = 0;
+
+    // Move only for a gain worth the reload
+    std::vector<int> brickOwners(count, 0);
+    const int lo[3] = {0, 0, 0};
+    split(costs, 0, mpiSize, lo, grid, brickOwners);
+    const double before = slowestRank(owners);
+    const double after = slowestRank(brickOwners);
+    if (brickOwners == owners || after * (1.0 + 0.5 * params.threshold) >= before) {
+        return false;
+    }
+    const double share = std::accumulate(costs.begin(), costs.end(), 0.0) / mpiSize;
+    assign(brickOwners);
+    framesSinceRebalance = 0;
+    if (mpiRank == 0) {
+        LOG_INFO("Rebalanced " << count << " bricks: slowest rank " << imbalance * 100.0f
+                 << "% over the mean, predicted " << (after / share - 1.0) * 100.0 << "%");
+    }
+    return true;
+}
+
+} // namespace morviq
@@ -1,9 +1,23 @@
 #include "renderer/Renderer.h"
+#include "renderer/LoadBalancer.h"
+#include "renderer/TemporalAccumulator.h"
+#include "renderer/TimestepPrefetcher.h"
+#include "renderer/VirtualVolume.h"
 #include "renderer/VolumeRenderer.h"
 #include "compositor/DepthCompositor.h"
+#include "compositor/HierarchicalCompositor.h"
+#include "compositor/TileCompositor.h"
+#include "data/BrickCache.h"
 #include "data/DataLoader.h"
+#include "data/MPIVolumeReader.h"
 #include "codec/PNGEncoder.h"
+#include "codec/PNGStream.h"
+#include "io/AsyncFrameWriter.h"
+#include "io/FrameStreamServer.h"
+#include "io/SharedFrameRing.h"
 #include "utils/Logger.h"
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
@@ -24,8 +38,8 @@ Renderer::~Renderer() {
 bool Renderer::initialize(int width, int height) {
     LOG_INFO("Initializing renderer at " << width << "x" << height);
     
-    currentFrame = std::make_unique<Frame>(width, height, 4);
-    if (mpiRank == 0) {
+    const bool distributed = compositeParams.distributedOutput && mpiSize > 1;
+    if (mpiRank == 0 && !distributed) {
         compositeFrame = std::make_unique<Frame>(width, height, 4);
     }
     
@@ -34,43 +48,426 @@ bool Renderer::initialize(int width, int height) {
         return false;
     }
     
-    if (!compositor->initialize(width, height)) {
-        LOG_ERROR("Failed to initialize compositor");
+    if (distributed) {
+        if (compositeParams.hierarchical && mpiRank == 0) {
+            LOG_WARN("Distributed output ignores hierarchical compositing");
+        }
+        // Each rank keeps and encodes its own stripe; rank 0 never holds the full image
+        tileCompositor = std::make_unique<TileCompositor>(mpiRank, mpiSize, mpiComm);
+        if (!tileCompositor->initialize(width, height)) {
+            LOG_ERROR("Failed to initialize tile compositor");
+            return false;
+        }
+        stripeEncoder = std::make_unique<PNGStripeEncoder>();
+        currentFrame = std::make_unique<Frame>(width, height, 4);
+    } else if (compositeParams.hierarchical && mpiSize > 1) {
+        nodeCompositor = std::make_unique<HierarchicalCompositor>(mpiRank, mpiSize, mpiComm);
+        if (!nodeCompositor->initialize(width, height)) {
+            LOG_ERROR("Failed to initialize hierarchical compositor");
+            return false;
+        }
+        // Render straight into this rank's shared-memory slot
+        currentFrame = std::make_unique<Frame>();
+        nodeCompositor->attachLocalFrame(*currentFrame);
+    } else {
+        currentFrame = std::make_unique<Frame>(width, height, 4);
+        if (!compositor->initialize(width, height)) {
+            LOG_ERROR("Failed to initialize compositor");
+            return false;
+        }
+    }
+    
+    if (distributed && outputParams.format != OutputParams::PNG) {
+        if (mpiRank == 0) {
+            LOG_WARN("Distributed output only supports PNG; ignoring --format");
+        }
+        outputParams.format = OutputParams::PNG;
+    }
+    if (outputParams.publishes()) {
+        if (distributed) {
+            if (mpiRank == 0) {
+                LOG_WARN("Shared-memory and stream output need the full frame on rank 0; writing files");
+            }
+            outputParams.shmName.clear();
+            outputParams.streamPort = 0;
+            outputParams.streamSocket.clear();
+        } else if (createSequenceWriter(outputParams)) {
+            if (mpiRank == 0) {
+                LOG_WARN("Published output carries single frames; using --format raw");
+            }
+            outputParams.format = OutputParams::RAW;
+        }
+    }
+    encoder = createEncoder(outputParams);
+    if (compositeFrame && !initializePublishers(width, height)) {
         return false;
     }
+    if (compositeFrame && publishers.empty()) {
+        // Opened on the first saveFrame, once the output directory is known
+        sequenceWriter = createSequenceWriter(outputParams);
+    }
+    if (outputParams.async && compositeFrame) {
+        frameWriter = std::make_unique<AsyncFrameWriter>();
+        if (!frameWriter->initialize(width, height, outputParams, sequenceWriter.get(), publishers)) {
+            LOG_ERROR("Failed to initialize async frame writer");
+            return false;
+        }
+    } else if (outputParams.async && distributed && mpiRank == 0) {
+        LOG_WARN("Async output is not used with distributed output");
+    }
+    
+    if (renderParams.temporalAccumulation) {
+        initializeTemporal();
+    }
     
     // Initialize bricks
-    assignBricks();
+    balancer = std::make_unique<LoadBalancer>(mpiRank, mpiSize, mpiComm);
+    assignBricks(nullptr);
     
     return true;
 }
 
+bool Renderer::initializePublishers(int width, int height) {
+    const uint32_t format = static_cast<uint32_t>(outputParams.format);
+    if (!outputParams.shmName.empty()) {
+        // Worst case is QOI at 5 bytes per pixel; tmpfs only backs the pages
+        // a frame actually touches
+        const size_t slotCapacity = static_cast<size_t>(width) * height * 5 + 64 * 1024;
+        frameRing = std::make_unique<SharedFrameRing>();
+        if (!frameRing->initialize(outputParams.shmName, outputParams.shmSlots, slotCapacity,
+                                   width, height, format)) {
+            LOG_ERROR("Failed to initialize shared-memory frame ring");
+            return false;
+        }
+        publishers.push_back(frameRing.get());
+    }
+    if (outputParams.streamPort > 0 || !outputParams.streamSocket.empty()) {
+        frameStream = std::make_unique<FrameStreamServer>();
+        bool ok = outputParams.streamSocket.empty()
+            ? frameStream->start(outputParams.streamPort, format)
+            : frameStream->startUnix(outputParams.streamSocket, format);
+        if (!ok) {
+            LOG_ERROR("Failed to start frame stream server");
+            return false;
+        }
+        publishers.push_back(frameStream.get());
+    }
+    return true;
+}
+
 void Renderer::shutdown() {
+    if (prefetcher) {
+        prefetcher->stop();
+    }
+    if (virtualVolume) {
+        const VirtualVolume::Stats pageStats = virtualVolume->getStats();
+        LOG_INFO("Paging: " << pageStats.pagesLoaded << " pages loaded, " << pageStats.pagesEvicted
+                 << " evicted, " << pageStats.residentPages << " resident ("
+                 << pageStats.residentBytes / (1024.0 * 1024.0) << " MB)");
+        volumeRenderer->setVirtualVolume(nullptr);
+        virtualVolume.reset();
+    }
+    const BrickCache::Stats cacheStats = BrickCache::shared().getStats();
+    if (cacheStats.hits + cacheStats.misses > 0) {
+        LOG_INFO("Brick cache: " << cacheStats.hits << " hits, " << cacheStats.misses << " misses, "
+                 << cacheStats.evictions << " evictions, " << cacheStats.entries << " blocks ("
+                 << cacheStats.bytes / (1024.0 * 1024.0) << " MB of "
+                 << cacheStats.budget / (1024.0 * 1024.0) << " MB)");
+    }
+    if (frameWriter) {
+        frameWriter->shutdown();
+    }
+    if (sequenceWriter) {
+        sequenceWriter->close();
+    }
+    publishers.clear();
+    if (frameStream) {
+        frameStream->stop();
+    }
+    if (frameRing) {
+        frameRing->shutdown();
+    }
     if (volumeRenderer) {
         volumeRenderer->shutdown();
     }
+    if (nodeCompositor) {
+        // Drop the borrowed view before the shared window goes away
+        currentFrame.reset();
+        nodeCompositor->shutdown();
+    }
+    if (tileCompositor) {
+        tileCompositor->shutdown();
+    }
     if (compositor) {
         compositor->shutdown();
     }
 }
 
 void Renderer::setDataPath(const std::string& path) {
+    dataPath = path;
     dataLoader->setBasePath(path);
 }
 
+void Renderer::setMapOptions(const MapOptions& options) {
+    mapOptions = options;
+    dataLoader->setMapOptions(options);
+}
+
+void Renderer::setReadParams(const ReadParams& params) {
+    readParams = params;
+}
+
+void Renderer::setPagingParams(const PagingParams& params) {
+    pagingParams = params;
+}
+
+void Renderer::setCacheBudget(size_t bytes) {
+    BrickCache::shared().setBudget(bytes);
+}
+
+void Renderer::setCompressRate(int rate) {
+    compressRate = rate;
+    dataLoader->setCompressRate(rate);
+}
+
+void Renderer::setSparseParams(const SparseParams& params) {
+    sparseParams = params;
+    dataLoader->setSparseParams(params);
+}
+
+void Renderer::setBalanceParams(const BalanceParams& params) {
+    balanceParams = params;
+}
+
+void Renderer::setPrefetchSlots(int slots) {
+    prefetchSlots = std::max(0, slots);
+}
+
+std::vector<BrickInfo> Renderer::blockRegions() const {
+    // Each rank reads only its own bricks plus ghost layers. Bricks that
+    // tile a box are read as that box, so shared faces are read once.
+    std::vector<BrickInfo> regions;
+    if (assignedBricks.empty()) {
+        return regions;
+    }
+    BrickInfo bounds = assignedBricks[0];
+    float brickVolume = 0.0f;
+    for (const BrickInfo& brick : assignedBricks) {
+        bounds.minBounds = Vec3(std::min(bounds.minBounds.x, brick.minBounds.x),
+                                std::min(bounds.minBounds.y, brick.minBounds.y),
+                                std::min(bounds.minBounds.z, brick.minBounds.z));
+        bounds.maxBounds = Vec3(std::max(bounds.maxBounds.x, brick.maxBounds.x),
+                                std::max(bounds.maxBounds.y, brick.maxBounds.y),
+                                std::max(bounds.maxBounds.z, brick.maxBounds.z));
+        brickVolume += (brick.maxBounds.x - brick.minBounds.x) * (brick.maxBounds.y - brick.minBounds.y) *
+                       (brick.maxBounds.z - brick.minBounds.z);
+    }
+    const float boundsVolume = (bounds.maxBounds.x - bounds.minBounds.x) *
+                               (bounds.maxBounds.y - bounds.minBounds.y) *
+                               (bounds.maxBounds.z - bounds.minBounds.z);
+    if (brickVolume >= boundsVolume * 0.999f) {
+        regions.push_back(bounds);
+    } else {
+        regions = assignedBricks;
+    }
+    return regions;
+}
+
 bool Renderer::loadVolume(const std::string& dataset, int timeStep) {
-    auto volumeData = dataLoader->loadVolume(dataset, timeStep);
-    if (!volumeData) {
+    int dimensions[3];
+    if (!dataLoader->getDimensions(dataset, timeStep, dimensions)) {
         LOG_ERROR("Failed to load volume data");
         return false;
     }
+    assignBricks(dimensions);
+    return loadBricks(dataset, timeStep, dimensions);
+}
+
+bool Renderer::loadBricks(const std::string& dataset, int timeStep, const int dimensions[3]) {
+    if (prefetcher) {
+        prefetcher->stop();
+        prefetcher.reset();
+    }
+    volumeRenderer->setVirtualVolume(nullptr);
+    virtualVolume.reset();
+    volumeRenderer->clearVolumeData();
+    resetHistory();
+    
+    if (pagingParams.memoryBudget > 0 && dataLoader->hasTimeStep(dataset, timeStep)) {
+        // Pages load as rays reach them; each rank touches only its bricks
+        auto loader = std::make_unique<DataLoader>();
+        loader->setBasePath(dataPath);
+        loader->setMapOptions(mapOptions);
+        loader->setCompressRate(compressRate);
+        loader->setSparseParams(sparseParams);
+        virtualVolume = std::make_unique<VirtualVolume>();
+        if (!virtualVolume->open(std::move(loader), dataset, timeStep, pagingParams)) {
+            virtualVolume.reset();
+            return false;
+        }
+        volumeRenderer->setVirtualVolume(virtualVolume.get());
+        currentDataset = dataset;
+        currentTimeStep = timeStep;
+        failedTimeStep = -1;
+        return true;
+    }
+    
+    const std::vector<BrickInfo> regions = blockRegions();
+    
+    auto start = std::chrono::steady_clock::now();
+    size_t loadedVoxels = 0;
+    std::string rawPath;
+    DataLoader::RawHeader rawHeader;
+    if (readParams.mode != ReadParams::MAPPED &&
+        dataLoader->getRawVolume(dataset, timeStep, rawPath, rawHeader)) {
+        const int rate = dataLoader->getCompressRate(dataset, timeStep);
+        if (!readRawBlocks(rawPath, rawHeader, timeStep, rate, regions, loadedVoxels)) {
+            volumeRenderer->clearVolumeData();
+            return false;
+        }
+    } else {
+        for (const BrickInfo& region : regions) {
+            int begin[3];
+            int size[3];
+            VolumeRenderer::brickRegion(region, dimensions, VolumeRenderer::kGhostVoxels, begin, size);
+            auto block = dataLoader->loadRegion(dataset, timeStep, begin, size);
+            if (!block) {
+                LOG_ERROR("Failed to load volume data");
+                volumeRenderer->clearVolumeData();
+                return false;
+            }
+            loadedVoxels += block->voxelCount;
+            volumeRenderer->addVolumeBlock(std::move(block));
+        }
+    }
+    currentDataset = dataset;
+    currentTimeStep = timeStep;
+    failedTimeStep = -1;
+    if (prefetchSlots > 0 && dataLoader->hasTimeStep(dataset, timeStep)) {
+        // MPI is not called from the prefetch thread, so it maps or reads
+        // raw volumes per rank even when readParams asks for MPI-IO
+        auto loader = std::make_unique<DataLoader>();
+        loader->setBasePath(dataPath);
+        loader->setMapOptions(mapOptions);
+        loader->setCompressRate(compressRate);
+        loader->setSparseParams(sparseParams);
+        prefetcher = std::make_unique<TimestepPrefetcher>();
+        prefetcher->start(std::move(loader), dataset, regions, timeStep, prefetchSlots);
+    }
+    if (assignedBricks.empty()) {
+        return true;
+    }
     
-    volumeRenderer->setVolumeData(std::move(volumeData));
-    assignBricks();
+    const size_t totalVoxels = static_cast<size_t>(dimensions[0]) * dimensions[1] * dimensions[2];
+    LOG_INFO("Rank " << mpiRank << " loaded " << regions.size() << " block(s) for "
+             << assignedBricks.size() << " brick(s): " << loadedVoxels * sizeof(float) / (1024.0 * 1024.0)
+             << " MB of " << totalVoxels * sizeof(float) / (1024.0 * 1024.0) << " MB ("
+             << dimensions[0] << "x" << dimensions[1] << "x" << dimensions[2] << ") in "
+             << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s");
     
     return true;
 }
 
+bool Renderer::updateTimeStep(int timeStep) {
+    if (currentDataset.empty()) {
+        return false;
+    }
+    if (!prefetcher) {
+        // Load synchronously; a dataset without time steps is left alone
+        if (timeStep == currentTimeStep || timeStep == failedTimeStep || prefetchSlots > 0 ||
+            !dataLoader->hasTimeStep(currentDataset, currentTimeStep)) {
+            return false;
+        }
+        if (!dataLoader->hasTimeStep(currentDataset, timeStep) || !loadVolume(currentDataset, timeStep)) {
+            if (mpiRank == 0) {
+                LOG_WARN("Time step " << timeStep << " could not be loaded");
+            }
+            failedTimeStep = timeStep;
+            return false;
+        }
+        return true;
+    }
+    prefetcher->request(timeStep);
+    if (timeStep == currentTimeStep) {
+        return false;
+    }
+    
+    // Swap only when every rank holds the step, so all ranks composite the same one
+    const TimestepPrefetcher::Status status = prefetcher->status(timeStep);
+    int state = status == TimestepPrefetcher::READY ? 1 : status == TimestepPrefetcher::FAILED ? -1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &state, 1, MPI_INT, MPI_MIN, mpiComm);
+    if (state < 0) {
+        if (failedTimeStep != timeStep && mpiRank == 0) {
+            LOG_WARN("Time step " << timeStep << " could not be loaded; keeping time step " << currentTimeStep);
+        }
+        failedTimeStep = timeStep;
+        return false;
+    }
+    std::vector<std::unique_ptr<VolumeData>> blocks;
+    if (state == 0 || !prefetcher->take(timeStep, blocks)) {
+        return false;
+    }
+    volumeRenderer->swapVolumeBlocks(blocks);
+    prefetcher->retire(blocks);
+    currentTimeStep = timeStep;
+    resetHistory();
+    if (mpiRank == 0) {
+        LOG_INFO("Showing time step " << timeStep);
+    }
+    return true;
+}
+
+bool Renderer::readRawBlocks(const std::string& path, const DataLoader::RawHeader& header, int timeStep,
+                             int rate, const std::vector<BrickInfo>& regions, size_t& loadedVoxels) {
+    // Blocks still cached (e.g. of a revisited time step) are not read again
+    BrickCache& cache = BrickCache::shared();
+    std::vector<BrickCache::Key> misses;
+    for (const BrickInfo& region : regions) {
+        BrickCache::Key key{path, timeStep, 0, {0, 0, 0}, {0, 0, 0}, rate, sparseParams.enabled};
+        VolumeRenderer::brickRegion(region, header.dimensions, VolumeRenderer::kGhostVoxels,
+                                    key.begin, key.size);
+        if (auto block = cache.find(key)) {
+            loadedVoxels += block->voxelCount;
+            volumeRenderer->addVolumeBlock(std::move(block));
+        } else {
+            misses.push_back(key);
+        }
+    }
+    
+    // Collective: every rank takes part in each read, with an empty region
+    // once it has read its own, and all ranks agree on the outcome
+    int reads = static_cast<int>(misses.size());
+    MPI_Allreduce(MPI_IN_PLACE, &reads, 1, MPI_INT, MPI_MAX, mpiComm);
+    if (reads == 0) {
+        return true;
+    }
+    MPIVolumeReader reader(mpiComm);
+    int ok = reader.open(path, header.dimensions, header.type, header.headerBytes, readParams);
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, mpiComm);
+    for (int i = 0; ok && i < reads; ++i) {
+        const bool own = i < static_cast<int>(misses.size());
+        const int none[3] = {0, 0, 0};
+        std::unique_ptr<VolumeData> block;
+        int readOk = reader.read(own ? misses[i].begin : none, own ? misses[i].size : none, block);
+        MPI_Allreduce(MPI_IN_PLACE, &readOk, 1, MPI_INT, MPI_LAND, mpiComm);
+        ok = readOk;
+        if (ok && block) {
+            for (int a = 0; a < 3; ++a) {
+                block->spacing[a] = header.spacing[a];
+                block->origin[a] = block->offset[a] * header.spacing[a];
+            }
+            loadedVoxels += block->voxelCount;
+            block = dataLoader->packBlock(std::move(block), rate);
+            volumeRenderer->addVolumeBlock(cache.insert(misses[i], std::move(block)));
+        }
+    }
+    reader.close();
+    if (!ok) {
+        LOG_ERROR("Failed to load volume data with MPI-IO");
+    }
+    return ok;
+}
+
 void Renderer::setCamera(const Camera& cam) {
     camera = cam;
     volumeRenderer->setCamera(camera);
@@ -79,44 +476,98 @@ void Renderer::setCamera(const Camera& cam) {
 void Renderer::setTransferFunction(const TransferFunction& tf) {
     transferFunction = tf;
     volumeRenderer->setTransferFunction(transferFunction);
+    resetHistory();
 }
 
 void Renderer::setRenderParams(const RenderParams& params) {
+    if (params.stepSize != renderParams.stepSize) {
+        resetHistory();
+    }
+    const bool enableTemporal = params.temporalAccumulation && !renderParams.temporalAccumulation;
     renderParams = params;
     volumeRenderer->setRenderParams(renderParams);
+    if (enableTemporal) {
+        initializeTemporal();
+    }
+}
+
+void Renderer::initializeTemporal() {
+    if (compositeFrame) {
+        if (!temporal) {
+            temporal = std::make_unique<TemporalAccumulator>();
+            temporal->initialize(compositeFrame->width, compositeFrame->height);
+        }
+        temporal->reset();
+    } else if (mpiRank == 0 && compositeParams.distributedOutput) {
+        LOG_WARN("Temporal accumulation needs the full frame on rank 0; not accumulating");
+    }
+}
+
+void Renderer::resetHistory() {
+    if (temporal) {
+        temporal->reset();
+    }
+}
+
+void Renderer::setCompositeParams(const CompositeParams& params) {
+    compositeParams = params;
+}
+
+void Renderer::setOutputParams(const OutputParams& params) {
+    outputParams = params;
 }
 
 bool Renderer::render() {
+    volumeRenderer->setJitterFrame(renderParams.temporalAccumulation ? jitterFrame++ : -1);
+    if (virtualVolume && virtualVolume->update() > 0) {
+        // Pages arrived: the image refines
+        resetHistory();
+    }
     renderBricks();
     compositeFrames();
+    balance();
+    if (temporal && renderParams.temporalAccumulation && compositeFrame) {
+        temporal->accumulate(*compositeFrame, camera);
+    }
     return true;
 }
 
-void Renderer::assignBricks() {
-    int totalBricks = 8;
-    assignedBricks.clear();
-    
-    int bricksPerRank = (totalBricks + mpiSize - 1) / mpiSize;
-    int startBrick = mpiRank * bricksPerRank;
-    int endBrick = std::min(startBrick + bricksPerRank, totalBricks);
-    
-    for (int i = startBrick; i < endBrick; ++i) {
-        BrickInfo brick;
-        brick.id = i;
-        brick.lodLevel = 0;
-        
-        int bx = i % 2;
-        int by = (i / 2) % 2;
-        int bz = i / 4;
-        
-        brick.minBounds = Vec3(bx * 0.5f, by * 0.5f, bz * 0.5f);
-        brick.maxBounds = Vec3((bx + 1) * 0.5f, (by + 1) * 0.5f, (bz + 1) * 0.5f);
-        brick.priority = 1.0f;
-        
-        assignedBricks.push_back(brick);
+float Renderer::getImbalance() const {
+    return balancer ? balancer->getImbalance() : 0.0f;
+}
+
+void Renderer::assignBricks(const int dimensions[3]) {
+    balancer->decompose(balanceParams, dimensions);
+    takeAssignment();
+}
+
+void Renderer::takeAssignment() {
+    // Rays march the loaded boxes; the work grid still tells the bricks apart
+    assignedBricks = balancer->getAssignedBricks();
+    renderedBricks = blockRegions();
+    volumeRenderer->setWorkGrid(balancer->getGrid());
+}
+
+void Renderer::balance() {
+    if (balanceParams.threshold <= 0.0f || mpiSize < 2 ||
+        !balancer->update(renderSeconds, volumeRenderer->getWork())) {
+        return;
+    }
+    // All ranks moved bricks together; pages follow the rays, and generated
+    // data is generated again for the new bricks
+    takeAssignment();
+    resetHistory();
+    if (virtualVolume) {
+        return;
+    }
+    int dimensions[3];
+    if (currentDataset.empty() || !dataLoader->getDimensions(currentDataset, currentTimeStep, dimensions)) {
+        volumeRenderer->clearVolumeData();
+        return;
+    }
+    if (!loadBricks(currentDataset, currentTimeStep, dimensions)) {
+        LOG_ERROR("Rank " << mpiRank << " could not load its rebalanced bricks");
     }
-    
-    LOG_DEBUG("Rank " << mpiRank << " assigned " << assignedBricks.size() << " bricks");
 }
 
 void Renderer::renderBricks() {
@@ -132,43 +583,147 @@ void Renderer::renderBricks() {
         currentFrame->colorBuffer[i * 4 + 3] = 255; // opaque
     }
     
-    // Render all bricks (for now just render brick 0 which contains the full volume)
-    if (!assignedBricks.empty()) {
-        volumeRenderer->renderBrick(assignedBricks[0], *currentFrame);
+    const auto start = std::chrono::steady_clock::now();
+    if (!renderedBricks.empty()) {
+        volumeRenderer->renderBricks(renderedBricks, *currentFrame);
     }
+    renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
 void Renderer::compositeFrames() {
-    CompositeParams params;
-    params.mode = CompositeParams::MIN_DEPTH;
-    params.useGPU = false;
-    params.numRanks = mpiSize;
+    // compositeParams and emptyFrame are members so a steady-state frame
+    // allocates nothing
+    compositeParams.useGPU = false;
+    compositeParams.numRanks = mpiSize;
+    if (tileCompositor) {
+        tileCompositor->composite(*currentFrame, compositeParams);
+        return;
+    }
     
-    if (mpiRank == 0) {
-        compositor->composite(*currentFrame, *compositeFrame, params);
+    Frame& output = mpiRank == 0 ? *compositeFrame : emptyFrame;
+    
+    if (nodeCompositor) {
+        nodeCompositor->composite(output, compositeParams);
     } else {
-        Frame dummy;
-        compositor->composite(*currentFrame, dummy, params);
+        compositor->composite(*currentFrame, output, compositeParams);
     }
 }
 
 void Renderer::saveFrame(const std::string& outputPath, int frameNumber) {
-    if (mpiRank != 0 || !compositeFrame) {
+    if (!tileCompositor && (mpiRank != 0 || !compositeFrame)) {
         return;
     }
     
     std::filesystem::path outDir(outputPath);
     std::filesystem::path compositedDir = outDir / "composited";
-    std::filesystem::create_directories(compositedDir);
-    
     char filename[256];
-    std::snprintf(filename, sizeof(filename), "frame_%06d.png", frameNumber);
+    std::snprintf(filename, sizeof(filename), "frame_%06d.%s", frameNumber,
+                  encoder->getFileExtension().c_str());
     std::filesystem::path filePath = compositedDir / filename;
     
-    PNGEncoder encoder;
-    if (!encoder.encode(*compositeFrame, filePath.string())) {
+    if (mpiRank == 0 && publishers.empty()) {
+        std::filesystem::create_directories(compositedDir);
+    }
+    
+    if (tileCompositor) {
+        saveDistributedFrame(filePath.string());
+        return;
+    }
+    
+    if (sequenceWriter) {
+        filePath = outputParams.sequencePath.empty()
+            ? compositedDir / ("animation." + sequenceWriter->getFileExtension())
+            : std::filesystem::path(outputParams.sequencePath);
+        if (!sequenceOpen &&
+            !sequenceWriter->open(filePath.string(), compositeFrame->width, compositeFrame->height)) {
+            LOG_ERROR("Failed to open " << filePath.string());
+            return;
+        }
+        sequenceOpen = true;
+    }
+    
+    if (frameWriter) {
+        // Hands the composite over and continues rendering into a recycled buffer
+        if (!frameWriter->submit(compositeFrame, filePath.string())) {
+            LOG_DEBUG("Output queue full, dropped frame " << frameNumber);
+        }
+        return;
+    }
+    
+    bool ok;
+    if (!publishers.empty()) {
+        bool resync = false;
+        for (FramePublisher* publisher : publishers) {
+            resync = publisher->takeKeyframeRequest() || resync;
+        }
+        if (resync) encoder->requestKeyframe();
+        ok = encoder->encode(*compositeFrame, encoded);
+        const bool keyframe = encoder->wroteKeyframe();
+        for (FramePublisher* publisher : publishers) {
+            ok = ok && publisher->publish(encoded.data(), encoded.size(), keyframe);
+        }
+    } else if (sequenceWriter) {
+        ok = sequenceWriter->writeFrame(*compositeFrame);
+    } else {
+        ok = encoder->encodeToFile(*compositeFrame, filePath.string());
+    }
+    if (!ok) {
         LOG_ERROR("Failed to save frame " << frameNumber);
     }
 }
 
+void Renderer::saveDistributedFrame(const std::string& filePath) {
+    // Every rank converts and deflates its own stripe; rank 0 only splices the
+    // compressed stripes into one PNG stream as they arrive, so its memory and
+    // work stay nearly flat as the resolution grows.
+    const Frame& tile = tileCompositor->getTile();
+    const bool last = mpiRank == mpiSize - 1;
+    const PNGEncodeParams png(outputParams);
+    bool ok = stripeEncoder->encode(tile.colorBuffer.get(), nullptr, tile.width, tile.height,
+                                    png.compressionLevel, png.filter, last, stripe, true);
+    
+    // A missing stripe would leave a hole in the deflate stream, so nothing
+    // is sent or written unless every rank encoded its own
+    int encoded = ok ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &encoded, 1, MPI_INT, MPI_LAND, mpiComm);
+    if (!encoded) {
+        if (mpiRank == 0) {
+            LOG_ERROR("Failed to encode a stripe of distributed frame " << filePath);
+        }
+        return;
+    }
+    
+    uint64_t meta[3] = {stripe.data.size(), stripe.adler, stripe.rawLength};
+    if (mpiRank != 0) {
+        MPI_Send(meta, 3, MPI_UINT64_T, 0, 2, mpiComm);
+        MPI_Send(stripe.data.data(), static_cast<int>(meta[0]), MPI_BYTE, 0, 3, mpiComm);
+        return;
+    }
+    
+    FILE* fp = std::fopen(filePath.c_str(), "wb");
+    if (!fp) {
+        LOG_ERROR("Failed to open " << filePath);
+    }
+    PNGStreamWriter writer(PNGStreamWriter::fileSink(fp));
+    ok = fp && writer.begin(tileCompositor->getTile().width, currentFrame->height) &&
+         writer.writeStripe(stripe);
+    
+    // Reuse this rank's stripe buffer for the incoming ones; keep receiving
+    // after a write error so the senders are not left blocked
+    std::vector<uint8_t>& incoming = stripe.data;
+    for (int r = 1; r < mpiSize; ++r) {
+        MPI_Recv(meta, 3, MPI_UINT64_T, r, 2, mpiComm, MPI_STATUS_IGNORE);
+        incoming.resize(meta[0]);
+        MPI_Recv(incoming.data(), static_cast<int>(meta[0]), MPI_BYTE, r, 3, mpiComm, MPI_STATUS_IGNORE);
+        ok = ok && writer.writeStripe(incoming.data(), incoming.size(),
+                                      static_cast<uint32_t>(meta[1]), meta[2]);
+    }
+    ok = ok && writer.finish();
+    if (fp) ok = std::fclose(fp) == 0 && ok;
+    if (!ok) {
+        LOG_ERROR("Failed to save distributed frame " << filePath);
+        if (fp) std::remove(filePath.c_str());
+    }
+}
+
 } // namespace morviq
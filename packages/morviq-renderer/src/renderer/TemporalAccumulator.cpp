@@ -0,0 +1,357 @@
+#include "renderer/TemporalAccumulator.h"
+#include "renderer/VolumeRenderer.h"
+#include "utils/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace morviq {
+
+namespace {
+
+// Column-major 4x4 helpers
+void multiply(const float* a, const float* b, float* out) {
+    for (int c = 0; c < 4; ++c) {
+        for (int r = 0; r < 4; ++r) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) sum += a[k * 4 + r] * b[c * 4 + k];
+            out[c * 4 + r] = sum;
+        }
+    }
+}
+
+void transform(const float* m, float x, float y, float z, float w, float* out) {
+    for (int r = 0; r < 4; ++r) {
+        out[r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r] * w;
+    }
+}
+
+bool invert(const float* m, float* out) {
+    float inv[16];
+    inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+    const float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (std::fabs(det) < 1e-12f) return false;
+    for (int i = 0; i < 16; ++i) out[i] = inv[i] / det;
+    return true;
+}
+
+struct BlendJob {
+    const uint8_t* color; // current frame
+    const float* depth;
+    uint8_t* output;      // same buffer, written once every row is blended
+    const float* previous;
+    float* next;
+    int width;
+    int height;
+    int motion;
+    float weight; // of the current frame
+    const float* reprojection;
+};
+
+constexpr int kStill = 0;
+constexpr int kMoving = 1;
+
+void catmullRomWeights(float t, float* w) {
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+    w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    w[3] = 0.5f * (t3 - t2);
+}
+
+// Position of pixel (x, y) in the previous frame, in pixels; false if it was
+// behind the camera.
+bool previousPosition(const float* reprojection, int width, int height, int x, int y,
+                      float depth, float& sx, float& sy) {
+    const float u = ((x + 0.5f) / width) * 2.0f - 1.0f;
+    const float v = 1.0f - ((y + 0.5f) / height) * 2.0f;
+    float clip[4];
+    transform(reprojection, u, v, depth * 2.0f - 1.0f, 1.0f, clip);
+    if (clip[3] <= 1e-6f) return false;
+    sx = (clip[0] / clip[3] + 1.0f) * 0.5f * width - 0.5f;
+    sy = (1.0f - clip[1] / clip[3]) * 0.5f * height - 0.5f;
+    return true;
+}
+
+// Bounds of the 3x3 neighbourhood of every pixel of row y: the channel
+// min/max and the nearest depth. Separable: rows y-1..y+1 are reduced per
+// column, then three adjacent columns per pixel.
+void neighbourhoodBounds(const BlendJob& j, int y, uint8_t* columnLo, uint8_t* columnHi,
+                         float* columnNearest, uint8_t* lo, uint8_t* hi, float* nearest) {
+    const size_t channels = static_cast<size_t>(j.width) * 4;
+    const int first = std::max(y - 1, 0);
+    const int last = std::min(y + 1, j.height - 1);
+    std::memcpy(columnLo, j.color + static_cast<size_t>(first) * channels, channels);
+    std::memcpy(columnHi, j.color + static_cast<size_t>(first) * channels, channels);
+    std::memcpy(columnNearest, j.depth + static_cast<size_t>(first) * j.width, j.width * sizeof(float));
+    for (int ny = first + 1; ny <= last; ++ny) {
+        const uint8_t* c = j.color + static_cast<size_t>(ny) * channels;
+        const float* d = j.depth + static_cast<size_t>(ny) * j.width;
+        for (size_t i = 0; i < channels; ++i) {
+            columnLo[i] = std::min(columnLo[i], c[i]);
+            columnHi[i] = std::max(columnHi[i], c[i]);
+        }
+        for (int x = 0; x < j.width; ++x) columnNearest[x] = std::min(columnNearest[x], d[x]);
+    }
+
+    // Then with the columns to either side; edge pixels have only one
+    std::memcpy(lo, columnLo, channels);
+    std::memcpy(hi, columnHi, channels);
+    std::memcpy(nearest, columnNearest, j.width * sizeof(float));
+    for (size_t i = 4; i < channels; ++i) {
+        lo[i] = std::min(lo[i], columnLo[i - 4]);
+        hi[i] = std::max(hi[i], columnHi[i - 4]);
+    }
+    for (size_t i = 4; i < channels; ++i) {
+        lo[i - 4] = std::min(lo[i - 4], columnLo[i]);
+        hi[i - 4] = std::max(hi[i - 4], columnHi[i]);
+    }
+    for (int x = 1; x < j.width; ++x) nearest[x] = std::min(nearest[x], columnNearest[x - 1]);
+    for (int x = 1; x < j.width; ++x) nearest[x - 1] = std::min(nearest[x - 1], columnNearest[x]);
+}
+
+// Catmull-Rom history fetch; bilinear would blur the history a little more
+// on every reprojected frame
+void fetchHistory(const BlendJob& j, float sx, float sy, float* h) {
+    const int x1 = static_cast<int>(std::floor(sx));
+    const int y1 = static_cast<int>(std::floor(sy));
+    float wx[4];
+    float wy[4];
+    catmullRomWeights(sx - x1, wx);
+    catmullRomWeights(sy - y1, wy);
+#if defined(__SSE2__)
+    // One RGBA tap per register; the clamps are only needed at the border
+    if (x1 >= 1 && y1 >= 1 && x1 + 2 < j.width && y1 + 2 < j.height) {
+        const float* line = j.previous + (static_cast<size_t>(y1 - 1) * j.width + x1 - 1) * 4;
+        const size_t stride = static_cast<size_t>(j.width) * 4;
+        __m128 sum = _mm_setzero_ps();
+        for (int ty = 0; ty < 4; ++ty, line += stride) {
+            __m128 taps = _mm_mul_ps(_mm_loadu_ps(line), _mm_set1_ps(wx[0]));
+            taps = _mm_add_ps(taps, _mm_mul_ps(_mm_loadu_ps(line + 4), _mm_set1_ps(wx[1])));
+            taps = _mm_add_ps(taps, _mm_mul_ps(_mm_loadu_ps(line + 8), _mm_set1_ps(wx[2])));
+            taps = _mm_add_ps(taps, _mm_mul_ps(_mm_loadu_ps(line + 12), _mm_set1_ps(wx[3])));
+            sum = _mm_add_ps(sum, _mm_mul_ps(taps, _mm_set1_ps(wy[ty])));
+        }
+        _mm_storeu_ps(h, sum);
+        return;
+    }
+#endif
+    int columns[4];
+    for (int tx = 0; tx < 4; ++tx) columns[tx] = std::min(std::max(x1 - 1 + tx, 0), j.width - 1);
+    for (int k = 0; k < 4; ++k) h[k] = 0.0f;
+    for (int ty = 0; ty < 4; ++ty) {
+        const int row = std::min(std::max(y1 - 1 + ty, 0), j.height - 1);
+        const float* line = j.previous + static_cast<size_t>(row) * j.width * 4;
+        float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int tx = 0; tx < 4; ++tx) {
+            const float* tap = line + columns[tx] * 4;
+            for (int k = 0; k < 4; ++k) sum[k] += tap[k] * wx[tx];
+        }
+        for (int k = 0; k < 4; ++k) h[k] += sum[k] * wy[ty];
+    }
+}
+
+// The 3x3 neighbourhood bounds the history (so stale colours cannot ghost),
+// and its nearest depth moves silhouette pixels with the foreground rather
+// than the background
+void reprojectRow(const BlendJob& j, int y, const uint8_t* lo, const uint8_t* hi, const float* nearest,
+                  float* out) {
+    // The reprojection is linear in the pixel's u, so only the u and depth
+    // terms change along the row (see previousPosition)
+    const float* m = j.reprojection;
+    const float v = 1.0f - ((y + 0.5f) / j.height) * 2.0f;
+    float base[4];
+    for (int r = 0; r < 4; ++r) base[r] = m[4 + r] * v + m[12 + r];
+    const float du = 2.0f / j.width;
+
+    for (int x = 0; x < j.width; ++x) {
+        const uint8_t* c = j.color + (static_cast<size_t>(y) * j.width + x) * 4;
+        float* o = out + static_cast<size_t>(x) * 4;
+
+        const float u = (x + 0.5f) * du - 1.0f;
+        const float z = nearest[x] * 2.0f - 1.0f;
+        float clip[4];
+        for (int r = 0; r < 4; ++r) clip[r] = base[r] + m[r] * u + m[8 + r] * z;
+        const float inverseW = 1.0f / clip[3];
+        const float sx = (clip[0] * inverseW + 1.0f) * 0.5f * j.width - 0.5f;
+        const float sy = (1.0f - clip[1] * inverseW) * 0.5f * j.height - 0.5f;
+        if (!(clip[3] > 1e-6f) || !(sx > -0.5f && sy > -0.5f && sx < j.width - 0.5f && sy < j.height - 0.5f)) {
+            // Disoccluded: nothing to reuse
+            for (int k = 0; k < 4; ++k) o[k] = c[k];
+            continue;
+        }
+
+        float h[4];
+        fetchHistory(j, sx, sy, h);
+        for (int k = 0; k < 4; ++k) {
+            const float clamped = std::min(std::max(h[k], static_cast<float>(lo[x * 4 + k])),
+                                           static_cast<float>(hi[x * 4 + k]));
+            o[k] = clamped + (c[k] - clamped) * j.weight;
+        }
+    }
+}
+
+void blendRows(const BlendJob& j, size_t rowBegin, size_t rowEnd) {
+    // Per-row scratch for the moving path
+    const size_t scratch = j.motion == kMoving ? static_cast<size_t>(j.width) : 0;
+    std::vector<uint8_t> columnLo(scratch * 4);
+    std::vector<uint8_t> columnHi(scratch * 4);
+    std::vector<uint8_t> lo(scratch * 4);
+    std::vector<uint8_t> hi(scratch * 4);
+    std::vector<float> columnNearest(scratch);
+    std::vector<float> nearest(scratch);
+    for (size_t y = rowBegin; y < rowEnd; ++y) {
+        const size_t row = y * j.width * 4;
+        if (j.motion == kStill) {
+            for (size_t i = row; i < row + static_cast<size_t>(j.width) * 4; ++i) {
+                j.next[i] = j.previous[i] + (j.color[i] - j.previous[i]) * j.weight;
+            }
+        } else if (j.motion == kMoving) {
+            neighbourhoodBounds(j, static_cast<int>(y), columnLo.data(), columnHi.data(), columnNearest.data(),
+                                lo.data(), hi.data(), nearest.data());
+            reprojectRow(j, static_cast<int>(y), lo.data(), hi.data(), nearest.data(), j.next + row);
+        } else {
+            for (size_t i = row; i < row + static_cast<size_t>(j.width) * 4; ++i) {
+                j.next[i] = j.color[i];
+            }
+        }
+    }
+}
+
+} // namespace
+
+TemporalAccumulator::TemporalAccumulator()
+    : width(0), height(0), current(0), historyLength(0), previousUsedCamera(false) {
+    std::memset(previousViewProj, 0, sizeof(previousViewProj));
+    std::memset(reprojection, 0, sizeof(reprojection));
+}
+
+bool TemporalAccumulator::initialize(int w, int h, const TemporalParams& p) {
+    if (w <= 0 || h <= 0) return false;
+    width = w;
+    height = h;
+    params = p;
+    params.maxHistory = std::max(1, params.maxHistory);
+    params.blend = std::min(std::max(params.blend, 0.01f), 1.0f);
+    const size_t size = static_cast<size_t>(w) * h * 4;
+    history[0].assign(size, 0.0f);
+    history[1].assign(size, 0.0f);
+    reset();
+    return true;
+}
+
+void TemporalAccumulator::reset() {
+    historyLength = 0;
+}
+
+TemporalAccumulator::Motion TemporalAccumulator::classifyMotion(const Frame& frame,
+                                                                const Camera& camera) {
+    const bool usesCamera = VolumeRenderer::usesCamera(camera);
+    if (historyLength == 0 || usesCamera != previousUsedCamera) return RESET;
+    // The fixed orbit view does not follow the camera
+    if (!usesCamera) return STILL;
+
+    // Largest displacement over a grid of probe pixels
+    constexpr int kProbes = 9;
+    float motion = 0.0f;
+    for (int py = 0; py < kProbes; ++py) {
+        for (int px = 0; px < kProbes; ++px) {
+            const int x = (2 * px + 1) * width / (2 * kProbes);
+            const int y = (2 * py + 1) * height / (2 * kProbes);
+            float sx;
+            float sy;
+            if (!previousPosition(reprojection, width, height, x, y,
+                                  frame.depthBuffer[static_cast<size_t>(y) * width + x], sx, sy)) {
+                return RESET;
+            }
+            motion = std::max(motion, std::max(std::fabs(sx - x), std::fabs(sy - y)));
+        }
+    }
+    if (motion > params.resetMotion * width) return RESET;
+    return motion < 0.01f ? STILL : MOVING;
+}
+
+void TemporalAccumulator::accumulate(Frame& frame, const Camera& camera) {
+    if (frame.channels != 4) return;
+    if (frame.width != width || frame.height != height) {
+        if (!initialize(frame.width, frame.height, params)) return;
+    }
+
+    float viewProj[16];
+    float inverseView[16];
+    float inverseViewProj[16];
+    Motion motion = RESET;
+    if (invert(camera.view.m, inverseView)) {
+        multiply(camera.projection.m, inverseView, viewProj);
+        if (invert(viewProj, inverseViewProj)) {
+            multiply(previousViewProj, inverseViewProj, reprojection);
+            motion = classifyMotion(frame, camera);
+        }
+    } else {
+        std::memcpy(viewProj, Mat4().m, sizeof(viewProj));
+    }
+
+    float weight = 1.0f;
+    switch (motion) {
+        case STILL:
+            historyLength = std::min(historyLength + 1, params.maxHistory);
+            weight = 1.0f / historyLength;
+            break;
+        case MOVING:
+            // Hand over to progressive averaging at about the same weight
+            // once the camera stops
+            historyLength = std::min(historyLength + 1, static_cast<int>(1.0f / params.blend));
+            weight = params.blend;
+            break;
+        case RESET:
+            historyLength = 1;
+            break;
+    }
+
+    const int next = 1 - current;
+    BlendJob job{frame.colorBuffer.get(), frame.depthBuffer.get(), frame.colorBuffer.get(),
+                 history[current].data(), history[next].data(), width, height,
+                 motion == STILL ? kStill : motion == MOVING ? kMoving : -1, weight, reprojection};
+    const BlendJob* j = &job;
+    // Capturing a single pointer keeps the std::function allocation-free
+    ThreadPool& pool = ThreadPool::shared();
+    const size_t minRows = std::max<size_t>(1, 16384 / static_cast<size_t>(width));
+    pool.parallelFor(0, static_cast<size_t>(height), [j](size_t rowBegin, size_t rowEnd) {
+        blendRows(*j, rowBegin, rowEnd);
+    }, minRows);
+
+    pool.parallelFor(0, static_cast<size_t>(height), [j](size_t rowBegin, size_t rowEnd) {
+        const size_t end = rowEnd * j->width * 4;
+        for (size_t i = rowBegin * j->width * 4; i < end; ++i) {
+            j->output[i] = static_cast<uint8_t>(j->next[i] + 0.5f);
+        }
+    }, minRows);
+
+    current = next;
+    previousUsedCamera = VolumeRenderer::usesCamera(camera);
+    std::memcpy(previousViewProj, viewProj, sizeof(previousViewProj));
+}
+
+} // namespace morviq
@@ -0,0 +1,239 @@
+#include "renderer/TimestepPrefetcher.h"
+#include "renderer/VolumeRenderer.h"
+#include "data/DataLoader.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace morviq {
+
+namespace {
+
+double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+TimestepPrefetcher::TimestepPrefetcher()
+    : target(0), displayed(0), stride(1), lastChange(0.0), changeInterval(0.0), loadSeconds(0.0),
+      stopping(false) {}
+
+TimestepPrefetcher::~TimestepPrefetcher() {
+    stop();
+}
+
+bool TimestepPrefetcher::start(std::unique_ptr<DataLoader> loader, const std::string& datasetName,
+                               const std::vector<BrickInfo>& brickRegions, int displayedStep,
+                               int slotCount) {
+    stop();
+    if (!loader || slotCount < 1) return false;
+    dataLoader = std::move(loader);
+    dataset = datasetName;
+    regions = brickRegions;
+    slots.clear();
+    slots.resize(slotCount);
+    target = displayed = displayedStep;
+    stride = 1; // until playback shows otherwise, expect it to go forward
+    lastChange = 0.0;
+    changeInterval = 0.0;
+    loadSeconds = 0.0;
+    stopping = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        schedule();
+    }
+    worker = std::thread(&TimestepPrefetcher::workerLoop, this);
+    return true;
+}
+
+void TimestepPrefetcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    slots.clear();
+    retired.clear();
+    dataLoader.reset();
+}
+
+void TimestepPrefetcher::request(int timeStep) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (timeStep == target) return;
+    const double time = now();
+    if (lastChange > 0.0) {
+        // A pause counts as one second so it does not stall the prediction
+        const double interval = std::min(time - lastChange, 1.0);
+        changeInterval = changeInterval > 0.0 ? 0.75 * changeInterval + 0.25 * interval : interval;
+    }
+    lastChange = time;
+    stride = timeStep - target;
+    target = timeStep;
+    schedule();
+}
+
+TimestepPrefetcher::Status TimestepPrefetcher::status(int timeStep) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Slot* slot = findSlot(timeStep);
+    if (slot && slot->state == SLOT_READY) return READY;
+    if (slot && slot->state == SLOT_FAILED) return FAILED;
+    return PENDING;
+}
+
+bool TimestepPrefetcher::take(int timeStep, std::vector<std::unique_ptr<VolumeData>>& blocks) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Slot* slot = findSlot(timeStep);
+    if (!slot || slot->state != SLOT_READY) return false;
+    blocks = std::move(slot->blocks);
+    slot->blocks.clear();
+    slot->timeStep = -1;
+    slot->state = SLOT_FREE;
+    ++slot->generation;
+    displayed = timeStep;
+    schedule();
+    return true;
+}
+
+void TimestepPrefetcher::retire(std::vector<std::unique_ptr<VolumeData>>& blocks) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& block : blocks) {
+            retired.push_back(std::move(block));
+        }
+    }
+    blocks.clear();
+    workAvailable.notify_one();
+}
+
+TimestepPrefetcher::Slot* TimestepPrefetcher::findSlot(int timeStep) {
+    for (Slot& slot : slots) {
+        if (slot.state != SLOT_FREE && slot.timeStep == timeStep) return &slot;
+    }
+    return nullptr;
+}
+
+const TimestepPrefetcher::Slot* TimestepPrefetcher::findSlot(int timeStep) const {
+    return const_cast<TimestepPrefetcher*>(this)->findSlot(timeStep);
+}
+
+void TimestepPrefetcher::schedule() {
+    // Skip ahead when a step takes longer to load than it is shown for
+    int step = stride;
+    if (changeInterval > 0.0 && loadSeconds > changeInterval) {
+        step *= static_cast<int>(std::ceil(loadSeconds / changeInterval));
+    }
+    const int direction = (step > 0) - (step < 0);
+    const int count = static_cast<int>(slots.size());
+    const int reach = std::abs(step) * count;
+
+    // Keep the target and the steps ahead of it within reach; loads still
+    // running for a freed slot are dropped when they finish
+    for (Slot& slot : slots) {
+        if (slot.state == SLOT_FREE) continue;
+        const int ahead = (slot.timeStep - target) * direction;
+        if (slot.timeStep == target || (ahead > 0 && ahead <= reach)) continue;
+        for (auto& block : slot.blocks) {
+            retired.push_back(std::move(block));
+        }
+        slot.blocks.clear();
+        slot.timeStep = -1;
+        slot.state = SLOT_FREE;
+        ++slot.generation;
+    }
+
+    for (int k = 0; k < count && (k == 0 || step != 0); ++k) {
+        const int timeStep = target + step * k;
+        if (timeStep < 0) break;
+        if (timeStep == displayed || findSlot(timeStep)) continue;
+        auto free = std::find_if(slots.begin(), slots.end(),
+                                 [](const Slot& slot) { return slot.state == SLOT_FREE; });
+        if (free == slots.end()) break;
+        free->timeStep = timeStep;
+        free->state = SLOT_QUEUED;
+    }
+    workAvailable.notify_one();
+}
+
+void TimestepPrefetcher::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        Slot* next = nullptr;
+        workAvailable.wait(lock, [&]() {
+            if (stopping || !retired.empty()) return true;
+            // The queued step nearest the target first
+            next = nullptr;
+            for (Slot& slot : slots) {
+                if (slot.state == SLOT_QUEUED &&
+                    (!next || std::abs(slot.timeStep - target) < std::abs(next->timeStep - target))) {
+                    next = &slot;
+                }
+            }
+            return next != nullptr;
+        });
+        if (stopping) return;
+        if (!retired.empty()) {
+            // Free replaced volumes off the render thread
+            std::vector<std::unique_ptr<VolumeData>> old;
+            old.swap(retired);
+            lock.unlock();
+            old.clear();
+            lock.lock();
+            continue;
+        }
+
+        const size_t index = next - slots.data();
+        const int timeStep = next->timeStep;
+        const unsigned generation = next->generation;
+        next->state = SLOT_LOADING;
+        lock.unlock();
+        const double start = now();
+        std::vector<std::unique_ptr<VolumeData>> blocks;
+        const bool ok = load(timeStep, blocks);
+        const double seconds = now() - start;
+        lock.lock();
+
+        if (ok) {
+            loadSeconds = loadSeconds > 0.0 ? 0.75 * loadSeconds + 0.25 * seconds : seconds;
+        }
+        Slot& slot = slots[index];
+        if (slot.generation != generation) {
+            for (auto& block : blocks) {
+                retired.push_back(std::move(block));
+            }
+            continue;
+        }
+        slot.blocks = std::move(blocks);
+        slot.state = ok ? SLOT_READY : SLOT_FAILED;
+        if (ok) {
+            LOG_DEBUG("Prefetched time step " << timeStep << " in " << seconds << " s");
+        }
+    }
+}
+
+bool TimestepPrefetcher::load(int timeStep, std::vector<std::unique_ptr<VolumeData>>& blocks) {
+    int dimensions[3];
+    if (!dataLoader->hasTimeStep(dataset, timeStep) ||
+        !dataLoader->getDimensions(dataset, timeStep, dimensions)) {
+        return false;
+    }
+    for (const BrickInfo& region : regions) {
+        int begin[3];
+        int size[3];
+        VolumeRenderer::brickRegion(region, dimensions, VolumeRenderer::kGhostVoxels, begin, size);
+        auto block = dataLoader->loadRegion(dataset, timeStep, begin, size);
+        if (!block) {
+            LOG_WARN("Failed to prefetch time step " << timeStep);
+            return false;
+        }
+        blocks.push_back(std::move(block));
+    }
+    return true;
+}
+
+} // namespace morviq
@@ -0,0 +1,284 @@
+#include "renderer/VirtualVolume.h"
+#include "renderer/VolumeRenderer.h"
+#include "data/DataLoader.h"
+#include "utils/Logger.h"
+#include <algorithm>
+#include <cmath>
+
+namespace morviq {
+
+VirtualVolume::VirtualVolume()
+    : timeStep(0), pageSize(64), pageShift(6), memoryBudget(0), residentBytes(0), finestLevel(0), frame(0),
+      lastBlock(nullptr), pagesLoaded(0), pagesEvicted(0), stopping(false) {}
+
+VirtualVolume::~VirtualVolume() {
+    close();
+}
+
+bool VirtualVolume::open(std::unique_ptr<DataLoader> loader, const std::string& datasetName,
+                         int step, const PagingParams& params) {
+    close();
+    dataLoader = std::move(loader);
+    dataset = datasetName;
+    timeStep = step;
+    pageShift = 3;
+    while ((1 << pageShift) < params.pageSize && pageShift < 10) {
+        ++pageShift;
+    }
+    pageSize = 1 << pageShift;
+    memoryBudget = params.memoryBudget;
+
+    const int levelCount = dataLoader->getLevelCount(dataset, timeStep);
+    for (int l = 0; l < levelCount; ++l) {
+        Level level;
+        if (!dataLoader->getDimensions(dataset, timeStep, level.dimensions, l)) {
+            LOG_ERROR("VirtualVolume: no level " << l << " of " << dataset);
+            return false;
+        }
+        size_t pages = 1;
+        for (int a = 0; a < 3; ++a) {
+            // Page p holds voxels [p * pageSize, (p + 1) * pageSize]
+            level.pages[a] = level.dimensions[a] > 1 ? ((level.dimensions[a] - 2) >> pageShift) + 1 : 1;
+            pages *= level.pages[a];
+        }
+        level.table.assign(pages, kMissing);
+        level.requested.assign(pages, 0);
+        levels.push_back(std::move(level));
+    }
+    if (levels.empty()) {
+        return false;
+    }
+
+    // The coarsest level is the fallback for every miss
+    const int coarsest = static_cast<int>(levels.size()) - 1;
+    for (size_t index = 0; index < levels[coarsest].table.size(); ++index) {
+        const Request request{coarsest, index};
+        auto block = loadPage(request);
+        if (!block) {
+            LOG_ERROR("VirtualVolume: failed to load the coarsest level of " << dataset);
+            close();
+            return false;
+        }
+        mapPage(request, std::move(block), true);
+    }
+    if (residentBytes > memoryBudget) {
+        LOG_WARN("VirtualVolume: the coarsest level alone exceeds the page budget");
+    }
+
+    stopping = false;
+    worker = std::thread(&VirtualVolume::workerLoop, this);
+    const Level& full = levels[0];
+    LOG_INFO("Paging " << dataset << " (" << full.dimensions[0] << "x" << full.dimensions[1] << "x"
+             << full.dimensions[2] << ", " << levels.size() << " levels) in " << pageSize
+             << "^3 pages within " << memoryBudget / (1024.0 * 1024.0) << " MB");
+    return true;
+}
+
+void VirtualVolume::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    workAvailable.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    loaded.clear();
+    loading.clear();
+    levels.clear();
+    resident.clear();
+    freePages.clear();
+    misses.clear();
+    residentBytes = 0;
+    lastBlock = nullptr;
+    dataLoader.reset();
+}
+
+void VirtualVolume::pageRegion(const Request& request, int begin[3], int size[3]) const {
+    const Level& level = levels[request.level];
+    size_t rest = request.index;
+    for (int a = 0; a < 3; ++a) {
+        const int page = static_cast<int>(rest % level.pages[a]);
+        rest /= level.pages[a];
+        begin[a] = page * pageSize;
+        size[a] = std::min(pageSize + 1, level.dimensions[a] - begin[a]);
+    }
+}
+
+std::unique_ptr<VolumeData> VirtualVolume::loadPage(const Request& request) {
+    int begin[3];
+    int size[3];
+    pageRegion(request, begin, size);
+    return dataLoader->loadRegion(dataset, timeStep, begin, size, request.level);
+}
+
+bool VirtualVolume::mapPage(const Request& request, std::unique_ptr<VolumeData> block, bool permanent) {
+    const size_t bytes = block->bytes();
+    while (!permanent && residentBytes + bytes > memoryBudget) {
+        // Least recently sampled first; pages the last frame used stay
+        int victim = -1;
+        for (size_t i = 0; i < resident.size(); ++i) {
+            const Page& page = resident[i];
+            if (!page.block || page.permanent || page.lastUsed >= frame) continue;
+            if (victim < 0 || page.lastUsed < resident[victim].lastUsed) {
+                victim = static_cast<int>(i);
+            }
+        }
+        if (victim < 0) {
+            return false;
+        }
+        Page& page = resident[victim];
+        levels[page.level].table[page.index] = kMissing;
+        residentBytes -= page.block->bytes();
+        page.block.reset();
+        freePages.push_back(victim);
+        ++pagesEvicted;
+    }
+
+    int slot;
+    if (freePages.empty()) {
+        slot = static_cast<int>(resident.size());
+        resident.emplace_back();
+    } else {
+        slot = freePages.back();
+        freePages.pop_back();
+    }
+    Page& page = resident[slot];
+    page.block = std::move(block);
+    page.level = request.level;
+    page.index = request.index;
+    page.lastUsed = frame;
+    page.permanent = permanent;
+    levels[request.level].table[request.index] = slot;
+    residentBytes += bytes;
+    ++pagesLoaded;
+    return true;
+}
+
+int VirtualVolume::update() {
+    std::vector<Loaded> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(loaded);
+    }
+    int mapped = 0;
+    lastBlock = nullptr; // pages may move
+    for (Loaded& page : ready) {
+        int& entry = levels[page.request.level].table[page.request.index];
+        if (entry != kMissing) continue;
+        if (!page.block) {
+            LOG_WARN("VirtualVolume: failed to load a page of level " << page.request.level);
+            entry = kFailed;
+            continue;
+        }
+        // Budget full of pages in use: the rest wait for their next miss
+        if (!mapPage(page.request, std::move(page.block), false)) break;
+        ++mapped;
+    }
+    return mapped;
+}
+
+void VirtualVolume::beginFrame(float stepSize) {
+    ++frame;
+    lastBlock = nullptr;
+    const Level& full = levels[0];
+    const int extent = std::max({full.dimensions[0], full.dimensions[1], full.dimensions[2]}) - 1;
+    const float voxelsPerStep = stepSize * extent;
+    finestLevel = voxelsPerStep >= 2.0f ? static_cast<int>(std::log2(voxelsPerStep)) : 0;
+    finestLevel = std::min(finestLevel, static_cast<int>(levels.size()) - 1);
+}
+
+void VirtualVolume::endFrame() {
+    {
+        // Only this frame's misses are worth loading; older ones not yet
+        // started are dropped
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        for (const Request& request : misses) {
+            if (!loading.count(request.key())) {
+                queue.push_back(request);
+            }
+        }
+    }
+    misses.clear();
+    workAvailable.notify_one();
+}
+
+float VirtualVolume::sample(const Vec3& pos) {
+    const float p[3] = {std::min(std::max(pos.x, 0.0f), 1.0f), std::min(std::max(pos.y, 0.0f), 1.0f),
+                        std::min(std::max(pos.z, 0.0f), 1.0f)};
+    if (lastBlock) {
+        const Level& level = levels[finestLevel];
+        const float v[3] = {p[0] * (level.dimensions[0] - 1), p[1] * (level.dimensions[1] - 1),
+                            p[2] * (level.dimensions[2] - 1)};
+        if (v[0] >= lastLow[0] && v[0] < lastHigh[0] && v[1] >= lastLow[1] && v[1] < lastHigh[1] &&
+            v[2] >= lastLow[2] && v[2] < lastHigh[2]) {
+            return VolumeRenderer::sampleBlock(*lastBlock, v[0] - lastLow[0], v[1] - lastLow[1],
+                                               v[2] - lastLow[2]);
+        }
+    }
+    const int levelCount = static_cast<int>(levels.size());
+    for (int l = finestLevel; l < levelCount; ++l) {
+        Level& level = levels[l];
+        float v[3];
+        int page[3];
+        for (int a = 0; a < 3; ++a) {
+            v[a] = p[a] * (level.dimensions[a] - 1);
+            page[a] = std::min(static_cast<int>(v[a]) >> pageShift, level.pages[a] - 1);
+        }
+        const size_t index = (static_cast<size_t>(page[2]) * level.pages[1] + page[1]) * level.pages[0] + page[0];
+        const int slot = level.table[index];
+        if (slot >= 0) {
+            Page& resident = this->resident[slot];
+            resident.lastUsed = frame;
+            const VolumeData& block = *resident.block;
+            if (l == finestLevel) {
+                // Voxels this page answers for; the last page also owns the far face
+                for (int a = 0; a < 3; ++a) {
+                    lastLow[a] = static_cast<float>(block.offset[a]);
+                    lastHigh[a] = page[a] == level.pages[a] - 1 ? static_cast<float>(level.dimensions[a])
+                                                                : lastLow[a] + pageSize;
+                }
+                lastBlock = &block;
+            }
+            return VolumeRenderer::sampleBlock(block, v[0] - block.offset[0], v[1] - block.offset[1],
+                                               v[2] - block.offset[2]);
+        }
+        if (l == finestLevel && slot == kMissing && level.requested[index] != frame) {
+            level.requested[index] = frame;
+            misses.push_back({l, index});
+        }
+    }
+    return 0.0f;
+}
+
+VirtualVolume::Stats VirtualVolume::getStats() const {
+    Stats stats;
+    stats.levels = static_cast<int>(levels.size());
+    stats.residentPages = resident.size() - freePages.size();
+    stats.residentBytes = residentBytes;
+    stats.pagesLoaded = pagesLoaded;
+    stats.pagesEvicted = pagesEvicted;
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.queuedPages = queue.size() + loading.size();
+    return stats;
+}
+
+void VirtualVolume::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        workAvailable.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (stopping) return;
+        const Request request = queue.front();
+        queue.pop_front();
+        loading.insert(request.key());
+        lock.unlock();
+        auto block = loadPage(request);
+        lock.lock();
+        loading.erase(request.key());
+        loaded.push_back({request, std::move(block)});
+    }
+}
+
+} // namespace morviq
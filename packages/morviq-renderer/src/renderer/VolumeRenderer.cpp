@@ -1,11 +1,19 @@
 #include "renderer/VolumeRenderer.h"
+#include "renderer/VirtualVolume.h"
+#include "renderer/BlueNoise.h"
 #include "utils/Logger.h"
 #include <cmath>
 #include <algorithm>
 
 namespace morviq {
 
-VolumeRenderer::VolumeRenderer() : frameWidth(0), frameHeight(0) {}
+namespace {
+// Samples at or below this contribute nothing
+constexpr float kMinValue = 0.05f;
+}
+
+VolumeRenderer::VolumeRenderer()
+    : generatedVolume(false), workGrid{1, 1, 1}, frameWidth(0), frameHeight(0), jitterFrame(-1) {}
 
 VolumeRenderer::~VolumeRenderer() {
     shutdown();
@@ -19,11 +27,51 @@ bool VolumeRenderer::initialize(int width, int height) {
 }
 
 void VolumeRenderer::shutdown() {
-    volumeData.reset();
+    clearVolumeData();
 }
 
 void VolumeRenderer::setVolumeData(std::unique_ptr<VolumeData> data) {
-    volumeData = std::move(data);
+    clearVolumeData();
+    addVolumeBlock(std::move(data));
+}
+
+void VolumeRenderer::addVolumeBlock(std::unique_ptr<VolumeData> block) {
+    if (!block) return;
+    if (block->fullDimensions[0] == 0) {
+        for (int a = 0; a < 3; ++a) {
+            block->fullDimensions[a] = block->dimensions[a];
+            block->offset[a] = 0;
+        }
+    }
+    blocks.push_back(std::move(block));
+    generatedVolume = false;
+}
+
+void VolumeRenderer::clearVolumeData() {
+    blocks.clear();
+    brickBlocks.clear();
+    generatedVolume = false;
+}
+
+void VolumeRenderer::swapVolumeBlocks(std::vector<std::unique_ptr<VolumeData>>& replacement) {
+    blocks.swap(replacement);
+    brickBlocks.clear();
+    generatedVolume = false;
+}
+
+void VolumeRenderer::setWorkGrid(const int grid[3]) {
+    for (int a = 0; a < 3; ++a) {
+        workGrid[a] = std::max(grid[a], 1);
+    }
+}
+
+size_t VolumeRenderer::workCell(const Vec3& pos) const {
+    const float p[3] = {pos.x, pos.y, pos.z};
+    int cell[3];
+    for (int a = 0; a < 3; ++a) {
+        cell[a] = std::min(std::max(static_cast<int>(p[a] * workGrid[a]), 0), workGrid[a] - 1);
+    }
+    return (static_cast<size_t>(cell[2]) * workGrid[1] + cell[1]) * workGrid[0] + cell[0];
 }
 
 void VolumeRenderer::setCamera(const Camera& cam) {
@@ -63,26 +111,41 @@ void VolumeRenderer::setBioelectricParams(const std::string& jsonParams) {
         }
     }
     
-    // Regenerate volume data with new parameters
-    if (volumeData) {
-        generateBioelectricVolume();
+    // Regenerate the generated blocks with new parameters; loaded data stays
+    if (generatedVolume) {
+        for (auto& block : blocks) {
+            fillBioelectric(*block);
+        }
     }
 }
 
-void VolumeRenderer::generateBioelectricVolume() {
-    if (!volumeData) {
-        volumeData = std::make_unique<VolumeData>();
-        volumeData->dimensions[0] = 64;
-        volumeData->dimensions[1] = 64;
-        volumeData->dimensions[2] = 64;
-        volumeData->voxelCount = 64 * 64 * 64;
-        volumeData->data = std::make_unique<float[]>(volumeData->voxelCount);
+void VolumeRenderer::generateBioelectricVolume(const std::vector<BrickInfo>& bricks) {
+    // Only the blocks the bricks need, like a loaded dataset
+    const int fullDimensions[3] = {64, 64, 64};
+    for (const BrickInfo& brick : bricks) {
+        int begin[3];
+        int size[3];
+        brickRegion(brick, fullDimensions, kGhostVoxels, begin, size);
+        auto block = std::make_unique<VolumeData>();
+        for (int a = 0; a < 3; ++a) {
+            block->dimensions[a] = size[a];
+            block->offset[a] = begin[a];
+            block->fullDimensions[a] = fullDimensions[a];
+        }
+        block->voxelCount = static_cast<size_t>(size[0]) * size[1] * size[2];
+        block->data.reset(new float[block->voxelCount]());
+        fillBioelectric(*block);
+        blocks.push_back(std::move(block));
     }
-    
+    generatedVolume = true;
+}
+
+void VolumeRenderer::fillBioelectric(VolumeData& block) {
     // Generate realistic bioelectric tissue patterns
-    for (int z = 0; z < 64; ++z) {
-        for (int y = 0; y < 64; ++y) {
-            for (int x = 0; x < 64; ++x) {
+    size_t idx = 0;
+    for (int z = block.offset[2]; z < block.offset[2] + block.dimensions[2]; ++z) {
+        for (int y = block.offset[1]; y < block.offset[1] + block.dimensions[1]; ++y) {
+            for (int x = block.offset[0]; x < block.offset[0] + block.dimensions[0]; ++x) {
                 float fx = x / 63.0f;
                 float fy = y / 63.0f;
                 float fz = z / 63.0f;
@@ -126,85 +189,215 @@ void VolumeRenderer::generateBioelectricVolume() {
                 
                 value = std::max(0.0f, std::min(1.0f, value));
                 
-                int idx = x + y * 64 + z * 64 * 64;
-                volumeData->data[idx] = value;
+                block.data[idx++] = value;
             }
         }
     }
 }
 
-void VolumeRenderer::renderBrick(const BrickInfo& brick, Frame& frame) {
-    // Generate 3D bioelectric volume data if not present
-    if (!volumeData) {
-        LOG_INFO("Generating 3D bioelectric tissue volume");
-        generateBioelectricVolume();
+void VolumeRenderer::brickRegion(const BrickInfo& brick, const int fullDimensions[3], int ghost,
+                                 int begin[3], int size[3]) {
+    const float lo[3] = {brick.minBounds.x, brick.minBounds.y, brick.minBounds.z};
+    const float hi[3] = {brick.maxBounds.x, brick.maxBounds.y, brick.maxBounds.z};
+    for (int a = 0; a < 3; ++a) {
+        // Volume coordinate p samples voxels floor(p (n - 1)) and the next one
+        const int last = fullDimensions[a] - 1;
+        const int first = static_cast<int>(std::floor(lo[a] * last)) - ghost;
+        const int end = static_cast<int>(std::ceil(hi[a] * last)) + ghost;
+        begin[a] = std::max(first, 0);
+        size[a] = std::min(end, last) - begin[a] + 1;
+    }
+}
+
+void VolumeRenderer::bindVirtualBricks(const std::vector<BrickInfo>& bricks) {
+    brickBlocks.clear();
+    for (const BrickInfo& brick : bricks) {
+        BrickBlock bound = {};
+        bound.minBounds = brick.minBounds;
+        bound.maxBounds = brick.maxBounds;
+        brickBlocks.push_back(bound);
     }
+}
+
+bool VolumeRenderer::bindBricks(const std::vector<BrickInfo>& bricks) {
+    brickBlocks.clear();
+    for (const BrickInfo& brick : bricks) {
+        const VolumeData* found = nullptr;
+        for (const auto& block : blocks) {
+            int begin[3];
+            int size[3];
+            brickRegion(brick, block->fullDimensions, 0, begin, size);
+            bool covers = true;
+            for (int a = 0; a < 3; ++a) {
+                covers = covers && begin[a] >= block->offset[a] &&
+                         begin[a] + size[a] <= block->offset[a] + block->dimensions[a];
+            }
+            if (covers) {
+                found = block.get();
+                break;
+            }
+        }
+        if (!found) {
+            LOG_WARN("No volume data for brick " << brick.id);
+            continue;
+        }
+        BrickBlock bound;
+        bound.volume = found;
+        bound.minBounds = brick.minBounds;
+        bound.maxBounds = brick.maxBounds;
+        for (int a = 0; a < 3; ++a) {
+            bound.scale[a] = static_cast<float>(found->fullDimensions[a] - 1);
+            bound.shift[a] = static_cast<float>(found->offset[a]);
+        }
+        bound.emptySpace = found->storage && found->storage->background() <= kMinValue
+            ? found->storage.get() : nullptr;
+        brickBlocks.push_back(bound);
+    }
+    return !brickBlocks.empty();
+}
+
+void VolumeRenderer::renderBricks(const std::vector<BrickInfo>& bricks, Frame& frame) {
+    const float stepSize = renderParams.stepSize > 0.0f ? renderParams.stepSize : 0.01f;
+    work.assign(static_cast<size_t>(workGrid[0]) * workGrid[1] * workGrid[2], 0);
+    if (virtualVolume) {
+        bindVirtualBricks(bricks);
+        virtualVolume->beginFrame(stepSize);
+    } else {
+        // Generate 3D bioelectric volume data if not present
+        if (blocks.empty()) {
+            LOG_INFO("Generating 3D bioelectric tissue volume");
+            generateBioelectricVolume(bricks);
+        }
+        if (!bindBricks(bricks)) return;
+    }
+    const bool fromCamera = usesCamera(camera);
+    // Golden-ratio sequence per frame on top of the spatial blue noise keeps
+    // each pixel's offsets evenly spread over time
+    const float jitterPhase = jitterFrame >= 0
+        ? static_cast<float>(std::fmod(jitterFrame * 0.6180339887498949, 1.0)) : 0.0f;
+    // The fixed view marches t over [0, kOrbitLength]
+    const float kOrbitLength = 5.0f;
     
     // 3D Ray marching through the volume
     for (int py = 0; py < frameHeight; ++py) {
         for (int px = 0; px < frameWidth; ++px) {
-            // Screen to NDC coordinates
-            float u = (px / float(frameWidth)) * 2.0f - 1.0f;
-            float v = 1.0f - (py / float(frameHeight)) * 2.0f;
-            
-            // Ray setup with perspective
             Vec3 rayOrigin;
             Vec3 rayDir;
+            float tStart = 0.0f;
+            float tEnd = kOrbitLength;
+            float depthScale = 0.0f;
             
-            // Camera at distance looking at origin
-            float camDist = 2.0f;
-            float rotAngle = brick.id * 0.5f; // Rotate based on brick for multi-view
+            if (fromCamera) {
+                if (!cameraRay(px, py, rayOrigin, rayDir, tStart, tEnd, depthScale)) continue;
+            } else {
+                // Fixed view; screen to NDC coordinates
+                float u = (px / float(frameWidth)) * 2.0f - 1.0f;
+                float v = 1.0f - (py / float(frameHeight)) * 2.0f;
             
-            // Eye position
-            rayOrigin.x = camDist * std::sin(rotAngle);
-            rayOrigin.y = 0.5f;
-            rayOrigin.z = camDist * std::cos(rotAngle);
+                // Camera at distance looking at origin
+                float camDist = 2.0f;
             
-            // Ray direction from eye through screen pixel
-            Vec3 screenPos;
-            screenPos.x = u * 0.5f;
-            screenPos.y = v * 0.5f;
-            screenPos.z = 0.0f;
+                // Eye position
+                rayOrigin.x = 0.0f;
+                rayOrigin.y = 0.5f;
+                rayOrigin.z = camDist;
             
-            // Transform screen position by rotation
-            float screenX = screenPos.x * std::cos(rotAngle) - screenPos.z * std::sin(rotAngle);
-            float screenZ = screenPos.x * std::sin(rotAngle) + screenPos.z * std::cos(rotAngle);
+                // Ray direction from eye through screen pixel
+                rayDir.x = u * 0.5f - rayOrigin.x + 0.5f;
+                rayDir.y = v * 0.5f - rayOrigin.y + 0.5f;
+                rayDir.z = -rayOrigin.z + 0.5f;
             
-            rayDir.x = screenX - rayOrigin.x + 0.5f;
-            rayDir.y = screenPos.y - rayOrigin.y + 0.5f;
-            rayDir.z = screenZ - rayOrigin.z + 0.5f;
+                // Normalize ray direction
+                float len = std::sqrt(rayDir.x*rayDir.x + rayDir.y*rayDir.y + rayDir.z*rayDir.z);
+                if (len > 0) {
+                    rayDir.x /= len;
+                    rayDir.y /= len;
+                    rayDir.z /= len;
+                }
+            }
             
-            // Normalize ray direction
-            float len = std::sqrt(rayDir.x*rayDir.x + rayDir.y*rayDir.y + rayDir.z*rayDir.z);
-            if (len > 0) {
-                rayDir.x /= len;
-                rayDir.y /= len;
-                rayDir.z /= len;
+            // Clip the ray to each brick; bricks are disjoint boxes, so the
+            // segments sorted by entry are the march order
+            segments.clear();
+            const float o[3] = {rayOrigin.x, rayOrigin.y, rayOrigin.z};
+            const float d[3] = {rayDir.x, rayDir.y, rayDir.z};
+            for (const BrickBlock& block : brickBlocks) {
+                const float lo[3] = {block.minBounds.x, block.minBounds.y, block.minBounds.z};
+                const float hi[3] = {block.maxBounds.x, block.maxBounds.y, block.maxBounds.z};
+                float t0 = tStart;
+                float t1 = tEnd;
+                for (int k = 0; k < 3 && t0 < t1; ++k) {
+                    if (std::fabs(d[k]) < 1e-8f) {
+                        if (o[k] < lo[k] || o[k] > hi[k]) t1 = t0;
+                        continue;
+                    }
+                    float a = (lo[k] - o[k]) / d[k];
+                    float b = (hi[k] - o[k]) / d[k];
+                    if (a > b) std::swap(a, b);
+                    t0 = std::max(t0, a);
+                    t1 = std::min(t1, b);
+                }
+                if (t0 < t1) {
+                    segments.push_back({t0, t1, &block});
+                }
             }
+            if (segments.empty()) continue;
+            std::sort(segments.begin(), segments.end(),
+                      [](const Segment& a, const Segment& b) { return a.tNear < b.tNear; });
             
             // Ray march
             Vec4 accum(0, 0, 0, 0);
-            float stepSize = 0.01f;
-            float tMax = 5.0f;
+            float weightedT = 0.0f;
+            float offset = 0.0f;
+            if (jitterFrame >= 0) {
+                offset = BlueNoise::sample(px, py) + jitterPhase;
+                offset -= std::floor(offset);
+            }
             
-            for (float t = 0; t < tMax; t += stepSize) {
-                Vec3 pos;
-                pos.x = rayOrigin.x + rayDir.x * t;
-                pos.y = rayOrigin.y + rayDir.y * t;
-                pos.z = rayOrigin.z + rayDir.z * t;
-                
-                // Check if inside volume [0,1]³
-                if (pos.x >= 0 && pos.x <= 1 &&
-                    pos.y >= 0 && pos.y <= 1 &&
-                    pos.z >= 0 && pos.z <= 1) {
+            float marched = tStart;
+            for (const Segment& segment : segments) {
+                // A ray running inside a shared face clips to both bricks;
+                // skip what an earlier segment already covered
+                const float tNear = std::max(segment.tNear, marched);
+                if (tNear >= segment.tFar) continue;
+                marched = segment.tFar;
+                // Samples t = tStart + (i + offset) * step in [tNear, tFar)
+                const int first = std::max(0, static_cast<int>(
+                    std::ceil((tNear - tStart) / stepSize - offset)) - 1);
+                for (int i = first;; ++i) {
+                    const float t = tStart + (i + offset) * stepSize;
+                    if (t >= segment.tFar) break;
+                    if (t < tNear) continue;
+                    Vec3 pos;
+                    pos.x = rayOrigin.x + rayDir.x * t;
+                    pos.y = rayOrigin.y + rayDir.y * t;
+                    pos.z = rayOrigin.z + rayDir.z * t;
+                    
+                    if (const VoxelStorage* empty = segment.block->emptySpace) {
+                        // Jump to the first sample past the empty region
+                        const float* scale = segment.block->scale;
+                        const float* shift = segment.block->shift;
+                        const float p[3] = {pos.x * scale[0] - shift[0], pos.y * scale[1] - shift[1],
+                                            pos.z * scale[2] - shift[2]};
+                        const float v[3] = {rayDir.x * scale[0], rayDir.y * scale[1], rayDir.z * scale[2]};
+                        const float skip = empty->emptyLength(p, v);
+                        if (skip > 0.0f) {
+                            const float resume = std::min(t + skip, segment.tFar);
+                            i = std::max(i, static_cast<int>(std::ceil((resume - tStart) / stepSize - offset)) - 1);
+                            continue;
+                        }
+                    }
                     
-                    float val = sampleVolume(pos);
+                    float val = sampleVolume(*segment.block, pos);
+                    uint64_t& cellWork = work[workCell(pos)];
+                    ++cellWork;
                     
-                    if (val > 0.05f) {
+                    if (val > kMinValue) {
                         Vec4 color = applyTransferFunction(val);
                         
                         // Apply gradient-based shading for 3D effect
-                        Vec3 gradient = sampleGradient(pos);
+                        Vec3 gradient = sampleGradient(*segment.block, pos);
+                        cellWork += 6;
                         float gradMag = std::sqrt(gradient.x*gradient.x + gradient.y*gradient.y + gradient.z*gradient.z);
                         if (gradMag > 0.01f) {
                             // Simple lighting
@@ -223,57 +416,127 @@ void VolumeRenderer::renderBrick(const BrickInfo& brick, Frame& frame) {
                         accum.x += color.x * alpha * (1.0f - accum.w);
                         accum.y += color.y * alpha * (1.0f - accum.w);
                         accum.z += color.z * alpha * (1.0f - accum.w);
+                        weightedT += t * alpha * (1.0f - accum.w);
                         accum.w += alpha * (1.0f - accum.w);
                         
                         if (accum.w > 0.95f) break;
                     }
                 }
+                if (accum.w > 0.95f) break;
             }
             
             // Write to frame buffer
             int idx = py * frameWidth + px;
             if (accum.w > 0.01f) {
+                const float meanT = weightedT / accum.w;
                 frame.colorBuffer[idx * 4 + 0] = static_cast<uint8_t>(std::min(1.0f, accum.x) * 255);
                 frame.colorBuffer[idx * 4 + 1] = static_cast<uint8_t>(std::min(1.0f, accum.y) * 255);
                 frame.colorBuffer[idx * 4 + 2] = static_cast<uint8_t>(std::min(1.0f, accum.z) * 255);
                 frame.colorBuffer[idx * 4 + 3] = static_cast<uint8_t>(std::min(1.0f, accum.w) * 255);
-                frame.depthBuffer[idx] = 0.5f;
+                // The fixed view has no projection; its depth is t along the
+                // march, which still orders the ranks' partial images
+                frame.depthBuffer[idx] = fromCamera ? windowDepth(meanT * depthScale)
+                                                    : std::min(meanT / kOrbitLength, 1.0f);
             }
         }
     }
+    if (virtualVolume) {
+        virtualVolume->endFrame();
+    }
 }
 
-float VolumeRenderer::sampleVolume(const Vec3& pos) {
-    if (!volumeData) return 0.0f;
+bool VolumeRenderer::cameraRay(int px, int py, Vec3& origin, Vec3& direction,
+                               float& tNear, float& tFar, float& depthScale) const {
+    // Column-major matrices; view is camera-to-world
+    const float* p = camera.projection.m;
+    const float* v = camera.view.m;
+    const float u = ((px + 0.5f) / frameWidth) * 2.0f - 1.0f;
+    const float w = 1.0f - ((py + 0.5f) / frameHeight) * 2.0f;
+    const float cx = (u + p[8]) / p[0];
+    const float cy = (w + p[9]) / p[5];
+    
+    // World [-1,1]^3 (the client's volume proxy) maps to volume [0,1]^3
+    float o[3];
+    float d[3];
+    for (int k = 0; k < 3; ++k) {
+        o[k] = 0.5f * (v[12 + k] + 1.0f);
+        d[k] = 0.5f * (v[k] * cx + v[4 + k] * cy - v[8 + k]);
+    }
+    const float len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    if (len <= 0.0f) return false;
+    // The camera-space direction has unit depth and a volume unit is two
+    // world units, so depth = 2t / (2 len)
+    depthScale = 1.0f / len;
     
-    // Trilinear interpolation for smooth rendering
-    float x = pos.x * (volumeData->dimensions[0] - 1);
-    float y = pos.y * (volumeData->dimensions[1] - 1);
-    float z = pos.z * (volumeData->dimensions[2] - 1);
+    tNear = 0.0f;
+    tFar = 1e30f;
+    for (int k = 0; k < 3; ++k) {
+        d[k] /= len;
+        if (std::fabs(d[k]) < 1e-8f) {
+            if (o[k] < 0.0f || o[k] > 1.0f) return false;
+            continue;
+        }
+        float t0 = -o[k] / d[k];
+        float t1 = (1.0f - o[k]) / d[k];
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+    }
+    origin = Vec3(o[0], o[1], o[2]);
+    direction = Vec3(d[0], d[1], d[2]);
+    return tNear < tFar;
+}
+
+float VolumeRenderer::windowDepth(float eyeDepth) const {
+    const float* p = camera.projection.m;
+    eyeDepth = std::max(eyeDepth, 1e-6f);
+    const float ndc = (p[14] - p[10] * eyeDepth) / eyeDepth;
+    return std::min(std::max(ndc * 0.5f + 0.5f, 0.0f), 1.0f);
+}
+
+float VolumeRenderer::sampleVolume(const BrickBlock& block, const Vec3& pos) {
+    if (!block.volume) {
+        return virtualVolume->sample(pos);
+    }
+    return sampleBlock(*block.volume, pos.x * block.scale[0] - block.shift[0],
+                       pos.y * block.scale[1] - block.shift[1], pos.z * block.scale[2] - block.shift[2]);
+}
+
+float VolumeRenderer::sampleBlock(const VolumeData& volume, float x, float y, float z) {
+    // Trilinear interpolation for smooth rendering; positions are clamped
+    // to the block, as they are to the dataset at its faces
+    const int last[3] = {volume.dimensions[0] - 1, volume.dimensions[1] - 1, volume.dimensions[2] - 1};
+    x = std::min(std::max(x, 0.0f), float(last[0]));
+    y = std::min(std::max(y, 0.0f), float(last[1]));
+    z = std::min(std::max(z, 0.0f), float(last[2]));
+    if (volume.storage) {
+        return volume.storage->sample(x, y, z);
+    }
     
     int x0 = static_cast<int>(x);
     int y0 = static_cast<int>(y);
     int z0 = static_cast<int>(z);
-    int x1 = std::min(x0 + 1, volumeData->dimensions[0] - 1);
-    int y1 = std::min(y0 + 1, volumeData->dimensions[1] - 1);
-    int z1 = std::min(z0 + 1, volumeData->dimensions[2] - 1);
+    int x1 = std::min(x0 + 1, last[0]);
+    int y1 = std::min(y0 + 1, last[1]);
+    int z1 = std::min(z0 + 1, last[2]);
     
     float fx = x - x0;
     float fy = y - y0;
     float fz = z - z0;
     
     // Sample 8 corners
-    int stride = volumeData->dimensions[0];
-    int slice = stride * volumeData->dimensions[1];
+    const size_t stride = volume.rowStride();
+    const size_t slice = volume.sliceStride();
+    const float* data = volume.data.get();
     
-    float v000 = volumeData->data[x0 + y0 * stride + z0 * slice];
-    float v100 = volumeData->data[x1 + y0 * stride + z0 * slice];
-    float v010 = volumeData->data[x0 + y1 * stride + z0 * slice];
-    float v110 = volumeData->data[x1 + y1 * stride + z0 * slice];
-    float v001 = volumeData->data[x0 + y0 * stride + z1 * slice];
-    float v101 = volumeData->data[x1 + y0 * stride + z1 * slice];
-    float v011 = volumeData->data[x0 + y1 * stride + z1 * slice];
-    float v111 = volumeData->data[x1 + y1 * stride + z1 * slice];
+    float v000 = data[x0 + y0 * stride + z0 * slice];
+    float v100 = data[x1 + y0 * stride + z0 * slice];
+    float v010 = data[x0 + y1 * stride + z0 * slice];
+    float v110 = data[x1 + y1 * stride + z0 * slice];
+    float v001 = data[x0 + y0 * stride + z1 * slice];
+    float v101 = data[x1 + y0 * stride + z1 * slice];
+    float v011 = data[x0 + y1 * stride + z1 * slice];
+    float v111 = data[x1 + y1 * stride + z1 * slice];
     
     // Trilinear interpolation
     float v00 = v000 * (1 - fx) + v100 * fx;
@@ -287,14 +550,14 @@ float VolumeRenderer::sampleVolume(const Vec3& pos) {
     return v0 * (1 - fz) + v1 * fz;
 }
 
-Vec3 VolumeRenderer::sampleGradient(const Vec3& pos) {
+Vec3 VolumeRenderer::sampleGradient(const BrickBlock& block, const Vec3& pos) {
     const float h = 0.01f;
-    float dx = sampleVolume(Vec3(pos.x + h, pos.y, pos.z)) - 
-               sampleVolume(Vec3(pos.x - h, pos.y, pos.z));
-    float dy = sampleVolume(Vec3(pos.x, pos.y + h, pos.z)) - 
-               sampleVolume(Vec3(pos.x, pos.y - h, pos.z));
-    float dz = sampleVolume(Vec3(pos.x, pos.y, pos.z + h)) - 
-               sampleVolume(Vec3(pos.x, pos.y, pos.z - h));
+    float dx = sampleVolume(block, Vec3(pos.x + h, pos.y, pos.z)) - 
+               sampleVolume(block, Vec3(pos.x - h, pos.y, pos.z));
+    float dy = sampleVolume(block, Vec3(pos.x, pos.y + h, pos.z)) - 
+               sampleVolume(block, Vec3(pos.x, pos.y - h, pos.z));
+    float dz = sampleVolume(block, Vec3(pos.x, pos.y, pos.z + h)) - 
+               sampleVolume(block, Vec3(pos.x, pos.y, pos.z - h));
     
     return Vec3(dx / (2*h), dy / (2*h), dz / (2*h));
 }
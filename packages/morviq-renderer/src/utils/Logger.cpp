@@ -1,10 +1,17 @@
 #include "utils/Logger.h"
+#include <mutex>
 
 namespace morviq {
 
 int Logger::mpiRank = 0;
 Logger::Level Logger::currentLevel = Logger::INFO;
 bool Logger::initialized = false;
+std::ostream* Logger::output = &std::cout;
+
+namespace {
+// Output threads log too; keep lines whole
+std::mutex logMutex;
+}
 
 void Logger::initialize(int rank) {
     mpiRank = rank;
@@ -20,6 +27,11 @@ void Logger::setLevel(Level level) {
     currentLevel = level;
 }
 
+void Logger::setOutput(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    output = &stream;
+}
+
 void Logger::log(Level level, const std::string& message) {
     if (!initialized || level < currentLevel) {
         return;
@@ -36,10 +48,11 @@ void Logger::log(Level level, const std::string& message) {
     auto now = std::chrono::system_clock::now();
     auto time_t = std::chrono::system_clock::to_time_t(now);
     
-    std::cout << "[" << std::put_time(std::localtime(&time_t), "%H:%M:%S") << "] "
-              << "[Rank " << mpiRank << "] "
-              << "[" << levelStr << "] "
-              << message << std::endl;
+    std::lock_guard<std::mutex> lock(logMutex);
+    *output << "[" << std::put_time(std::localtime(&time_t), "%H:%M:%S") << "] "
+            << "[Rank " << mpiRank << "] "
+            << "[" << levelStr << "] "
+            << message << std::endl;
 }
 
 } // namespace morviq
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "utils/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+
+namespace morviq {
+
+struct ThreadPool::ForJob {
+    const std::function<void(size_t, size_t)>* body;
+    size_t begin;
+    size_t perRange;
+    size_t remainder;
+    size_t ranges;
+    std::atomic<size_t> nextRange;
+    size_t finishedRanges; // guarded by the pool mutex
+    ForJob* next;
+};
+
+ThreadPool::ThreadPool(size_t threadCount) : jobs(nullptr), stopping(false) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // The caller of parallelFor always works too, so one fewer worker keeps
+    // the pool at exactly threadCount busy threads.
+    size_t workerCount = threadCount > 1 ? threadCount - 1 : 0;
+    workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::runRange(ForJob& job, size_t r) {
+    size_t rangeBegin = job.begin + r * job.perRange + std::min(r, job.remainder);
+    size_t rangeEnd = rangeBegin + job.perRange + (r < job.remainder ? 1 : 0);
+    (*job.body)(rangeBegin, rangeEnd);
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        taskAvailable.wait(lock, [this]() { return stopping || jobs || !tasks.empty(); });
+        if (jobs) {
+            // Claim under the lock: a job with a claimed but unfinished range
+            // cannot complete, so its owner keeps it alive until we are done.
+            ForJob* job = jobs;
+            size_t r = job->nextRange.fetch_add(1);
+            if (r >= job->ranges) {
+                jobs = job->next; // fully claimed; the owner waits for completion
+                continue;
+            }
+            lock.unlock();
+            runRange(*job, r);
+            lock.lock();
+            if (++job->finishedRanges == job->ranges) {
+                jobFinished.notify_all();
+            }
+            continue;
+        }
+        if (!tasks.empty()) {
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+            continue;
+        }
+        if (stopping) return;
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end,
+                             const std::function<void(size_t, size_t)>& body,
+                             size_t minChunk) {
+    if (end <= begin) return;
+    size_t count = end - begin;
+    minChunk = std::max<size_t>(1, minChunk);
+    size_t maxRanges = (count + minChunk - 1) / minChunk;
+    size_t ranges = std::min(workers.size() + 1, maxRanges);
+    if (ranges <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    ForJob job;
+    job.body = &body;
+    job.begin = begin;
+    job.perRange = count / ranges;
+    job.remainder = count % ranges;
+    job.ranges = ranges;
+    job.nextRange.store(0);
+    job.finishedRanges = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.next = jobs;
+        jobs = &job;
+    }
+    taskAvailable.notify_all();
+
+    size_t ranHere = 0;
+    for (size_t r = job.nextRange.fetch_add(1); r < ranges; r = job.nextRange.fetch_add(1)) {
+        runRange(job, r);
+        ++ranHere;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job.finishedRanges += ranHere;
+    jobFinished.wait(lock, [&]() { return job.finishedRanges == job.ranges; });
+    // Unlink if no worker retired the job yet
+    for (ForJob** link = &jobs; *link; link = &(*link)->next) {
+        if (*link == &job) {
+            *link = job.next;
+            break;
+        }
+    }
+}
+
+} // namespace morviq
@@ -0,0 +1,431 @@
+// Converts a dataset the renderer reads (raw or Zarr, see DataLoader) into
+// bricked time steps (data/BrickedVolume.h) that the renderer then reads
+// one contiguous span per brick: fixed-size bricks with ghost voxels, a mip
+// pyramid filtered with a [1 2 1] tent per axis, and per-brick min/max and
+// histograms in an index. Time steps are spread over the ranks; when there
+// are fewer steps than ranks, the ranks sharing a step split its bricks.
+// Within a rank, filtering and bricks run on the shared thread pool.
+// Usage: mpirun -np N morviq_convert --data DIR --dataset NAME --out DIR
+//            [--brick-size 64] [--ghost 1] [--bins 64] [--first T] [--last T]
+
+#include "data/BrickCache.h"
+#include "data/BrickedVolume.h"
+#include "data/DataLoader.h"
+#include "utils/Logger.h"
+#include "utils/ThreadPool.h"
+#include <mpi.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace morviq;
+
+namespace {
+
+struct Options {
+    std::string dataPath;
+    std::string dataset;
+    std::string outputPath;
+    int brickSize = 64;
+    int ghost = 1;
+    int bins = 64;
+    int first = 0;
+    int last = -1;
+};
+
+// A level, x fastest. Level 0 views the loaded block in place (with its
+// pitches); the coarser levels hold their voxels packed.
+struct Level {
+    int dimensions[3];
+    std::vector<float> voxels;
+    const float* data = nullptr;
+    size_t rowStride = 0;
+    size_t sliceStride = 0;
+
+    float at(int x, int y, int z) const {
+        return data[x + rowStride * y + sliceStride * z];
+    }
+};
+
+// A rank's part in converting one time step: brick i is converted by
+// member i % size of the ranks on it; size 0 for ranks not on it
+struct Share {
+    int leader;
+    int member;
+    int size;
+};
+
+// Steps go to ranks round robin; with fewer steps than ranks, each step
+// gets a group of consecutive ranks and the remainder idles
+Share shareOf(int rank, int ranks, int steps, int step) {
+    if (steps >= ranks) {
+        return {step % ranks, 0, step % ranks == rank ? 1 : 0};
+    }
+    const int group = ranks / steps;
+    const int leader = step * group;
+    const bool member = rank >= leader && rank < leader + group;
+    return {leader, rank - leader, member ? group : 0};
+}
+
+// Level l + 1 voxel i is the [1 2 1] / 4 tent of level l around voxel 2i per
+// axis, clamped at the faces, so both levels span the same box
+void downsample(const Level& in, Level& out) {
+    BrickedVolume::levelDimensions(in.dimensions, 1, out.dimensions);
+    auto tent = [](const float* line, size_t stride, int count, int i) {
+        const int c = 2 * i;
+        const float left = line[std::max(c - 1, 0) * stride];
+        const float right = line[std::min(c + 1, count - 1) * stride];
+        return 0.25f * left + 0.5f * line[c * stride] + 0.25f * right;
+    };
+    // x, then y, then z; each pass shrinks one axis. The first reads the
+    // level in place.
+    int dims[3] = {in.dimensions[0], in.dimensions[1], in.dimensions[2]};
+    const float* current = in.data;
+    size_t pitch[2] = {in.rowStride, in.sliceStride};
+    std::vector<float> packed;
+    for (int axis = 0; axis < 3; ++axis) {
+        int next[3] = {dims[0], dims[1], dims[2]};
+        next[axis] = out.dimensions[axis];
+        std::vector<float> reduced(static_cast<size_t>(next[0]) * next[1] * next[2]);
+        const size_t stride = axis == 0 ? 1 : pitch[axis - 1];
+        ThreadPool::shared().parallelFor(0, next[2], [&](size_t z0, size_t z1) {
+            for (size_t z = z0; z < z1; ++z) {
+                for (int y = 0; y < next[1]; ++y) {
+                    for (int x = 0; x < next[0]; ++x) {
+                        const int p[3] = {x, y, static_cast<int>(z)};
+                        int source[3] = {x, y, static_cast<int>(z)};
+                        source[axis] = 0;
+                        const float* line = current + source[0] + pitch[0] * source[1] + pitch[1] * source[2];
+                        reduced[x + static_cast<size_t>(next[0]) * (y + static_cast<size_t>(next[1]) * z)] =
+                            tent(line, stride, dims[axis], p[axis]);
+                    }
+                }
+            }
+        });
+        packed.swap(reduced);
+        current = packed.data();
+        std::copy(next, next + 3, dims);
+        pitch[0] = dims[0];
+        pitch[1] = static_cast<size_t>(dims[0]) * dims[1];
+    }
+    out.voxels.swap(packed);
+    out.data = out.voxels.data();
+    out.rowStride = pitch[0];
+    out.sliceStride = pitch[1];
+}
+
+bool writeAll(int fd, const void* data, size_t bytes, size_t offset) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        const ssize_t written = pwrite(fd, p, bytes, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+        bytes -= static_cast<size_t>(written);
+        offset += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+std::string stepDirectory(const Options& options, int timeStep) {
+    return (std::filesystem::path(options.outputPath) / ("t_" + std::to_string(timeStep))).string();
+}
+
+// Converts this rank's share of a time step: writes its bricks into
+// bricks.dat and fills their annotations. header is completed on return.
+bool convertStep(DataLoader& loader, const Options& options, int timeStep, const Share& share,
+                 BrickedVolume::Header& header, BrickedVolume::Annotations& annotations) {
+    int dimensions[3];
+    if (!loader.getDimensions(options.dataset, timeStep, dimensions)) {
+        LOG_ERROR("Cannot read the dimensions of time step " << timeStep);
+        return false;
+    }
+    const int begin[3] = {0, 0, 0};
+    auto block = loader.loadRegion(options.dataset, timeStep, begin, dimensions);
+    if (!block || !block->data) {
+        LOG_ERROR("Cannot load time step " << timeStep);
+        return false;
+    }
+
+    // The block stays loaded until the bricks are written, so level 0
+    // costs no copy
+    std::vector<Level> levels(BrickedVolume::levelCount(dimensions, options.brickSize));
+    Level& full = levels[0];
+    std::copy(dimensions, dimensions + 3, full.dimensions);
+    full.data = block->data.get();
+    full.rowStride = block->rowStride();
+    full.sliceStride = block->sliceStride();
+    std::memcpy(header.magic, BrickedVolume::kMagic, sizeof(header.magic));
+    header.byteOrder = BrickedVolume::kByteOrder;
+    header.version = BrickedVolume::kVersion;
+    std::copy(dimensions, dimensions + 3, header.dimensions);
+    header.brickSize = options.brickSize;
+    header.ghost = options.ghost;
+    header.levelCount = static_cast<int32_t>(levels.size());
+    header.histogramBins = options.bins;
+    std::copy(block->spacing, block->spacing + 3, header.spacing);
+
+    float low = std::numeric_limits<float>::max();
+    float high = -std::numeric_limits<float>::max();
+    for (int z = 0; z < dimensions[2]; ++z) {
+        for (int y = 0; y < dimensions[1]; ++y) {
+            const float* row = full.data + full.rowStride * y + full.sliceStride * z;
+            for (int x = 0; x < dimensions[0]; ++x) {
+                if (!std::isfinite(row[x])) continue;
+                low = std::min(low, row[x]);
+                high = std::max(high, row[x]);
+            }
+        }
+    }
+    if (low > high) {
+        low = high = 0.0f;
+    }
+    header.valueRange[0] = low;
+    header.valueRange[1] = high;
+    for (size_t l = 1; l < levels.size(); ++l) {
+        downsample(levels[l - 1], levels[l]);
+    }
+
+    const std::vector<uint64_t> firstBricks =
+        BrickedVolume::levelFirstBricks(dimensions, options.brickSize, header.levelCount);
+    const size_t count = firstBricks.back();
+    header.brickCount = count;
+    annotations.minimum.assign(count, std::numeric_limits<float>::infinity());
+    annotations.maximum.assign(count, -std::numeric_limits<float>::infinity());
+    annotations.histograms.assign(count * options.bins, 0);
+
+    const std::string dataPath = BrickedVolume::dataPath(stepDirectory(options, timeStep) + "/bricks.idx");
+    const int fd = ::open(dataPath.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("Cannot open " << dataPath << ": " << std::strerror(errno));
+        return false;
+    }
+    const int edge = options.brickSize + 2 * options.ghost;
+    const size_t brickBytes = BrickedVolume::brickBytes(options.brickSize, options.ghost);
+    const float scale = high > low ? options.bins / (high - low) : 0.0f;
+    // Cleared from the pool's threads
+    std::atomic<bool> ok{true};
+    for (size_t l = 0; l < levels.size(); ++l) {
+        const Level& level = levels[l];
+        int bricks[3];
+        BrickedVolume::bricksPerAxis(dimensions, static_cast<int>(l), options.brickSize, bricks);
+        const size_t levelBricks = firstBricks[l + 1] - firstBricks[l];
+        ThreadPool::shared().parallelFor(0, levelBricks, [&](size_t b0, size_t b1) {
+            std::vector<float> stored(static_cast<size_t>(edge) * edge * edge);
+            for (size_t b = b0; b < b1; ++b) {
+                const size_t index = firstBricks[l] + b;
+                if (static_cast<int>(index % share.size) != share.member) continue;
+                const int origin[3] = {static_cast<int>(b % bricks[0]) * options.brickSize - options.ghost,
+                                       static_cast<int>(b / bricks[0] % bricks[1]) * options.brickSize - options.ghost,
+                                       static_cast<int>(b / bricks[0] / bricks[1]) * options.brickSize - options.ghost};
+                float minimum = std::numeric_limits<float>::infinity();
+                float maximum = -std::numeric_limits<float>::infinity();
+                uint32_t* histogram = annotations.histograms.data() + index * options.bins;
+                size_t i = 0;
+                for (int z = 0; z < edge; ++z) {
+                    const int vz = std::min(std::max(origin[2] + z, 0), level.dimensions[2] - 1);
+                    for (int y = 0; y < edge; ++y) {
+                        const int vy = std::min(std::max(origin[1] + y, 0), level.dimensions[1] - 1);
+                        for (int x = 0; x < edge; ++x, ++i) {
+                            const int vx = std::min(std::max(origin[0] + x, 0), level.dimensions[0] - 1);
+                            const float v = level.at(vx, vy, vz);
+                            stored[i] = v;
+                            if (!std::isfinite(v)) continue;
+                            minimum = std::min(minimum, v);
+                            maximum = std::max(maximum, v);
+                            // Interior voxels inside the volume, each counted once
+                            const int interior[3] = {origin[0] + x, origin[1] + y, origin[2] + z};
+                            if (x >= options.ghost && y >= options.ghost && z >= options.ghost &&
+                                x < edge - options.ghost && y < edge - options.ghost &&
+                                z < edge - options.ghost && interior[0] < level.dimensions[0] &&
+                                interior[1] < level.dimensions[1] && interior[2] < level.dimensions[2] &&
+                                options.bins > 0) {
+                                const int bin = static_cast<int>((v - low) * scale);
+                                ++histogram[std::min(std::max(bin, 0), options.bins - 1)];
+                            }
+                        }
+                    }
+                }
+                annotations.minimum[index] = minimum;
+                annotations.maximum[index] = maximum;
+                if (!writeAll(fd, stored.data(), brickBytes, index * brickBytes)) {
+                    ok.store(false);
+                }
+            }
+        });
+    }
+    ::close(fd);
+    if (!ok.load()) {
+        LOG_ERROR("Cannot write " << dataPath << ": " << std::strerror(errno));
+    }
+    return ok.load();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank = 0;
+    int ranks = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    Logger::initialize(rank);
+
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--data" && i + 1 < argc) {
+            options.dataPath = argv[++i];
+        } else if (arg == "--dataset" && i + 1 < argc) {
+            options.dataset = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            options.outputPath = argv[++i];
+        } else if (arg == "--brick-size" && i + 1 < argc) {
+            options.brickSize = std::max(4, std::atoi(argv[++i]));
+        } else if (arg == "--ghost" && i + 1 < argc) {
+            options.ghost = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--bins" && i + 1 < argc) {
+            options.bins = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--first" && i + 1 < argc) {
+            options.first = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--last" && i + 1 < argc) {
+            options.last = std::atoi(argv[++i]);
+        } else {
+            if (rank == 0) {
+                std::cout << "Usage: " << argv[0] << " --data DIR --dataset NAME --out DIR [options]\n"
+                          << "  --brick-size N   Brick edge in voxels, without ghosts (default: 64)\n"
+                          << "  --ghost N        Ghost voxels on each brick face (default: 1)\n"
+                          << "  --bins N         Histogram bins per brick (default: 64)\n"
+                          << "  --first T, --last T  Time steps to convert (default: all)\n";
+            }
+            MPI_Finalize();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (options.dataset.empty() || options.outputPath.empty()) {
+        if (rank == 0) {
+            LOG_ERROR("Need --dataset and --out");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    DataLoader loader;
+    loader.setBasePath(options.dataPath);
+    loader.setCompressRate(0);
+    // Every block is read once
+    BrickCache::shared().setBudget(0);
+    const int available = loader.getTimeStepCount(options.dataset);
+    const int last = options.last < 0 ? available - 1 : std::min(options.last, available - 1);
+    const int steps = last - options.first + 1;
+    if (steps <= 0) {
+        if (rank == 0) {
+            LOG_ERROR("No time steps to convert in " << options.dataset);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    // With fewer steps than ranks, each step's ranks share a communicator,
+    // leader first
+    MPI_Comm group = MPI_COMM_NULL;
+    if (steps < ranks) {
+        int color = MPI_UNDEFINED;
+        for (int s = 0; s < steps; ++s) {
+            const Share share = shareOf(rank, ranks, steps, s);
+            if (share.size > 0) color = share.leader;
+        }
+        MPI_Comm_split(MPI_COMM_WORLD, color, rank, &group);
+    }
+
+    // The leader of each step creates its files before anyone writes
+    int ok = 1;
+    for (int s = 0; s < steps; ++s) {
+        if (shareOf(rank, ranks, steps, s).leader != rank) continue;
+        const std::string directory = stepDirectory(options, options.first + s);
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        // A stale index would describe the bricks being rewritten
+        std::filesystem::remove(directory + "/bricks.idx", error);
+        const std::string dataPath = directory + "/bricks.dat";
+        const int fd = ::open(dataPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOG_ERROR("Cannot create " << dataPath << ": " << std::strerror(errno));
+            ok = 0;
+            continue;
+        }
+        ::close(fd);
+    }
+    if (group != MPI_COMM_NULL) {
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, group);
+    }
+
+    // Each rank converts all its steps before anyone synchronizes. A step's
+    // annotations end up on its leader, which writes the index last, so an
+    // interrupted conversion leaves no index behind.
+    size_t bytes = 0;
+    for (int s = 0; ok && s < steps; ++s) {
+        const int timeStep = options.first + s;
+        const Share share = shareOf(rank, ranks, steps, s);
+        if (share.size == 0) continue;
+        BrickedVolume::Header header = {};
+        BrickedVolume::Annotations annotations;
+        auto stepStart = std::chrono::steady_clock::now();
+        int converted = convertStep(loader, options, timeStep, share, header, annotations);
+        if (converted) {
+            LOG_INFO("Time step " << timeStep << ": " << header.levelCount << " levels, " << header.brickCount
+                     << " bricks" << (share.size > 1 ? " (this rank's share)" : "") << " in "
+                     << std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count()
+                     << " s");
+        }
+        if (share.size > 1) {
+            // The group's ranks each annotated their own bricks
+            MPI_Allreduce(MPI_IN_PLACE, &converted, 1, MPI_INT, MPI_LAND, group);
+            if (converted) {
+                const bool root = rank == share.leader;
+                const int count = static_cast<int>(header.brickCount);
+                MPI_Reduce(root ? MPI_IN_PLACE : annotations.minimum.data(), annotations.minimum.data(), count,
+                           MPI_FLOAT, MPI_MIN, 0, group);
+                MPI_Reduce(root ? MPI_IN_PLACE : annotations.maximum.data(), annotations.maximum.data(), count,
+                           MPI_FLOAT, MPI_MAX, 0, group);
+                MPI_Reduce(root ? MPI_IN_PLACE : annotations.histograms.data(), annotations.histograms.data(),
+                           count * options.bins, MPI_UINT32_T, MPI_SUM, 0, group);
+            }
+        }
+        ok = converted;
+        if (ok && rank == share.leader) {
+            const std::string indexPath = stepDirectory(options, timeStep) + "/bricks.idx";
+            ok = BrickedVolume::writeIndex(indexPath, header, annotations);
+            bytes += header.brickCount * BrickedVolume::brickBytes(options.brickSize, options.ghost);
+        }
+    }
+    if (group != MPI_COMM_NULL) {
+        MPI_Comm_free(&group);
+    }
+
+    // Failed ranks and bytes written, in one reduction
+    unsigned long long totals[2] = {ok ? 0ull : 1ull, bytes};
+    MPI_Allreduce(MPI_IN_PLACE, totals, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    ok = totals[0] == 0;
+    const unsigned long long total = totals[1];
+    if (rank == 0 && ok) {
+        LOG_INFO("Converted " << steps << " time step(s) of " << options.dataset << " into " << options.outputPath
+                 << ": " << total / (1024.0 * 1024.0) << " MB of bricks in "
+                 << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s");
+    }
+    MPI_Finalize();
+    return ok ? 0 : 1;
+}
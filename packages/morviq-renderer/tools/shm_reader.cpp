@@ -0,0 +1,102 @@
+// Test consumer for the renderer's shared-memory frame ring (--shm-ring).
+// Waits for notifications, takes the newest frame straight from the
+// mapping and reports its size and publish-to-read latency.
+// Usage: morviq_shm_reader NAME [frames] [dump-dir]
+
+#include "io/SharedFrameRing.h"
+#include "utils/Logger.h"
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <thread>
+
+using namespace morviq;
+
+namespace {
+
+uint64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s NAME [frames] [dump-dir]\n", argv[0]);
+        return 2;
+    }
+    const std::string name = argv[1];
+    const long maxFrames = argc > 2 ? std::atol(argv[2]) : 0;
+    const std::string dumpDir = argc > 3 ? argv[3] : "";
+
+    SharedFrameRingReader reader;
+    // The renderer may still be starting up; stay quiet until the last try
+    const int attempts = 50;
+    for (int attempt = 1;; ++attempt) {
+        if (attempt == attempts) Logger::initialize(0);
+        if (reader.open(name)) break;
+        if (attempt == attempts) return 1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    Logger::initialize(0);
+    const SharedRingHeader& header = reader.getHeader();
+    std::printf("ring %s: %ux%u, format %u, %u slots of %llu bytes\n", name.c_str(),
+                header.width, header.height, header.format, header.slotCount,
+                static_cast<unsigned long long>(header.slotCapacity));
+
+    int fd = reader.connectNotifications();
+    if (fd < 0) {
+        std::printf("no notification socket, polling\n");
+    }
+
+    long received = 0;
+    uint64_t nextFrame = 0;
+    uint64_t skipped = 0;
+    uint64_t torn = 0;
+    while (maxFrames == 0 || received < maxFrames) {
+        SharedFrameRingReader::View view;
+        if (!reader.latest(view, nextFrame)) {
+            if (reader.isClosed()) break;
+            if (fd >= 0) {
+                pollfd pfd = {fd, POLLIN, 0};
+                poll(&pfd, 1, 200);
+                if (!reader.drainNotifications()) fd = -1;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            continue;
+        }
+        const double latencyMs = (monotonicNs() - view.timestampNs) / 1e6;
+
+        // Consume in place; a real consumer would hand view.data to a socket
+        bool dumped = true;
+        if (!dumpDir.empty()) {
+            char path[512];
+            std::snprintf(path, sizeof(path), "%s/ring_%06llu.bin", dumpDir.c_str(),
+                          static_cast<unsigned long long>(view.frame));
+            FILE* fp = std::fopen(path, "wb");
+            dumped = fp && std::fwrite(view.data, 1, view.size, fp) == view.size;
+            if (fp) std::fclose(fp);
+        }
+        if (!reader.stillValid(view)) {
+            // Overwritten while we read it; the next pass takes a newer frame
+            ++torn;
+            continue;
+        }
+        skipped += view.frame - nextFrame;
+        nextFrame = view.frame + 1;
+        ++received;
+        std::printf("frame %llu: %zu bytes, slot %d, latency %.3f ms%s\n",
+                    static_cast<unsigned long long>(view.frame), view.size, view.slot, latencyMs,
+                    dumped ? "" : " (dump failed)");
+    }
+    std::printf("received %ld frames, skipped %llu, torn %llu\n", received,
+                static_cast<unsigned long long>(skipped), static_cast<unsigned long long>(torn));
+    return 0;
+}